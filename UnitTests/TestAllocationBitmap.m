@@ -0,0 +1,165 @@
+//
+//  TestAllocationBitmap.m
+//  UnitTests
+//
+//  Created by Peter Hosey on 2024-06-17.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "ImpAllocationBitmap.h"
+
+@interface TestAllocationBitmap : XCTestCase
+
+@end
+
+@implementation TestAllocationBitmap
+{
+	ImpAllocationBitmap *_Nonnull _bitmap;
+}
+
+///Enough bits for several vectors' worth of words, plus a partial word at the end.
+enum { TestBitmapNumberOfBits = 64 * 4 * 3 + 37 };
+
+- (void) setUp {
+	_bitmap = [[ImpAllocationBitmap alloc] initWithNumberOfBits:TestBitmapNumberOfBits];
+}
+
+- (void) tearDown {
+	_bitmap = nil;
+}
+
+- (void) testEmptyBitmapIsOneRun {
+	NSRange const run = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 0, TestBitmapNumberOfBits } maximumLength:NSUIntegerMax];
+	XCTAssertEqual(run.location, 0u);
+	XCTAssertEqual(run.length, (NSUInteger)TestBitmapNumberOfBits);
+}
+
+- (void) testFullBitmapHasNoRun {
+	[_bitmap setBitsInRange:(NSRange){ 0, TestBitmapNumberOfBits }];
+	NSRange const run = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 0, TestBitmapNumberOfBits } maximumLength:NSUIntegerMax];
+	XCTAssertEqual(run.location, (NSUInteger)NSNotFound);
+	XCTAssertEqual(run.length, 0u);
+}
+
+- (void) testRunIsCappedAtMaximumLength {
+	NSRange const run = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 10, TestBitmapNumberOfBits } maximumLength:100];
+	XCTAssertEqual(run.location, 10u);
+	XCTAssertEqual(run.length, 100u);
+}
+
+- (void) testRunEndsAtNextSetBit {
+	[_bitmap setBitsInRange:(NSRange){ 0, 5 }];
+	[_bitmap setBitsInRange:(NSRange){ 70, 1 }];
+	NSRange const run = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 0, TestBitmapNumberOfBits } maximumLength:NSUIntegerMax];
+	XCTAssertEqual(run.location, 5u);
+	XCTAssertEqual(run.length, 65u);
+}
+
+- (void) testRunAfterManyFullWords {
+	//Fill more than one vector's worth of words, so the search has to skip whole vectors and then whole words before it finds a clear bit.
+	NSUInteger const firstClearBit = 64 * 4 * 2 + 64 + 3;
+	[_bitmap setBitsInRange:(NSRange){ 0, firstClearBit }];
+	[_bitmap setBitsInRange:(NSRange){ firstClearBit + 2, 1 }];
+	NSRange const run = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 0, TestBitmapNumberOfBits } maximumLength:NSUIntegerMax];
+	XCTAssertEqual(run.location, firstClearBit);
+	XCTAssertEqual(run.length, 2u);
+}
+
+- (void) testRunIsClippedToSearchRange {
+	[_bitmap setBitsInRange:(NSRange){ 0, 300 }];
+	NSRange const run = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 200, 150 } maximumLength:NSUIntegerMax];
+	XCTAssertEqual(run.location, 300u);
+	XCTAssertEqual(run.length, 50u);
+
+	NSRange const noRun = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 100, 150 } maximumLength:NSUIntegerMax];
+	XCTAssertEqual(noRun.location, (NSUInteger)NSNotFound);
+}
+
+- (void) testRunIsClippedToEndOfBitmap {
+	[_bitmap setBitsInRange:(NSRange){ 0, TestBitmapNumberOfBits - 4 }];
+	NSRange const run = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 0, NSUIntegerMax } maximumLength:NSUIntegerMax];
+	XCTAssertEqual(run.location, (NSUInteger)TestBitmapNumberOfBits - 4);
+	XCTAssertEqual(run.length, 4u);
+}
+
+- (void) testPaddingBitsFromDiskAreIgnored {
+	//Two bytes, but only 12 bits in the bitmap. The last four bits are set on disk; they must not be counted or found.
+	u_int8_t const bytes[] = { 0xff, 0x0f };
+	ImpAllocationBitmap *_Nonnull const bitmap = [[ImpAllocationBitmap alloc] initWithBitmapData:[NSData dataWithBytes:bytes length:sizeof(bytes)] numberOfBits:12];
+	XCTAssertEqual([bitmap countOfSetBitsInRange:(NSRange){ 0, 12 }], 8u);
+	NSRange const run = [bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ 0, 12 } maximumLength:NSUIntegerMax];
+	XCTAssertEqual(run.location, 8u);
+	XCTAssertEqual(run.length, 4u);
+	XCTAssertEqualObjects(bitmap.bitmapData, ([NSData dataWithBytes:(u_int8_t const[]){ 0xff, 0x00 } length:2]));
+}
+
+///Set a pseudorandom pattern of runs, then check every search against a bit-at-a-time reading of the same bitmap.
+- (void) testSearchesMatchBitByBitScan {
+	srandom(1150);
+	NSUInteger idx = 0;
+	bool value = false;
+	while (idx < TestBitmapNumberOfBits) {
+		//Mostly short runs, with the occasional long one to cover whole-word and whole-vector skipping.
+		NSUInteger const length = (random() % 8 == 0) ? (NSUInteger)(random() % 400) + 1 : (NSUInteger)(random() % 12) + 1;
+		if (value) {
+			[_bitmap setBitsInRange:(NSRange){ idx, length }];
+		}
+		idx += length;
+		value = ! value;
+	}
+
+	NSMutableData *_Nonnull const bitsData = [NSMutableData dataWithLength:TestBitmapNumberOfBits * sizeof(bool)];
+	bool *_Nonnull const bits = bitsData.mutableBytes;
+	for (NSUInteger i = 0; i < TestBitmapNumberOfBits; ++i) {
+		bits[i] = [_bitmap bitAtIndex:i];
+	}
+
+	for (NSUInteger start = 0; start < TestBitmapNumberOfBits; start += 7) {
+		NSUInteger expectedStart = start;
+		while (expectedStart < TestBitmapNumberOfBits && bits[expectedStart]) {
+			++expectedStart;
+		}
+		NSUInteger expectedEnd = expectedStart;
+		while (expectedEnd < TestBitmapNumberOfBits && ! bits[expectedEnd]) {
+			++expectedEnd;
+		}
+
+		NSRange const run = [_bitmap rangeOfFirstRunOfClearBitsInRange:(NSRange){ start, TestBitmapNumberOfBits - start } maximumLength:NSUIntegerMax];
+		if (expectedStart == TestBitmapNumberOfBits) {
+			XCTAssertEqual(run.location, (NSUInteger)NSNotFound, @"Search from %lu", (unsigned long)start);
+		} else {
+			XCTAssertEqual(run.location, expectedStart, @"Search from %lu", (unsigned long)start);
+			XCTAssertEqual(run.length, expectedEnd - expectedStart, @"Search from %lu", (unsigned long)start);
+		}
+
+		NSUInteger expectedLastSet = NSNotFound;
+		for (NSUInteger i = start; i > 0; --i) {
+			if (bits[i - 1]) {
+				expectedLastSet = i - 1;
+				break;
+			}
+		}
+		XCTAssertEqual([_bitmap indexOfLastSetBitInRange:(NSRange){ 0, start }], expectedLastSet, @"Backward search from %lu", (unsigned long)start);
+	}
+
+	__block NSUInteger numSetBitsInRuns = 0;
+	__block NSUInteger previousRunEnd = NSNotFound;
+	[_bitmap enumerateRunsOfSetBitsInRange:(NSRange){ 0, TestBitmapNumberOfBits } usingBlock:^(NSRange const run) {
+		XCTAssertGreaterThan(run.length, 0u);
+		//Runs are maximal, so there must be at least one clear bit between each run and the one before it.
+		if (previousRunEnd != NSNotFound) {
+			XCTAssertGreaterThan(run.location, previousRunEnd);
+		}
+		XCTAssertTrue(run.location == 0 || ! bits[run.location - 1]);
+		XCTAssertTrue(NSMaxRange(run) == TestBitmapNumberOfBits || ! bits[NSMaxRange(run)]);
+		for (NSUInteger i = run.location; i < NSMaxRange(run); ++i) {
+			XCTAssertTrue(bits[i]);
+		}
+		numSetBitsInRuns += run.length;
+		previousRunEnd = NSMaxRange(run);
+	}];
+	XCTAssertEqual(numSetBitsInRuns, [_bitmap countOfSetBitsInRange:(NSRange){ 0, TestBitmapNumberOfBits }]);
+}
+
+@end
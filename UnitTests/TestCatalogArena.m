@@ -0,0 +1,105 @@
+//
+//  TestCatalogArena.m
+//  UnitTests
+//
+//  Created by Peter Hosey on 2024-06-16.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "ImpCatalogArena.h"
+
+@interface TestCatalogArena : XCTestCase
+
+@end
+
+@implementation TestCatalogArena
+{
+	ImpCatalogArena *_Nonnull _arena;
+}
+
+- (void) setUp {
+	//Small slabs, so it doesn't take much to fill one.
+	_arena = [[ImpCatalogArena alloc] initWithBytesPerSlab:64];
+}
+
+- (void) tearDown {
+	_arena = nil;
+}
+
+- (void) testSlicesAreAligned {
+	u_int32_t const lengths[] = { 1, 3, 7, 13, 2 };
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(*lengths); ++i) {
+		ImpCatalogArenaSlice const slice = [_arena allocateSliceWithLength:lengths[i]];
+		XCTAssertEqual(slice.length, lengths[i]);
+		XCTAssertEqual(slice.offset % 8, 0u, @"Slice of length %u starts at misaligned offset %u", lengths[i], slice.offset);
+		XCTAssertEqual((uintptr_t)[_arena mutableBytesOfSlice:slice] % 8, 0u, @"Slice of length %u has a misaligned pointer", lengths[i]);
+	}
+}
+
+- (void) testSlicesDoNotOverlap {
+	ImpCatalogArenaSlice const first = [_arena sliceByCopyingBytes:"ABCDE" length:5];
+	ImpCatalogArenaSlice const second = [_arena sliceByCopyingBytes:"vwxyz" length:5];
+	XCTAssertEqual(first.slabIndex, second.slabIndex);
+	XCTAssertGreaterThanOrEqual(second.offset, first.offset + first.length);
+	XCTAssertEqualObjects([_arena dataForSlice:first], [NSData dataWithBytes:"ABCDE" length:5]);
+	XCTAssertEqualObjects([_arena dataForSlice:second], [NSData dataWithBytes:"vwxyz" length:5]);
+}
+
+- (void) testEmptySlice {
+	ImpCatalogArenaSlice const slice = [_arena allocateSliceWithLength:0];
+	XCTAssertEqual(slice.length, 0u);
+	XCTAssertTrue([_arena mutableBytesOfSlice:slice] == NULL);
+	XCTAssertEqual([_arena dataForSlice:slice].length, 0u);
+	XCTAssertEqual(_arena.numberOfBytesAllocated, 0u, @"An empty slice shouldn't cause a slab to be allocated");
+}
+
+- (void) testFullSlabStartsANewSlab {
+	ImpCatalogArenaSlice const first = [_arena allocateSliceWithLength:40];
+	ImpCatalogArenaSlice const second = [_arena allocateSliceWithLength:40];
+	XCTAssertEqual(first.slabIndex, 0u);
+	XCTAssertEqual(second.slabIndex, 1u);
+	XCTAssertEqual(second.offset, 0u);
+	XCTAssertEqual(_arena.numberOfBytesAllocated, 128u);
+}
+
+- (void) testOversizedSliceGetsASlabOfItsOwn {
+	ImpCatalogArenaSlice const small = [_arena allocateSliceWithLength:8];
+	ImpCatalogArenaSlice const big = [_arena allocateSliceWithLength:100];
+	ImpCatalogArenaSlice const afterBig = [_arena allocateSliceWithLength:8];
+	XCTAssertNotEqual(big.slabIndex, small.slabIndex);
+	XCTAssertEqual(big.offset, 0u);
+	XCTAssertNotEqual(afterBig.slabIndex, big.slabIndex, @"The oversized slice's slab should have been full");
+	XCTAssertEqual(_arena.numberOfBytesAllocated, 64u + 100u + 64u);
+}
+
+- (void) testTruncatingLastSliceGivesBytesBack {
+	ImpCatalogArenaSlice slice = [_arena allocateSliceWithLength:16];
+	[_arena truncateSlice:&slice toLength:5];
+	XCTAssertEqual(slice.length, 5u);
+
+	//The next slice should start at the first aligned offset after the truncated slice, not after the original 16 bytes.
+	ImpCatalogArenaSlice const next = [_arena allocateSliceWithLength:8];
+	XCTAssertEqual(next.slabIndex, slice.slabIndex);
+	XCTAssertEqual(next.offset, 8u);
+}
+
+- (void) testTruncatingEarlierSliceKeepsItsBytes {
+	ImpCatalogArenaSlice earlier = [_arena allocateSliceWithLength:16];
+	ImpCatalogArenaSlice const later = [_arena allocateSliceWithLength:8];
+	[_arena truncateSlice:&earlier toLength:4];
+	XCTAssertEqual(earlier.length, 4u);
+
+	//Only the most recent slice can give bytes back, so the next slice still comes after the later one.
+	ImpCatalogArenaSlice const next = [_arena allocateSliceWithLength:8];
+	XCTAssertEqual(next.offset, later.offset + later.length);
+}
+
+- (void) testTruncatingToALongerLengthDoesNothing {
+	ImpCatalogArenaSlice slice = [_arena sliceByCopyingBytes:"ABCD" length:4];
+	[_arena truncateSlice:&slice toLength:10];
+	XCTAssertEqual(slice.length, 4u);
+	XCTAssertEqualObjects([_arena dataForSlice:slice], [NSData dataWithBytes:"ABCD" length:4]);
+}
+
+@end
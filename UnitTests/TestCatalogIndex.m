@@ -0,0 +1,169 @@
+//
+//  TestCatalogIndex.m
+//  UnitTests
+//
+//  Created by Peter Hosey on 2024-06-22.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <fcntl.h>
+#import <sys/time.h>
+
+#import "ImpCatalogIndex.h"
+#import "ImpHFSSourceVolume.h"
+#import "ImpDehydratedItem.h"
+
+/*The fixture is a small HFS volume made by:
+ *tools/make_synthetic_hfs.py --files 12 --depth 1 --fanout 3 --data-sizes 0:1,512:3,4K:2 --rsrc-sizes 0:2,1K:1 --fragmented-percent 50 --max-extents 5 --volume-name "Index Test" CatalogIndexTest.img
+ *That's the root folder plus three subfolders (CNIDs 16–18), with three files in each of the four (CNIDs 19–30) named “File 1” through “File 3”. Some forks are fragmented, and one has more extents than fit in its catalog record, so the index has to pick some up from the extents overflow file.
+ */
+enum {
+	TestCatalogIndexNumberOfFolders = 4,
+	TestCatalogIndexNumberOfFiles = 12,
+	TestCatalogIndexFirstFolderID = 16,
+	TestCatalogIndexLastFileID = 30,
+};
+
+@interface TestCatalogIndex : XCTestCase
+
+@end
+
+@implementation TestCatalogIndex
+{
+	NSURL *_Nonnull _directoryURL;
+	NSURL *_Nonnull _imageURL;
+	NSURL *_Nonnull _indexURL;
+	int _imageFD;
+	ImpHFSSourceVolume *_Nonnull _srcVol;
+}
+
+- (void) setUp {
+	self.continueAfterFailure = false;
+
+	//Work on a copy, since some tests change the image, and saving an index puts it next to the image.
+	NSBundle *_Nonnull const testBundle = [NSBundle bundleForClass:[self class]];
+	NSURL *_Nullable const fixtureURL = [testBundle URLForResource:@"CatalogIndexTest" withExtension:@"img"];
+	XCTAssertNotNil(fixtureURL);
+
+	NSFileManager *_Nonnull const mgr = [NSFileManager defaultManager];
+	NSError *_Nullable error = nil;
+	_directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory() isDirectory:true] URLByAppendingPathComponent:[NSUUID UUID].UUIDString isDirectory:true];
+	XCTAssertTrue([mgr createDirectoryAtURL:_directoryURL withIntermediateDirectories:true attributes:nil error:&error], @"%@", error);
+	_imageURL = [_directoryURL URLByAppendingPathComponent:fixtureURL.lastPathComponent isDirectory:false];
+	XCTAssertTrue([mgr copyItemAtURL:fixtureURL toURL:_imageURL error:&error], @"%@", error);
+
+	_imageFD = open(_imageURL.fileSystemRepresentation, O_RDONLY);
+	XCTAssertGreaterThanOrEqual(_imageFD, 0);
+	_srcVol = [[ImpHFSSourceVolume alloc] initWithFileDescriptor:_imageFD startOffsetInBytes:0 lengthInBytes:0 textEncoding:kTextEncodingMacRoman];
+	XCTAssertTrue([_srcVol loadAndReturnError:&error], @"%@", error);
+
+	_indexURL = [ImpCatalogIndex indexURLForVolume:_srcVol inImageAtURL:_imageURL];
+}
+
+- (void) tearDown {
+	_srcVol = nil;
+	if (_imageFD >= 0) {
+		close(_imageFD);
+	}
+	[[NSFileManager defaultManager] removeItemAtURL:_directoryURL error:NULL];
+}
+
+///Build an index from the volume and save it where indexAtURL:forVolume:error: will look for it.
+- (ImpCatalogIndex *_Nonnull) buildAndSaveIndex {
+	ImpCatalogIndex *_Nonnull const index = [ImpCatalogIndex indexByReadingCatalogOfVolume:_srcVol];
+	NSError *_Nullable error = nil;
+	XCTAssertTrue([index writeToURL:_indexURL error:&error], @"%@", error);
+	return index;
+}
+
+- (void) testMissingIndexIsNotAnError {
+	NSError *_Nullable error = nil;
+	XCTAssertNil([ImpCatalogIndex indexAtURL:_indexURL forVolume:_srcVol error:&error]);
+	XCTAssertNil(error);
+}
+
+- (void) testRoundTrip {
+	ImpCatalogIndex *_Nonnull const builtIndex = [self buildAndSaveIndex];
+	XCTAssertEqual(builtIndex.numberOfItems, (NSUInteger)(TestCatalogIndexNumberOfFolders + TestCatalogIndexNumberOfFiles));
+
+	NSError *_Nullable error = nil;
+	ImpCatalogIndex *_Nullable const loadedIndex = [ImpCatalogIndex indexAtURL:_indexURL forVolume:_srcVol error:&error];
+	XCTAssertNotNil(loadedIndex, @"Freshly saved index was rejected; error: %@", error);
+	XCTAssertEqual(loadedIndex.numberOfItems, builtIndex.numberOfItems);
+
+	//Lookups by name within a folder.
+	for (NSString *_Nonnull const name in @[ @"File 1", @"File 3", @"Folder 1", @"Folder 3" ]) {
+		HFSCatalogNodeID const cnid = [loadedIndex catalogNodeIDOfItemNamed:name inFolderWithID:kHFSRootFolderID];
+		XCTAssertNotEqual(cnid, 0u, @"No “%@” in the root folder", name);
+		XCTAssertEqual(cnid, [builtIndex catalogNodeIDOfItemNamed:name inFolderWithID:kHFSRootFolderID]);
+		XCTAssertEqualObjects([loadedIndex itemWithCatalogNodeID:cnid].name, name);
+	}
+	XCTAssertEqual([loadedIndex catalogNodeIDOfItemNamed:@"File 4" inFolderWithID:kHFSRootFolderID], 0u);
+
+	//Lookups by name anywhere. Every folder has a “File 1”.
+	NSMutableSet <NSNumber *> *_Nonnull const builtCNIDs = [NSMutableSet new];
+	NSMutableSet <NSNumber *> *_Nonnull const loadedCNIDs = [NSMutableSet new];
+	[builtIndex forEachItemNamed:@"File 1" block:^(HFSCatalogNodeID const cnid) {
+		[builtCNIDs addObject:@(cnid)];
+	}];
+	[loadedIndex forEachItemNamed:@"File 1" block:^(HFSCatalogNodeID const cnid) {
+		[loadedCNIDs addObject:@(cnid)];
+	}];
+	XCTAssertEqual(loadedCNIDs.count, (NSUInteger)TestCatalogIndexNumberOfFolders);
+	XCTAssertEqualObjects(loadedCNIDs, builtCNIDs);
+
+	//Extents, including those from the extents overflow file.
+	NSUInteger mostExtentsInOneFork = 0;
+	for (HFSCatalogNodeID cnid = TestCatalogIndexFirstFolderID; cnid <= TestCatalogIndexLastFileID; ++cnid) {
+		for (NSUInteger forkIdx = 0; forkIdx < 2; ++forkIdx) {
+			ImpForkType const forkType = forkIdx == 0 ? ImpForkTypeData : ImpForkTypeResource;
+			NSUInteger numBuiltExtents = 0, numLoadedExtents = 0;
+			struct ImpCatalogIndexExtent const *_Nullable const builtExtents = [builtIndex extentsOfFileWithID:cnid fork:forkType count:&numBuiltExtents];
+			struct ImpCatalogIndexExtent const *_Nullable const loadedExtents = [loadedIndex extentsOfFileWithID:cnid fork:forkType count:&numLoadedExtents];
+			XCTAssertEqual(numLoadedExtents, numBuiltExtents, @"Fork %lu of item #%u", (unsigned long)forkIdx, cnid);
+			if (numBuiltExtents > 0) {
+				XCTAssertEqual(memcmp(loadedExtents, builtExtents, numBuiltExtents * sizeof(*builtExtents)), 0, @"Fork %lu of item #%u", (unsigned long)forkIdx, cnid);
+			}
+			mostExtentsInOneFork = MAX(mostExtentsInOneFork, numLoadedExtents);
+		}
+	}
+	XCTAssertGreaterThan(mostExtentsInOneFork, 3u, @"No fork had extents beyond its catalog record's three, so the extents overflow file went untested");
+}
+
+- (void) testIndexIsStaleAfterImageGrows {
+	[self buildAndSaveIndex];
+
+	NSError *_Nullable error = nil;
+	NSFileHandle *_Nullable const appendFH = [NSFileHandle fileHandleForWritingToURL:_imageURL error:&error];
+	XCTAssertNotNil(appendFH, @"%@", error);
+	[appendFH seekToEndOfFile];
+	[appendFH writeData:[NSMutableData dataWithLength:512]];
+	XCTAssertTrue([appendFH closeAndReturnError:&error], @"%@", error);
+
+	XCTAssertNil([ImpCatalogIndex indexAtURL:_indexURL forVolume:_srcVol error:&error]);
+	XCTAssertNil(error, @"A stale index should be quietly rejected, not reported as an error");
+}
+
+- (void) testIndexIsStaleAfterImageIsModified {
+	[self buildAndSaveIndex];
+
+	//Same size, different modification date, as if something had written to the volume in place.
+	struct timeval const times[2] = { { .tv_sec = 946684800 }, { .tv_sec = 946684800 } };
+	XCTAssertEqual(utimes(_imageURL.fileSystemRepresentation, times), 0);
+
+	NSError *_Nullable error = nil;
+	XCTAssertNil([ImpCatalogIndex indexAtURL:_indexURL forVolume:_srcVol error:&error]);
+	XCTAssertNil(error, @"A stale index should be quietly rejected, not reported as an error");
+}
+
+- (void) testDamagedIndexIsRejected {
+	[self buildAndSaveIndex];
+
+	NSData *_Nonnull const indexData = [NSData dataWithContentsOfURL:_indexURL];
+	XCTAssertTrue([[indexData subdataWithRange:(NSRange){ 0, indexData.length / 2 }] writeToURL:_indexURL atomically:true]);
+
+	XCTAssertNil([ImpCatalogIndex indexAtURL:_indexURL forVolume:_srcVol error:NULL]);
+}
+
+@end
@@ -0,0 +1,92 @@
+//
+//  TestFileTransfer.m
+//  UnitTests
+//
+//  Created by Peter Hosey on 2024-06-23.
+//
+
+#import <XCTest/XCTest.h>
+
+#import <fcntl.h>
+
+#import "ImpFileTransfer.h"
+
+@interface TestFileTransfer : XCTestCase
+
+@end
+
+@implementation TestFileTransfer
+{
+	NSURL *_Nonnull _directoryURL;
+	int _readFD, _writeFD;
+}
+
+///More than one transfer buffer's worth, so the copy takes more than one read.
+enum { TestFileTransferSourceLength = 1024 * 1024 * 2 + 1000 };
+
+- (void) setUp {
+	self.continueAfterFailure = false;
+
+	NSFileManager *_Nonnull const mgr = [NSFileManager defaultManager];
+	NSError *_Nullable error = nil;
+	_directoryURL = [[NSURL fileURLWithPath:NSTemporaryDirectory() isDirectory:true] URLByAppendingPathComponent:[NSUUID UUID].UUIDString isDirectory:true];
+	XCTAssertTrue([mgr createDirectoryAtURL:_directoryURL withIntermediateDirectories:true attributes:nil error:&error], @"%@", error);
+
+	NSMutableData *_Nonnull const sourceData = [NSMutableData dataWithLength:TestFileTransferSourceLength];
+	u_int8_t *_Nonnull const sourceBytes = sourceData.mutableBytes;
+	for (NSUInteger i = 0; i < TestFileTransferSourceLength; ++i) {
+		sourceBytes[i] = (u_int8_t)(i % 251);
+	}
+	NSURL *_Nonnull const sourceURL = [_directoryURL URLByAppendingPathComponent:@"source" isDirectory:false];
+	XCTAssertTrue([sourceData writeToURL:sourceURL options:0 error:&error], @"%@", error);
+
+	_readFD = open(sourceURL.fileSystemRepresentation, O_RDONLY);
+	XCTAssertGreaterThanOrEqual(_readFD, 0);
+	_writeFD = open([_directoryURL URLByAppendingPathComponent:@"destination" isDirectory:false].fileSystemRepresentation, O_RDWR | O_CREAT, 0644);
+	XCTAssertGreaterThanOrEqual(_writeFD, 0);
+}
+
+- (void) tearDown {
+	if (_readFD >= 0) {
+		close(_readFD);
+	}
+	if (_writeFD >= 0) {
+		close(_writeFD);
+	}
+	[[NSFileManager defaultManager] removeItemAtURL:_directoryURL error:NULL];
+}
+
+- (void) testCopiesRangeIntoMiddleOfDestination {
+	off_t const readOffset = 100, writeOffset = 5000;
+	u_int64_t const length = TestFileTransferSourceLength - 200;
+	u_int64_t amtTransferred = 0;
+	NSError *_Nullable error = nil;
+	XCTAssertTrue(ImpTransferBytes(_readFD, readOffset, _writeFD, writeOffset, length, &amtTransferred, &error), @"%@", error);
+	XCTAssertEqual(amtTransferred, length);
+
+	NSMutableData *_Nonnull const expected = [NSMutableData dataWithLength:length];
+	NSMutableData *_Nonnull const actual = [NSMutableData dataWithLength:length];
+	XCTAssertEqual(pread(_readFD, expected.mutableBytes, length, readOffset), (ssize_t)length);
+	XCTAssertEqual(pread(_writeFD, actual.mutableBytes, length, writeOffset), (ssize_t)length);
+	XCTAssertEqualObjects(actual, expected);
+}
+
+- (void) testCopyingToEndOfFileStopsAtEndOfInput {
+	off_t const readOffset = 1024 * 1024;
+	u_int64_t amtTransferred = 0;
+	NSError *_Nullable error = nil;
+	XCTAssertTrue(ImpTransferBytes(_readFD, readOffset, _writeFD, 0, ImpTransferBytesToEndOfFile, &amtTransferred, &error), @"%@", error);
+	XCTAssertEqual(amtTransferred, (u_int64_t)(TestFileTransferSourceLength - readOffset));
+}
+
+- (void) testRunningOutOfInputEarlyIsAnError {
+	off_t const readOffset = 1024 * 1024;
+	u_int64_t amtTransferred = 0;
+	NSError *_Nullable error = nil;
+	XCTAssertFalse(ImpTransferBytes(_readFD, readOffset, _writeFD, 0, TestFileTransferSourceLength, &amtTransferred, &error));
+	XCTAssertEqual(amtTransferred, (u_int64_t)(TestFileTransferSourceLength - readOffset), @"Should still report the bytes that were copied before the input ran out");
+	XCTAssertEqualObjects(error.domain, NSCocoaErrorDomain);
+	XCTAssertEqual(error.code, NSFileReadCorruptFileError);
+}
+
+@end
@@ -0,0 +1,151 @@
+//
+//  TestFoldedNameComparison.m
+//  UnitTests
+//
+//  Created by Peter Hosey on 2024-06-17.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "ImpByteOrder.h"
+#import "ImpComparisonUtilities.h"
+
+@interface TestFoldedNameComparison : XCTestCase
+
+@end
+
+@implementation TestFoldedNameComparison
+
+///Make an HFSUniStr255 as it would appear in a catalog key (big-endian).
+static struct HFSUniStr255 ImpMakeHFSUniStr255(NSString *_Nonnull const string) {
+	struct HFSUniStr255 name = { 0 };
+	NSUInteger const length = MIN(string.length, (NSUInteger)255);
+	UniChar units[255];
+	[string getCharacters:units range:(NSRange){ 0, length }];
+	S(name.length, (u_int16_t)length);
+	for (NSUInteger i = 0; i < length; ++i) {
+		S(name.unicode[i], units[i]);
+	}
+	return name;
+}
+
+static NSComparisonResult ImpCompareByFolding(struct HFSUniStr255 const *_Nonnull const name0, struct HFSUniStr255 const *_Nonnull const name1) {
+	UniChar folded0[ImpHFSPlusFoldedNameMaximumLength], folded1[ImpHFSPlusFoldedNameMaximumLength];
+	NSUInteger const length0 = ImpHFSPlusFoldName(name0, folded0);
+	NSUInteger const length1 = ImpHFSPlusFoldName(name1, folded1);
+	return ImpHFSPlusCompareFoldedNames(folded0, length0, folded1, length1);
+}
+
+///Names chosen to exercise the ASCII fast path (including names longer than one vector's worth), case folding of non-ASCII letters, and ignorable code points (ZWNJ, ZWJ, directional marks, and the BOM) at the start, middle, and end.
+- (NSArray <NSString *> *_Nonnull) sampleNames {
+	return @[
+		@"",
+		@"a",
+		@"A",
+		@"apple",
+		@"Apple",
+		@"APPLE",
+		@"apples",
+		@"Applesauce",
+		@"a\u200Cpple",
+		@"\u200Dapple",
+		@"apple\u200E",
+		@"\uFEFF",
+		@"\u202A\u202E",
+		@"\uFEFFZeta",
+		@"ZETA",
+		@"zeta",
+		@"Banana",
+		@"banana",
+		@"ärger",
+		@"Ärger",
+		@"Æon",
+		@"æon",
+		@"éclair",
+		@"Éclair",
+		@"Σίσυφος",
+		@"ΣΊΣΥΦΟΣ",
+		@"Read Me First Please",
+		@"read me first please",
+		@"Read Me First Pleasé",
+		@"Read Me First PleasÉ",
+		@"Read Me\u200C First Please",
+		@"System Folder",
+		@"System Folder 2",
+		@"Ωmega 0123456789ABCDEF",
+		@"ωmega 0123456789abcdef",
+	];
+}
+
+- (void) testFoldedComparisonMatchesUnfoldedComparison {
+	NSArray <NSString *> *_Nonnull const names = [self sampleNames];
+	NSUInteger const numNames = names.count;
+	struct HFSUniStr255 hfsNames[numNames];
+	for (NSUInteger i = 0; i < numNames; ++i) {
+		hfsNames[i] = ImpMakeHFSUniStr255(names[i]);
+	}
+
+	for (NSUInteger i = 0; i < numNames; ++i) {
+		for (NSUInteger j = 0; j < numNames; ++j) {
+			NSComparisonResult const expected = ImpHFSPlusCompareNames(&hfsNames[i], &hfsNames[j]);
+			NSComparisonResult const actual = ImpCompareByFolding(&hfsNames[i], &hfsNames[j]);
+			XCTAssertEqual(actual, expected, @"Folded comparison of “%@” with “%@” gave %ld, but ImpHFSPlusCompareNames gave %ld", names[i], names[j], (long)actual, (long)expected);
+		}
+	}
+}
+
+///The catalog key comparator folds the found key's name only as far as the first difference, so check it separately against the comparison that folds both names in full.
+- (void) testCatalogKeyComparisonMatchesUnfoldedComparison {
+	NSArray <NSString *> *_Nonnull const names = [self sampleNames];
+	NSUInteger const numNames = names.count;
+	struct HFSPlusCatalogKey keys[numNames];
+	for (NSUInteger i = 0; i < numNames; ++i) {
+		keys[i] = (struct HFSPlusCatalogKey){ 0 };
+		S(keys[i].parentID, kHFSRootFolderID);
+		keys[i].nodeName = ImpMakeHFSUniStr255(names[i]);
+	}
+
+	for (NSUInteger i = 0; i < numNames; ++i) {
+		struct ImpHFSPlusFoldedName quarryName;
+		quarryName.length = (u_int16_t)ImpHFSPlusFoldName(&keys[i].nodeName, quarryName.unicode);
+		for (NSUInteger j = 0; j < numNames; ++j) {
+			ImpBTreeComparisonResult const expected = (ImpBTreeComparisonResult)ImpHFSPlusCompareNames(&keys[i].nodeName, &keys[j].nodeName);
+			ImpBTreeComparisonResult const actual = ImpBTreeCompareHFSPlusCatalogKeyWithFoldedName(kHFSRootFolderID, &quarryName, &keys[j]);
+			XCTAssertEqual(actual, expected, @"Comparing “%@” with the key for “%@” gave %ld, but ImpHFSPlusCompareNames gave %ld", names[i], names[j], (long)actual, (long)expected);
+		}
+
+		//Parent IDs come before names.
+		XCTAssertEqual(ImpBTreeCompareHFSPlusCatalogKeyWithFoldedName(kHFSRootParentID, &quarryName, &keys[i]), ImpBTreeComparisonQuarryIsLesser);
+	}
+}
+
+- (void) testCaseIsIgnored {
+	struct HFSUniStr255 const lower = ImpMakeHFSUniStr255(@"read me first please");
+	struct HFSUniStr255 const mixed = ImpMakeHFSUniStr255(@"Read Me First Please");
+	XCTAssertEqual(ImpCompareByFolding(&lower, &mixed), NSOrderedSame);
+
+	struct HFSUniStr255 const lowerAccented = ImpMakeHFSUniStr255(@"ärger");
+	struct HFSUniStr255 const upperAccented = ImpMakeHFSUniStr255(@"Ärger");
+	XCTAssertEqual(ImpCompareByFolding(&lowerAccented, &upperAccented), NSOrderedSame);
+}
+
+- (void) testIgnorableCharactersAreDropped {
+	struct HFSUniStr255 const plain = ImpMakeHFSUniStr255(@"apple");
+	struct HFSUniStr255 const withIgnorables = ImpMakeHFSUniStr255(@"\u200Da\u200Cpple\uFEFF");
+	XCTAssertEqual(ImpCompareByFolding(&plain, &withIgnorables), NSOrderedSame);
+
+	UniChar folded[ImpHFSPlusFoldedNameMaximumLength];
+	XCTAssertEqual(ImpHFSPlusFoldName(&withIgnorables, folded), 5u);
+
+	struct HFSUniStr255 const allIgnorable = ImpMakeHFSUniStr255(@"\u200C\u200D\uFEFF");
+	XCTAssertEqual(ImpHFSPlusFoldName(&allIgnorable, folded), 0u);
+}
+
+- (void) testPrefixSortsFirst {
+	struct HFSUniStr255 const shorter = ImpMakeHFSUniStr255(@"Apple");
+	struct HFSUniStr255 const longer = ImpMakeHFSUniStr255(@"applesauce");
+	XCTAssertEqual(ImpCompareByFolding(&shorter, &longer), NSOrderedAscending);
+	XCTAssertEqual(ImpCompareByFolding(&longer, &shorter), NSOrderedDescending);
+}
+
+@end
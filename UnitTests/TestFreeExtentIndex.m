@@ -0,0 +1,145 @@
+//
+//  TestFreeExtentIndex.m
+//  UnitTests
+//
+//  Created by Peter Hosey on 2024-06-18.
+//
+
+#import <XCTest/XCTest.h>
+
+#import "ImpFreeExtentIndex.h"
+#import "ImpAllocationBitmap.h"
+
+@interface TestFreeExtentIndex : XCTestCase
+
+@end
+
+@implementation TestFreeExtentIndex
+{
+	ImpFreeExtentIndex *_Nonnull _index;
+}
+
+- (void) setUp {
+	_index = [[ImpFreeExtentIndex alloc] init];
+}
+
+- (void) tearDown {
+	_index = nil;
+}
+
+///Read back every free run in start order. Runs are never adjacent, so each search that starts just past the previous run finds the next one whole.
+- (NSArray <NSValue *> *_Nonnull) freeRangesOfIndex:(ImpFreeExtentIndex *_Nonnull const)index {
+	NSMutableArray <NSValue *> *_Nonnull const ranges = [NSMutableArray arrayWithCapacity:index.numberOfFreeExtents];
+	NSUInteger nextStart = 0;
+	NSRange range;
+	while ((range = [index firstFreeRangeInRange:(NSRange){ nextStart, UINT32_MAX } minimumLength:1]).location != NSNotFound) {
+		[ranges addObject:[NSValue valueWithRange:range]];
+		nextStart = NSMaxRange(range);
+	}
+	return ranges;
+}
+
+- (void) assertFreeRanges:(NSArray <NSValue *> *_Nonnull const)expected {
+	XCTAssertEqualObjects([self freeRangesOfIndex:_index], expected);
+	XCTAssertEqual(_index.numberOfFreeExtents, expected.count);
+}
+
+static NSValue *_Nonnull R(NSUInteger const location, NSUInteger const length) {
+	return [NSValue valueWithRange:(NSRange){ location, length }];
+}
+
+- (void) testSeparateRangesStaySeparate {
+	[_index addFreeRange:(NSRange){ 10, 5 }];
+	[_index addFreeRange:(NSRange){ 20, 5 }];
+	[self assertFreeRanges:@[ R(10, 5), R(20, 5) ]];
+}
+
+- (void) testAbuttingRangesCoalesce {
+	[_index addFreeRange:(NSRange){ 10, 5 }];
+	[_index addFreeRange:(NSRange){ 15, 5 }];
+	[self assertFreeRanges:@[ R(10, 10) ]];
+
+	[_index addFreeRange:(NSRange){ 5, 5 }];
+	[self assertFreeRanges:@[ R(5, 15) ]];
+}
+
+- (void) testOverlappingRangesCoalesce {
+	[_index addFreeRange:(NSRange){ 10, 10 }];
+	[_index addFreeRange:(NSRange){ 15, 10 }];
+	[self assertFreeRanges:@[ R(10, 15) ]];
+
+	//Entirely inside an existing run: nothing changes.
+	[_index addFreeRange:(NSRange){ 12, 3 }];
+	[self assertFreeRanges:@[ R(10, 15) ]];
+}
+
+- (void) testRangeBridgingSeveralRunsCoalescesThemAll {
+	[_index addFreeRange:(NSRange){ 0, 2 }];
+	[_index addFreeRange:(NSRange){ 10, 2 }];
+	[_index addFreeRange:(NSRange){ 20, 2 }];
+	[_index addFreeRange:(NSRange){ 30, 2 }];
+	[_index addFreeRange:(NSRange){ 50, 2 }];
+	[_index addFreeRange:(NSRange){ 2, 28 }];
+	[self assertFreeRanges:@[ R(0, 32), R(50, 2) ]];
+
+	//The by-length list must have been updated too, or best fit would still find the small runs that were merged away.
+	XCTAssertEqual([_index smallestFreeRangeWithMinimumLength:1].location, 50u);
+	XCTAssertTrue(NSEqualRanges([_index smallestFreeRangeWithMinimumLength:3], (NSRange){ 0, 32 }));
+	XCTAssertTrue(NSEqualRanges(_index.largestFreeRange, (NSRange){ 0, 32 }));
+}
+
+- (void) testRemovingFromTheMiddleSplitsARun {
+	[_index addFreeRange:(NSRange){ 0, 100 }];
+	[_index removeRange:(NSRange){ 40, 10 }];
+	[self assertFreeRanges:@[ R(0, 40), R(50, 50) ]];
+
+	//Freeing it again brings the run back whole.
+	[_index addFreeRange:(NSRange){ 40, 10 }];
+	[self assertFreeRanges:@[ R(0, 100) ]];
+}
+
+- (void) testRemovingAcrossAllocatedBlocks {
+	[_index addFreeRange:(NSRange){ 0, 10 }];
+	[_index addFreeRange:(NSRange){ 20, 10 }];
+	[_index addFreeRange:(NSRange){ 40, 10 }];
+	[_index removeRange:(NSRange){ 5, 40 }];
+	[self assertFreeRanges:@[ R(0, 5), R(45, 5) ]];
+}
+
+- (void) testBestFitPrefersTheSmallestThenTheLowest {
+	[_index addFreeRange:(NSRange){ 0, 8 }];
+	[_index addFreeRange:(NSRange){ 20, 4 }];
+	[_index addFreeRange:(NSRange){ 30, 4 }];
+	[_index addFreeRange:(NSRange){ 40, 16 }];
+	XCTAssertTrue(NSEqualRanges([_index smallestFreeRangeWithMinimumLength:3], (NSRange){ 20, 4 }));
+	XCTAssertTrue(NSEqualRanges([_index smallestFreeRangeWithMinimumLength:5], (NSRange){ 0, 8 }));
+	XCTAssertEqual([_index smallestFreeRangeWithMinimumLength:17].location, (NSUInteger)NSNotFound);
+	XCTAssertTrue(NSEqualRanges([_index firstFreeRangeInRange:(NSRange){ 2, 100 } minimumLength:5], (NSRange){ 2, 6 }));
+}
+
+///Apply a pseudorandom series of frees and allocations to both an index and a bitmap, and check that the index always matches the runs of clear bits in the bitmap.
+- (void) testCoalescingMatchesBitmap {
+	NSUInteger const numBlocks = 2000;
+	ImpAllocationBitmap *_Nonnull const bitmap = [[ImpAllocationBitmap alloc] initWithNumberOfBits:numBlocks];
+	[bitmap setBitsInRange:(NSRange){ 0, numBlocks }];
+
+	srandom(1150);
+	for (NSUInteger i = 0; i < 500; ++i) {
+		NSUInteger const location = (NSUInteger)random() % numBlocks;
+		NSUInteger const length = MIN((NSUInteger)random() % 64 + 1, numBlocks - location);
+		NSRange const range = { location, length };
+		if (random() % 3 != 0) {
+			[_index addFreeRange:range];
+			[bitmap clearBitsInRange:range];
+		} else {
+			[_index removeRange:range];
+			[bitmap setBitsInRange:range];
+		}
+
+		ImpFreeExtentIndex *_Nonnull const expectedIndex = [[ImpFreeExtentIndex alloc] initWithFreeBlocksInBitmap:bitmap];
+		XCTAssertEqualObjects([self freeRangesOfIndex:_index], [self freeRangesOfIndex:expectedIndex], @"Index diverged from bitmap after operation #%lu on %@", (unsigned long)i, NSStringFromRange(range));
+		XCTAssertTrue(NSEqualRanges(_index.largestFreeRange, expectedIndex.largestFreeRange), @"Largest free range is %@; expected %@", NSStringFromRange(_index.largestFreeRange), NSStringFromRange(expectedIndex.largestFreeRange));
+	}
+}
+
+@end
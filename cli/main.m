@@ -7,6 +7,8 @@
 
 #import <Foundation/Foundation.h>
 #import <sysexits.h>
+#import <stdatomic.h>
+#import <sys/stat.h>
 
 #import "ImpTextEncodingConverter.h"
 #import "ImpHFSToHFSPlusConverter.h"
@@ -15,6 +17,33 @@
 #import "ImpHFSArchiver.h"
 #import "ImpHFSLister.h"
 #import "ImpHFSAnalyzer.h"
+#import "ImpConversionReport.h"
+#import "ImpProgressEmitter.h"
+#import "ImpTrace.h"
+
+///Options shared by convert and convert-batch.
+struct ImpConversionOptions {
+	NSNumber *_Nullable defaultEncoding;
+	NSUInteger catalogMemoryBudgetInMiB;
+	bool copyForkData;
+	bool writesPlaceholderForkData;
+	bool writesSparseOutput;
+	bool preallocatesDestination;
+	bool readsSourceInPhysicalOrder;
+	bool expectsEncoding;
+	///Where to write the performance report. For convert-batch, this is a folder, and each conversion's report is numbered in manifest order and named after its destination.
+	NSString *_Nullable reportPath;
+	ImpConversionReportFormat reportFormat;
+	///If false, the report format is inferred from reportPath's extension.
+	bool reportFormatWasSpecified;
+	///Print a line for every file copied, rather than a summary every progressInterval seconds.
+	bool verbose;
+	///If non-negative, progress is written to this file descriptor as newline-delimited JSON every progressInterval seconds.
+	int progressFileDescriptor;
+	NSTimeInterval progressInterval;
+	///Set if an option's value couldn't be parsed. The option parser will already have said what was wrong with it.
+	bool hasInvalidOption;
+};
 
 @interface Impluse : NSObject
 
@@ -28,10 +57,24 @@
 - (void) help:(NSEnumerator <NSString *> *_Nonnull const)argsEnum;
 - (void) list:(NSEnumerator <NSString *> *_Nonnull const)argsEnum;
 - (void) convert:(NSEnumerator <NSString *> *_Nonnull const)argsEnum;
+- (void) convertBatch:(NSEnumerator <NSString *> *_Nonnull const)argsEnum;
 - (void) extract:(NSEnumerator <NSString *> *_Nonnull const)argsEnum;
 
 @end
 
+///Subcommands with more than one word are spelled with dashes on the command line (convert-batch) and in camel case as methods (convertBatch:).
+static NSString *_Nullable ImpMethodNameForSubcommand(NSString *_Nullable const subcommand) {
+	NSArray <NSString *> *_Nonnull const words = [subcommand componentsSeparatedByString:@"-"];
+	if (words.count < 2) {
+		return subcommand;
+	}
+	NSMutableString *_Nonnull const methodName = [words.firstObject mutableCopy];
+	for (NSString *_Nonnull const word in [words subarrayWithRange:(NSRange){ 1, words.count - 1 }]) {
+		[methodName appendString:word.capitalizedString];
+	}
+	return methodName;
+}
+
 int main(int argc, const char * argv[]) {
 	int status = EXIT_SUCCESS;
 	@autoreleasepool {
@@ -40,8 +83,18 @@ int main(int argc, const char * argv[]) {
 		Impluse *_Nonnull const impluse = [Impluse new];
 		impluse.argv0 = [argsEnum nextObject];
 
-		NSString *_Nonnull const subcommand = [argsEnum nextObject];
-		SEL _Nonnull const subcmdSelector = NSSelectorFromString([subcommand stringByAppendingString:@":"]);
+		NSString *_Nullable subcommand = [argsEnum nextObject];
+		//--trace is the only option that goes before the subcommand, since it applies to all of them.
+		NSString *_Nullable tracePath = nil;
+		while ([subcommand hasPrefix:@"--trace="]) {
+			tracePath = [subcommand substringFromIndex:@"--trace=".length];
+			subcommand = [argsEnum nextObject];
+		}
+		if (tracePath != nil) {
+			ImpTraceStartRecording();
+		}
+
+		SEL _Nonnull const subcmdSelector = NSSelectorFromString([ImpMethodNameForSubcommand(subcommand) stringByAppendingString:@":"]);
 		if ([impluse respondsToSelector:subcmdSelector]) {
 			//ARC warns because we could use performSelector:withObject: to call -release or something. We're not doing that, so take out a license to use dynamic dispatch without complaint.
 #pragma clang diagnostic push
@@ -53,6 +106,16 @@ int main(int argc, const char * argv[]) {
 		}
 
 		status = impluse.status;
+
+		if (tracePath != nil) {
+			NSError *_Nullable traceError = nil;
+			if (! ImpTraceWriteToURL([NSURL fileURLWithPath:tracePath isDirectory:false], &traceError)) {
+				NSLog(@"Failed to write trace: %@", traceError.localizedDescription);
+				if (status == EXIT_SUCCESS) {
+					status = EX_CANTCREAT;
+				}
+			}
+		}
 	}
 	return status;
 }
@@ -60,21 +123,40 @@ int main(int argc, const char * argv[]) {
 @implementation Impluse
 
 - (void) printUsageToFile:(FILE *_Nonnull const)outputFile {
-	fprintf(outputFile, "usage: %s list [--paths] hfs-device\n", self.argv0.UTF8String ?: "impluse");
+	fprintf(outputFile, "usage: %s [--trace=path] subcommand [options and arguments]\n", self.argv0.UTF8String ?: "impluse");
+	fprintf(outputFile, "With --trace, a timeline of reads, writes, catalog building, and other work is written to path when the subcommand finishes, in Chrome's trace-event format (open it in chrome://tracing or Perfetto).\n");
+	fprintf(outputFile, "\n");
+
+	fprintf(outputFile, "usage: %s list [--paths] [--stream] hfs-device\n", self.argv0.UTF8String ?: "impluse");
 	fprintf(outputFile, "Recursively lists the entire contents of a volume, starting from its root directory. With --paths, each item is listed as its full absolute path, which you can pass to extract. Otherwise, you get a more-readable indented listing.\n");
+	fprintf(outputFile, "With --stream, items are listed as they're read from the catalog, so output starts right away and memory use stays flat even on huge volumes. Items are listed as absolute paths, with each folder's contents together, but folders aren't in hierarchy order.\n");
 	fprintf(outputFile, "\n");
 
-	fprintf(outputFile, "usage: %s convert hfs-device hfsplus-device\n", self.argv0.UTF8String ?: "impluse");
+	fprintf(outputFile, "usage: %s convert [--catalog-memory-limit=MiB] [--metadata-only] [--no-sparse] [--preallocate] [--physical-order] [--report=path] [--report-format=json|csv] [--verbose] [--progress-fd=N] [--progress-interval=seconds] hfs-device hfsplus-device\n", self.argv0.UTF8String ?: "impluse");
 	fprintf(outputFile, "The two paths must not be the same. The contents of hfs-device will be copied to hfsplus-device. This may take some time.\n");
+	fprintf(outputFile, "With --catalog-memory-limit, the new catalog is built using about that many MiB of working memory, with the rest spilled to temporary files. Use this for volumes with millions of items.\n");
+	fprintf(outputFile, "Blocks that are all zeroes (including free space) are left as holes, so hfsplus-device, if it's a file, is sparse. --no-sparse writes every block. --preallocate reserves space for the whole volume up front, which avoids fragmenting the file at the cost of the space savings.\n");
+	fprintf(outputFile, "With --physical-order, file contents are read in one pass from the start of hfs-device to the end, after the whole catalog has been read, instead of file by file. Use this when hfs-device is slow to seek, such as a CD or an old hard disk.\n");
+	fprintf(outputFile, "With --metadata-only, only the volume structures and catalog are written; file contents are left out (as holes), for examining a volume's structure without copying its data.\n");
+	fprintf(outputFile, "With --report=path, a report of the time taken and I/O, B-tree, and allocator work done by each step of the conversion is written to path, as JSON or (with --report-format=csv, or if path ends in .csv) CSV.\n");
+	fprintf(outputFile, "Progress is summarized every --progress-interval seconds (default 1). --verbose prints a line for every file copied instead, which slows down conversion of volumes with many small files. With --progress-fd=N, each summary is also written to file descriptor N as one line of JSON, for other programs to follow along.\n");
+	fprintf(outputFile, "\n");
+	fprintf(outputFile, "usage: %s convert-batch [--jobs=N] [convert options] manifest\n", self.argv0.UTF8String ?: "impluse");
+	fprintf(outputFile, "Converts many volumes, several at a time. Each line of the manifest is a source path and a destination path, separated by a tab; blank lines and lines starting with # are ignored. A manifest path of - reads the manifest from standard input. Any of convert's options apply to every conversion in the batch.\n");
+	fprintf(outputFile, "--jobs sets how many conversions run at once; the default is the number of CPUs. One line is printed as each conversion finishes, so --verbose isn't accepted. The exit status is non-zero if any conversion failed.\n");
+	fprintf(outputFile, "With --progress-fd, each conversion's progress lines are labeled with its destination path.\n");
+	fprintf(outputFile, "With --report, the path is a folder, and each conversion's report is numbered in manifest order and named after its destination. I/O and other counts are process-wide, so conversions with --report run one at a time (the default when --jobs isn't given; --jobs greater than 1 is an error).\n");
 	fprintf(outputFile, "\n");
 
-	fprintf(outputFile, "usage: %s extract hfs-device [name-or-path] [destination]\n", self.argv0.UTF8String ?: "impluse");
+	fprintf(outputFile, "usage: %s extract [--jobs=N] [--index] hfs-device [name-or-path] [destination]\n", self.argv0.UTF8String ?: "impluse");
 	fprintf(outputFile, "If name-or-path is a single name: Attempt to find a file or folder uniquely bearing that name. If there are multiple matches, list their paths and then exit without extracting anything; otherwise, extract that file or folder.\n");
 	fprintf(outputFile, "If name-or-path is an HFS path (like “Macintosh HD:Applications:ResEdit”), extracts that file or folder specifically.\n");
 	fprintf(outputFile, "If name-or-path is missing (i.e., there are no arguments after the source device) or is a single colon (“:”), extracts the entire volume.\n");
 	fprintf(outputFile, "If destination is absent and name-or-path is a single name, the copy will be created in the current directory. If name-or-path is a full HFS path, the extraction will recreate the folder hierarchy down to that file, starting by creating a folder named for the volume in the current directory.\n");
 	fprintf(outputFile, "If destination is a path that does end in a slash, it is treated as the location where the copy should be created, instead of the working directory, and the behavior is otherwise the same as if no destination had been indicated.\n");
 	fprintf(outputFile, "If destination is a path that does not end in a slash, it is treated as the location and name where the copy should be created—i.e., the copy will be renamed to the destination path's name if it's different. (If the name-or-path is a full path, the folder hierarchy is not recreated; the indicated file or folder is created at the destination path without any of its containing folders from the source volume.)\n");
+	fprintf(outputFile, "When extracting a folder, its subfolders are all created first, then its files are extracted several at a time. --jobs sets how many; the default is the number of CPUs.\n");
+	fprintf(outputFile, "With --index, the volume's catalog is indexed into a file next to hfs-device (named the same with “.impluse-index” on the end), and the item to extract is looked up in the index. The first extraction builds the index; later ones from the same image reuse it, so they don't need to search the catalog. If the image changes, the index is rebuilt.\n");
 	fprintf(outputFile, "\n");
 
 	[self printArchiveUsage:outputFile goryDetails:false];
@@ -164,6 +246,7 @@ int main(int argc, const char * argv[]) {
 
 - (void) list:(NSEnumerator <NSString *> *_Nonnull const)argsEnum {
 	bool printAbsolutePaths = false;
+	bool streamsFromCatalog = false;
 	bool inventoryApplications = false;
 	bool inventoryExtensions = false;
 	bool inventoryControlPanels = false;
@@ -177,6 +260,8 @@ int main(int argc, const char * argv[]) {
 			expectsEncoding = false;
 		} else if ((srcDevPath == nil) && [arg isEqualToString:@"--paths"]) {
 			printAbsolutePaths = true;
+		} else if ((srcDevPath == nil) && [arg isEqualToString:@"--stream"]) {
+			streamsFromCatalog = true;
 		} else if ([arg isEqualToString:@"--application-inventory"] || [arg isEqualToString:@"--app-inventory"]) {
 			inventoryApplications = true;
 		} else if ([arg isEqualToString:@"--inventory"]) {
@@ -207,6 +292,7 @@ int main(int argc, const char * argv[]) {
 	ImpHFSLister *_Nonnull const lister = [ImpHFSLister new];
 	lister.sourceDevice = [NSURL fileURLWithPath:srcDevPath isDirectory:false];
 	lister.printAbsolutePaths = printAbsolutePaths;
+	lister.streamsFromCatalog = streamsFromCatalog;
 	lister.inventoryApplications = inventoryApplications;
 	lister.inventoryExtensions = inventoryExtensions;
 	lister.inventoryControlPanels = inventoryControlPanels;
@@ -222,27 +308,135 @@ int main(int argc, const char * argv[]) {
 		self.status = EXIT_FAILURE;
 	}
 }
+- (struct ImpConversionOptions) defaultConversionOptions {
+	return (struct ImpConversionOptions){
+		.copyForkData = true,
+		.writesPlaceholderForkData = true,
+		.writesSparseOutput = true,
+		.progressFileDescriptor = -1,
+		.progressInterval = 1.0,
+	};
+}
+///Returns true if arg was one of convert's options (or the value of one), in which case it has been consumed.
+- (bool) parseConversionOption:(NSString *_Nonnull const)arg into:(struct ImpConversionOptions *_Nonnull const)options {
+	if (options->expectsEncoding) {
+		options->defaultEncoding = @([arg integerValue]);
+		options->expectsEncoding = false;
+	} else if ((options->defaultEncoding == nil) && [arg hasPrefix:@"--encoding"]) {
+		if ([arg hasPrefix:@"--encoding="]) {
+			//--encoding=42
+			options->defaultEncoding = @([[arg substringFromIndex:@"--encoding=".length] integerValue]);
+		} else {
+			//--encoding 42
+			options->expectsEncoding = true;
+		}
+	} else if ([arg isEqualToString:@"--no-copy-fork-data"]) {
+		options->copyForkData = false;
+	} else if ([arg isEqualToString:@"--copy-fork-data"]) {
+		options->copyForkData = true;
+	} else if ([arg isEqualToString:@"--metadata-only"]) {
+		options->copyForkData = false;
+		options->writesPlaceholderForkData = false;
+	} else if ([arg isEqualToString:@"--no-sparse"]) {
+		options->writesSparseOutput = false;
+	} else if ([arg isEqualToString:@"--preallocate"]) {
+		options->preallocatesDestination = true;
+	} else if ([arg isEqualToString:@"--physical-order"]) {
+		options->readsSourceInPhysicalOrder = true;
+	} else if ([arg hasPrefix:@"--catalog-memory-limit="]) {
+		options->catalogMemoryBudgetInMiB = (NSUInteger)[[arg substringFromIndex:@"--catalog-memory-limit=".length] integerValue];
+	} else if ([arg isEqualToString:@"--verbose"] || [arg isEqualToString:@"-v"]) {
+		options->verbose = true;
+	} else if ([arg hasPrefix:@"--progress-fd="]) {
+		NSString *_Nonnull const fdString = [arg substringFromIndex:@"--progress-fd=".length];
+		int const fd = fdString.intValue;
+		if (fd < 0 || ! [fdString isEqualToString:[NSString stringWithFormat:@"%d", fd]]) {
+			fprintf(stderr, "--progress-fd must be a file descriptor number\n");
+			options->hasInvalidOption = true;
+		}
+		options->progressFileDescriptor = fd;
+	} else if ([arg hasPrefix:@"--progress-interval="]) {
+		double const interval = [arg substringFromIndex:@"--progress-interval=".length].doubleValue;
+		if (! (interval > 0.0)) {
+			fprintf(stderr, "--progress-interval must be a positive number of seconds\n");
+			options->hasInvalidOption = true;
+		}
+		options->progressInterval = interval;
+	} else if ([arg hasPrefix:@"--report="]) {
+		options->reportPath = [arg substringFromIndex:@"--report=".length];
+	} else if ([arg hasPrefix:@"--report-format="]) {
+		NSString *_Nonnull const formatName = [arg substringFromIndex:@"--report-format=".length];
+		if ([formatName isEqualToString:@"json"]) {
+			options->reportFormat = ImpConversionReportFormatJSON;
+		} else if ([formatName isEqualToString:@"csv"]) {
+			options->reportFormat = ImpConversionReportFormatCSV;
+		} else {
+			fprintf(stderr, "Unrecognized report format: %s (expected json or csv)\n", formatName.UTF8String);
+			options->hasInvalidOption = true;
+		}
+		options->reportFormatWasSpecified = true;
+	} else {
+		return false;
+	}
+	return true;
+}
+- (ImpHFSToHFSPlusConverter *_Nonnull) converterFromPath:(NSString *_Nonnull const)srcDevPath toPath:(NSString *_Nonnull const)dstDevPath options:(struct ImpConversionOptions const)options {
+	ImpHFSToHFSPlusConverter *_Nonnull const converter = [ImpDefragmentingHFSToHFSPlusConverter new];
+	converter.sourceDevice = [NSURL fileURLWithPath:srcDevPath isDirectory:false];
+	converter.destinationDevice = [NSURL fileURLWithPath:dstDevPath isDirectory:false];
+	if (options.defaultEncoding != nil) {
+		converter.hfsTextEncoding = (TextEncoding)options.defaultEncoding.integerValue;
+	}
+	converter.copyForkData = options.copyForkData;
+	converter.writesPlaceholderForkData = options.writesPlaceholderForkData;
+	converter.writesSparseOutput = options.writesSparseOutput;
+	converter.preallocatesDestination = options.preallocatesDestination;
+	converter.readsSourceInPhysicalOrder = options.readsSourceInPhysicalOrder;
+	converter.catalogMemoryBudgetInBytes = options.catalogMemoryBudgetInMiB * 1048576;
+	converter.verboseProgress = options.verbose;
+	return converter;
+}
+///Returns an emitter that samples the converter's progress every so often, printing a summary line (if printsSummaries is true) and/or writing JSON to the options' progress file descriptor. Returns nil if there's nothing to emit. The caller is responsible for starting and stopping the emitter.
+- (ImpProgressEmitter *_Nullable) progressEmitterForConverter:(ImpHFSToHFSPlusConverter *_Nonnull const)converter label:(NSString *_Nullable const)label printsSummaries:(bool const)printsSummaries options:(struct ImpConversionOptions const)options {
+	if (! printsSummaries && options.progressFileDescriptor < 0) {
+		return nil;
+	}
+	//Hold the converter weakly so the emitter doesn't keep it alive (nor the other way around, if anybody ever stores one on the other).
+	__weak ImpHFSToHFSPlusConverter *_Nullable const weakConverter = converter;
+	ImpProgressEmitter *_Nonnull const emitter = [[ImpProgressEmitter alloc] initWithSampler:^(struct ImpProgressSnapshot *_Nonnull const outSnapshot) {
+		[weakConverter getProgressSnapshot:outSnapshot];
+	}];
+	emitter.interval = options.progressInterval;
+	emitter.outputFileDescriptor = options.progressFileDescriptor;
+	emitter.label = label;
+	if (printsSummaries) {
+		emitter.sampleHandler = ^(struct ImpProgressSnapshot const *_Nonnull const snapshot, NSTimeInterval const elapsed) {
+			double const fraction = snapshot->blocksTotal > 0 ? MIN(1.0, snapshot->blocksDone / (double)snapshot->blocksTotal) : 0.0;
+			ImpPrintf(@"%u%%: Copied %llu of %llu files, %llu of %llu blocks (%.1f seconds)", (unsigned)round(100.0 * fraction), snapshot->filesDone, snapshot->filesTotal, snapshot->blocksDone, snapshot->blocksTotal, elapsed);
+		};
+	}
+	return emitter;
+}
+///Write the converter's performance report to reportPath, if the options ask for one. Returns false (having logged why) if the report couldn't be written.
+- (bool) writeReportForConverter:(ImpHFSToHFSPlusConverter *_Nonnull const)converter toPath:(NSString *_Nullable const)reportPath options:(struct ImpConversionOptions const)options {
+	if (reportPath == nil) {
+		return true;
+	}
+	ImpConversionReportFormat const format = options.reportFormatWasSpecified ? options.reportFormat : [ImpConversionReport formatForPathExtension:reportPath.pathExtension];
+	NSError *_Nullable reportError = nil;
+	if (! [converter.performanceReport writeToURL:[NSURL fileURLWithPath:reportPath isDirectory:false] format:format error:&reportError]) {
+		NSLog(@"Failed to write report to %@: %@", reportPath, reportError.localizedDescription);
+		return false;
+	}
+	return true;
+}
+
 - (void) convert:(NSEnumerator <NSString *> *_Nonnull const)argsEnum {
-	NSNumber *_Nullable defaultEncoding = nil;
-	bool copyForkData = true;
-	bool expectsEncoding = false;
+	struct ImpConversionOptions options = [self defaultConversionOptions];
 	NSMutableArray *_Nonnull const devicePaths = [NSMutableArray arrayWithCapacity:2];
 	for (NSString *_Nonnull const arg in argsEnum) {
-		if (expectsEncoding) {
-			defaultEncoding = @([arg integerValue]);
-			expectsEncoding = false;
-		} else if ((defaultEncoding == nil) && [arg hasPrefix:@"--encoding"]) {
-			if ([arg hasPrefix:@"--encoding="]) {
-				//--encoding=42
-				defaultEncoding = @([[arg substringFromIndex:@"--encoding=".length] integerValue]);
-			} else {
-				//--encoding 42
-				expectsEncoding = true;
-			}
-		} else if ([arg isEqualToString:@"--no-copy-fork-data"]) {
-			copyForkData = false;
-		} else if ([arg isEqualToString:@"--copy-fork-data"]) {
-			copyForkData = true;
+		if ([self parseConversionOption:arg into:&options]) {
+			//Consumed.
 		} else if (devicePaths.count < 2) {
 			[devicePaths addObject:arg];
 		} else {
@@ -251,6 +445,10 @@ int main(int argc, const char * argv[]) {
 			return;
 		}
 	}
+	if (options.hasInvalidOption) {
+		self.status = EX_USAGE;
+		return;
+	}
 	if (devicePaths.count != 2) {
 		[self printUsageToFile:stderr];
 		self.status = EX_USAGE;
@@ -260,42 +458,239 @@ int main(int argc, const char * argv[]) {
 	NSString *_Nullable const srcDevPath = devicePaths.firstObject;
 	NSString *_Nullable const dstDevPath = devicePaths.lastObject;
 
-	ImpHFSToHFSPlusConverter *_Nonnull const converter = [ImpDefragmentingHFSToHFSPlusConverter new];
-	converter.sourceDevice = [NSURL fileURLWithPath:srcDevPath isDirectory:false];
-	converter.destinationDevice = [NSURL fileURLWithPath:dstDevPath isDirectory:false];
-	if (defaultEncoding != nil) {
-		converter.hfsTextEncoding = (TextEncoding)defaultEncoding.integerValue;
-	}
-	converter.copyForkData = copyForkData;
+	ImpHFSToHFSPlusConverter *_Nonnull const converter = [self converterFromPath:srcDevPath toPath:dstDevPath options:options];
 	converter.conversionProgressUpdateBlock = ^(double progress, NSString * _Nonnull operationDescription) {
 		ImpPrintf(@"%u%%: %@", (unsigned)round(100.0 * progress), operationDescription);
 	};
+	//With --verbose, every file gets its own line, so periodic summaries would just be noise.
+	ImpProgressEmitter *_Nullable const progressEmitter = [self progressEmitterForConverter:converter label:nil printsSummaries:! options.verbose options:options];
+	[progressEmitter start];
 	NSError *_Nullable error = nil;
 	bool const converted = [converter performConversionOrReturnError:&error];
+	[progressEmitter stop];
 	if (converted) {
 		ImpPrintf(@"Successfully wrote volume to %@", converter.destinationDevice.absoluteURL.path);
 	} else {
 		NSLog(@"Failed: %@", error.localizedDescription);
 		self.status = EXIT_FAILURE;
 	}
+	//A report for a failed conversion is still useful, for seeing how far it got and how long that took.
+	if (! [self writeReportForConverter:converter toPath:options.reportPath options:options]) {
+		self.status = EX_CANTCREAT;
+	}
+}
+- (void) convertBatch:(NSEnumerator <NSString *> *_Nonnull const)argsEnum {
+	struct ImpConversionOptions options = [self defaultConversionOptions];
+	NSUInteger numberOfWorkers = [NSProcessInfo processInfo].activeProcessorCount;
+	bool numberOfWorkersWasSpecified = false;
+	NSString *_Nullable manifestPath = nil;
+	for (NSString *_Nonnull const arg in argsEnum) {
+		NSString *_Nullable jobsString = nil;
+		if ([self parseConversionOption:arg into:&options]) {
+			//Consumed.
+		} else if ((jobsString = [self argument:arg hasPrefix:@"--jobs"]) != nil) {
+			NSInteger const requestedJobs = jobsString.integerValue;
+			if (requestedJobs < 1) {
+				fprintf(stderr, "--jobs must be at least 1\n");
+				self.status = EX_USAGE;
+				return;
+			}
+			numberOfWorkers = (NSUInteger)requestedJobs;
+			numberOfWorkersWasSpecified = true;
+		} else if (manifestPath == nil) {
+			manifestPath = arg;
+		} else {
+			[self printUsageToFile:stderr];
+			self.status = EX_USAGE;
+			return;
+		}
+	}
+	if (manifestPath == nil) {
+		[self printUsageToFile:stderr];
+		self.status = EX_USAGE;
+		return;
+	}
+	if (options.hasInvalidOption) {
+		self.status = EX_USAGE;
+		return;
+	}
+	//Per-file progress is only delivered to a conversion's progress update block, and a batch has nowhere to show it.
+	if (options.verbose) {
+		fprintf(stderr, "--verbose can't be used with convert-batch\n");
+		self.status = EX_USAGE;
+		return;
+	}
+	//The performance counters are process-wide, so a report is only accurate if its conversion had the process to itself.
+	if (options.reportPath != nil) {
+		if (numberOfWorkersWasSpecified && numberOfWorkers > 1) {
+			fprintf(stderr, "--report can't be used with --jobs greater than 1, because each report would include other conversions' work\n");
+			self.status = EX_USAGE;
+			return;
+		}
+		numberOfWorkers = 1;
+	}
+	NSString *_Nonnull const reportExtension = (options.reportFormatWasSpecified && options.reportFormat == ImpConversionReportFormatCSV) ? @"csv" : @"json";
+	if (options.reportPath != nil) {
+		NSError *_Nullable mkdirError = nil;
+		if (! [[NSFileManager defaultManager] createDirectoryAtPath:options.reportPath withIntermediateDirectories:true attributes:nil error:&mkdirError]) {
+			NSLog(@"Failed to create report folder %@: %@", options.reportPath, mkdirError.localizedDescription);
+			self.status = EX_CANTCREAT;
+			return;
+		}
+	}
 
+	NSError *_Nullable error = nil;
+	NSData *_Nullable const manifestData = [manifestPath isEqualToString:@"-"]
+		? [[NSFileHandle fileHandleWithStandardInput] readDataToEndOfFileAndReturnError:&error]
+		: [NSData dataWithContentsOfFile:manifestPath options:0 error:&error];
+	if (manifestData == nil) {
+		NSLog(@"Failed to read manifest: %@", error.localizedDescription);
+		self.status = EX_NOINPUT;
+		return;
+	}
+	NSString *_Nullable const manifest = [[NSString alloc] initWithData:manifestData encoding:NSUTF8StringEncoding];
+	if (manifest == nil) {
+		fprintf(stderr, "Manifest is not UTF-8: %s\n", manifestPath.UTF8String);
+		self.status = EX_DATAERR;
+		return;
+	}
+
+	NSMutableArray <NSString *> *_Nonnull const srcPaths = [NSMutableArray new];
+	NSMutableArray <NSString *> *_Nonnull const dstPaths = [NSMutableArray new];
+	NSMutableSet <NSString *> *_Nonnull const dstPathsSeen = [NSMutableSet new];
+	__block NSUInteger lineNumber = 0;
+	__block bool manifestIsValid = true;
+	[manifest enumerateLinesUsingBlock:^(NSString *_Nonnull const line, BOOL *_Nonnull const stop) {
+		++lineNumber;
+		if (line.length == 0 || [line hasPrefix:@"#"]) {
+			return;
+		}
+		NSArray <NSString *> *_Nonnull const fields = [line componentsSeparatedByString:@"\t"];
+		if (fields.count != 2 || fields[0].length == 0 || fields[1].length == 0) {
+			fprintf(stderr, "%s:%lu: expected a source path and a destination path separated by a tab\n", manifestPath.UTF8String, (unsigned long)lineNumber);
+			manifestIsValid = false;
+			return;
+		}
+		//A conversion that writes over its own source destroys the source before it's done reading it. Catch both the same path spelled differently and two paths to the same file (e.g., by way of a symlink).
+		NSString *_Nonnull const srcPath = fields[0].stringByStandardizingPath;
+		NSString *_Nonnull const dstPath = fields[1].stringByStandardizingPath;
+		struct stat srcSB, dstSB;
+		bool const sameFile = [srcPath isEqualToString:dstPath]
+			|| (stat(srcPath.fileSystemRepresentation, &srcSB) == 0 && stat(dstPath.fileSystemRepresentation, &dstSB) == 0 && srcSB.st_dev == dstSB.st_dev && srcSB.st_ino == dstSB.st_ino);
+		if (sameFile) {
+			fprintf(stderr, "%s:%lu: %s is both the source and the destination of a conversion\n", manifestPath.UTF8String, (unsigned long)lineNumber, fields[1].UTF8String);
+			manifestIsValid = false;
+			return;
+		}
+		//Two conversions writing to the same destination at the same time would destroy each other's output.
+		if ([dstPathsSeen containsObject:dstPath]) {
+			fprintf(stderr, "%s:%lu: %s is the destination of more than one conversion\n", manifestPath.UTF8String, (unsigned long)lineNumber, fields[1].UTF8String);
+			manifestIsValid = false;
+			return;
+		}
+		[dstPathsSeen addObject:dstPath];
+		[srcPaths addObject:fields[0]];
+		[dstPaths addObject:fields[1]];
+	}];
+	if (! manifestIsValid) {
+		self.status = EX_DATAERR;
+		return;
+	}
+
+	NSUInteger const numberOfJobs = srcPaths.count;
+	numberOfWorkers = MIN(numberOfWorkers, numberOfJobs);
+
+	//Each worker takes the next job off the list until there are none left. The expensive shared state (text encoding converters, placeholder fork data) is cached process-wide, so only the first conversion to need each piece pays for it.
+	__block _Atomic NSUInteger nextJobIndex = 0;
+	__block _Atomic NSUInteger numberOfJobsFinished = 0;
+	__block _Atomic NSUInteger numberOfJobsFailed = 0;
+	__block _Atomic bool failedToWriteAnyReport = false;
+	//Destinations in different folders can have the same name, so each report is also numbered by its job's place in the batch.
+	int const jobNumberWidth = (int)[NSString stringWithFormat:@"%lu", (unsigned long)numberOfJobs].length;
+	dispatch_queue_t _Nonnull const workerQueue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+	dispatch_group_t _Nonnull const workers = dispatch_group_create();
+	for (NSUInteger workerIdx = 0; workerIdx < numberOfWorkers; ++workerIdx) {
+		dispatch_group_async(workers, workerQueue, ^{
+			NSUInteger jobIdx;
+			while ((jobIdx = atomic_fetch_add(&nextJobIndex, 1)) < numberOfJobs) { @autoreleasepool {
+				NSString *_Nonnull const srcDevPath = srcPaths[jobIdx];
+				NSString *_Nonnull const dstDevPath = dstPaths[jobIdx];
+				ImpHFSToHFSPlusConverter *_Nonnull const converter = [self converterFromPath:srcDevPath toPath:dstDevPath options:options];
+				//Batches already print a line per conversion, so the only progress worth emitting is JSON, labeled with the destination so the lines can be told apart.
+				ImpProgressEmitter *_Nullable const progressEmitter = [self progressEmitterForConverter:converter label:dstDevPath printsSummaries:false options:options];
+
+				NSDate *_Nonnull const startDate = [NSDate date];
+				NSError *_Nullable jobError = nil;
+				[progressEmitter start];
+				bool const converted = [converter performConversionOrReturnError:&jobError];
+				[progressEmitter stop];
+				NSTimeInterval const duration = -startDate.timeIntervalSinceNow;
+
+				NSUInteger const numFinished = atomic_fetch_add(&numberOfJobsFinished, 1) + 1;
+				if (converted) {
+					ImpPrintf(@"[%lu/%lu] OK %@ -> %@ (%.1f seconds)", (unsigned long)numFinished, (unsigned long)numberOfJobs, srcDevPath, dstDevPath, duration);
+				} else {
+					atomic_fetch_add(&numberOfJobsFailed, 1);
+					ImpPrintf(@"[%lu/%lu] FAILED %@ -> %@: %@", (unsigned long)numFinished, (unsigned long)numberOfJobs, srcDevPath, dstDevPath, jobError.localizedDescription);
+				}
+				if (options.reportPath != nil) {
+					NSString *_Nonnull const reportName = [[NSString stringWithFormat:@"%0*lu-%@", jobNumberWidth, (unsigned long)(jobIdx + 1), dstDevPath.lastPathComponent] stringByAppendingPathExtension:reportExtension];
+					if (! [self writeReportForConverter:converter toPath:[options.reportPath stringByAppendingPathComponent:reportName] options:options]) {
+						failedToWriteAnyReport = true;
+					}
+				}
+			} }
+		});
+	}
+	dispatch_group_wait(workers, DISPATCH_TIME_FOREVER);
+
+	NSUInteger const numFailed = numberOfJobsFailed;
+	ImpPrintf(@"Converted %lu of %lu volumes using %lu workers; %lu failed", (unsigned long)(numberOfJobs - numFailed), (unsigned long)numberOfJobs, (unsigned long)numberOfWorkers, (unsigned long)numFailed);
+	if (numFailed > 0) {
+		self.status = EXIT_FAILURE;
+	}
+	if (failedToWriteAnyReport) {
+		self.status = EX_CANTCREAT;
+	}
 }
 - (void) extract:(NSEnumerator <NSString *> *_Nonnull const)argsEnum {
-	NSString *_Nullable const srcDevPath = [argsEnum nextObject];
+	//--jobs and --index can go anywhere; everything else is positional.
+	NSUInteger numberOfWorkers = [NSProcessInfo processInfo].activeProcessorCount;
+	bool usesCatalogIndex = false;
+	NSMutableArray <NSString *> *_Nonnull const positionalArgs = [NSMutableArray arrayWithCapacity:3];
+	for (NSString *_Nonnull const arg in argsEnum) {
+		NSString *_Nullable jobsString = nil;
+		if ((jobsString = [self argument:arg hasPrefix:@"--jobs"]) != nil) {
+			NSInteger const requestedJobs = jobsString.integerValue;
+			if (requestedJobs < 1) {
+				fprintf(stderr, "--jobs must be at least 1\n");
+				self.status = EX_USAGE;
+				return;
+			}
+			numberOfWorkers = (NSUInteger)requestedJobs;
+		} else if ([arg isEqualToString:@"--index"]) {
+			usesCatalogIndex = true;
+		} else {
+			[positionalArgs addObject:arg];
+		}
+	}
+	NSEnumerator <NSString *> *_Nonnull const positionalArgsEnum = [positionalArgs objectEnumerator];
+
+	NSString *_Nullable const srcDevPath = [positionalArgsEnum nextObject];
 	if (srcDevPath == nil) {
 		[self printUsageToFile:stderr];
 		self.status = EX_USAGE;
 		return;
 	}
 
-	NSString *_Nullable quarryNameOrPath = [argsEnum nextObject];
+	NSString *_Nullable quarryNameOrPath = [positionalArgsEnum nextObject];
 	if ([quarryNameOrPath isEqualToString:@""] || [quarryNameOrPath isEqualToString:@":"]) {
 		//This means “extract the entire volume”, which is the same as nil.
 		//nil means no arguments were passed after the source device. If the user wants to extract the whole volume to a specific destination (destinationPath is about to be non-nil), they need to pass something in between the source device or destination; we accept either a single colon or the empty string, though the latter is undocumented (see usage above).
 		quarryNameOrPath = nil;
 	}
 
-	NSString *_Nullable const destinationPath = [argsEnum nextObject];
+	NSString *_Nullable const destinationPath = [positionalArgsEnum nextObject];
 	bool const shouldCopyToDestination = (destinationPath != nil) && (![destinationPath hasSuffix:@"/"]);
 
 	ImpHFSExtractor *_Nonnull const extractor = [ImpHFSExtractor new];
@@ -303,6 +698,8 @@ int main(int argc, const char * argv[]) {
 	extractor.shouldCopyToDestination = shouldCopyToDestination;
 	extractor.quarryNameOrPath = quarryNameOrPath;
 	extractor.destinationPath = destinationPath;
+	extractor.numberOfWorkers = numberOfWorkers;
+	extractor.usesCatalogIndex = usesCatalogIndex;
 
 	extractor.extractionProgressUpdateBlock = ^(double progress, NSString * _Nonnull operationDescription) {
 		ImpPrintf(@"%u%%: %@", (unsigned)round(100.0 * progress), operationDescription);
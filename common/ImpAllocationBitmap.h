@@ -0,0 +1,51 @@
+//
+//  ImpAllocationBitmap.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-17.
+//
+
+#import <Foundation/Foundation.h>
+
+/*!An allocation bitmap is a bit vector with one bit per allocation block, kept in the same layout as an HFS or HFS+ volume bitmap on disk: the first block is the most significant bit of the first byte. This means the bitmap can be written out as-is, without converting it first.
+ *Internally, the bits are stored in 64-bit words, and searches skip over words (several at a time, using vector comparisons) that are entirely set or entirely clear. Setting or clearing a range only touches individual bits in the first and last words of the range; everything in between is filled a whole word at a time.
+ */
+@interface ImpAllocationBitmap : NSObject <NSCopying>
+
+///Create a bitmap of this many bits, all clear.
+- (instancetype _Nonnull) initWithNumberOfBits:(NSUInteger const)numBits;
+
+///Create a bitmap of this many bits from a volume bitmap as read from disk. The bytes are copied. If the data is shorter than numBits, the missing bits are clear; if it's longer, the excess is ignored.
+- (instancetype _Nonnull) initWithBitmapData:(NSData *_Nonnull const)bitmapData numberOfBits:(NSUInteger const)numBits;
+
+@property(readonly) NSUInteger numberOfBits;
+
+///The bitmap's bytes, in on-disk layout, ceil(numberOfBits / 8) long. Any bits past numberOfBits in the last byte are clear. This is a view into the bitmap's own storage, not a copy, so it's only valid until the bitmap is deallocated, and it will reflect any changes made in the meantime.
+@property(readonly) NSData *_Nonnull bitmapData;
+
+- (bool) bitAtIndex:(NSUInteger const)idx;
+
+///Set every bit in the range. Any part of the range past the end of the bitmap is ignored.
+- (void) setBitsInRange:(NSRange const)range;
+///Clear every bit in the range. Any part of the range past the end of the bitmap is ignored.
+- (void) clearBitsInRange:(NSRange const)range;
+
+- (NSUInteger) countOfSetBitsInRange:(NSRange const)range;
+- (NSUInteger) countOfClearBitsInRange:(NSRange const)range;
+
+///Returns the index of the first set bit in the range, or NSNotFound if every bit in the range is clear.
+- (NSUInteger) indexOfFirstSetBitInRange:(NSRange const)range;
+///Returns the index of the first clear bit in the range, or NSNotFound if every bit in the range is set.
+- (NSUInteger) indexOfFirstClearBitInRange:(NSRange const)range;
+///Returns the index of the last set bit in the range, or NSNotFound if every bit in the range is clear.
+- (NSUInteger) indexOfLastSetBitInRange:(NSRange const)range;
+///Returns the index of the last clear bit in the range, or NSNotFound if every bit in the range is set.
+- (NSUInteger) indexOfLastClearBitInRange:(NSRange const)range;
+
+///Find the first run of consecutive clear bits in the range. The run ends at the next set bit, the end of the range, or after maxLength bits, whichever comes first. (Capping the length means a search on a mostly-empty volume doesn't have to scan all the way to the end to find out how big the empty space is.) Returns a range with location NSNotFound if every bit in the range is set.
+- (NSRange) rangeOfFirstRunOfClearBitsInRange:(NSRange const)range maximumLength:(NSUInteger const)maxLength;
+
+///Call the block with each maximal run of consecutive set bits in the range, in order. Runs are clipped to the range.
+- (void) enumerateRunsOfSetBitsInRange:(NSRange const)range usingBlock:(void (^_Nonnull const)(NSRange const run))block;
+
+@end
@@ -0,0 +1,265 @@
+//
+//  ImpAllocationBitmap.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-17.
+//
+
+#import "ImpAllocationBitmap.h"
+
+#import "ImpSizeUtilities.h"
+
+#import <simd/simd.h>
+
+enum {
+	ImpBitsPerWord = 64,
+	///How many words to compare at once when skipping over words that are all set or all clear.
+	ImpWordsPerVector = 4,
+};
+
+///Words are stored big-endian, so that the first bit (most significant bit of the first byte) is the most significant bit of the word once it's been swapped. These masks are in host order.
+static inline u_int64_t ImpMaskFromBitInWord(NSUInteger const bitInWord) {
+	return UINT64_MAX >> bitInWord;
+}
+static inline u_int64_t ImpMaskThroughBitInWord(NSUInteger const bitInWord) {
+	return UINT64_MAX << (ImpBitsPerWord - 1 - bitInWord);
+}
+
+///Returns the index of the first word at or after wordIdx (and before endWordIdx) that isn't equal to uniformWord. uniformWord must be all zeroes or all ones, which are the same in either byte order.
+static NSUInteger ImpSkipUniformWordsForward(u_int64_t const *_Nonnull const words, NSUInteger wordIdx, NSUInteger const endWordIdx, u_int64_t const uniformWord) {
+	simd_ulong4 const uniformVector = uniformWord;
+	for (; wordIdx + ImpWordsPerVector <= endWordIdx; wordIdx += ImpWordsPerVector) {
+		simd_ulong4 chunk;
+		memcpy(&chunk, words + wordIdx, sizeof(chunk));
+		if (! simd_all(chunk == uniformVector)) {
+			break;
+		}
+	}
+	while (wordIdx < endWordIdx && words[wordIdx] == uniformWord) {
+		++wordIdx;
+	}
+	return wordIdx;
+}
+
+///Returns one past the index of the last word before endWordIdx (and at or after firstWordIdx) that isn't equal to uniformWord, or firstWordIdx if they all are.
+static NSUInteger ImpSkipUniformWordsBackward(u_int64_t const *_Nonnull const words, NSUInteger const firstWordIdx, NSUInteger endWordIdx, u_int64_t const uniformWord) {
+	simd_ulong4 const uniformVector = uniformWord;
+	for (; endWordIdx >= firstWordIdx + ImpWordsPerVector; endWordIdx -= ImpWordsPerVector) {
+		simd_ulong4 chunk;
+		memcpy(&chunk, words + endWordIdx - ImpWordsPerVector, sizeof(chunk));
+		if (! simd_all(chunk == uniformVector)) {
+			break;
+		}
+	}
+	while (endWordIdx > firstWordIdx && words[endWordIdx - 1] == uniformWord) {
+		--endWordIdx;
+	}
+	return endWordIdx;
+}
+
+///Returns the index of the first bit in [startIdx, endIdx) whose value is value, or NSNotFound.
+static NSUInteger ImpFindFirstBit(u_int64_t const *_Nonnull const words, NSUInteger const startIdx, NSUInteger const endIdx, bool const value) {
+	if (startIdx >= endIdx) {
+		return NSNotFound;
+	}
+
+	//Flip the words we're searching for clear bits in, so either way we're looking for a 1.
+	u_int64_t const flip = value ? 0 : UINT64_MAX;
+	NSUInteger const endWordIdx = (endIdx - 1) / ImpBitsPerWord + 1;
+	NSUInteger wordIdx = startIdx / ImpBitsPerWord;
+	u_int64_t word = (L(words[wordIdx]) ^ flip) & ImpMaskFromBitInWord(startIdx % ImpBitsPerWord);
+	while (word == 0) {
+		wordIdx = ImpSkipUniformWordsForward(words, wordIdx + 1, endWordIdx, flip);
+		if (wordIdx >= endWordIdx) {
+			return NSNotFound;
+		}
+		word = L(words[wordIdx]) ^ flip;
+	}
+
+	NSUInteger const foundIdx = wordIdx * ImpBitsPerWord + (NSUInteger)__builtin_clzll(word);
+	return foundIdx < endIdx ? foundIdx : NSNotFound;
+}
+
+///Returns the index of the last bit in [startIdx, endIdx) whose value is value, or NSNotFound.
+static NSUInteger ImpFindLastBit(u_int64_t const *_Nonnull const words, NSUInteger const startIdx, NSUInteger const endIdx, bool const value) {
+	if (startIdx >= endIdx) {
+		return NSNotFound;
+	}
+
+	u_int64_t const flip = value ? 0 : UINT64_MAX;
+	NSUInteger const firstWordIdx = startIdx / ImpBitsPerWord;
+	NSUInteger wordIdx = (endIdx - 1) / ImpBitsPerWord;
+	u_int64_t word = (L(words[wordIdx]) ^ flip) & ImpMaskThroughBitInWord((endIdx - 1) % ImpBitsPerWord);
+	while (word == 0) {
+		if (wordIdx == firstWordIdx) {
+			return NSNotFound;
+		}
+		NSUInteger const endOfNonUniformWords = ImpSkipUniformWordsBackward(words, firstWordIdx, wordIdx, flip);
+		if (endOfNonUniformWords == firstWordIdx) {
+			return NSNotFound;
+		}
+		wordIdx = endOfNonUniformWords - 1;
+		word = L(words[wordIdx]) ^ flip;
+	}
+
+	NSUInteger const foundIdx = wordIdx * ImpBitsPerWord + (ImpBitsPerWord - 1 - (NSUInteger)__builtin_ctzll(word));
+	return foundIdx >= startIdx ? foundIdx : NSNotFound;
+}
+
+static inline void ImpApplyMask(u_int64_t *_Nonnull const wordPtr, u_int64_t const hostMask, bool const value) {
+	u_int64_t const bigEndianMask = S64(hostMask);
+	*wordPtr = value ? (*wordPtr | bigEndianMask) : (*wordPtr & ~bigEndianMask);
+}
+
+static void ImpSetBits(u_int64_t *_Nonnull const words, NSUInteger const startIdx, NSUInteger const endIdx, bool const value) {
+	if (startIdx >= endIdx) {
+		return;
+	}
+
+	NSUInteger const firstWordIdx = startIdx / ImpBitsPerWord;
+	NSUInteger const lastWordIdx = (endIdx - 1) / ImpBitsPerWord;
+	u_int64_t const headMask = ImpMaskFromBitInWord(startIdx % ImpBitsPerWord);
+	u_int64_t const tailMask = ImpMaskThroughBitInWord((endIdx - 1) % ImpBitsPerWord);
+
+	if (firstWordIdx == lastWordIdx) {
+		ImpApplyMask(words + firstWordIdx, headMask & tailMask, value);
+	} else {
+		ImpApplyMask(words + firstWordIdx, headMask, value);
+		memset(words + firstWordIdx + 1, value ? 0xff : 0x00, (lastWordIdx - firstWordIdx - 1) * sizeof(*words));
+		ImpApplyMask(words + lastWordIdx, tailMask, value);
+	}
+}
+
+static NSUInteger ImpCountSetBits(u_int64_t const *_Nonnull const words, NSUInteger const startIdx, NSUInteger const endIdx) {
+	if (startIdx >= endIdx) {
+		return 0;
+	}
+
+	NSUInteger const firstWordIdx = startIdx / ImpBitsPerWord;
+	NSUInteger const lastWordIdx = (endIdx - 1) / ImpBitsPerWord;
+	u_int64_t const headMask = ImpMaskFromBitInWord(startIdx % ImpBitsPerWord);
+	u_int64_t const tailMask = ImpMaskThroughBitInWord((endIdx - 1) % ImpBitsPerWord);
+
+	if (firstWordIdx == lastWordIdx) {
+		return (NSUInteger)__builtin_popcountll(L(words[firstWordIdx]) & headMask & tailMask);
+	}
+
+	NSUInteger count = (NSUInteger)__builtin_popcountll(L(words[firstWordIdx]) & headMask);
+	//Byte order doesn't matter for a population count, so the whole words in the middle can be counted as they are.
+	for (NSUInteger wordIdx = firstWordIdx + 1; wordIdx < lastWordIdx; ++wordIdx) {
+		count += (NSUInteger)__builtin_popcountll(words[wordIdx]);
+	}
+	count += (NSUInteger)__builtin_popcountll(L(words[lastWordIdx]) & tailMask);
+	return count;
+}
+
+@implementation ImpAllocationBitmap
+{
+	NSMutableData *_Nonnull _wordsData;
+	u_int64_t *_Nonnull _words;
+}
+
+- (instancetype _Nonnull) initWithNumberOfBits:(NSUInteger const)numBits {
+	if ((self = [super init])) {
+		_numberOfBits = numBits;
+		_wordsData = [NSMutableData dataWithLength:MAX(ImpCeilingDivide(numBits, ImpBitsPerWord), (NSUInteger)1) * sizeof(u_int64_t)];
+		_words = _wordsData.mutableBytes;
+	}
+	return self;
+}
+
+- (instancetype _Nonnull) initWithBitmapData:(NSData *_Nonnull const)bitmapData numberOfBits:(NSUInteger const)numBits {
+	if ((self = [self initWithNumberOfBits:numBits])) {
+		memcpy(_words, bitmapData.bytes, MIN(bitmapData.length, ImpCeilingDivide(numBits, 8)));
+		//The last byte copied may have bits past the end of the bitmap; keep those clear, so counts and searches that cover the whole last word don't see them.
+		ImpSetBits(_words, numBits, _wordsData.length * 8, false);
+	}
+	return self;
+}
+
+- (id _Nonnull) copyWithZone:(NSZone *_Nullable)zone {
+	ImpAllocationBitmap *_Nonnull const copy = [[ImpAllocationBitmap alloc] initWithNumberOfBits:_numberOfBits];
+	memcpy(copy->_words, _words, _wordsData.length);
+	return copy;
+}
+
+- (NSString *_Nonnull) description {
+	NSUInteger const numSet = [self countOfSetBitsInRange:(NSRange){ 0, _numberOfBits }];
+	return [NSString stringWithFormat:@"<%@ %p with %lu of %lu bits set>", self.class, self, (unsigned long)numSet, (unsigned long)_numberOfBits];
+}
+
+- (NSData *_Nonnull) bitmapData {
+	return [NSData dataWithBytesNoCopy:_words length:ImpCeilingDivide(_numberOfBits, 8) freeWhenDone:false];
+}
+
+///Clip a range to the end of the bitmap, and return the index just past its end.
+- (NSUInteger) endOfRange:(NSRange const)range {
+	if (range.location >= _numberOfBits) {
+		return range.location;
+	}
+	return range.location + MIN(range.length, _numberOfBits - range.location);
+}
+
+- (bool) bitAtIndex:(NSUInteger const)idx {
+	NSParameterAssert(idx < _numberOfBits);
+	u_int64_t const bitMask = 1ULL << (ImpBitsPerWord - 1 - idx % ImpBitsPerWord);
+	return (L(_words[idx / ImpBitsPerWord]) & bitMask) != 0;
+}
+
+- (void) setBitsInRange:(NSRange const)range {
+	ImpSetBits(_words, range.location, [self endOfRange:range], true);
+}
+- (void) clearBitsInRange:(NSRange const)range {
+	ImpSetBits(_words, range.location, [self endOfRange:range], false);
+}
+
+- (NSUInteger) countOfSetBitsInRange:(NSRange const)range {
+	return ImpCountSetBits(_words, range.location, [self endOfRange:range]);
+}
+- (NSUInteger) countOfClearBitsInRange:(NSRange const)range {
+	NSUInteger const endIdx = [self endOfRange:range];
+	if (range.location >= endIdx) {
+		return 0;
+	}
+	return (endIdx - range.location) - ImpCountSetBits(_words, range.location, endIdx);
+}
+
+- (NSUInteger) indexOfFirstSetBitInRange:(NSRange const)range {
+	return ImpFindFirstBit(_words, range.location, [self endOfRange:range], true);
+}
+- (NSUInteger) indexOfFirstClearBitInRange:(NSRange const)range {
+	return ImpFindFirstBit(_words, range.location, [self endOfRange:range], false);
+}
+- (NSUInteger) indexOfLastSetBitInRange:(NSRange const)range {
+	return ImpFindLastBit(_words, range.location, [self endOfRange:range], true);
+}
+- (NSUInteger) indexOfLastClearBitInRange:(NSRange const)range {
+	return ImpFindLastBit(_words, range.location, [self endOfRange:range], false);
+}
+
+- (NSRange) rangeOfFirstRunOfClearBitsInRange:(NSRange const)range maximumLength:(NSUInteger const)maxLength {
+	NSUInteger const endIdx = [self endOfRange:range];
+	NSUInteger const runStart = ImpFindFirstBit(_words, range.location, endIdx, false);
+	if (runStart == NSNotFound) {
+		return (NSRange){ NSNotFound, 0 };
+	}
+
+	NSUInteger const runEndLimit = runStart + MIN(maxLength, endIdx - runStart);
+	NSUInteger const nextSetBit = ImpFindFirstBit(_words, runStart, runEndLimit, true);
+	NSUInteger const runEnd = nextSetBit != NSNotFound ? nextSetBit : runEndLimit;
+	return (NSRange){ runStart, runEnd - runStart };
+}
+
+- (void) enumerateRunsOfSetBitsInRange:(NSRange const)range usingBlock:(void (^_Nonnull const)(NSRange const run))block {
+	NSUInteger const endIdx = [self endOfRange:range];
+	NSUInteger runStart = ImpFindFirstBit(_words, range.location, endIdx, true);
+	while (runStart != NSNotFound) {
+		NSUInteger const nextClearBit = ImpFindFirstBit(_words, runStart, endIdx, false);
+		NSUInteger const runEnd = nextClearBit != NSNotFound ? nextClearBit : endIdx;
+		block((NSRange){ runStart, runEnd - runStart });
+
+		runStart = ImpFindFirstBit(_words, runEnd, endIdx, true);
+	}
+}
+
+@end
@@ -14,6 +14,16 @@
 @class ImpBTreeNode;
 @class ImpBTreeHeaderNode;
 
+///One node's descriptor, decoded to native byte order. See -[ImpBTreeFile nodeTableEntryAtIndex:].
+struct ImpBTreeNodeTableEntry {
+	u_int32_t forwardLink, backwardLink;
+	///Index of this node's first record offset in the tree's table of record offsets. A node has numberOfRecords + 1 offsets in that table: one for the start of each record, followed by the offset of the node's free space (which is also where the last record ends).
+	u_int32_t firstRecordOffsetIndex;
+	u_int16_t numberOfRecords;
+	BTreeNodeKind kind;
+	u_int8_t height;
+};
+
 @interface ImpBTreeFile : NSObject <NSFastEnumeration>
 {
 	NSData *_Nonnull _bTreeData;
@@ -57,6 +67,16 @@
 
 - (ImpBTreeNode *_Nonnull const) nodeAtIndex:(u_int32_t const)idx;
 
+#pragma mark Node table
+
+///Returns the node table entry for the node at this index. When a tree is loaded from a volume, every node's descriptor and record offsets are decoded up front into a flat table, so that walking and searching the tree doesn't need to create node objects or byte-swap anything. Returns NULL if the index is out of bounds, or if this tree has no node table (mutable trees don't, since their nodes change as they're built).
+- (struct ImpBTreeNodeTableEntry const *_Nullable) nodeTableEntryAtIndex:(u_int32_t const)idx;
+
+///Using the node table, returns a pointer to a record (key and payload together) within a node, and returns its length by reference. Returns NULL if this tree has no node table or the node doesn't have that many records.
+- (void const *_Nullable) pointerToRecordAtIndex:(u_int16_t const)recordIdx
+	inNodeAtIndex:(u_int32_t const)nodeIdx
+	length:(u_int16_t *_Nullable const)outLength;
+
 ///This is meant for the mutable subclass's use.
 - (void) storeNode:(ImpBTreeNode *_Nonnull const)node inCacheAtIndex:(NSUInteger)idx;
 
@@ -77,6 +97,8 @@
 
 ///Starting from the first leaf node, call the block for every node from that one until the last leaf node, following nextNode/fLink connections. Whereas walkBreadthFirst: visits index and leaf nodes, this method only visits leaf nodes.
 - (NSUInteger) walkLeafNodes:(bool (^_Nonnull const)(ImpBTreeNode *_Nonnull const node))block;
+///Like walkLeafNodes:, but any node that isn't already in the cache is made just for the block and not added to it, so a walk over the whole catalog doesn't leave an object behind for every leaf node. The node may be deallocated once the block returns; don't hold on to it.
+- (NSUInteger) walkLeafNodesWithoutCaching:(bool (^_Nonnull const)(ImpBTreeNode *_Nonnull const node))block;
 
 ///Given the CNID of a folder, call one of the blocks with each item in that folder. Either block can return false to stop iteration. Returns the number of items visited. If the CNID does not refer to a folder, returns 0. (This includes if it is a file.)
 ///You can pass nil for either or both blocks. If you pass nil for both blocks, you'll find out how many items are actually in the folder, regardless of what its valence says.
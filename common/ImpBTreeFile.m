@@ -8,10 +8,12 @@
 #import "ImpBTreeFile.h"
 
 #import <hfs/hfs_format.h>
+#import <os/lock.h>
 #import "ImpByteOrder.h"
 #import "ImpSizeUtilities.h"
 #import "ImpComparisonUtilities.h"
 #import "NSData+ImpSubdata.h"
+#import "ImpPerformanceCounters.h"
 #import "ImpBTreeHeaderNode.h"
 #import "ImpBTreeIndexNode.h"
 #import "ImpTextEncodingConverter.h"
@@ -20,8 +22,16 @@
 {
 	struct BTNodeDescriptor const *_Nonnull _nodes;
 	NSUInteger _numPotentialNodes;
-	NSMutableArray *_Nullable _lastEnumeratedObjects;
 	NSMutableArray <ImpBTreeNode *> *_Nullable _nodeCache;
+	///Forks may be read on several threads at once (e.g., when rehydrating files in parallel), and reading a fork past its first extent record looks up the extents overflow tree, which fills in this cache. Guards every access to _nodeCache's elements.
+	os_unfair_lock _nodeCacheLock;
+
+	///Flat, native-endian copy of every node's descriptor and record offsets. Only built for trees loaded from a volume; nil for mutable trees.
+	NSMutableData *_Nullable _nodeTableData;
+	NSMutableData *_Nullable _recordOffsetsData;
+	struct ImpBTreeNodeTableEntry const *_Nullable _nodeTable;
+	BTreeNodeOffset const *_Nullable _recordOffsets;
+	u_int16_t _tableKeyLengthSize;
 }
 
 + (u_int16_t) nodeSizeForVersion:(ImpBTreeVersion const)version {
@@ -75,21 +85,79 @@
 	if ((self = [super init])) {
 		_version = version;
 
+		//If the data is immutable (e.g., a view into a memory-mapped source volume), copy is just a retain, so the tree is backed directly by the original pages.
 		_bTreeData = copyData ? [bTreeFileContents copy] : bTreeFileContents;
 		_nodes = _bTreeData.bytes;
 		_nodeSize = nodeSize;
 
 		_numPotentialNodes = _bTreeData.length / _nodeSize;
 
+		_nodeCacheLock = OS_UNFAIR_LOCK_INIT;
 		_nodeCache = [NSMutableArray arrayWithCapacity:_numPotentialNodes];
 		NSNull *_Nonnull const null = [NSNull null];
 		for (NSUInteger i = 0; i < _numPotentialNodes; ++i) {
 			[_nodeCache addObject:(ImpBTreeNode *)null];
 		}
+
+		if (! self.hasMutableNodes) {
+			[self buildNodeTable];
+		}
 	}
 	return self;
 }
 
+///Decode every node's descriptor and record offsets into _nodeTable and _recordOffsets.
+- (void) buildNodeTable {
+	NSUInteger const numNodes = _numPotentialNodes;
+	void const *_Nonnull const fileBytes = _bTreeData.bytes;
+	//Every record needs an offset, plus one more for the start of free space, and they all have to fit after the node descriptor.
+	NSUInteger const maxNumOffsetsPerNode = (_nodeSize - sizeof(struct BTNodeDescriptor)) / sizeof(BTreeNodeOffset);
+
+	_nodeTableData = [NSMutableData dataWithLength:numNodes * sizeof(struct ImpBTreeNodeTableEntry)];
+	struct ImpBTreeNodeTableEntry *_Nonnull const table = _nodeTableData.mutableBytes;
+
+	NSUInteger totalNumOffsets = 0;
+	for (NSUInteger i = 0; i < numNodes; ++i) {
+		struct BTNodeDescriptor const *_Nonnull const nodeDesc = fileBytes + i * _nodeSize;
+		struct ImpBTreeNodeTableEntry *_Nonnull const entry = table + i;
+		entry->forwardLink = L(nodeDesc->fLink);
+		entry->backwardLink = L(nodeDesc->bLink);
+		entry->kind = L(nodeDesc->kind);
+		entry->height = L(nodeDesc->height);
+		u_int16_t const numRecords = L(nodeDesc->numRecords);
+		//Unused nodes may contain anything. If this one claims more records than it has room for, treat it as empty rather than reading off the end of it.
+		entry->numberOfRecords = numRecords < maxNumOffsetsPerNode ? numRecords : 0;
+		entry->firstRecordOffsetIndex = (u_int32_t)totalNumOffsets;
+		totalNumOffsets += entry->numberOfRecords + 1;
+	}
+
+	_recordOffsetsData = [NSMutableData dataWithLength:totalNumOffsets * sizeof(BTreeNodeOffset)];
+	BTreeNodeOffset *_Nonnull const allOffsets = _recordOffsetsData.mutableBytes;
+	for (NSUInteger i = 0; i < numNodes; ++i) {
+		struct ImpBTreeNodeTableEntry const *_Nonnull const entry = table + i;
+		//The offsets stack grows down from the end of the node: the last two bytes are the offset of record 0.
+		BTreeNodeOffset const *_Nonnull const endOfNode = fileBytes + (i + 1) * _nodeSize;
+		BTreeNodeOffset *_Nonnull const nodeOffsets = allOffsets + entry->firstRecordOffsetIndex;
+		BTreeNodeOffset previousOffset = sizeof(struct BTNodeDescriptor);
+		for (u_int16_t r = 0; r <= entry->numberOfRecords; ++r) {
+			BTreeNodeOffset offset = L(endOfNode[-1 - (NSInteger)r]);
+			//Keep records in order and within the node, so a bogus offset can't send a reader off into some other node.
+			if (offset < previousOffset || offset > _nodeSize) {
+				offset = previousOffset;
+			}
+			nodeOffsets[r] = offset;
+			previousOffset = offset;
+		}
+	}
+
+	//Walks and searches start from the header record, so without one the table is no use to them.
+	if (numNodes > 0 && table[0].kind == kBTHeaderNode && table[0].numberOfRecords > 0) {
+		_nodeTable = table;
+		_recordOffsets = allOffsets;
+		_tableKeyLengthSize = self.keyLengthSize;
+	}
+}
+
 - (instancetype _Nullable )initWithVersion:(ImpBTreeVersion const)version data:(NSData *_Nonnull const)bTreeFileContents {
 	_version = version;
 	u_int16_t nodeSize = [[self class] nodeSizeForVersion:_version];
@@ -172,6 +240,21 @@
 - (NSUInteger) numberOfLiveNodes {
 	__block NSUInteger count = 0;
 
+	if (_nodeTable != NULL) {
+		//Count up the header node and any map nodes.
+		u_int32_t mapNodeIdx = 0;
+		do {
+			++count;
+			mapNodeIdx = _nodeTable[mapNodeIdx].forwardLink;
+		} while (mapNodeIdx != 0 && mapNodeIdx < _numPotentialNodes && count < _numPotentialNodes);
+
+		//Count up the index and leaf nodes.
+		count += [self walkNodeTableBreadthFirst:^bool(u_int32_t const nodeIdx) {
+			return true;
+		}];
+		return count;
+	}
+
 	//Count up the header node and any map nodes.
 	for (ImpBTreeNode *_Nullable node = self.headerNode; node != nil; node = node.nextNode) {
 		++count;
@@ -200,12 +283,28 @@
 #pragma mark Node access
 
 - (ImpBTreeNode *_Nullable) alreadyCachedNodeAtIndex:(NSUInteger)idx {
-	return idx < _nodeCache.count
+	os_unfair_lock_lock(&_nodeCacheLock);
+	ImpBTreeNode *_Nullable const node = idx < _nodeCache.count
 		? _nodeCache[idx]
 		: nil;
+	os_unfair_lock_unlock(&_nodeCacheLock);
+	return node;
 }
 - (void) storeNode:(ImpBTreeNode *_Nonnull const)node inCacheAtIndex:(NSUInteger)idx {
+	os_unfair_lock_lock(&_nodeCacheLock);
 	_nodeCache[idx] = node;
+	os_unfair_lock_unlock(&_nodeCacheLock);
+}
+///Cache a newly-made node unless another thread got there first, and return whichever node ends up in the cache, so every caller gets the same object for the same node.
+- (ImpBTreeNode *_Nonnull) storeNodeIfNotAlreadyCached:(ImpBTreeNode *_Nonnull const)node atIndex:(NSUInteger)idx {
+	os_unfair_lock_lock(&_nodeCacheLock);
+	ImpBTreeNode *_Nonnull cachedNode = _nodeCache[idx];
+	if (cachedNode == (ImpBTreeNode *)[NSNull null]) {
+		_nodeCache[idx] = node;
+		cachedNode = node;
+	}
+	os_unfair_lock_unlock(&_nodeCacheLock);
+	return cachedNode;
 }
 
 - (ImpBTreeHeaderNode *_Nullable const) headerNode {
@@ -216,6 +315,65 @@
 	return nil;
 }
 
+#pragma mark Node table
+
+- (struct ImpBTreeNodeTableEntry const *_Nullable) nodeTableEntryAtIndex:(u_int32_t const)idx {
+	return (_nodeTable != NULL && idx < _numPotentialNodes) ? _nodeTable + idx : NULL;
+}
+
+///Table-backed record access for use within this file. The caller is responsible for checking that the tree has a node table and that the indexes are in range.
+static inline void const *_Nonnull ImpBTreeFileRecordPointer(ImpBTreeFile *_Nonnull const self, u_int32_t const nodeIdx, u_int16_t const recordIdx, u_int16_t *_Nullable const outLength) {
+	BTreeNodeOffset const *_Nonnull const nodeOffsets = self->_recordOffsets + self->_nodeTable[nodeIdx].firstRecordOffsetIndex;
+	if (outLength != NULL) {
+		*outLength = nodeOffsets[recordIdx + 1] - nodeOffsets[recordIdx];
+	}
+	return (void const *)self->_nodes + (NSUInteger)nodeIdx * self->_nodeSize + nodeOffsets[recordIdx];
+}
+
+///Returns the length of the key at the start of a keyed record, including the key length field itself.
+static inline u_int16_t ImpBTreeFileKeyLength(ImpBTreeFile *_Nonnull const self, void const *_Nonnull const recordPtr) {
+	if (self->_tableKeyLengthSize == sizeof(u_int16_t)) {
+		u_int16_t const *_Nonnull const keyLengthPtr = recordPtr;
+		return L(*keyLengthPtr) + sizeof(u_int16_t);
+	} else {
+		u_int8_t const *_Nonnull const keyLengthPtr = recordPtr;
+		return *keyLengthPtr + sizeof(u_int8_t);
+	}
+}
+
+///Returns a pointer to the payload of a keyed record (skipping the pad byte after the key, if any), and its length by reference. Same rules as -[ImpBTreeNode recordPayloadDataAtIndex:].
+static inline void const *_Nonnull ImpBTreeFilePayloadPointer(ImpBTreeFile *_Nonnull const self, void const *_Nonnull const recordPtr, u_int16_t const recordLength, u_int16_t *_Nullable const outPayloadLength) {
+	u_int16_t payloadOffset = ImpBTreeFileKeyLength(self, recordPtr);
+	u_int16_t payloadLength = recordLength > payloadOffset ? recordLength - payloadOffset : 0;
+	if (payloadLength % 2 == 1) {
+		++payloadOffset;
+		--payloadLength;
+	}
+	if (outPayloadLength != NULL) {
+		*outPayloadLength = payloadLength;
+	}
+	return recordPtr + payloadOffset;
+}
+
+///Returns the node number that an index node record points down to.
+static inline u_int32_t ImpBTreeFileChildNodeIndex(ImpBTreeFile *_Nonnull const self, void const *_Nonnull const recordPtr) {
+	u_int32_t const *_Nonnull const downwardNodePtr = recordPtr + ImpBTreeFileKeyLength(self, recordPtr);
+	return L(*downwardNodePtr);
+}
+
+- (void const *_Nullable) pointerToRecordAtIndex:(u_int16_t const)recordIdx
+	inNodeAtIndex:(u_int32_t const)nodeIdx
+	length:(u_int16_t *_Nullable const)outLength
+{
+	struct ImpBTreeNodeTableEntry const *_Nullable const entry = [self nodeTableEntryAtIndex:nodeIdx];
+	if (entry == NULL || recordIdx >= entry->numberOfRecords) {
+		return NULL;
+	}
+	return ImpBTreeFileRecordPointer(self, nodeIdx, recordIdx, outLength);
+}
+
+#pragma mark -
+
 - (u_int64_t) offsetInFileOfPointer:(void const *_Nonnull const)ptr {
 	return ptr - _bTreeData.bytes;
 }
@@ -245,20 +403,27 @@
 		//This will throw a range exception.
 		return _nodeCache[idx];
 	}
+	//Trees with a node table count their visits where they walk or search it; node objects fetched from them are for nodes that have already been counted.
+	if (_nodeTable == NULL) {
+		ImpPerformanceCountBTreeNodeVisit();
+	}
 
 	ImpBTreeNode *_Nonnull const oneWeMadeEarlier = [self alreadyCachedNodeAtIndex:idx];
 	if (oneWeMadeEarlier != (ImpBTreeNode *)[NSNull null]) {
 		return oneWeMadeEarlier;
 	}
 
-	//TODO: Create all of these once, probably up front, and keep them in an array. Turn this into objectAtIndex: and the fast enumeration into fast enumeration of that array.
+	//Node objects are only made when someone asks for one. Walking and searching the tree use the node table instead, so most nodes never get an object at all.
+	return [self storeNodeIfNotAlreadyCached:[self makeNodeAtIndex:idx] atIndex:idx];
+}
+
+///Create a new node object for the node at this index, without looking in or adding to the cache.
+- (ImpBTreeNode *_Nonnull const) makeNodeAtIndex:(u_int32_t const)idx {
 	NSData *_Nonnull const nodeData = [self nodeDataAtIndex:idx];
 	ImpBTreeNode *_Nonnull const node = [ImpBTreeNode nodeWithTree:self data:nodeData copy:false mutable:self.hasMutableNodes]; //copy:false because we either already copied it when the tree was created or we're intentionally creating a mutable subdata of a mutable data.
 	node.nodeNumber = idx;
 	NSRange const nodeByteRange = { _nodeSize * idx, _nodeSize };
 	node.byteRange = nodeByteRange;
-	[self storeNode:node inCacheAtIndex:idx];
-
 	return node;
 }
 
@@ -283,20 +448,10 @@
 		nextReturnedRange.length = self.count - nextReturnedRange.location;
 	}
 
-	if (_lastEnumeratedObjects == nil) {
-		_lastEnumeratedObjects = [NSMutableArray arrayWithCapacity:nextReturnedRange.length];
-	} else {
-		[_lastEnumeratedObjects removeAllObjects];
-	}
 	for (NSUInteger	i = 0; i < nextReturnedRange.length; ++i) {
 		u_int32_t const nodeNumber = (u_int32_t)(nextReturnedRange.location + i);
-
-		NSData *_Nonnull const data = [self nodeDataAtIndex:nodeNumber];
-		ImpBTreeNode *_Nonnull const node = [ImpBTreeNode nodeWithTree:self data:data];
-		node.nodeNumber = nodeNumber;
-
-		[_lastEnumeratedObjects addObject:node];
-		outObjects[i] = node;
+		//The node cache keeps these alive, so we don't need to hang on to them ourselves.
+		outObjects[i] = [self nodeAtIndex:nodeNumber];
 	}
 	state->extra[0] = nextReturnedRange.location;
 	state->extra[1] = nextReturnedRange.length;
@@ -330,7 +485,37 @@
 
 	return numNodesVisited;
 }
+///Node-table version of walkBreadthFirst:. Visits each row from left to right, then moves down to the row below by way of the first record of the row's first node.
+- (NSUInteger) walkNodeTableBreadthFirst:(bool (^_Nonnull const)(u_int32_t const nodeIdx))block {
+	struct BTHeaderRec const *_Nonnull const headerRec = ImpBTreeFileRecordPointer(self, 0, 0, NULL);
+	NSUInteger numNodesVisited = 0;
+	u_int32_t firstNodeOfRow = L(headerRec->rootNode);
+	while (firstNodeOfRow != 0 && firstNodeOfRow < _numPotentialNodes) {
+		for (u_int32_t nodeIdx = firstNodeOfRow; nodeIdx != 0 && nodeIdx < _numPotentialNodes; nodeIdx = _nodeTable[nodeIdx].forwardLink) {
+			++numNodesVisited;
+			ImpPerformanceCountBTreeNodeVisit();
+			//If we've visited more nodes than there are, the links must go in a circle somewhere.
+			if (numNodesVisited > _numPotentialNodes || ! block(nodeIdx)) {
+				return numNodesVisited;
+			}
+		}
+
+		struct ImpBTreeNodeTableEntry const *_Nonnull const firstEntry = _nodeTable + firstNodeOfRow;
+		if (firstEntry->kind != kBTIndexNode || firstEntry->numberOfRecords == 0) {
+			break;
+		}
+		firstNodeOfRow = ImpBTreeFileChildNodeIndex(self, ImpBTreeFileRecordPointer(self, firstNodeOfRow, 0, NULL));
+	}
+	return numNodesVisited;
+}
+
 - (NSUInteger) walkBreadthFirst:(bool (^_Nonnull const)(ImpBTreeNode *_Nonnull const node))block {
+	if (_nodeTable != NULL) {
+		return [self walkNodeTableBreadthFirst:^bool(u_int32_t const nodeIdx) {
+			return block([self nodeAtIndex:nodeIdx]);
+		}];
+	}
+
 	ImpBTreeHeaderNode *_Nullable const headerNode = self.headerNode;
 	if (headerNode == nil) {
 		//No header node. Welp!
@@ -346,7 +531,42 @@
 	return [self _walkNodeAndItsSiblingsAndThenItsChildren:rootNode keepIterating:NULL block:block];
 }
 
+///Node-table version of walkLeafNodes:.
+- (NSUInteger) walkLeafNodesInNodeTable:(bool (^_Nonnull const)(u_int32_t const nodeIdx))block {
+	struct BTHeaderRec const *_Nonnull const headerRec = ImpBTreeFileRecordPointer(self, 0, 0, NULL);
+	NSUInteger numVisited = 0;
+	for (u_int32_t nodeIdx = L(headerRec->firstLeafNode); nodeIdx != 0 && nodeIdx < _numPotentialNodes; nodeIdx = _nodeTable[nodeIdx].forwardLink) {
+		++numVisited;
+		ImpPerformanceCountBTreeNodeVisit();
+		if (numVisited > _numPotentialNodes || ! block(nodeIdx)) {
+			break;
+		}
+	}
+	return numVisited;
+}
+
+- (NSUInteger) walkLeafNodesWithoutCaching:(bool (^_Nonnull const)(ImpBTreeNode *_Nonnull const node))block {
+	if (_nodeTable == NULL) {
+		//Mutable trees' nodes are where their contents live, so those have to stay cached.
+		return [self walkLeafNodes:block];
+	}
+
+	return [self walkLeafNodesInNodeTable:^bool(u_int32_t const nodeIdx) {
+		@autoreleasepool {
+			ImpBTreeNode *_Nullable const cachedNode = [self alreadyCachedNodeAtIndex:nodeIdx];
+			ImpBTreeNode *_Nonnull const node = cachedNode != (ImpBTreeNode *)[NSNull null] ? cachedNode : [self makeNodeAtIndex:nodeIdx];
+			return block(node);
+		}
+	}];
+}
+
 - (NSUInteger) walkLeafNodes:(bool (^_Nonnull const)(ImpBTreeNode *_Nonnull const node))block {
+	if (_nodeTable != NULL) {
+		return [self walkLeafNodesInNodeTable:^bool(u_int32_t const nodeIdx) {
+			return block([self nodeAtIndex:nodeIdx]);
+		}];
+	}
+
 	ImpBTreeHeaderNode *_Nullable const headerNode = self.headerNode;
 	if (headerNode == nil) {
 		//No header node. Welp!
@@ -392,8 +612,53 @@
 		return ImpBTreeComparisonQuarryIsEqual;
 	};
 
-	ImpBTreeNode *_Nullable threadRecordNode = nil;
+	u_int32_t threadRecordNodeIdx = 0;
 	u_int16_t threadRecordIdx;
+	if (_nodeTable != NULL) {
+		if ([self searchNodeTableWithKeyComparator:compareKeys getNodeIndex:&threadRecordNodeIdx recordIndex:&threadRecordIdx]) {
+			u_int32_t nodeIdx = threadRecordNodeIdx;
+			u_int16_t recordIdx = threadRecordIdx + 1;
+			NSUInteger numNodesVisited = 0;
+
+			while (keepIterating && nodeIdx != 0 && nodeIdx < _numPotentialNodes && numNodesVisited++ < _numPotentialNodes) {
+				ImpPerformanceCountBTreeNodeVisit();
+				u_int16_t const numRecords = _nodeTable[nodeIdx].numberOfRecords;
+				for (u_int16_t i = recordIdx; keepIterating && i < numRecords; ++i) {
+					u_int16_t recordLength = 0;
+					void const *_Nonnull const recordPtr = ImpBTreeFileRecordPointer(self, nodeIdx, i, &recordLength);
+					struct HFSCatalogKey const *_Nonnull const keyPtr = recordPtr;
+
+					if (L(keyPtr->parentID) != dirID) {
+						keepIterating = false;
+					} else {
+						++numVisited;
+
+						void const *_Nonnull const payloadPtr = ImpBTreeFilePayloadPointer(self, recordPtr, recordLength, NULL);
+						u_int8_t const *_Nonnull const recordTypePtr = payloadPtr;
+						switch (*recordTypePtr << 8) {
+							case kHFSFileRecord:
+								if (visitFile != nil) {
+									keepIterating = visitFile(keyPtr, payloadPtr);
+								}
+								break;
+							case kHFSFolderRecord:
+								if (visitFolder != nil) {
+									keepIterating = visitFolder(keyPtr, payloadPtr);
+								}
+								break;
+							default:
+								break;
+						}
+					}
+				}
+				nodeIdx = _nodeTable[nodeIdx].forwardLink;
+				recordIdx = 0;
+			}
+		}
+		return numVisited;
+	}
+
+	ImpBTreeNode *_Nullable threadRecordNode = nil;
 	if ([self searchTreeForItemWithKeyComparator:compareKeys getNode:&threadRecordNode recordIndex:&threadRecordIdx]) {
 		ImpBTreeNode *_Nullable node = threadRecordNode;
 		u_int16_t recordIdx = threadRecordIdx + 1;
@@ -446,6 +711,48 @@
 {
 	__block NSUInteger numVisited = 0;
 	__block bool keepIterating = true;
+
+	if (_nodeTable != NULL) {
+		if (self.version != ImpBTreeVersionHFSCatalog) {
+			return 0;
+		}
+		[self walkLeafNodesInNodeTable:^bool(u_int32_t const nodeIdx) {
+			@autoreleasepool {
+				u_int16_t const numRecords = self->_nodeTable[nodeIdx].numberOfRecords;
+				for (u_int16_t i = 0; keepIterating && i < numRecords; ++i) {
+					u_int16_t recordLength = 0;
+					void const *_Nonnull const recordPtr = ImpBTreeFileRecordPointer(self, nodeIdx, i, &recordLength);
+					struct HFSCatalogKey const *_Nonnull const keyPtr = recordPtr;
+					void const *_Nonnull const payloadPtr = ImpBTreeFilePayloadPointer(self, recordPtr, recordLength, NULL);
+					//As in -[ImpBTreeNode forEachHFSCatalogRecord_file:folder:thread:], only the high byte of the record type is significant.
+					int8_t const recordType = *(int8_t const *)payloadPtr;
+					switch (recordType << 8) {
+						case kHFSFileRecord:
+							++numVisited;
+							if (visitFile != nil) {
+								keepIterating = visitFile(keyPtr, payloadPtr);
+							}
+							break;
+						case kHFSFolderRecord:
+							++numVisited;
+							if (visitFolder != nil) {
+								keepIterating = visitFolder(keyPtr, payloadPtr);
+							}
+							break;
+						case kHFSFileThreadRecord:
+						case kHFSFolderThreadRecord:
+							break;
+						default:
+							fprintf(stderr, "\tUnrecognized record type 0x%x while trying to iterate catalog records; either this isn't a catalog file, or the parsing has gotten off-track somehow.\n", (unsigned)recordType);
+							break;
+					}
+				}
+			}
+			return keepIterating;
+		}];
+		return numVisited;
+	}
+
 	[self walkLeafNodes:^bool(ImpBTreeNode *_Nonnull const node) {
 		[node forEachHFSCatalogRecord_file:^(struct HFSCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSCatalogFile const *_Nonnull const fileRecPtr) {
 			if (keepIterating) {
@@ -469,10 +776,123 @@
 	return numVisited;
 }
 
+///Node-table version of -[ImpBTreeNode searchSiblingsForBestMatchingNodeWithComparator:]. Returns 0 if there's no suitable node.
+- (u_int32_t) searchNodeTableForBestMatchingSiblingOfNodeAtIndex:(u_int32_t)nodeIdx comparator:(ImpBTreeRecordKeyComparator _Nonnull const)compareKeys {
+	NSUInteger numNodesVisited = 0;
+	while (nodeIdx != 0 && nodeIdx < _numPotentialNodes && numNodesVisited++ < _numPotentialNodes) {
+		struct ImpBTreeNodeTableEntry const *_Nonnull const entry = _nodeTable + nodeIdx;
+		if (entry->numberOfRecords == 0) {
+			return 0;
+		}
+
+		//First, if the first record in this node is already greater than the quarry, search the previous node.
+		if (compareKeys(ImpBTreeFileRecordPointer(self, nodeIdx, 0, NULL)) == ImpBTreeComparisonQuarryIsLesser) {
+			nodeIdx = entry->backwardLink;
+			continue;
+		}
+
+		//If the last record in this node is less than the quarry, check the next node's first record and if it's less than or equal to the quarry, search it.
+		if (entry->numberOfRecords > 1 && compareKeys(ImpBTreeFileRecordPointer(self, nodeIdx, entry->numberOfRecords - 1, NULL)) == ImpBTreeComparisonQuarryIsGreater) {
+			u_int32_t const nextNodeIdx = entry->forwardLink;
+			if (nextNodeIdx != 0 && nextNodeIdx < _numPotentialNodes && _nodeTable[nextNodeIdx].numberOfRecords > 0) {
+				ImpBTreeComparisonResult const comparisonResult = compareKeys(ImpBTreeFileRecordPointer(self, nextNodeIdx, 0, NULL));
+				if (comparisonResult == ImpBTreeComparisonQuarryIsEqual) {
+					return nextNodeIdx;
+				} else if (comparisonResult == ImpBTreeComparisonQuarryIsGreater) {
+					nodeIdx = nextNodeIdx;
+					continue;
+				}
+			}
+		}
+
+		//Otherwise, the best matching node is this one.
+		return nodeIdx;
+	}
+	return 0;
+}
+
+///Node-table version of -[ImpBTreeNode indexOfBestMatchingRecord:]. Also a binary search.
+- (int32_t) indexOfBestMatchingRecordInNodeTableAtIndex:(u_int32_t const)nodeIdx comparator:(ImpBTreeRecordKeyComparator _Nonnull const)compareKeys {
+	ImpPerformanceCountBTreeNodeVisit();
+	u_int16_t low = 0, high = _nodeTable[nodeIdx].numberOfRecords;
+	while (low < high) {
+		u_int16_t const mid = low + (high - low) / 2;
+		ImpBTreeComparisonResult const comparisonResult = compareKeys(ImpBTreeFileRecordPointer(self, nodeIdx, mid, NULL));
+		if (comparisonResult == ImpBTreeComparisonQuarryIsEqual) {
+			return mid;
+		} else if (comparisonResult == ImpBTreeComparisonQuarryIsLesser) {
+			high = mid;
+		} else {
+			low = mid + 1;
+		}
+	}
+	return (int32_t)low - 1;
+}
+
+///Node-table version of -[ImpBTreeIndexNode descendWithKeyComparator:]. Returns the index of the child node under the greatest record that is less than or equal to the quarry, or 0 if there is no such record.
+- (u_int32_t) descendNodeTableFromIndexNodeAtIndex:(u_int32_t const)nodeIdx comparator:(ImpBTreeRecordKeyComparator _Nonnull const)compareKeys {
+	int32_t const recordIdx = [self indexOfBestMatchingRecordInNodeTableAtIndex:nodeIdx comparator:compareKeys];
+	if (recordIdx < 0) {
+		return 0;
+	}
+	return ImpBTreeFileChildNodeIndex(self, ImpBTreeFileRecordPointer(self, nodeIdx, (u_int16_t)recordIdx, NULL));
+}
+
+///Node-table version of searchTreeForItemWithKeyComparator:getNode:recordIndex:. Doesn't create any node objects.
+- (bool) searchNodeTableWithKeyComparator:(ImpBTreeRecordKeyComparator _Nonnull const)compareKeys
+	getNodeIndex:(u_int32_t *_Nullable const)outNodeIdx
+	recordIndex:(u_int16_t *_Nullable const)outRecordIdx
+{
+	struct BTHeaderRec const *_Nonnull const headerRec = ImpBTreeFileRecordPointer(self, 0, 0, NULL);
+	u_int32_t nodeIdx = L(headerRec->rootNode);
+	NSUInteger numTiersDescended = 0;
+	while (nodeIdx != 0 && nodeIdx < _numPotentialNodes && _nodeTable[nodeIdx].kind == kBTIndexNode) {
+		nodeIdx = [self searchNodeTableForBestMatchingSiblingOfNodeAtIndex:nodeIdx comparator:compareKeys];
+
+		//If the best matching node on this tier is an index node, descend through it to the next tier.
+		if (nodeIdx != 0 && _nodeTable[nodeIdx].kind == kBTIndexNode) {
+			nodeIdx = [self descendNodeTableFromIndexNodeAtIndex:nodeIdx comparator:compareKeys];
+		}
+
+		//Heights are 8-bit, so a tree that goes deeper than this has a loop in it.
+		if (++numTiersDescended > UINT8_MAX) {
+			return false;
+		}
+	}
+
+	if (nodeIdx == 0 || nodeIdx >= _numPotentialNodes || _nodeTable[nodeIdx].kind != kBTLeafNode) {
+		return false;
+	}
+
+	int32_t const recordIdx = [self indexOfBestMatchingRecordInNodeTableAtIndex:nodeIdx comparator:compareKeys];
+	if (recordIdx < 0) {
+		return false;
+	}
+	if (compareKeys(ImpBTreeFileRecordPointer(self, nodeIdx, (u_int16_t)recordIdx, NULL)) == ImpBTreeComparisonQuarryIsEqual) {
+		if (outNodeIdx != NULL) {
+			*outNodeIdx = nodeIdx;
+		}
+		if (outRecordIdx != NULL) {
+			*outRecordIdx = (u_int16_t)recordIdx;
+		}
+		return true;
+	}
+	return false;
+}
+
 - (bool) searchTreeForItemWithKeyComparator:(ImpBTreeRecordKeyComparator _Nonnull const)compareKeys
 	getNode:(ImpBTreeNode *_Nullable *_Nullable const)outNode
 	recordIndex:(u_int16_t *_Nullable const)outRecordIdx
 {
+	if (_nodeTable != NULL) {
+		u_int32_t foundNodeIdx = 0;
+		bool const found = [self searchNodeTableWithKeyComparator:compareKeys getNodeIndex:&foundNodeIdx recordIndex:outRecordIdx];
+		if (found && outNode != NULL) {
+			*outNode = [self nodeAtIndex:foundNodeIdx];
+		}
+		return found;
+	}
+
 	ImpBTreeHeaderNode *_Nullable const headerNode = self.headerNode;
 	ImpBTreeNode *_Nullable const rootNode = headerNode.rootNode;
 //	ImpPrintf(@"Searching catalog file starting from root node #%u at height %u", rootNode.nodeNumber, (unsigned)rootNode.nodeHeight);
@@ -507,8 +927,11 @@
 			//TODO: If outItemRecordData is non-NULL, we need a file or folder record—a thread record will not do.
 			//We'll need to look before or after this record for a non-thread record. It might not be in this node. It might not even be in this catalog (although I'm not sure what it would mean for a catalog to have a thread record but no file or folder record—is that possible when items are deleted?).
 
-			NSData *_Nonnull const recordKeyData = [nextSearchNode recordKeyDataAtIndex:recordIdx];
-			ImpBTreeComparisonResult const comparisonResult = compareKeys(recordKeyData.bytes);
+			if (recordIdx < 0) {
+				//Every key in the leaf node is greater than the quarry, so the quarry isn't in the tree.
+				return false;
+			}
+			ImpBTreeComparisonResult const comparisonResult = compareKeys([nextSearchNode pointerToRecordAtIndex:recordIdx length:NULL]);
 			if (comparisonResult != ImpBTreeComparisonQuarryIsEqual) {
 //				ImpPrintf(@"Not an exact match. Bummer.");
 			}
@@ -629,15 +1052,14 @@
 	getRecordKeyData:(NSData *_Nullable *_Nullable const)outRecordKeyData
 	fileOrFolderRecordData:(NSData *_Nullable *_Nullable const)outItemRecordData
 {
-	struct HFSPlusCatalogKey quarryCatalogKey;
-	S(quarryCatalogKey.parentID, cnid);
-	memcpy(quarryCatalogKey.nodeName.unicode, nodeName->unicode, nodeName->length * sizeof(UniChar));
-	quarryCatalogKey.nodeName.length = nodeName->length;
-	S(quarryCatalogKey.keyLength, (u_int16_t)(sizeof(struct HFSPlusCatalogKey) - self.keyLengthSize));
+	//Fold the quarry's name once up front, rather than once for every key we compare it to.
+	struct ImpHFSPlusFoldedName quarryName;
+	quarryName.length = (u_int16_t)ImpHFSPlusFoldName(nodeName, quarryName.unicode);
+	struct ImpHFSPlusFoldedName const *_Nonnull const quarryNamePtr = &quarryName;
 
 	ImpBTreeRecordKeyComparator _Nonnull const compareKeys = ^ImpBTreeComparisonResult(const void *const  _Nonnull foundKeyPtr) {
 		struct HFSPlusCatalogKey const *_Nonnull const foundCatKeyPtr = foundKeyPtr;
-		return ImpBTreeCompareHFSPlusCatalogKeys(&quarryCatalogKey, foundCatKeyPtr);
+		return ImpBTreeCompareHFSPlusCatalogKeyWithFoldedName(cnid, quarryNamePtr, foundCatKeyPtr);
 	};
 
 	return [self searchCatalogTreeWithKeyComparator:compareKeys getRecordKeyData:outRecordKeyData payloadData:outItemRecordData];
@@ -647,15 +1069,14 @@
 	getRecordKeyData:(NSData *_Nullable *_Nullable const)outRecordKeyData
 	threadRecordData:(NSData *_Nullable *_Nullable const)outThreadRecordData
 {
-	struct HFSPlusCatalogKey quarryCatalogKey;
-	S(quarryCatalogKey.parentID, cnid);
-	memcpy(quarryCatalogKey.nodeName.unicode, nodeName->unicode, nodeName->length * sizeof(UniChar));
-	quarryCatalogKey.nodeName.length = nodeName->length;
-	S(quarryCatalogKey.keyLength, (u_int16_t)(sizeof(struct HFSPlusCatalogKey) - self.keyLengthSize));
+	//Fold the quarry's name once up front, rather than once for every key we compare it to.
+	struct ImpHFSPlusFoldedName quarryName;
+	quarryName.length = (u_int16_t)ImpHFSPlusFoldName(nodeName, quarryName.unicode);
+	struct ImpHFSPlusFoldedName const *_Nonnull const quarryNamePtr = &quarryName;
 
 	ImpBTreeRecordKeyComparator _Nonnull const compareKeys = ^ImpBTreeComparisonResult(const void *const  _Nonnull foundKeyPtr) {
 		struct HFSPlusCatalogKey const *_Nonnull const foundCatKeyPtr = foundKeyPtr;
-		return ImpBTreeCompareHFSPlusCatalogKeys(&quarryCatalogKey, foundCatKeyPtr);
+		return ImpBTreeCompareHFSPlusCatalogKeyWithFoldedName(cnid, quarryNamePtr, foundCatKeyPtr);
 	};
 
 	return [self searchCatalogTreeWithKeyComparator:compareKeys getRecordKeyData:outRecordKeyData payloadData:outThreadRecordData];
@@ -7,6 +7,7 @@
 
 #import "ImpBTreeIndexNode.h"
 
+#import <os/lock.h>
 #import "ImpByteOrder.h"
 #import "ImpPrintf.h"
 #import "ImpBTreeFile.h"
@@ -14,10 +15,16 @@
 @implementation ImpBTreeIndexNode
 {
 	NSArray <ImpBTreeNode *> *_Nullable _children;
+	///Like the record cache, _children is filled in lazily on a node that several threads may share. Guards the _children pointer. (The ivar starts out zeroed, which is OS_UNFAIR_LOCK_INIT.)
+	os_unfair_lock _childrenLock;
 }
 
 - (NSArray <ImpBTreeNode *> *_Nonnull const) children {
-	if (_children == nil) {
+	os_unfair_lock_lock(&_childrenLock);
+	NSArray <ImpBTreeNode *> *_Nullable existingChildren = _children;
+	os_unfair_lock_unlock(&_childrenLock);
+
+	if (existingChildren == nil) {
 		NSMutableArray *_Nonnull const children = [NSMutableArray arrayWithCapacity:self.numberOfRecords];
 
 		ImpBTreeFile *_Nonnull const tree = self.tree;
@@ -30,85 +37,29 @@
 			return true;
 		}];
 
-		_children = children;
+		os_unfair_lock_lock(&_childrenLock);
+		if (_children == nil) {
+			_children = children;
+		}
+		existingChildren = _children;
+		os_unfair_lock_unlock(&_childrenLock);
 	}
 
-	return _children;
+	return existingChildren;
 }
 
 - (ImpBTreeNode *_Nullable) descendWithKeyComparator:(ImpBTreeComparisonResult (^_Nonnull const)(void const *_Nonnull const keyPtr))block {
-	__block ImpBTreeNode *_Nullable result = nil;
-	__block bool foundBestMatch = false;
-
-	ImpBTreeFile *_Nullable const tree = self.tree;
-
-	bool isHFSPlus = false;
-	switch (tree.version) {
-		case ImpBTreeVersionHFSPlusCatalog:
-		case ImpBTreeVersionHFSPlusExtentsOverflow:
-		case ImpBTreeVersionHFSPlusAttributes:
-			isHFSPlus = true;
-			break;
-
-		case ImpBTreeVersionHFSCatalog:
-		case ImpBTreeVersionHFSExtentsOverflow:
-		default:
-			isHFSPlus = false;
-			break;
-	}
-
-	[self forEachRecord:^bool(NSData *const  _Nonnull data) {
-		void const *_Nonnull const recordPtr = data.bytes;
-		void const *_Nonnull const keyPtr = recordPtr;
-
-		u_int8_t const *_Nonnull const hfsKeyLengthPtr = recordPtr;
-		u_int16_t const *_Nonnull const hfsPlusKeyLengthPtr = recordPtr;
-
-		u_int16_t const keyLengthSize = self.tree.keyLengthSize;
-		u_int16_t const keyLength = keyLengthSize == sizeof(u_int16_t)
-			? L(*hfsPlusKeyLengthPtr) + keyLengthSize
-			:  (*hfsKeyLengthPtr) + keyLengthSize;
-		u_int32_t const *_Nonnull const downwardNodePtr = (u_int32_t const *)(recordPtr + keyLength);
-
-		ImpBTreeComparisonResult order = block(keyPtr);
-		bool keepIterating = true;
-		switch (order) {
-			case ImpBTreeComparisonQuarryIsEqual:
-				//Hooray, an exact match! Descend directly to this node.
-				result = [tree nodeAtIndex:L(*downwardNodePtr)];
-				foundBestMatch = true;
-				keepIterating = false;
-				break;
-
-			case ImpBTreeComparisonQuarryIsGreater:
-				//Not an exact match yet (if there even is one), but we're still in the range of eligible keys (we're searching for either an exact match or the greatest key that's less than the quarry). So this is the new greatest candidate so far, but we're not yet ready to stop the search.
-				result = [tree nodeAtIndex:L(*downwardNodePtr)];
-				break;
-
-			case ImpBTreeComparisonQuarryIsLesser:
-				//We've found a key that is greater than the quarry, so we've run out of eligible candidates. Stop iterating and descend to the last result we got.
-				foundBestMatch = true;
-				keepIterating = false;
-				break;
-
-			case ImpBTreeComparisonQuarryIsIncomparable:
-			default:
-				//Well, bummer. There's at least one key here that the comparator didn't recognize. This might indicate the reading or parsing got off-track, or the volume is actually corrupt.
-				//TODO: This cries out for better reporting, both of content (which file were we searching? where was the bad key detected? what were we searching for?) and of venue (how are we going to report this in a GUI?).
-				ImpPrintf(@"WARNING: Incomparable key detected during search. This may be a bug or it may indicate volume corruption.");
-				break;
-		}
-		return keepIterating;
-	}];
-
-	if (! foundBestMatch) {
-		//At this point, it might be tempting to look in sibling nodes.
-		//But we've already been selected by searchSiblingsForBestMatchingNodeWithComparator:. This *is* the node to descend from. If we've gotten to this point, every single record in *this* node is viable, but the first record in the *next* node—if there is one—is not (because if it were, searchSiblings would have returned that node).
-		//So, stay in this node and descend through our last record.
-		NSAssert(result != nil, @"Expected to have found a viable match here (was the catalog file empty?); node contains %u records", self.numberOfRecords);
+	//We've already been selected by searchSiblingsForBestMatchingNodeWithComparator:, so this *is* the node to descend from. All that remains is to find the record with the greatest key that's less than or equal to the quarry—which is what indexOfBestMatchingRecord: does—and follow its pointer.
+	int16_t const recordIdx = [self indexOfBestMatchingRecord:block];
+	if (recordIdx < 0) {
+		//Every key in this node is greater than the quarry.
+		return nil;
 	}
 
-	return result;
+	u_int16_t keyLength = 0;
+	void const *_Nonnull const keyPtr = [self pointerToKeyOfRecordAtIndex:(u_int16_t)recordIdx length:&keyLength];
+	u_int32_t const *_Nonnull const downwardNodePtr = (u_int32_t const *)(keyPtr + keyLength);
+	return [self.tree nodeAtIndex:L(*downwardNodePtr)];
 }
 
 @end
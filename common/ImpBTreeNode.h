@@ -83,6 +83,7 @@
 - (ImpBTreeNode *_Nullable) searchSiblingsForBestMatchingNodeWithComparator:(ImpBTreeRecordKeyComparator _Nonnull)comparator;
 
 ///Search this node for the record with the greatest key that is less than or equal to the quarry. Returns its index. Returns -1 if the first key in this node is greater than the quarry.
+///Records within a node are in key order, so this is a binary search.
 - (int16_t) indexOfBestMatchingRecord:(ImpBTreeRecordKeyComparator _Nonnull)comparator;
 
 #pragma mark Records
@@ -96,6 +97,13 @@
 ///This is for subclasses' use.
 - (bool) forRecordAtIndex:(u_int16_t const)idx getItsOffset:(BTreeNodeOffset *_Nullable const)outThisOffset andTheOneAfterThat:(BTreeNodeOffset *_Nullable const)outNextOffset;
 
+///Returns a pointer to the whole record, key and payload, at the given index within the node, and returns its length by reference. Unlike recordDataAtIndex:, this doesn't create any objects, so it's the one to use for searching. The pointer is only good for as long as the node (and its tree) is alive.
+- (void const *_Nonnull) pointerToRecordAtIndex:(u_int16_t const)idx length:(u_int16_t *_Nullable const)outLength;
+///Returns a pointer to the key of the record at the given index, and returns the key's length (including the key length field) by reference. Only meaningful for index and leaf nodes. The key pointer is the same as the record pointer.
+- (void const *_Nonnull) pointerToKeyOfRecordAtIndex:(u_int16_t const)idx length:(u_int16_t *_Nullable const)outKeyLength;
+///Returns a pointer to the payload of the record at the given index, and returns the payload's length by reference. Only meaningful for index and leaf nodes. Same bytes as recordPayloadDataAtIndex:, without the NSData.
+- (void const *_Nonnull) pointerToPayloadOfRecordAtIndex:(u_int16_t const)idx length:(u_int16_t *_Nullable const)outPayloadLength;
+
 ///Returns the whole catalog record, key and payload, at the given index within the node.
 - (NSData *_Nonnull) recordDataAtIndex:(u_int16_t)idx;
 
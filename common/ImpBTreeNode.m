@@ -7,6 +7,7 @@
 
 #import "ImpBTreeNode.h"
 
+#import <os/lock.h>
 #import "ImpByteOrder.h"
 #import "ImpPrintf.h"
 #import "ImpSizeUtilities.h"
@@ -29,7 +30,9 @@
 @implementation ImpBTreeNode
 {
 	NSData *_nodeData;
-	NSMutableArray <NSData *> *_Nonnull _recordCache;
+	NSArray <NSData *> *_Nullable _recordCache;
+	///Nodes come from the tree's node cache, so several threads (e.g., parallel rehydration workers reading the extents overflow tree) can ask the same node for its records at once. Guards every read and write of the _recordCache pointer; the array itself is built outside the lock and never changed once published.
+	os_unfair_lock _recordCacheLock;
 	bool _dataIsMutable;
 }
 
@@ -92,6 +95,7 @@
 
 		_nodeData = shouldCopyData ? (dataShouldBeMutable ? [nodeData mutableCopy] : [nodeData copy]) : nodeData;
 		_dataIsMutable = dataShouldBeMutable;
+		_recordCacheLock = OS_UNFAIR_LOCK_INIT;
 
 		struct BTNodeDescriptor const *_Nonnull const nodeDescriptor = _nodeData.bytes;
 		_forwardLink = L(nodeDescriptor->fLink);
@@ -273,17 +277,22 @@
 }
 
 - (int16_t) indexOfBestMatchingRecord:(ImpBTreeRecordKeyComparator _Nonnull)comparator {
-	//We *could* bisect this, but there are only likely to be a handful of records in each node, so let's just search linearly.
-	for (u_int16_t i = 0; i < (u_int16_t)_numberOfRecords; ++i) {
-		ImpBTreeComparisonResult const comparisonResult = comparator([self recordDataAtIndex:i].bytes);
+	//Records within a node are sorted by key, so bisect. HFS+ nodes can hold dozens of records, and every tier of every search comes through here.
+	//Find the first record whose key is greater than the quarry; the one before it is the best match. (Incomparable keys are stepped over, as a linear search would.)
+	u_int16_t low = 0, high = _numberOfRecords;
+	while (low < high) {
+		u_int16_t const mid = low + (high - low) / 2;
+		ImpBTreeComparisonResult const comparisonResult = comparator([self pointerToRecordAtIndex:mid length:NULL]);
 		if (comparisonResult == ImpBTreeComparisonQuarryIsEqual) {
-			return i;
+			return mid;
 		} else if (comparisonResult == ImpBTreeComparisonQuarryIsLesser) {
-			return i - 1;
+			high = mid;
+		} else {
+			low = mid + 1;
 		}
 	}
-	//At this point, every record in the node was less than or equal to the quarry, so the last record is the greatest candidate. Return its index.
-	return self.numberOfRecords - 1;
+	//If every record in the node was less than the quarry, this is the last record. If every record was greater, this is -1.
+	return (int16_t)low - 1;
 }
 
 #pragma mark Walking and searching neighbors
@@ -303,18 +312,18 @@
 
 	//First, if the first record in this node is already greater than the quarry, search the previous node.
 //	NSLog(@"%s: Checking first record for need to visit previous sibling", sel_getName(_cmd));
-	if (comparator([self recordDataAtIndex:0].bytes) == ImpBTreeComparisonQuarryIsLesser) {
+	if (comparator([self pointerToRecordAtIndex:0 length:NULL]) == ImpBTreeComparisonQuarryIsLesser) {
 //		NSLog(@"%s: Continuing search in previous sibling", sel_getName(_cmd));
 		return [self.previousNode searchSiblingsForBestMatchingNodeWithComparator:comparator];
 	}
 
 	//If the last record in this node is less than the quarry, check the next node's first record and if it's less than or equal to the quarry, search it.
 //	ImpPrintf(@"%s: Checking last record for need to visit next node", sel_getName(_cmd));
-	if (self.numberOfRecords > 1 && comparator([self recordDataAtIndex:self.numberOfRecords - 1].bytes) == ImpBTreeComparisonQuarryIsGreater) {
+	if (self.numberOfRecords > 1 && comparator([self pointerToRecordAtIndex:self.numberOfRecords - 1 length:NULL]) == ImpBTreeComparisonQuarryIsGreater) {
 		ImpBTreeNode *_Nullable const nextNode = self.nextNode;
 		if (nextNode != nil && nextNode.numberOfRecords > 0) {
 //			ImpPrintf(@"%s: Checking next sibling's first record for need to visit next node", sel_getName(_cmd));
-			ImpBTreeComparisonResult const comparisonResult = comparator([nextNode recordDataAtIndex:0].bytes);
+			ImpBTreeComparisonResult const comparisonResult = comparator([nextNode pointerToRecordAtIndex:0 length:NULL]);
 			if (comparisonResult == ImpBTreeComparisonQuarryIsEqual) {
 //				ImpPrintf(@"%s: Found exact match", sel_getName(_cmd));
 				return nextNode;
@@ -333,13 +342,27 @@
 
 #pragma mark Record access
 
-- (void) buildRecordCache {
+///Return the array of every record's data, building it the first time. If two threads build it at once, the first one published wins, and both get that array.
+- (NSArray <NSData *> *_Nonnull) recordCache {
+	os_unfair_lock_lock(&_recordCacheLock);
+	NSArray <NSData *> *_Nullable recordCache = _recordCache;
+	os_unfair_lock_unlock(&_recordCacheLock);
+	if (recordCache != nil) {
+		return recordCache;
+	}
+
+	NSMutableArray <NSData *> *_Nonnull const newRecordCache = [NSMutableArray arrayWithCapacity:_numberOfRecords];
+	for (u_int16_t i = 0; i < (u_int16_t)_numberOfRecords; ++i) {
+		[newRecordCache addObject:[self recordDataAtIndex_nocache:i]];
+	}
+
+	os_unfair_lock_lock(&_recordCacheLock);
 	if (_recordCache == nil) {
-		_recordCache = [NSMutableArray arrayWithCapacity:_numberOfRecords];
-		for (u_int16_t i = 0; i < (u_int16_t)_numberOfRecords; ++i) {
-			[_recordCache addObject:[self recordDataAtIndex_nocache:i]];
-		}
+		_recordCache = newRecordCache;
 	}
+	recordCache = _recordCache;
+	os_unfair_lock_unlock(&_recordCacheLock);
+	return recordCache;
 }
 
 - (bool) hasKeyedRecords {
@@ -514,11 +537,58 @@
 	return isValidIndex;
 }
 
+- (void const *_Nonnull) pointerToRecordAtIndex:(u_int16_t const)idx length:(u_int16_t *_Nullable const)outLength {
+	NSParameterAssert(idx < _numberOfRecords);
+
+	//Same arithmetic as forRecordAtIndex:getItsOffset:andLength:, inlined because searches call this for every comparison.
+	void const *_Nonnull const nodeBytes = _nodeData.bytes;
+	BTreeNodeOffset const *_Nonnull const offsets = nodeBytes;
+	NSUInteger const bottomOffsetIdx = _nodeData.length / sizeof(BTreeNodeOffset) - 1;
+	BTreeNodeOffset const thisRecordOffset = L(offsets[bottomOffsetIdx - idx]);
+	if (outLength != NULL) {
+		BTreeNodeOffset const nextRecordOffset = L(offsets[bottomOffsetIdx - (idx + 1)]);
+		*outLength = nextRecordOffset - thisRecordOffset;
+	}
+	return nodeBytes + thisRecordOffset;
+}
+
+- (void const *_Nonnull) pointerToKeyOfRecordAtIndex:(u_int16_t const)idx length:(u_int16_t *_Nullable const)outKeyLength {
+	void const *_Nonnull const recordPtr = [self pointerToRecordAtIndex:idx length:NULL];
+	if (outKeyLength != NULL) {
+		u_int16_t const keyLengthSize = self.tree.keyLengthSize;
+		if (keyLengthSize == sizeof(u_int16_t)) {
+			u_int16_t const *_Nonnull const keyLengthPtr = recordPtr;
+			*outKeyLength = L(*keyLengthPtr) + keyLengthSize;
+		} else {
+			u_int8_t const *_Nonnull const keyLengthPtr = recordPtr;
+			*outKeyLength = *keyLengthPtr + keyLengthSize;
+		}
+	}
+	return recordPtr;
+}
+
+- (void const *_Nonnull) pointerToPayloadOfRecordAtIndex:(u_int16_t const)idx length:(u_int16_t *_Nullable const)outPayloadLength {
+	u_int16_t recordLength = 0, keyLength = 0;
+	void const *_Nonnull const recordPtr = [self pointerToRecordAtIndex:idx length:&recordLength];
+	[self pointerToKeyOfRecordAtIndex:idx length:&keyLength];
+
+	u_int16_t payloadOffset = keyLength;
+	u_int16_t payloadLength = recordLength > keyLength ? recordLength - keyLength : 0;
+	//Skip the pad byte after an odd-length key. See recordPayloadDataAtIndex:.
+	if (payloadLength % 2 == 1) {
+		++payloadOffset;
+		--payloadLength;
+	}
+	if (outPayloadLength != NULL) {
+		*outPayloadLength = payloadLength;
+	}
+	return recordPtr + payloadOffset;
+}
+
 - (NSData *_Nonnull) recordDataAtIndex:(u_int16_t)idx {
 	NSParameterAssert(idx < self.numberOfRecords);
 
-	[self buildRecordCache];
-	NSData *_Nonnull const recordData = _recordCache[idx];
+	NSData *_Nonnull const recordData = self.recordCache[idx];
 	NSAssert(recordData != nil, @"Consistency error! Node has %u records, so a record index of %u is valid, but somehow this node didn't have a record for that index.", self.numberOfRecords, idx);
 	return recordData;
 }
@@ -857,7 +927,9 @@
 	//Note that we checked the length above *including* the new offset, so this should succeed.
 	[self pushOffsetOntoRecordOffsetsStack:offsetOfEmptySpace];
 
+	os_unfair_lock_lock(&_recordCacheLock);
 	_recordCache = nil;
+	os_unfair_lock_unlock(&_recordCacheLock);
 
 	return true;
 }
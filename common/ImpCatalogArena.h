@@ -0,0 +1,49 @@
+//
+//  ImpCatalogArena.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-16.
+//
+
+#import <Foundation/Foundation.h>
+
+///A handle to a run of bytes in an ImpCatalogArena: which slab it's in, where it starts in that slab, and how long it is. A slice with length 0 is empty, and may not refer to any storage at all.
+typedef struct ImpCatalogArenaSlice {
+	u_int32_t slabIndex;
+	u_int32_t offset;
+	u_int32_t length;
+} ImpCatalogArenaSlice;
+
+/*!An arena is a set of large buffers (slabs) out of which many small keys and records can be carved, so that building a catalog with hundreds of thousands of items doesn't mean making millions of tiny allocations. Each key or record is identified by an ImpCatalogArenaSlice, which is just a few integers, rather than by an object of its own.
+ *Storage is never freed piecemeal; everything in the arena goes away at once when the arena is deallocated. Slices are never moved, so a pointer to a slice's bytes is good for as long as the arena lives.
+ */
+@interface ImpCatalogArena : NSObject
+
+///Create an arena that allocates slabs of this many bytes at a time. Slices longer than this get a slab to themselves.
+- (instancetype _Nonnull) initWithBytesPerSlab:(u_int32_t const)bytesPerSlab;
+
+///Create an arena with a default slab size of 1 MiB.
+- (instancetype _Nonnull) init;
+
+///Total number of bytes allocated for slabs, including space not yet handed out.
+@property(readonly) u_int64_t numberOfBytesAllocated;
+
+///Carve out a new zero-filled slice.
+- (ImpCatalogArenaSlice) allocateSliceWithLength:(u_int32_t const)length;
+
+///Carve out a new slice and copy these bytes into it.
+- (ImpCatalogArenaSlice) sliceByCopyingBytes:(void const *_Nonnull const)bytes length:(u_int32_t const)length;
+
+///Carve out a new slice and copy the contents of this data object into it.
+- (ImpCatalogArenaSlice) sliceByCopyingData:(NSData *_Nonnull const)data;
+
+///Returns a pointer to the slice's bytes, which you can read or change in place. Returns NULL for an empty slice.
+- (void *_Nullable) mutableBytesOfSlice:(ImpCatalogArenaSlice const)slice;
+
+///Returns a data object whose bytes are the slice's bytes (not a copy). The data object does not retain the arena, so don't use it after the arena has been deallocated.
+- (NSData *_Nonnull) dataForSlice:(ImpCatalogArenaSlice const)slice;
+
+///Shorten a slice. If it was the most recently allocated slice in its slab, the trimmed-off bytes are given back to the slab for reuse.
+- (void) truncateSlice:(ImpCatalogArenaSlice *_Nonnull const)slice toLength:(u_int32_t const)newLength;
+
+@end
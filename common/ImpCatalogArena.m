@@ -0,0 +1,126 @@
+//
+//  ImpCatalogArena.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-16.
+//
+
+#import "ImpCatalogArena.h"
+
+#import "ImpPerformanceCounters.h"
+
+enum {
+	ImpCatalogArenaDefaultBytesPerSlab = 1048576,
+	///Every slice starts on a multiple of this, so that structures laid over a slice's bytes are aligned.
+	ImpCatalogArenaAlignment = 8,
+};
+
+@implementation ImpCatalogArena
+{
+	NSMutableArray <NSMutableData *> *_Nonnull _slabs;
+	///Array of void *, one for each slab's mutableBytes, so we don't have to go through NSArray and NSData for every lookup.
+	NSMutableData *_Nonnull _slabBasePointersData;
+	u_int32_t _bytesPerSlab;
+	///How much of the last slab has been handed out.
+	u_int32_t _numBytesUsedInLastSlab;
+}
+
+- (instancetype _Nonnull) initWithBytesPerSlab:(u_int32_t const)bytesPerSlab {
+	if ((self = [super init])) {
+		_bytesPerSlab = bytesPerSlab > 0 ? bytesPerSlab : ImpCatalogArenaDefaultBytesPerSlab;
+		_slabs = [NSMutableArray array];
+		_slabBasePointersData = [NSMutableData data];
+	}
+	return self;
+}
+
+- (instancetype _Nonnull) init {
+	return [self initWithBytesPerSlab:ImpCatalogArenaDefaultBytesPerSlab];
+}
+
+- (void) dealloc {
+	ImpPerformanceBufferFreed(self.numberOfBytesAllocated);
+}
+
+- (NSString *_Nonnull) description {
+	return [NSString stringWithFormat:@"<%@ %p with %lu slabs totaling %llu bytes>", self.class, self, (unsigned long)_slabs.count, self.numberOfBytesAllocated];
+}
+
+- (u_int64_t) numberOfBytesAllocated {
+	u_int64_t total = 0;
+	for (NSData *_Nonnull const slab in _slabs) {
+		total += slab.length;
+	}
+	return total;
+}
+
+- (void) addSlabWithLength:(u_int32_t const)length {
+	NSMutableData *_Nonnull const slab = [NSMutableData dataWithLength:length];
+	[_slabs addObject:slab];
+	ImpPerformanceBufferAllocated(length);
+	void *_Nonnull const basePtr = slab.mutableBytes;
+	[_slabBasePointersData appendBytes:&basePtr length:sizeof(basePtr)];
+	_numBytesUsedInLastSlab = 0;
+}
+
+- (ImpCatalogArenaSlice) allocateSliceWithLength:(u_int32_t const)length {
+	if (length == 0) {
+		return (ImpCatalogArenaSlice){ 0, 0, 0 };
+	}
+
+	u_int32_t const alignedOffset = (_numBytesUsedInLastSlab + (ImpCatalogArenaAlignment - 1)) & ~(u_int32_t)(ImpCatalogArenaAlignment - 1);
+	bool const fitsInLastSlab = _slabs.count > 0 && alignedOffset <= _slabs.lastObject.length && length <= _slabs.lastObject.length - alignedOffset;
+	if (! fitsInLastSlab) {
+		//Oversized slices get a slab of their own. Since that slab will be full, the next slice will start a new regular-sized slab.
+		[self addSlabWithLength:MAX(length, _bytesPerSlab)];
+		ImpCatalogArenaSlice const slice = { (u_int32_t)(_slabs.count - 1), 0, length };
+		_numBytesUsedInLastSlab = length;
+		return slice;
+	}
+
+	ImpCatalogArenaSlice const slice = { (u_int32_t)(_slabs.count - 1), alignedOffset, length };
+	_numBytesUsedInLastSlab = alignedOffset + length;
+	return slice;
+}
+
+- (ImpCatalogArenaSlice) sliceByCopyingBytes:(void const *_Nonnull const)bytes length:(u_int32_t const)length {
+	ImpCatalogArenaSlice const slice = [self allocateSliceWithLength:length];
+	if (length > 0) {
+		memcpy([self mutableBytesOfSlice:slice], bytes, length);
+	}
+	return slice;
+}
+
+- (ImpCatalogArenaSlice) sliceByCopyingData:(NSData *_Nonnull const)data {
+	NSParameterAssert(data.length <= UINT32_MAX);
+	return [self sliceByCopyingBytes:data.bytes length:(u_int32_t)data.length];
+}
+
+- (void *_Nullable) mutableBytesOfSlice:(ImpCatalogArenaSlice const)slice {
+	if (slice.length == 0) {
+		return NULL;
+	}
+	void *_Nonnull const *_Nonnull const basePointers = _slabBasePointersData.bytes;
+	return basePointers[slice.slabIndex] + slice.offset;
+}
+
+- (NSData *_Nonnull) dataForSlice:(ImpCatalogArenaSlice const)slice {
+	if (slice.length == 0) {
+		return [NSData data];
+	}
+	return [NSData dataWithBytesNoCopy:[self mutableBytesOfSlice:slice] length:slice.length freeWhenDone:false];
+}
+
+- (void) truncateSlice:(ImpCatalogArenaSlice *_Nonnull const)slice toLength:(u_int32_t const)newLength {
+	if (newLength >= slice->length) {
+		return;
+	}
+
+	bool const isLastSliceInLastSlab = (slice->slabIndex == _slabs.count - 1) && (slice->offset + slice->length == _numBytesUsedInLastSlab);
+	if (isLastSliceInLastSlab) {
+		_numBytesUsedInLastSlab = slice->offset + newLength;
+	}
+	slice->length = newLength;
+}
+
+@end
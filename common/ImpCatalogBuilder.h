@@ -29,14 +29,20 @@
 ///An idea of what tree depth to expect. You could set this to the tree depth of a source tree being converted. Set it to 0 if you're not sure.
 @property u_int16_t treeDepthHint;
 
-///Add a file record to the new tree's leaf row. The layout of the key and payload must be consistent with the version of tree being built (i.e., they must be HFS+ if the version is HFS+) and with each other (an HFS+ file record for an HFS+ key).
-- (ImpCatalogItem *_Nonnull const) addKey:(NSMutableData *_Nonnull const)keyData fileRecord:(NSMutableData *_Nonnull const)payloadData;
+/*!If nonzero, an approximate limit on how much memory the builder uses for sorting and laying out the tree. Key-value pairs are sorted in batches that fit in this budget, each batch is spilled to a temporary file, and the batches are merged back together as the leaf row is laid out; each index row is likewise spilled as it's built and read back to build the row above it. So the builder never holds more than one node per row, plus the merge buffers.
+ *Note that the items themselves (and their keys and records) are still held until the tree is populated, since clients can revise them up until then.
+ *If zero (the default), the whole tree is laid out in memory. Set this before calling totalNodeCount.
+ */
+@property NSUInteger memoryBudgetInBytes;
+
+///Add a file record to the new tree's leaf row. The key and payload are copied into the builder's own storage, so the caller is free to reuse the same data objects for the next item. The layout of the key and payload must be consistent with the version of tree being built (i.e., they must be HFS+ if the version is HFS+) and with each other (an HFS+ file record for an HFS+ key).
+- (ImpCatalogItem *_Nonnull const) addKey:(NSData *_Nonnull const)keyData fileRecord:(NSData *_Nonnull const)payloadData;
 
 ///Add a folder record to the new tree's leaf row. The layout of the key and payload must be consistent with the version of tree being built (i.e., they must be HFS+ if the version is HFS+) and with each other (an HFS+ folder record for an HFS+ key).
-- (ImpCatalogItem *_Nonnull const) addKey:(NSMutableData *_Nonnull const)keyData folderRecord:(NSMutableData *_Nonnull const)payloadData;
+- (ImpCatalogItem *_Nonnull const) addKey:(NSData *_Nonnull const)keyData folderRecord:(NSData *_Nonnull const)payloadData;
 
 ///Add a thread record to the new tree's leaf row. The layout of the key and payload must be consistent with the version of tree being built (i.e., they must be HFS+ if the version is HFS+) and with each other (an HFS+ thread record for an HFS+ key).
-- (ImpCatalogItem *_Nonnull const) addKey:(NSMutableData *_Nonnull const)keyData threadRecord:(NSMutableData *_Nonnull const)payloadData;
+- (ImpCatalogItem *_Nonnull const) addKey:(NSData *_Nonnull const)keyData threadRecord:(NSData *_Nonnull const)payloadData;
 
 ///The number of nodes required to hold the entire tree so far, including the header node, any map nodes, and any index nodes.
 - (NSUInteger) totalNodeCount;
@@ -48,7 +54,8 @@
 - (void) catalogItemsAreDirty;
 
 ///Populate a real tree with the records added so far. Note that this method does not work incrementally, so it should only be used on a real tree. Create the tree with a number of nodes equal to or greater than totalNodeCount.
-- (void) populateTree:(ImpMutableBTreeFile *_Nonnull const)tree;
+///Returns false if the tree is being built under a memory budget and the records couldn't be spilled to or read back from temporary files. In that case, the tree is incomplete and must not be written out.
+- (bool) populateTree:(ImpMutableBTreeFile *_Nonnull const)tree error:(NSError *_Nullable *_Nullable const)outError;
 
 #pragma mark Creation of original files
 
@@ -74,16 +81,20 @@
 ///The item's file or folder record. This version of the record comes from the source volume.
 @property(strong) NSData *_Nullable sourceRecord;
 ///The key for the item's file or folder record, containing its parent item CNID and its own name. This version of the key has been converted for the destination volume.
-@property(strong) NSMutableData *_Nullable destinationKey;
-///The item's file or folder record, converted for the destination volume.
-@property(strong) NSMutableData *_Nullable destinationRecord;
+///This and the other destination properties return views into storage owned by the catalog builder, and are only valid as long as the item is.
+@property(readonly) NSData *_Nullable destinationKey;
+///The item's file or folder record, converted for the destination volume. To change it, use reviseDestinationRecord:.
+@property(readonly) NSData *_Nullable destinationRecord;
 ///The key for the item's thread record, containing its own CNID. This version of the key comes from the source volume.
 @property(strong) NSData *_Nullable sourceThreadKey;
 ///The thread record, containing the item's parent CNID and its own name. This version of the key comes from the source volume.
 @property(strong) NSData *_Nullable sourceThreadRecord;
 ///The key for the item's thread record, containing its own CNID. This version of the key has been converted for the destination volume.
-@property(strong) NSMutableData *_Nullable destinationThreadKey;
+@property(readonly) NSData *_Nullable destinationThreadKey;
 ///The thread record, containing the item's parent CNID and its own name. This version of the key has been converted for the destination volume.
-@property(strong) NSMutableData *_Nullable destinationThreadRecord;
+@property(readonly) NSData *_Nullable destinationThreadRecord;
+
+///Change the item's destination file or folder record in place (e.g., to fill in extents once they've been allocated). The record's length can't be changed. After revising any items that have already been laid out, call catalogItemsAreDirty on the builder.
+- (void) reviseDestinationRecord:(void (^_Nonnull const)(void *_Nonnull const bytes, NSUInteger const length))block;
 
 @end
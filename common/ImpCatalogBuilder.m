@@ -8,11 +8,15 @@
 #import "ImpCatalogBuilder.h"
 
 #import "ImpTextEncodingConverter.h"
+#import "ImpCatalogArena.h"
 #import "ImpBTreeFile.h"
 #import "ImpMutableBTreeFile.h"
 #import "ImpBTreeNode.h"
 #import "ImpBTreeHeaderNode.h"
 #import "ImpBTreeIndexNode.h"
+#import "ImpTrace.h"
+
+#import <stdio.h>
 
 #pragma mark Prologue: Interfaces of the helper classes
 
@@ -40,6 +44,9 @@
 
 - (instancetype _Nonnull)initWithKey:(NSData *_Nonnull const)keyData value:(NSData *_Nonnull const)valueData;
 
+///Create a pair whose key is an HFS+ catalog key, along with that key's name as folded by ImpHFSPlusFoldName. The folded name is not copied, so it must last as long as the pair does. Pairs created this way compare with each other without folding their names again.
+- (instancetype _Nonnull)initWithKey:(NSData *_Nonnull const)keyData value:(NSData *_Nonnull const)valueData foldedName:(UniChar const *_Nullable const)foldedUnits length:(NSUInteger const)numFoldedUnits;
+
 @property(strong) NSData *key;
 @property(strong) NSData *value;
 
@@ -49,6 +56,22 @@
 
 @property(readwrite, strong) ImpCatalogItemIdentifier *_Nonnull identifier;
 
+///The arena holding the item's destination keys and records. Every item from the same builder shares the same arena.
+@property(strong) ImpCatalogArena *_Nullable arena;
+@property(nonatomic) ImpCatalogArenaSlice destinationKeySlice;
+@property(nonatomic) ImpCatalogArenaSlice destinationRecordSlice;
+@property(nonatomic) ImpCatalogArenaSlice destinationThreadKeySlice;
+@property(nonatomic) ImpCatalogArenaSlice destinationThreadRecordSlice;
+///The name from destinationKey, folded for comparison. Empty if the key isn't an HFS+ key (or the name folds down to nothing).
+@property(nonatomic) ImpCatalogArenaSlice destinationFoldedNameSlice;
+///The name from destinationThreadKey, folded for comparison. Since thread keys have empty names, this is normally empty too.
+@property(nonatomic) ImpCatalogArenaSlice destinationThreadFoldedNameSlice;
+
+///Make a pair from the item's destination key and its file or folder record.
+- (ImpCatalogKeyValuePair *_Nonnull) destinationKeyValuePair;
+///Make a pair from the item's destination thread key and thread record.
+- (ImpCatalogKeyValuePair *_Nonnull) destinationThreadKeyValuePair;
+
 @end
 
 ///Pared-down substitute for ImpBTreeNode, which needs to be backed by a complete tree. This is used in making a new tree.
@@ -85,6 +108,53 @@
 
 @end
 
+///A batch of key-value pairs that has been sorted and written out to a temporary file, so it doesn't need to stay in memory. Used when building under a memory budget: the builder spills one of these for every budget's worth of pairs, then merges them all back together to produce the leaf row in order.
+@interface ImpCatalogSpilledRun : NSObject
+
+///Sort the pairs and write them to a temporary file. The temporary file is deleted when the run is deallocated. Returns nil if the temporary file couldn't be created or written to.
+- (instancetype _Nullable) initBySpillingPairs:(NSMutableArray <ImpCatalogKeyValuePair *> *_Nonnull const)pairs;
+
+///Seek back to the start of the run and prepare to read it using a buffer of (approximately) this many bytes. Returns false if the temporary file couldn't be reopened for reading.
+- (bool) rewindWithBufferSize:(size_t const)bufferSize;
+
+///Read the next pair into currentKey and currentValue. Returns false at the end of the run.
+- (bool) readNextPair;
+
+///The key most recently read by readNextPair. This object is reused for every pair, so copy it if you need to keep it.
+@property(nonatomic, readonly) NSData *_Nonnull currentKey;
+///The record most recently read by readNextPair. This object is reused for every pair, so copy it if you need to keep it.
+@property(nonatomic, readonly) NSData *_Nonnull currentValue;
+
+///Compare this run's current key with another run's current key, using the names that were folded when the keys were read.
+- (NSComparisonResult) compareCurrentKeyWithCurrentKeyOfRun:(ImpCatalogSpilledRun *_Nonnull const)otherRun;
+
+@end
+
+///Lays out one row of a tree using the same rules as ImpMockNode, but only keeps the node currently being filled. The first key and node number of each node in the row are spilled to a temporary file as the node is started; reading those back provides the pointer records for the row above.
+///If given a real tree, the row builder writes records into real nodes as it goes. Otherwise, it only counts nodes.
+@interface ImpStreamingRowBuilder : NSObject
+
+- (instancetype _Nullable) initWithCapacity:(u_int32_t const)maxNumBytes
+	nodeKind:(BTreeNodeKind const)kind
+	height:(u_int8_t const)height
+	tree:(ImpMutableBTreeFile *_Nullable const)destTree;
+
+@property(readonly) u_int8_t nodeHeight;
+@property(readonly) u_int32_t numberOfNodes;
+@property(readonly) u_int32_t numberOfRecords;
+///The node number of the first node in the row, or 0 if there's no real tree (or no nodes yet).
+@property(readonly) u_int32_t firstNodeNumber;
+///The node number of the last node in the row, or 0 if there's no real tree (or no nodes yet).
+@property(readonly) u_int32_t lastNodeNumber;
+
+///Append a record to the row, starting a new node if it won't fit in the current one. Returns false if it won't even fit in an empty node, or the spill file couldn't be written to.
+- (bool) appendKey:(NSData *_Nonnull const)keyData payload:(NSData *_Nonnull const)payloadData;
+
+///Read back the first key and node number of every node in the row, in order. Returns false if the spill file couldn't be read.
+- (bool) forEachNodeFirstKey:(void (^_Nonnull const)(NSData *_Nonnull const keyData, u_int32_t const nodeNumber))block;
+
+@end
+
 static u_int16_t ImpGetCatalogKeyType(NSData *_Nonnull const keyData) {
 	if (keyData.length < sizeof(u_int16_t)) {
 		return 0;
@@ -107,6 +177,37 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 	return 0;
 }
 
+///Order two catalog keys the way they'll be ordered in the tree. HFS keys sort before HFS+ keys, though a single tree should never contain both.
+static NSComparisonResult ImpCompareCatalogKeyData(NSData *_Nonnull const keyData, NSData *_Nonnull const otherKeyData) {
+	ImpBTreeVersion const thisVersion = ImpGetCatalogKeyVersion(keyData);
+	ImpBTreeVersion const otherVersion = ImpGetCatalogKeyVersion(otherKeyData);
+	if (thisVersion == ImpBTreeVersionHFSCatalog && otherVersion == ImpBTreeVersionHFSPlusCatalog) {
+		return NSOrderedAscending;
+	} else if (thisVersion == ImpBTreeVersionHFSPlusCatalog && otherVersion == ImpBTreeVersionHFSCatalog) {
+		return NSOrderedDescending;
+	} else if (thisVersion == ImpBTreeVersionHFSPlusCatalog) {
+		return (NSComparisonResult)ImpBTreeCompareHFSPlusCatalogKeys(keyData.bytes, otherKeyData.bytes);
+	} else if (thisVersion == ImpBTreeVersionHFSCatalog) {
+		return (NSComparisonResult)ImpBTreeCompareHFSCatalogKeys(keyData.bytes, otherKeyData.bytes);
+	} else {
+		return NSOrderedSame;
+	}
+}
+
+///Stand-in for the folded units of a name that folds down to nothing, since an empty arena slice has no bytes to point to.
+static UniChar const ImpEmptyFoldedName[1] = { 0 };
+
+///Order two HFS+ catalog keys by parent ID and then by name, given their names already folded by ImpHFSPlusFoldName.
+static NSComparisonResult ImpCompareFoldedCatalogKeys(HFSCatalogNodeID const parentID, UniChar const *_Nonnull const foldedUnits, NSUInteger const numFoldedUnits, HFSCatalogNodeID const otherParentID, UniChar const *_Nonnull const otherFoldedUnits, NSUInteger const otherNumFoldedUnits) {
+	if (parentID < otherParentID) {
+		return NSOrderedAscending;
+	}
+	if (parentID > otherParentID) {
+		return NSOrderedDescending;
+	}
+	return ImpHFSPlusCompareFoldedNames(foldedUnits, numFoldedUnits, otherFoldedUnits, otherNumFoldedUnits);
+}
+
 #pragma mark -
 #pragma mark And now, the actual implementation
 
@@ -126,6 +227,8 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 	NSMutableDictionary <ImpCatalogItemIdentifier *, ImpCatalogItem *> *_Nonnull _sourceItemsByIdentifier;
 	NSMutableSet <ImpCatalogItem *> *_Nonnull _sourceItemsThatNeedThreadRecords;
 	NSMutableArray <ImpCatalogItem *> *_Nonnull _allSourceItems;
+	///Storage for all items' destination keys and records.
+	ImpCatalogArena *_Nonnull _arena;
 
 	NSMutableArray <NSArray <ImpMockNode *> *> *_Nullable _mockRows;
 	NSMutableArray <ImpMockIndexNode *> *_Nullable _allMockIndexNodes;
@@ -137,6 +240,8 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 	u_int32_t _numLiveNodes;
 	u_int16_t _nodeSize;
 	bool _treeIsBuilt;
+	///True if the tree was laid out from spilled runs (under a memory budget) rather than as mock nodes. In that case, there are no mock rows, and populateTree: lays out the tree again from scratch.
+	bool _treeIsStreamed;
 }
 
 - (instancetype _Nullable) initWithBTreeVersion:(ImpBTreeVersion const)version
@@ -149,6 +254,7 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 		_sourceItemsByIdentifier = [NSMutableDictionary dictionaryWithCapacity:numItems];
 		_sourceItemsThatNeedThreadRecords = [NSMutableSet setWithCapacity:numItems];
 		_allSourceItems = [NSMutableArray arrayWithCapacity:numItems];
+		_arena = [ImpCatalogArena new];
 
 		//_mockRows, _allMockIndexNodes, and _allKeyValuePairs are created during buildMockTree.
 
@@ -169,7 +275,20 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 	}
 }
 
-- (ImpCatalogItem *_Nonnull const) addKey:(NSMutableData *_Nonnull const)keyData fileRecord:(NSMutableData *_Nonnull const)payloadData {
+///Fold the name in a destination key once, when the key is added, so that sorting the leaf row doesn't have to fold it again for every comparison. Returns an empty slice for keys that aren't HFS+ catalog keys.
+- (ImpCatalogArenaSlice) foldedNameSliceForKeyData:(NSData *_Nonnull const)keyData {
+	if (ImpGetCatalogKeyVersion(keyData) != ImpBTreeVersionHFSPlusCatalog) {
+		return (ImpCatalogArenaSlice){ 0, 0, 0 };
+	}
+
+	struct HFSPlusCatalogKey const *_Nonnull const keyPtr = keyData.bytes;
+	ImpCatalogArenaSlice slice = [_arena allocateSliceWithLength:ImpHFSPlusFoldedNameMaximumLength * sizeof(UniChar)];
+	NSUInteger const numFoldedUnits = ImpHFSPlusFoldName(&keyPtr->nodeName, [_arena mutableBytesOfSlice:slice]);
+	[_arena truncateSlice:&slice toLength:(u_int32_t)(numFoldedUnits * sizeof(UniChar))];
+	return slice;
+}
+
+- (ImpCatalogItem *_Nonnull const) addKey:(NSData *_Nonnull const)keyData fileRecord:(NSData *_Nonnull const)payloadData {
 	[self invalidateMockTree];
 
 	void const *_Nonnull const payloadPtr = payloadData.bytes;
@@ -188,20 +307,22 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 //		ImpPrintf(@"📄 Found existing item for %@: %@", identifier, item);
 	}else {
 		item = [[ImpCatalogItem alloc] initWithIdentifier:identifier];
+		item.arena = _arena;
 		_sourceItemsByIdentifier[identifier] = item;
 		[_allSourceItems addObject:item];
 		[_sourceItemsThatNeedThreadRecords addObject:item];
 //		ImpPrintf(@"📄 Created item for %@: %@", identifier, item);
 	}
 
-	item.destinationKey = keyData;
-	item.destinationRecord = payloadData;
+	item.destinationKeySlice = [_arena sliceByCopyingData:keyData];
+	item.destinationRecordSlice = [_arena sliceByCopyingData:payloadData];
+	item.destinationFoldedNameSlice = [self foldedNameSliceForKeyData:keyData];
 //	ImpPrintf(@"📄 Item is updated: %@", item);
 
 	return item;
 }
 
-- (ImpCatalogItem *_Nonnull const) addKey:(NSMutableData *_Nonnull const)keyData folderRecord:(NSMutableData *_Nonnull const)payloadData {
+- (ImpCatalogItem *_Nonnull const) addKey:(NSData *_Nonnull const)keyData folderRecord:(NSData *_Nonnull const)payloadData {
 	[self invalidateMockTree];
 
 	void const *_Nonnull const payloadPtr = payloadData.bytes;
@@ -220,20 +341,22 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 //		ImpPrintf(@"📁 Found existing item for %@: %@", identifier, item);
 	} else {
 		item = [[ImpCatalogItem alloc] initWithIdentifier:identifier];
+		item.arena = _arena;
 		_sourceItemsByIdentifier[identifier] = item;
 		[_allSourceItems addObject:item];
 		[_sourceItemsThatNeedThreadRecords addObject:item];
 //		ImpPrintf(@"📁 Created item for %@: %@", identifier, item);
 	}
 
-	item.destinationKey = keyData;
-	item.destinationRecord = payloadData;
+	item.destinationKeySlice = [_arena sliceByCopyingData:keyData];
+	item.destinationRecordSlice = [_arena sliceByCopyingData:payloadData];
+	item.destinationFoldedNameSlice = [self foldedNameSliceForKeyData:keyData];
 //	ImpPrintf(@"📁 Item is updated: %@", item);
 
 	return item;
 }
 
-- (ImpCatalogItem *_Nonnull const) addKey:(NSMutableData *_Nonnull const)keyData threadRecord:(NSMutableData *_Nonnull const)payloadData {
+- (ImpCatalogItem *_Nonnull const) addKey:(NSData *_Nonnull const)keyData threadRecord:(NSData *_Nonnull const)payloadData {
 	[self invalidateMockTree];
 
 	void const *_Nonnull const keyPtr = keyData.bytes;
@@ -252,6 +375,7 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 	ImpCatalogItem *_Nullable item = _sourceItemsByIdentifier[identifier];
 	if (item == nil) {
 		item = [[ImpCatalogItem alloc] initWithIdentifier:identifier];
+		item.arena = _arena;
 		_sourceItemsByIdentifier[identifier] = item;
 		[_allSourceItems addObject:item];
 //		ImpPrintf(@"🧵 Created item for %@: %@", identifier, item);
@@ -260,8 +384,9 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 		[_sourceItemsThatNeedThreadRecords removeObject:item];
 	}
 
-	item.destinationThreadKey = keyData;
-	item.destinationThreadRecord = payloadData;
+	item.destinationThreadKeySlice = [_arena sliceByCopyingData:keyData];
+	item.destinationThreadRecordSlice = [_arena sliceByCopyingData:payloadData];
+	item.destinationThreadFoldedNameSlice = [self foldedNameSliceForKeyData:keyData];
 	item.needsThreadRecord = false;
 //	ImpPrintf(@"🧵 Item is updated: %@", item);
 
@@ -275,13 +400,12 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 		struct HFSCatalogKey const *_Nonnull const keyPtr = keyData.bytes;
 //		ImpPrintf(@"Item %p “%@” needs thread record: %@", item, [ImpBTreeNode describeHFSCatalogKeyWithData:keyData], item.needsThreadRecord ? @"YES" : @"NO");
 		if (item.needsThreadRecord) {
-			NSMutableData *_Nonnull const threadKeyData = [NSMutableData dataWithLength:sizeof(struct HFSCatalogKey)];
-			struct HFSCatalogKey *_Nonnull const threadKeyPtr = threadKeyData.mutableBytes;
-			NSMutableData *_Nonnull const threadRecData = [NSMutableData dataWithLength:sizeof(struct HFSCatalogThread)];
-			struct HFSCatalogThread *_Nonnull const threadRecPtr = threadRecData.mutableBytes;
+			ImpCatalogArenaSlice threadKeySlice = [_arena allocateSliceWithLength:sizeof(struct HFSCatalogKey)];
+			struct HFSCatalogKey *_Nonnull const threadKeyPtr = [_arena mutableBytesOfSlice:threadKeySlice];
+			ImpCatalogArenaSlice threadRecSlice = [_arena allocateSliceWithLength:sizeof(struct HFSCatalogThread)];
+			struct HFSCatalogThread *_Nonnull const threadRecPtr = [_arena mutableBytesOfSlice:threadRecSlice];
 
-			NSMutableData *_Nonnull const recData = item.destinationRecord;
-			void *_Nonnull const recPtr = recData.mutableBytes;
+			void *_Nonnull const recPtr = [_arena mutableBytesOfSlice:item.destinationRecordSlice];
 			int16_t const *_Nonnull const recTypePtr = recPtr;
 			struct HFSCatalogFile *_Nonnull const filePtr = recPtr;
 			struct HFSCatalogFolder *_Nonnull const folderPtr = recPtr;
@@ -306,16 +430,16 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 			memcpy(&threadRecPtr->nodeName, &keyPtr->nodeName, sizeof(threadRecPtr->nodeName));
 			//DiskWarrior complains about “oversized thread records” if the thread payload contains empty space. Plus, shrinking these down frees up space in the node for more records.
 			u_int32_t const threadRecSize = sizeof(threadRecPtr->recordType) + sizeof(threadRecPtr->reserved) + sizeof(threadRecPtr->parentID) + sizeof(threadRecPtr->nodeName[0]) + sizeof(unsigned char) * L(threadRecPtr->nodeName[0]);
-			[threadRecData setLength:threadRecSize];
+			[_arena truncateSlice:&threadRecSlice toLength:threadRecSize];
 
 			//A thread key has a CNID and an empty node name (so, length 0). keyLength doesn't include itself.
 			u_int16_t const threadKeySize = sizeof(threadKeyPtr->keyLength) + sizeof(threadKeyPtr->parentID) + sizeof(threadKeyPtr->nodeName[0]);
 			u_int16_t const threadKeyLength = threadKeySize - sizeof(threadKeyPtr->keyLength);
 			S(threadKeyPtr->keyLength, threadKeyLength);
-			[threadKeyData setLength:threadKeySize];
+			[_arena truncateSlice:&threadKeySlice toLength:threadKeySize];
 
-			item.destinationThreadKey = threadKeyData;
-			item.destinationThreadRecord = threadRecData;
+			item.destinationThreadKeySlice = threadKeySlice;
+			item.destinationThreadRecordSlice = threadRecSlice;
 			item.needsThreadRecord = false;
 		}
 	}
@@ -328,13 +452,12 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 		struct HFSPlusCatalogKey const *_Nonnull const keyPtr = keyData.bytes;
 //			ImpPrintf(@"Item %p “%@” needs thread record: %@", item, [ImpBTreeNode describeHFSPlusCatalogKeyWithData:keyData], item.needsThreadRecord ? @"YES" : @"NO");
 		if (item.needsThreadRecord) {
-			NSMutableData *_Nonnull const threadKeyData = [NSMutableData dataWithLength:sizeof(struct HFSPlusCatalogKey)];
-			struct HFSPlusCatalogKey *_Nonnull const threadKeyPtr = threadKeyData.mutableBytes;
-			NSMutableData *_Nonnull const threadRecData = [NSMutableData dataWithLength:sizeof(struct HFSPlusCatalogThread)];
-			struct HFSPlusCatalogThread *_Nonnull const threadRecPtr = threadRecData.mutableBytes;
+			ImpCatalogArenaSlice threadKeySlice = [_arena allocateSliceWithLength:sizeof(struct HFSPlusCatalogKey)];
+			struct HFSPlusCatalogKey *_Nonnull const threadKeyPtr = [_arena mutableBytesOfSlice:threadKeySlice];
+			ImpCatalogArenaSlice threadRecSlice = [_arena allocateSliceWithLength:sizeof(struct HFSPlusCatalogThread)];
+			struct HFSPlusCatalogThread *_Nonnull const threadRecPtr = [_arena mutableBytesOfSlice:threadRecSlice];
 
-			NSMutableData *_Nonnull const recData = item.destinationRecord;
-			void *_Nonnull const recPtr = recData.mutableBytes;
+			void *_Nonnull const recPtr = [_arena mutableBytesOfSlice:item.destinationRecordSlice];
 			int16_t const *_Nonnull const recTypePtr = recPtr;
 			struct HFSPlusCatalogFile *_Nonnull const filePtr = recPtr;
 			struct HFSPlusCatalogFolder *_Nonnull const folderPtr = recPtr;
@@ -359,16 +482,17 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 			memcpy(&threadRecPtr->nodeName, &keyPtr->nodeName, sizeof(threadRecPtr->nodeName));
 			//DiskWarrior complains about “oversized thread records” if the thread payload contains empty space. Plus, shrinking these down frees up space in the node for more records.
 			u_int32_t const threadRecSize = sizeof(threadRecPtr->recordType) + sizeof(threadRecPtr->reserved) + sizeof(threadRecPtr->parentID) + sizeof(threadRecPtr->nodeName.length) + sizeof(UniChar) * L(threadRecPtr->nodeName.length);
-			[threadRecData setLength:threadRecSize];
+			[_arena truncateSlice:&threadRecSlice toLength:threadRecSize];
 
 			//A thread key has a CNID and an empty node name (so, length 0). keyLength doesn't include itself.
 			u_int16_t const threadKeySize = sizeof(threadKeyPtr->keyLength) + sizeof(threadKeyPtr->parentID) + sizeof(threadKeyPtr->nodeName.length);
 			u_int16_t const threadKeyLength = threadKeySize - sizeof(threadKeyPtr->keyLength);
 			S(threadKeyPtr->keyLength, threadKeyLength);
-			[threadKeyData setLength:threadKeySize];
+			[_arena truncateSlice:&threadKeySlice toLength:threadKeySize];
 
-			item.destinationThreadKey = threadKeyData;
-			item.destinationThreadRecord = threadRecData;
+			item.destinationThreadKeySlice = threadKeySlice;
+			item.destinationThreadRecordSlice = threadRecSlice;
+			item.destinationThreadFoldedNameSlice = [self foldedNameSliceForKeyData:item.destinationThreadKey];
 			item.needsThreadRecord = false;
 		}
 	}
@@ -376,6 +500,7 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 
 - (void) buildMockTree {
 	if (! _treeIsBuilt) {
+		ImpTraceTimestamp const traceStart = ImpTraceBegin();
 		/*We can't just convert leaf records straight across in the same order, for three reasons:
 		 *- For files, we probably need to add a thread record (optional in HFS, mandatory in HFS+).
 		 *- File thread records may be at a very different position in the leaf row from the corresponding file record, because the file thread record's key has the file ID as its “parent ID”, whereas the file record's key has the actual parent (directory) of the file. These are two different CNIDs and cannot be assumed to be anywhere near each other in the number sequence.
@@ -393,6 +518,14 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 			[self fillInHFSPlusThreadRecords];
 		}
 
+		//Under a memory budget, we only need to count the nodes for now. populateTree: will go through the same layout again, writing into real nodes this time.
+		if (self.memoryBudgetInBytes > 0 && [self layOutTreeFromSpilledRunsIntoTree:nil]) {
+			_treeIsStreamed = true;
+			_treeIsBuilt = true;
+			ImpTraceEndWithArguments(traceStart, "catalog", "buildMockTree", "items", _allSourceItems.count, NULL, 0);
+			return;
+		}
+
 		//Now all of our items have both a file or folder record and a thread record. Each of these is filed under a different key in the catalog file, due to their different purposes. (File and folder records are stored under a key containing their parent item's CNID; thread records are stored under a key containing the item's own CNID, for the purpose of finding the parent ID stored in the thread record.) So turn our list of n items into n * 2 key-value pairs, half of them being file or folder records and half being thread records. These will be the contents of the leaf row.
 		_allKeyValuePairs = [NSMutableArray arrayWithCapacity:_allSourceItems.count];
 		for (ImpCatalogItem *_Nonnull const item in _allSourceItems) {
@@ -403,8 +536,8 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 //			if (item.destinationThreadKey != nil) ImpPrintf(@"\tDestination thread key %@", [ImpBTreeNode describeHFSPlusCatalogKeyWithData:item.destinationThreadKey]);
 //			if (item.destinationThreadRecord != nil) ImpPrintf(@"\tDestination thread record %@", [ImpBTreeNode describeHFSPlusCatalogThreadRecordWithData:item.destinationThreadRecord]);
 
-			[_allKeyValuePairs addObject:[[ImpCatalogKeyValuePair alloc] initWithKey:item.destinationKey value:item.destinationRecord]];
-			[_allKeyValuePairs addObject:[[ImpCatalogKeyValuePair alloc] initWithKey:item.destinationThreadKey value:item.destinationThreadRecord]];
+			[_allKeyValuePairs addObject:[item destinationKeyValuePair]];
+			[_allKeyValuePairs addObject:[item destinationThreadKeyValuePair]];
 		}
 		[_allKeyValuePairs sortUsingSelector:@selector(caseInsensitiveCompare:)];
 
@@ -472,25 +605,31 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 			[_allMockIndexNodes addObjectsFromArray:upperRow];
 			[_mockRows insertObject:upperRow atIndex:0];
 
-			if (_largestCNIDYet < UINT32_MAX) {
-				self.nextCatalogNodeID = _largestCNIDYet + 1;
-				self.hasReusedCatalogNodeIDs = false;
-			} else {
-				self.nextCatalogNodeID = _firstUnusedCNID;
-				self.hasReusedCatalogNodeIDs = true;
-			}
+			[self chooseNextCatalogNodeID];
 		}
 
 		_treeIsBuilt = true;
+		ImpTraceEndWithArguments(traceStart, "catalog", "buildMockTree", "items", _allSourceItems.count, "nodes", _numLiveNodes);
 	}
 }
 - (void) invalidateMockTree {
 	_treeIsBuilt = false;
+	_treeIsStreamed = false;
 	_mockRows = nil;
 	_allMockIndexNodes = nil;
 	_allKeyValuePairs = nil;
 }
 
+- (void) chooseNextCatalogNodeID {
+	if (_largestCNIDYet < UINT32_MAX) {
+		self.nextCatalogNodeID = _largestCNIDYet + 1;
+		self.hasReusedCatalogNodeIDs = false;
+	} else {
+		self.nextCatalogNodeID = _firstUnusedCNID;
+		self.hasReusedCatalogNodeIDs = true;
+	}
+}
+
 - (void) catalogItemsAreDirty {
 	[self invalidateMockTree];
 }
@@ -502,9 +641,19 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 }
 
 ///Populate a real tree with the records added so far. Note that this method does not work incrementally, so it should only be used on a real tree. Create the tree with a number of nodes equal to or greater than totalNodeCount.
-- (void) populateTree:(ImpMutableBTreeFile *_Nonnull const)destTree {
+- (bool) populateTree:(ImpMutableBTreeFile *_Nonnull const)destTree error:(NSError *_Nullable *_Nullable const)outError {
 	[self buildMockTree];
 
+	ImpTraceTimestamp const traceStart = ImpTraceBegin();
+	if (_treeIsStreamed) {
+		bool const populated = [self layOutTreeFromSpilledRunsIntoTree:destTree];
+		ImpTraceEnd(traceStart, "catalog", "populateTree:");
+		if (! populated && outError != NULL) {
+			*outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteUnknownError userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Could not spill catalog records to temporary files (or read them back) while populating the catalog", @"") }];
+		}
+		return populated;
+	}
+
 	NSArray <NSArray <ImpMockNode *> *> *_Nonnull const mockRows = _mockRows;
 	NSArray <ImpMockNode *> *_Nullable const topRow = mockRows.firstObject;
 	NSArray <ImpMockNode *> *_Nullable const bottomRow = mockRows.lastObject;
@@ -557,6 +706,185 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 		S(headerRecPtr->totalNodes, numPotentialNodes);
 		S(headerRecPtr->freeNodes, numFreeNodes);
 	}];
+	ImpTraceEndWithArguments(traceStart, "catalog", "populateTree:", "nodes", _numLiveNodes, NULL, 0);
+	return true;
+}
+
+#pragma mark Building under a memory budget
+
+enum {
+	///Approximately how much memory each pair in a batch costs beyond its key and record: the ImpCatalogKeyValuePair object plus its slot in the batch array.
+	ImpCatalogKeyValuePairOverhead = 64,
+};
+
+///Make key-value pairs from every item's file or folder record and thread record, sorting them in batches that fit within the memory budget and spilling each batch to a temporary file. Returns nil if a batch couldn't be spilled.
+- (NSArray <ImpCatalogSpilledRun *> *_Nullable) spillSortedRuns {
+	NSUInteger const budget = self.memoryBudgetInBytes;
+	NSMutableArray <ImpCatalogSpilledRun *> *_Nonnull const runs = [NSMutableArray array];
+	NSMutableArray <ImpCatalogKeyValuePair *> *_Nonnull const batch = [NSMutableArray arrayWithCapacity:budget / (ImpCatalogKeyValuePairOverhead + sizeof(struct HFSPlusCatalogKey))];
+	NSUInteger batchSize = 0;
+
+	for (ImpCatalogItem *_Nonnull const item in _allSourceItems) {
+		NSData *_Nonnull const keyData = item.destinationKey;
+		NSData *_Nonnull const recordData = item.destinationRecord;
+		NSData *_Nonnull const threadKeyData = item.destinationThreadKey;
+		NSData *_Nonnull const threadRecordData = item.destinationThreadRecord;
+		[batch addObject:[item destinationKeyValuePair]];
+		[batch addObject:[item destinationThreadKeyValuePair]];
+		batchSize += keyData.length + recordData.length + threadKeyData.length + threadRecordData.length + ImpCatalogKeyValuePairOverhead * 2;
+
+		if (batchSize >= budget) {
+			ImpCatalogSpilledRun *_Nullable const run = [[ImpCatalogSpilledRun alloc] initBySpillingPairs:batch];
+			if (run == nil) {
+				return nil;
+			}
+			[runs addObject:run];
+			[batch removeAllObjects];
+			batchSize = 0;
+		}
+	}
+	if (batch.count > 0) {
+		ImpCatalogSpilledRun *_Nullable const run = [[ImpCatalogSpilledRun alloc] initBySpillingPairs:batch];
+		if (run == nil) {
+			return nil;
+		}
+		[runs addObject:run];
+	}
+
+	return runs;
+}
+
+///Merge sorted runs back together, calling the block with every key-value pair in order. The key and value objects are reused from one pair to the next, so the block must copy them if it needs to keep them. Returns false if a run couldn't be read or the block returned false.
+- (bool) mergeSpilledRuns:(NSArray <ImpCatalogSpilledRun *> *_Nonnull const)runs
+	forEachPair:(bool (^_Nonnull const)(NSData *_Nonnull const keyData, NSData *_Nonnull const valueData))block
+{
+	NSUInteger const numRuns = runs.count;
+	//Split the budget evenly between the runs' read buffers, but don't let the buffers get silly-small if there are lots of runs.
+	size_t const bufferSize = MAX(self.memoryBudgetInBytes / MAX(numRuns, (NSUInteger)1), (size_t)BUFSIZ);
+
+	//A binary min-heap of runs, ordered by each run's current key. The top of the heap is always the run with the next pair in the merged order.
+	NSMutableData *_Nonnull const heapData = [NSMutableData dataWithLength:numRuns * sizeof(ImpCatalogSpilledRun *)];
+	ImpCatalogSpilledRun *__unsafe_unretained _Nonnull *_Nonnull const heap = (ImpCatalogSpilledRun *__unsafe_unretained *)heapData.mutableBytes;
+	NSUInteger heapCount = 0;
+	for (ImpCatalogSpilledRun *_Nonnull const run in runs) {
+		if (! [run rewindWithBufferSize:bufferSize]) {
+			return false;
+		}
+		if ([run readNextPair]) {
+			heap[heapCount++] = run;
+		}
+	}
+
+	void (^_Nonnull const siftDown)(NSUInteger, NSUInteger) = ^(NSUInteger parentIdx, NSUInteger const count) {
+		while (true) {
+			NSUInteger const leftIdx = parentIdx * 2 + 1, rightIdx = leftIdx + 1;
+			NSUInteger leastIdx = parentIdx;
+			if (leftIdx < count && [heap[leftIdx] compareCurrentKeyWithCurrentKeyOfRun:heap[leastIdx]] == NSOrderedAscending) {
+				leastIdx = leftIdx;
+			}
+			if (rightIdx < count && [heap[rightIdx] compareCurrentKeyWithCurrentKeyOfRun:heap[leastIdx]] == NSOrderedAscending) {
+				leastIdx = rightIdx;
+			}
+			if (leastIdx == parentIdx) {
+				break;
+			}
+			ImpCatalogSpilledRun *__unsafe_unretained const swap = heap[parentIdx];
+			heap[parentIdx] = heap[leastIdx];
+			heap[leastIdx] = swap;
+			parentIdx = leastIdx;
+		}
+	};
+	for (NSUInteger i = heapCount / 2; i > 0; --i) {
+		siftDown(i - 1, heapCount);
+	}
+
+	while (heapCount > 0) {
+		ImpCatalogSpilledRun *_Nonnull const run = heap[0];
+		if (! block(run.currentKey, run.currentValue)) {
+			return false;
+		}
+		if (! [run readNextPair]) {
+			//This run is exhausted. Replace it with the last run in the heap.
+			heap[0] = heap[--heapCount];
+		}
+		siftDown(0, heapCount);
+	}
+
+	return true;
+}
+
+///Lay out the tree from spilled runs, one node at a time. With no tree, this only counts nodes (for totalNodeCount). With a tree, this allocates and fills real nodes in it and updates its header record. Either way, the result should be the same layout buildMockTree would produce.
+///Returns false if something couldn't be spilled to or read back from a temporary file.
+- (bool) layOutTreeFromSpilledRunsIntoTree:(ImpMutableBTreeFile *_Nullable const)destTree {
+	//The runs from counting aren't kept for populating, since clients can revise the records in between.
+	NSArray <ImpCatalogSpilledRun *> *_Nullable const runs = [self spillSortedRuns];
+	if (runs == nil) {
+		return false;
+	}
+
+	u_int32_t const nodeBodySize = _nodeSize - (sizeof(struct BTNodeDescriptor) + sizeof(BTreeNodeOffset));
+
+	ImpStreamingRowBuilder *_Nullable const leafRow = [[ImpStreamingRowBuilder alloc] initWithCapacity:nodeBodySize nodeKind:kBTLeafNode height:1 tree:destTree];
+	if (leafRow == nil) {
+		return false;
+	}
+	bool const merged = [self mergeSpilledRuns:runs forEachPair:^bool(NSData *_Nonnull const keyData, NSData *_Nonnull const valueData) {
+		return [leafRow appendKey:keyData payload:valueData];
+	}];
+	if (! merged) {
+		return false;
+	}
+	NSAssert(leafRow.numberOfNodes > 0, @"No leaf nodes? The converted tree is empty!");
+
+	//1 for the header node
+	u_int32_t numLiveNodes = 1 + leafRow.numberOfNodes;
+	ImpStreamingRowBuilder *_Nonnull topRow = leafRow;
+	u_int16_t numRows = 1;
+
+	NSMutableData *_Nonnull const pointerRecordData = [NSMutableData dataWithLength:sizeof(u_int32_t)];
+	u_int32_t *_Nonnull const pointerRecordPtr = pointerRecordData.mutableBytes;
+	while (topRow.numberOfNodes > 1) {
+		ImpStreamingRowBuilder *_Nullable const upperRow = [[ImpStreamingRowBuilder alloc] initWithCapacity:nodeBodySize nodeKind:kBTIndexNode height:(u_int8_t)(topRow.nodeHeight + 1) tree:destTree];
+		if (upperRow == nil) {
+			return false;
+		}
+
+		__block bool appendedAll = true;
+		bool const readBack = [topRow forEachNodeFirstKey:^(NSData *_Nonnull const keyData, u_int32_t const nodeNumber) {
+			S(*pointerRecordPtr, nodeNumber);
+			appendedAll = appendedAll && [upperRow appendKey:keyData payload:pointerRecordData];
+		}];
+		if (! (readBack && appendedAll)) {
+			return false;
+		}
+
+		numLiveNodes += upperRow.numberOfNodes;
+		++numRows;
+		topRow = upperRow;
+	}
+
+	_numLiveNodes = numLiveNodes;
+	[self chooseNextCatalogNodeID];
+
+	if (destTree != nil) {
+		u_int32_t const rootNodeNumber = topRow.firstNodeNumber;
+		u_int32_t const firstLeafNodeNumber = leafRow.firstNodeNumber;
+		u_int32_t const lastLeafNodeNumber = leafRow.lastNodeNumber;
+		u_int32_t const numLeafRecords = leafRow.numberOfRecords;
+		[destTree.headerNode reviseHeaderRecord:^(struct BTHeaderRec *_Nonnull const headerRecPtr) {
+			S(headerRecPtr->rootNode, rootNodeNumber);
+			S(headerRecPtr->treeDepth, numRows);
+			S(headerRecPtr->firstLeafNode, firstLeafNodeNumber);
+			S(headerRecPtr->lastLeafNode, lastLeafNodeNumber);
+			S(headerRecPtr->leafRecords, numLeafRecords);
+			u_int32_t const numPotentialNodes = (u_int32_t)destTree.numberOfPotentialNodes;
+			u_int32_t const numFreeNodes = numPotentialNodes - numLiveNodes;
+			S(headerRecPtr->totalNodes, numPotentialNodes);
+			S(headerRecPtr->freeNodes, numFreeNodes);
+		}];
+	}
+
+	return true;
 }
 
 #pragma mark Creation of original files
@@ -567,14 +895,8 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 	creator:(OSType const)creator
 	finderFlags:(UInt16)finderFlags
 {
-	//TEMP: Stolen from -buildMockTree, where it belongs. The whole CNID-assignment mechanism needs to be reworked; it's currently very ad-hoc.
-	if (_largestCNIDYet < UINT32_MAX) {
-		self.nextCatalogNodeID = _largestCNIDYet + 1;
-		self.hasReusedCatalogNodeIDs = false;
-	} else {
-		self.nextCatalogNodeID = _firstUnusedCNID;
-		self.hasReusedCatalogNodeIDs = true;
-	}
+	//TEMP: This belongs in -buildMockTree. The whole CNID-assignment mechanism needs to be reworked; it's currently very ad-hoc.
+	[self chooseNextCatalogNodeID];
 
 	//TODO: Really should make this failable in case all possible CNIDs are in use.
 	HFSCatalogNodeID const cnid = self.nextCatalogNodeID;
@@ -687,11 +1009,7 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 @implementation ImpCatalogItemIdentifier
 
 + (ImpTextEncodingConverter *_Nonnull const) reusableTextEncodingConverter {
-	static ImpTextEncodingConverter *_Nullable _tec = nil;
-	if (_tec == nil) {
-		_tec = [[ImpTextEncodingConverter alloc] initWithHFSTextEncoding:kTextEncodingMacRoman];
-	}
-	return _tec;
+	return [ImpTextEncodingConverter converterWithHFSTextEncoding:kTextEncodingMacRoman];
 }
 
 - (instancetype) initWithParentCNID:(HFSCatalogNodeID const)parentID ownCNID:(HFSCatalogNodeID const)ownID nodeName:(NSString *_Nonnull const)nodeName {
@@ -795,6 +1113,47 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 	return self;
 }
 
+- (NSData *_Nullable) dataForSlice:(ImpCatalogArenaSlice const)slice {
+	return slice.length > 0 ? [self.arena dataForSlice:slice] : nil;
+}
+
+- (NSData *_Nullable) destinationKey {
+	return [self dataForSlice:self.destinationKeySlice];
+}
+- (NSData *_Nullable) destinationRecord {
+	return [self dataForSlice:self.destinationRecordSlice];
+}
+- (NSData *_Nullable) destinationThreadKey {
+	return [self dataForSlice:self.destinationThreadKeySlice];
+}
+- (NSData *_Nullable) destinationThreadRecord {
+	return [self dataForSlice:self.destinationThreadRecordSlice];
+}
+
+- (ImpCatalogKeyValuePair *_Nonnull) keyValuePairWithKeySlice:(ImpCatalogArenaSlice const)keySlice recordSlice:(ImpCatalogArenaSlice const)recordSlice foldedNameSlice:(ImpCatalogArenaSlice const)foldedNameSlice {
+	NSData *_Nonnull const keyData = [self.arena dataForSlice:keySlice];
+	NSData *_Nonnull const recordData = [self.arena dataForSlice:recordSlice];
+	if (ImpGetCatalogKeyVersion(keyData) != ImpBTreeVersionHFSPlusCatalog) {
+		return [[ImpCatalogKeyValuePair alloc] initWithKey:keyData value:recordData];
+	}
+	return [[ImpCatalogKeyValuePair alloc] initWithKey:keyData value:recordData foldedName:[self.arena mutableBytesOfSlice:foldedNameSlice] length:foldedNameSlice.length / sizeof(UniChar)];
+}
+
+- (ImpCatalogKeyValuePair *_Nonnull) destinationKeyValuePair {
+	return [self keyValuePairWithKeySlice:self.destinationKeySlice recordSlice:self.destinationRecordSlice foldedNameSlice:self.destinationFoldedNameSlice];
+}
+- (ImpCatalogKeyValuePair *_Nonnull) destinationThreadKeyValuePair {
+	return [self keyValuePairWithKeySlice:self.destinationThreadKeySlice recordSlice:self.destinationThreadRecordSlice foldedNameSlice:self.destinationThreadFoldedNameSlice];
+}
+
+- (void) reviseDestinationRecord:(void (^_Nonnull const)(void *_Nonnull const bytes, NSUInteger const length))block {
+	ImpCatalogArenaSlice const slice = self.destinationRecordSlice;
+	void *_Nullable const bytes = [self.arena mutableBytesOfSlice:slice];
+	if (bytes != NULL) {
+		block(bytes, slice.length);
+	}
+}
+
 - (NSUInteger)hash {
 	return self.cnid;
 }
@@ -809,7 +1168,14 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 
 - (NSComparisonResult) caseInsensitiveCompare:(id)other {
 	ImpCatalogItem *_Nonnull const otherItem = other;
-	return (NSComparisonResult)ImpBTreeCompareHFSPlusCatalogKeys(self.destinationKey.bytes, otherItem.destinationKey.bytes);
+	struct HFSPlusCatalogKey const *_Nonnull const keyPtr = [self.arena mutableBytesOfSlice:self.destinationKeySlice];
+	struct HFSPlusCatalogKey const *_Nonnull const otherKeyPtr = [otherItem.arena mutableBytesOfSlice:otherItem.destinationKeySlice];
+	ImpCatalogArenaSlice const foldedNameSlice = self.destinationFoldedNameSlice;
+	ImpCatalogArenaSlice const otherFoldedNameSlice = otherItem.destinationFoldedNameSlice;
+	return ImpCompareFoldedCatalogKeys(
+		L(keyPtr->parentID), [self.arena mutableBytesOfSlice:foldedNameSlice] ?: ImpEmptyFoldedName, foldedNameSlice.length / sizeof(UniChar),
+		L(otherKeyPtr->parentID), [otherItem.arena mutableBytesOfSlice:otherFoldedNameSlice] ?: ImpEmptyFoldedName, otherFoldedNameSlice.length / sizeof(UniChar)
+	);
 }
 
 - (NSString *_Nonnull) description {
@@ -836,6 +1202,12 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 @end
 
 @implementation ImpCatalogKeyValuePair
+{
+	bool _hasFoldedName;
+	HFSCatalogNodeID _parentID;
+	UniChar const *_Nonnull _foldedUnits;
+	NSUInteger _numFoldedUnits;
+}
 
 - (instancetype _Nonnull)initWithKey:(NSData *_Nonnull const)keyData value:(NSData *_Nonnull const)valueData {
 	ImpBTreeVersion const version = ImpGetCatalogKeyVersion(keyData);
@@ -850,6 +1222,19 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 	if ((self = [super init])) {
 		_key = keyData;
 		_value = valueData;
+		_foldedUnits = ImpEmptyFoldedName;
+	}
+	return self;
+}
+
+- (instancetype _Nonnull)initWithKey:(NSData *_Nonnull const)keyData value:(NSData *_Nonnull const)valueData foldedName:(UniChar const *_Nullable const)foldedUnits length:(NSUInteger const)numFoldedUnits {
+	NSParameterAssert(ImpGetCatalogKeyVersion(keyData) == ImpBTreeVersionHFSPlusCatalog);
+	if ((self = [self initWithKey:keyData value:valueData])) {
+		struct HFSPlusCatalogKey const *_Nonnull const keyPtr = keyData.bytes;
+		_hasFoldedName = true;
+		_parentID = L(keyPtr->parentID);
+		_foldedUnits = foldedUnits ?: ImpEmptyFoldedName;
+		_numFoldedUnits = numFoldedUnits;
 	}
 	return self;
 }
@@ -893,19 +1278,229 @@ static ImpBTreeVersion ImpGetCatalogKeyVersion(NSData *_Nonnull const keyData) {
 
 - (NSComparisonResult) caseInsensitiveCompare:(id)other {
 	ImpCatalogKeyValuePair *_Nonnull const otherPair = other;
-	ImpBTreeVersion const thisVersion = ImpGetCatalogKeyVersion(self.key);
-	ImpBTreeVersion const otherVersion = ImpGetCatalogKeyVersion(otherPair.key);
-	if (thisVersion == ImpBTreeVersionHFSCatalog && otherVersion == ImpBTreeVersionHFSPlusCatalog) {
-		return NSOrderedAscending;
-	} else if (thisVersion == ImpBTreeVersionHFSPlusCatalog && otherVersion == ImpBTreeVersionHFSCatalog) {
-		return NSOrderedDescending;
-	} else if (thisVersion == ImpBTreeVersionHFSPlusCatalog) {
-		return (NSComparisonResult)ImpBTreeCompareHFSPlusCatalogKeys(self.key.bytes, otherPair.key.bytes);
-	} else if (thisVersion == ImpBTreeVersionHFSCatalog) {
-		return (NSComparisonResult)ImpBTreeCompareHFSCatalogKeys(self.key.bytes, otherPair.key.bytes);
-	} else {
-		return NSOrderedSame;
+	if (_hasFoldedName && otherPair->_hasFoldedName) {
+		return ImpCompareFoldedCatalogKeys(_parentID, _foldedUnits, _numFoldedUnits, otherPair->_parentID, otherPair->_foldedUnits, otherPair->_numFoldedUnits);
+	}
+	return ImpCompareCatalogKeyData(self.key, otherPair.key);
+}
+
+@end
+
+@implementation ImpCatalogSpilledRun
+{
+	///The temporary file itself, opened for writing. It's deleted when closed.
+	FILE *_Nullable _file;
+	///A second stream on the same file, opened for reading, with the buffer size requested in rewindWithBufferSize:.
+	FILE *_Nullable _readFile;
+	NSMutableData *_Nonnull _keyBuffer;
+	NSMutableData *_Nonnull _valueBuffer;
+	///The name from the current key, folded as it was read, so that every comparison during the merge doesn't fold it again. Only valid if the current key is an HFS+ key.
+	struct ImpHFSPlusFoldedName _currentFoldedName;
+	HFSCatalogNodeID _currentParentID;
+	bool _currentKeyIsHFSPlus;
+}
+
+- (instancetype _Nullable) initBySpillingPairs:(NSMutableArray <ImpCatalogKeyValuePair *> *_Nonnull const)pairs {
+	if ((self = [super init])) {
+		_keyBuffer = [NSMutableData dataWithCapacity:kHFSPlusCatalogKeyMaximumLength];
+		_valueBuffer = [NSMutableData dataWithCapacity:sizeof(struct HFSPlusCatalogFile)];
+
+		_file = tmpfile();
+		if (_file == NULL) {
+			return nil;
+		}
+
+		[pairs sortUsingSelector:@selector(caseInsensitiveCompare:)];
+		for (ImpCatalogKeyValuePair *_Nonnull const kvp in pairs) {
+			if (! ([self writeData:kvp.key] && [self writeData:kvp.value])) {
+				return nil;
+			}
+		}
+		if (fflush(_file) != 0) {
+			return nil;
+		}
+	}
+	return self;
+}
+
+- (void) dealloc {
+	if (_readFile != NULL) {
+		fclose(_readFile);
+	}
+	if (_file != NULL) {
+		fclose(_file);
+	}
+}
+
+- (bool) writeData:(NSData *_Nonnull const)data {
+	u_int32_t const length = (u_int32_t)data.length;
+	return fwrite(&length, sizeof(length), 1, _file) == 1 && fwrite(data.bytes, length, 1, _file) == 1;
+}
+- (bool) readIntoData:(NSMutableData *_Nonnull const)data {
+	u_int32_t length = 0;
+	if (fread(&length, sizeof(length), 1, _readFile) != 1) {
+		return false;
+	}
+	data.length = length;
+	return fread(data.mutableBytes, length, 1, _readFile) == 1;
+}
+
+- (bool) rewindWithBufferSize:(size_t const)bufferSize {
+	if (_readFile != NULL) {
+		fclose(_readFile);
+		_readFile = NULL;
+	}
+
+	//setvbuf can only be used on a stream that hasn't been read from or written to yet, so open a fresh stream for reading.
+	int const readFD = dup(fileno(_file));
+	if (readFD < 0) {
+		return false;
+	}
+	_readFile = fdopen(readFD, "rb");
+	if (_readFile == NULL) {
+		close(readFD);
+		return false;
+	}
+	setvbuf(_readFile, NULL, _IOFBF, bufferSize);
+	return fseeko(_readFile, 0, SEEK_SET) == 0;
+}
+
+- (bool) readNextPair {
+	if (! (_readFile != NULL && [self readIntoData:_keyBuffer] && [self readIntoData:_valueBuffer])) {
+		return false;
+	}
+
+	_currentKeyIsHFSPlus = ImpGetCatalogKeyVersion(_keyBuffer) == ImpBTreeVersionHFSPlusCatalog;
+	if (_currentKeyIsHFSPlus) {
+		struct HFSPlusCatalogKey const *_Nonnull const keyPtr = _keyBuffer.bytes;
+		_currentParentID = L(keyPtr->parentID);
+		_currentFoldedName.length = (u_int16_t)ImpHFSPlusFoldName(&keyPtr->nodeName, _currentFoldedName.unicode);
+	}
+	return true;
+}
+
+- (NSComparisonResult) compareCurrentKeyWithCurrentKeyOfRun:(ImpCatalogSpilledRun *_Nonnull const)otherRun {
+	if (_currentKeyIsHFSPlus && otherRun->_currentKeyIsHFSPlus) {
+		return ImpCompareFoldedCatalogKeys(_currentParentID, _currentFoldedName.unicode, _currentFoldedName.length, otherRun->_currentParentID, otherRun->_currentFoldedName.unicode, otherRun->_currentFoldedName.length);
+	}
+	return ImpCompareCatalogKeyData(_keyBuffer, otherRun->_keyBuffer);
+}
+
+- (NSData *_Nonnull) currentKey {
+	return _keyBuffer;
+}
+- (NSData *_Nonnull) currentValue {
+	return _valueBuffer;
+}
+
+@end
+
+@implementation ImpStreamingRowBuilder
+{
+	ImpMutableBTreeFile *_Nullable _tree;
+	ImpBTreeNode *_Nullable _currentRealNode;
+	///Holds the node number and first key of each node in the row, for building the row above.
+	FILE *_Nullable _firstKeysFile;
+	u_int32_t _capacity;
+	u_int32_t _currentNodeNumber;
+	u_int32_t _totalSizeOfRecordsInCurrentNode;
+	BTreeNodeKind _nodeKind;
+}
+
+- (instancetype _Nullable) initWithCapacity:(u_int32_t const)maxNumBytes
+	nodeKind:(BTreeNodeKind const)kind
+	height:(u_int8_t const)height
+	tree:(ImpMutableBTreeFile *_Nullable const)destTree
+{
+	if ((self = [super init])) {
+		_capacity = maxNumBytes;
+		_nodeKind = kind;
+		_nodeHeight = height;
+		_tree = destTree;
+
+		_firstKeysFile = tmpfile();
+		if (_firstKeysFile == NULL) {
+			return nil;
+		}
+	}
+	return self;
+}
+
+- (void) dealloc {
+	if (_firstKeysFile != NULL) {
+		fclose(_firstKeysFile);
+	}
+}
+
+- (void) startNewNode {
+	if (_tree != nil) {
+		u_int8_t const height = _nodeHeight;
+		ImpBTreeNode *_Nonnull const realNode = [_tree allocateNewNodeOfKind:_nodeKind populate:^(void *_Nonnull bytes, NSUInteger length) {
+			struct BTNodeDescriptor *_Nonnull const nodeDesc = bytes;
+			nodeDesc->height = height;
+		}];
+		[_currentRealNode connectNextNode:realNode];
+		_currentRealNode = realNode;
+		_currentNodeNumber = realNode.nodeNumber;
+
+		if (_numberOfNodes == 0) {
+			_firstNodeNumber = _currentNodeNumber;
+		}
+		_lastNodeNumber = _currentNodeNumber;
+	}
+
+	++_numberOfNodes;
+	_totalSizeOfRecordsInCurrentNode = 0;
+}
+
+- (bool) appendKey:(NSData *_Nonnull const)keyData payload:(NSData *_Nonnull const)payloadData {
+	//Same rule as ImpMockNode, so that we tear off nodes at the same points buildMockTree would.
+	u_int32_t const recordSize = (u_int32_t)(keyData.length + payloadData.length + sizeof(BTreeNodeOffset));
+	if (recordSize > _capacity) {
+		return false;
+	}
+
+	if (_numberOfNodes == 0 || (_capacity - _totalSizeOfRecordsInCurrentNode) < recordSize) {
+		[self startNewNode];
+
+		u_int32_t const keyLength = (u_int32_t)keyData.length;
+		bool const wroteFirstKey = fwrite(&_currentNodeNumber, sizeof(_currentNodeNumber), 1, _firstKeysFile) == 1
+			&& fwrite(&keyLength, sizeof(keyLength), 1, _firstKeysFile) == 1
+			&& fwrite(keyData.bytes, keyLength, 1, _firstKeysFile) == 1;
+		if (! wroteFirstKey) {
+			return false;
+		}
+	}
+
+	if (_currentRealNode != nil) {
+		bool const appended = [_currentRealNode appendRecordWithKey:keyData payload:payloadData];
+		NSAssert(appended, @"Could not append record to real node %@; it may be out of space (%u bytes remaining; key is %lu bytes and payload is %lu bytes)", _currentRealNode, _currentRealNode.numberOfBytesAvailable, keyData.length, payloadData.length);
 	}
+	_totalSizeOfRecordsInCurrentNode += recordSize;
+	++_numberOfRecords;
+
+	return true;
+}
+
+- (bool) forEachNodeFirstKey:(void (^_Nonnull const)(NSData *_Nonnull const keyData, u_int32_t const nodeNumber))block {
+	if (fflush(_firstKeysFile) != 0 || fseeko(_firstKeysFile, 0, SEEK_SET) != 0) {
+		return false;
+	}
+
+	NSMutableData *_Nonnull const keyData = [NSMutableData dataWithCapacity:kHFSPlusCatalogKeyMaximumLength];
+	for (u_int32_t i = 0; i < _numberOfNodes; ++i) {
+		u_int32_t nodeNumber = 0, keyLength = 0;
+		if (fread(&nodeNumber, sizeof(nodeNumber), 1, _firstKeysFile) != 1 || fread(&keyLength, sizeof(keyLength), 1, _firstKeysFile) != 1) {
+			return false;
+		}
+		keyData.length = keyLength;
+		if (fread(keyData.mutableBytes, keyLength, 1, _firstKeysFile) != 1) {
+			return false;
+		}
+		block(keyData, nodeNumber);
+	}
+
+	return true;
 }
 
 @end
@@ -0,0 +1,60 @@
+//
+//  ImpCatalogIndex.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-22.
+//
+
+#import <Foundation/Foundation.h>
+
+#import "ImpForkUtilities.h"
+
+@class ImpSourceVolume;
+@class ImpDehydratedItem;
+
+///One extent of a fork, as recorded in a catalog index. Unlike extents in the volume's own structures, these are in host byte order.
+struct ImpCatalogIndexExtent {
+	u_int32_t startBlock;
+	u_int32_t blockCount;
+};
+
+/*!A catalog index is a file kept alongside a disk image that records, for a volume in that image, where every file's and folder's catalog record is, which item has each name in each folder, and the complete list of extents of every fork. Once an index exists, opening it is a matter of mapping it, so finding an item by name or path, or finding a fork's extents, becomes a lookup rather than a walk through the catalog or extents overflow file.
+ *An index is only good for the image as it was when the index was built. It records the volume's location in the image, a checksum of its volume header, the volume's last-modified date, and the image's size and modification date; if any of those no longer match, the index is stale and won't be opened, so that a fresh one can be built.
+ */
+@interface ImpCatalogIndex : NSObject
+
+///The URL of the index for a volume in an image: the image's URL with “.impluse-index” appended (plus the volume's offset, for volumes that don't start at the beginning of the image).
++ (NSURL *_Nonnull) indexURLForVolume:(ImpSourceVolume *_Nonnull const)srcVol inImageAtURL:(NSURL *_Nonnull const)imageURL;
+
+///Map an existing index, and check that it's current for this volume. Returns nil if there is no index at this URL, or if it's stale or damaged. outError is set only for errors other than the index not existing.
++ (instancetype _Nullable) indexAtURL:(NSURL *_Nonnull const)indexURL forVolume:(ImpSourceVolume *_Nonnull const)srcVol error:(NSError *_Nullable *_Nullable const)outError;
+
+///Build an index by walking the volume's catalog once. The volume must already be loaded.
++ (instancetype _Nonnull) indexByReadingCatalogOfVolume:(ImpSourceVolume *_Nonnull const)srcVol;
+
+///Open the index for this volume if there's a current one; otherwise, build one and save it for next time. Being unable to save the index (e.g., because the image is on read-only media) is reported but isn't fatal; the newly built index is returned regardless.
++ (instancetype _Nonnull) indexForVolume:(ImpSourceVolume *_Nonnull const)srcVol inImageAtURL:(NSURL *_Nonnull const)imageURL;
+
+///Save the index to a file. The file is replaced atomically, so nobody opening it at the same time will see half an index.
+- (bool) writeToURL:(NSURL *_Nonnull const)indexURL error:(NSError *_Nullable *_Nullable const)outError;
+
+///The number of files and folders in the index.
+@property(nonatomic, readonly) NSUInteger numberOfItems;
+
+#pragma mark Lookups
+
+///Create a dehydrated item from the catalog record for this CNID, which the index knows the location of. Returns nil if there's no file or folder with this CNID.
+- (ImpDehydratedItem *_Nullable) itemWithCatalogNodeID:(HFSCatalogNodeID const)cnid;
+
+///Returns the CNID of the item directly within this folder that has exactly this name, or 0 if there's no such item.
+- (HFSCatalogNodeID) catalogNodeIDOfItemNamed:(NSString *_Nonnull const)name inFolderWithID:(HFSCatalogNodeID const)parentID;
+
+///Call the block with the CNID of every item, anywhere on the volume, that has exactly this name.
+- (void) forEachItemNamed:(NSString *_Nonnull const)name block:(void (^_Nonnull const)(HFSCatalogNodeID const cnid))block;
+
+///Returns every extent of a fork, in order: those from the catalog record followed by any from the extents overflow file. Returns NULL, with the count set to 0, if the index has no extents for that fork.
+- (struct ImpCatalogIndexExtent const *_Nullable) extentsOfFileWithID:(HFSCatalogNodeID const)cnid
+	fork:(ImpForkType const)forkType
+	count:(NSUInteger *_Nonnull const)outNumExtents;
+
+@end
@@ -0,0 +1,516 @@
+//
+//  ImpCatalogIndex.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-22.
+//
+
+#import "ImpCatalogIndex.h"
+
+#import "ImpPrintf.h"
+#import "ImpTextEncodingConverter.h"
+#import "ImpSourceVolume.h"
+#import "ImpHFSSourceVolume.h"
+#import "ImpHFSPlusSourceVolume.h"
+#import "ImpBTreeFile.h"
+#import "ImpBTreeNode.h"
+#import "ImpDehydratedItem.h"
+
+#import <hfs/hfs_format.h>
+#import <sys/stat.h>
+
+enum {
+	ImpCatalogIndexSignature = 'ImpX',
+	///Bump this whenever the layout of anything in the file changes, so that older indexes get rebuilt rather than misread.
+	ImpCatalogIndexVersion = 1,
+};
+
+///Everything about the image that must be the same as when the index was built for the index to be current.
+struct ImpCatalogIndexIdentity {
+	u_int64_t volumeStartOffset;
+	u_int64_t volumeHeaderChecksum;
+	u_int32_t volumeModificationDate;
+	u_int32_t isHFSPlus;
+	int64_t imageSize;
+	int64_t imageModificationSeconds;
+	int64_t imageModificationNanoseconds;
+};
+
+///An index file is this header, then the record locations, name entries, forks, and extents, then all of the names' bytes. Everything is in host byte order; the signature doubles as a byte-order mark.
+struct ImpCatalogIndexHeader {
+	u_int32_t signature;
+	u_int16_t version;
+	u_int16_t headerSize;
+	struct ImpCatalogIndexIdentity identity;
+	u_int32_t numRecordLocations;
+	u_int32_t numNameEntries;
+	u_int32_t numForks;
+	u_int32_t numExtents;
+	u_int64_t numNameBytes;
+};
+
+///Where an item's catalog record is in the catalog file. Sorted by CNID.
+struct ImpCatalogIndexRecordLocation {
+	u_int32_t cnid;
+	u_int32_t nodeIndex;
+	u_int16_t recordIndex;
+	u_int16_t isFolder;
+};
+
+///An item's parent and name. The name is UTF-8, stored in the name bytes. Sorted by parent ID, then by name bytes.
+struct ImpCatalogIndexNameEntry {
+	u_int32_t parentID;
+	u_int32_t cnid;
+	u_int32_t nameOffset;
+	u_int32_t nameLength;
+};
+
+///The run of extents that makes up one fork. Sorted by CNID, then by fork type.
+struct ImpCatalogIndexFork {
+	u_int32_t cnid;
+	u_int32_t forkType;
+	u_int32_t firstExtentIndex;
+	u_int32_t numExtents;
+};
+
+static u_int64_t ImpFNV1a64(void const *_Nonnull const bytes, size_t const length) {
+	u_int8_t const *_Nonnull const bytePtr = bytes;
+	u_int64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= bytePtr[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+///Names are ordered bytewise, not the way the catalog orders them. All the index needs is some consistent order to search in.
+static int ImpCatalogIndexCompareNames(char const *_Nonnull const nameA, u_int32_t const lengthA, char const *_Nonnull const nameB, u_int32_t const lengthB) {
+	int const prefixComparison = memcmp(nameA, nameB, MIN(lengthA, lengthB));
+	if (prefixComparison != 0) {
+		return prefixComparison;
+	}
+	return lengthA < lengthB ? -1 : lengthA > lengthB ? 1 : 0;
+}
+
+///Describe the image and the volume in it as they are right now. Returns false if the image can't be examined or the volume isn't HFS or HFS+.
+static bool ImpCatalogIndexGetIdentity(ImpSourceVolume *_Nonnull const srcVol, struct ImpCatalogIndexIdentity *_Nonnull const outIdentity) {
+	struct stat sb;
+	if (fstat(srcVol.fileDescriptor, &sb) != 0) {
+		return false;
+	}
+
+	__block struct ImpCatalogIndexIdentity identity = {
+		.volumeStartOffset = srcVol.startOffsetInBytes,
+		.imageSize = sb.st_size,
+		.imageModificationSeconds = sb.st_mtimespec.tv_sec,
+		.imageModificationNanoseconds = sb.st_mtimespec.tv_nsec,
+	};
+	if ([srcVol isKindOfClass:[ImpHFSPlusSourceVolume class]]) {
+		[(ImpHFSPlusSourceVolume *)srcVol peekAtHFSPlusVolumeHeader:^(struct HFSPlusVolumeHeader const *_Nonnull const vhPtr) {
+			identity.volumeHeaderChecksum = ImpFNV1a64(vhPtr, sizeof(*vhPtr));
+			identity.volumeModificationDate = L(vhPtr->modifyDate);
+		}];
+		identity.isHFSPlus = true;
+	} else if ([srcVol isKindOfClass:[ImpHFSSourceVolume class]]) {
+		[(ImpHFSSourceVolume *)srcVol peekAtHFSVolumeHeader:^(struct HFSMasterDirectoryBlock const *_Nonnull const mdbPtr) {
+			identity.volumeHeaderChecksum = ImpFNV1a64(mdbPtr, sizeof(*mdbPtr));
+			identity.volumeModificationDate = L(mdbPtr->drLsMod);
+		}];
+		identity.isHFSPlus = false;
+	} else {
+		return false;
+	}
+
+	*outIdentity = identity;
+	return true;
+}
+
+@implementation ImpCatalogIndex
+{
+	NSData *_Nonnull _data;
+	///The volume owns its index, not the other way around.
+	__weak ImpSourceVolume *_Nullable _volume;
+
+	struct ImpCatalogIndexHeader const *_Nonnull _header;
+	struct ImpCatalogIndexRecordLocation const *_Nonnull _recordLocations;
+	struct ImpCatalogIndexNameEntry const *_Nonnull _nameEntries;
+	struct ImpCatalogIndexFork const *_Nonnull _forks;
+	struct ImpCatalogIndexExtent const *_Nonnull _extents;
+	char const *_Nonnull _nameBytes;
+}
+
+///Check that the data is laid out like an index (but not whether it's current) and find its tables. Returns nil if the data isn't a well-formed index.
+- (instancetype _Nullable) initWithData:(NSData *_Nonnull const)data volume:(ImpSourceVolume *_Nonnull const)srcVol {
+	if ((self = [super init])) {
+		if (data.length < sizeof(struct ImpCatalogIndexHeader)) {
+			return nil;
+		}
+		struct ImpCatalogIndexHeader const *_Nonnull const header = data.bytes;
+		if (header->signature != ImpCatalogIndexSignature || header->version != ImpCatalogIndexVersion || header->headerSize != sizeof(*header)) {
+			return nil;
+		}
+		if (header->numNameBytes > data.length) {
+			return nil;
+		}
+		u_int64_t const expectedLength = sizeof(*header)
+			+ (u_int64_t)header->numRecordLocations * sizeof(struct ImpCatalogIndexRecordLocation)
+			+ (u_int64_t)header->numNameEntries * sizeof(struct ImpCatalogIndexNameEntry)
+			+ (u_int64_t)header->numForks * sizeof(struct ImpCatalogIndexFork)
+			+ (u_int64_t)header->numExtents * sizeof(struct ImpCatalogIndexExtent)
+			+ header->numNameBytes;
+		if (expectedLength != data.length) {
+			return nil;
+		}
+
+		_data = data;
+		_volume = srcVol;
+		_header = header;
+		_recordLocations = (void const *)(header + 1);
+		_nameEntries = (void const *)(_recordLocations + header->numRecordLocations);
+		_forks = (void const *)(_nameEntries + header->numNameEntries);
+		_extents = (void const *)(_forks + header->numForks);
+		_nameBytes = (void const *)(_extents + header->numExtents);
+
+		//Everything else is self-contained, but these point into other tables, so make sure they don't point out of bounds.
+		for (u_int32_t i = 0; i < header->numNameEntries; ++i) {
+			if ((u_int64_t)_nameEntries[i].nameOffset + _nameEntries[i].nameLength > header->numNameBytes) {
+				return nil;
+			}
+		}
+		for (u_int32_t i = 0; i < header->numForks; ++i) {
+			if ((u_int64_t)_forks[i].firstExtentIndex + _forks[i].numExtents > header->numExtents) {
+				return nil;
+			}
+		}
+	}
+	return self;
+}
+
++ (NSURL *_Nonnull) indexURLForVolume:(ImpSourceVolume *_Nonnull const)srcVol inImageAtURL:(NSURL *_Nonnull const)imageURL {
+	u_int64_t const startOffset = srcVol.startOffsetInBytes;
+	NSString *_Nonnull const suffix = startOffset == 0 ? @".impluse-index" : [NSString stringWithFormat:@".%llu.impluse-index", startOffset];
+	return [NSURL fileURLWithPath:[imageURL.path stringByAppendingString:suffix] isDirectory:false];
+}
+
++ (instancetype _Nullable) indexAtURL:(NSURL *_Nonnull const)indexURL forVolume:(ImpSourceVolume *_Nonnull const)srcVol error:(NSError *_Nullable *_Nullable const)outError {
+	NSError *_Nullable readError = nil;
+	NSData *_Nullable const data = [NSData dataWithContentsOfURL:indexURL options:NSDataReadingMappedAlways error:&readError];
+	if (data == nil) {
+		bool const noIndexYet = [readError.domain isEqualToString:NSCocoaErrorDomain] && readError.code == NSFileReadNoSuchFileError;
+		if (! noIndexYet && outError != NULL) {
+			*outError = readError;
+		}
+		return nil;
+	}
+
+	ImpCatalogIndex *_Nullable const index = [[self alloc] initWithData:data volume:srcVol];
+	struct ImpCatalogIndexIdentity identity;
+	if (index == nil || ! ImpCatalogIndexGetIdentity(srcVol, &identity) || memcmp(&identity, &(index->_header->identity), sizeof(identity)) != 0) {
+		//Damaged, or the image has changed since the index was built. Either way, it needs to be rebuilt, which isn't an error.
+		return nil;
+	}
+	return index;
+}
+
++ (instancetype _Nonnull) indexForVolume:(ImpSourceVolume *_Nonnull const)srcVol inImageAtURL:(NSURL *_Nonnull const)imageURL {
+	NSURL *_Nonnull const indexURL = [self indexURLForVolume:srcVol inImageAtURL:imageURL];
+
+	NSError *_Nullable openError = nil;
+	ImpCatalogIndex *_Nullable index = [self indexAtURL:indexURL forVolume:srcVol error:&openError];
+	if (index == nil) {
+		if (openError != nil) {
+			ImpPrintf(@"Couldn't read catalog index %@ (%@); rebuilding it", indexURL.path, openError.localizedDescription);
+		}
+		index = [self indexByReadingCatalogOfVolume:srcVol];
+
+		NSError *_Nullable writeError = nil;
+		if (! [index writeToURL:indexURL error:&writeError]) {
+			ImpPrintf(@"Couldn't save catalog index to %@: %@", indexURL.path, writeError.localizedDescription);
+		}
+	}
+	return index;
+}
+
+- (bool) writeToURL:(NSURL *_Nonnull const)indexURL error:(NSError *_Nullable *_Nullable const)outError {
+	return [_data writeToURL:indexURL options:NSDataWritingAtomic error:outError];
+}
+
+#pragma mark Building
+
++ (instancetype _Nonnull) indexByReadingCatalogOfVolume:(ImpSourceVolume *_Nonnull const)srcVol {
+	ImpTextEncodingConverter *_Nonnull const tec = srcVol.textEncodingConverter;
+	ImpHFSSourceVolume *_Nullable const hfsVol = [srcVol isKindOfClass:[ImpHFSSourceVolume class]] ? (ImpHFSSourceVolume *)srcVol : nil;
+	ImpHFSPlusSourceVolume *_Nullable const hfsPlusVol = [srcVol isKindOfClass:[ImpHFSPlusSourceVolume class]] ? (ImpHFSPlusSourceVolume *)srcVol : nil;
+	u_int64_t const blockSize = srcVol.numberOfBytesPerBlock;
+
+	NSUInteger const estimatedNumItems = srcVol.numberOfFiles + srcVol.numberOfFolders;
+	NSMutableData *_Nonnull const recordLocations = [NSMutableData dataWithCapacity:estimatedNumItems * sizeof(struct ImpCatalogIndexRecordLocation)];
+	NSMutableData *_Nonnull const nameEntries = [NSMutableData dataWithCapacity:estimatedNumItems * sizeof(struct ImpCatalogIndexNameEntry)];
+	NSMutableData *_Nonnull const forks = [NSMutableData dataWithCapacity:srcVol.numberOfFiles * 2 * sizeof(struct ImpCatalogIndexFork)];
+	NSMutableData *_Nonnull const extents = [NSMutableData dataWithCapacity:srcVol.numberOfFiles * 2 * sizeof(struct ImpCatalogIndexExtent)];
+	//Another wild guess: names average about 16 bytes.
+	NSMutableData *_Nonnull const nameBytes = [NSMutableData dataWithCapacity:estimatedNumItems * 16];
+
+	__block u_int32_t numExtents = 0;
+	u_int64_t (^_Nonnull const appendExtent)(u_int32_t const startBlock, u_int32_t const blockCount) = ^u_int64_t(u_int32_t const startBlock, u_int32_t const blockCount) {
+		struct ImpCatalogIndexExtent const extent = { .startBlock = startBlock, .blockCount = blockCount };
+		[extents appendBytes:&extent length:sizeof(extent)];
+		++numExtents;
+		return blockCount * blockSize;
+	};
+	void (^_Nonnull const appendForkIfNotEmpty)(HFSCatalogNodeID const cnid, ImpForkType const forkType, u_int32_t const firstExtentIndex) = ^(HFSCatalogNodeID const cnid, ImpForkType const forkType, u_int32_t const firstExtentIndex) {
+		if (numExtents > firstExtentIndex) {
+			struct ImpCatalogIndexFork const fork = { .cnid = cnid, .forkType = forkType, .firstExtentIndex = firstExtentIndex, .numExtents = numExtents - firstExtentIndex };
+			[forks appendBytes:&fork length:sizeof(fork)];
+		}
+	};
+	//Uses the same extent walk that reading the fork would, so the index has exactly the extents (including any from the extents overflow file) that reading would have visited.
+	void (^_Nonnull const indexHFSFork)(HFSCatalogNodeID const cnid, ImpForkType const forkType, u_int64_t const logicalLength, struct HFSExtentDescriptor const *_Nonnull const extentRec) = ^(HFSCatalogNodeID const cnid, ImpForkType const forkType, u_int64_t const logicalLength, struct HFSExtentDescriptor const *_Nonnull const extentRec) {
+		u_int32_t const firstExtentIndex = numExtents;
+		[hfsVol forEachExtentInFileWithID:cnid fork:forkType forkLogicalLength:logicalLength startingWithExtentsRecord:extentRec block:^u_int64_t(struct HFSExtentDescriptor const *_Nonnull const oneExtent, u_int64_t const logicalBytesRemaining) {
+			return appendExtent(L(oneExtent->startBlock), L(oneExtent->blockCount));
+		}];
+		appendForkIfNotEmpty(cnid, forkType, firstExtentIndex);
+	};
+	void (^_Nonnull const indexHFSPlusFork)(HFSCatalogNodeID const cnid, ImpForkType const forkType, struct HFSPlusForkData const *_Nonnull const forkData) = ^(HFSCatalogNodeID const cnid, ImpForkType const forkType, struct HFSPlusForkData const *_Nonnull const forkData) {
+		u_int32_t const firstExtentIndex = numExtents;
+		[hfsPlusVol forEachExtentInFileWithID:cnid fork:forkType forkLogicalLength:L(forkData->logicalSize) startingWithBigExtentsRecord:forkData->extents block:^u_int64_t(struct HFSPlusExtentDescriptor const *_Nonnull const oneExtent, u_int64_t const logicalBytesRemaining) {
+			return appendExtent(L(oneExtent->startBlock), L(oneExtent->blockCount));
+		}];
+		appendForkIfNotEmpty(cnid, forkType, firstExtentIndex);
+	};
+
+	ImpBTreeFile *_Nonnull const catalog = srcVol.catalogBTree;
+	[catalog walkLeafNodes:^bool(ImpBTreeNode *_Nonnull const node) {
+		@autoreleasepool {
+			u_int32_t const nodeIndex = node.nodeNumber;
+			u_int16_t const numRecords = node.numberOfRecords;
+			for (u_int16_t recordIdx = 0; recordIdx < numRecords; ++recordIdx) {
+				void const *_Nonnull const keyPtr = [node pointerToKeyOfRecordAtIndex:recordIdx length:NULL];
+				u_int16_t payloadLength = 0;
+				void const *_Nonnull const payloadPtr = [node pointerToPayloadOfRecordAtIndex:recordIdx length:&payloadLength];
+				if (payloadLength < sizeof(int16_t)) {
+					continue;
+				}
+				int16_t const recordType = L(*(int16_t const *)payloadPtr);
+
+				HFSCatalogNodeID cnid = 0, parentID = 0;
+				bool isFolder = false;
+				NSString *_Nullable name = nil;
+				if (hfsPlusVol != nil) {
+					struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr = keyPtr;
+					if (recordType == kHFSPlusFolderRecord && payloadLength >= sizeof(struct HFSPlusCatalogFolder)) {
+						struct HFSPlusCatalogFolder const *_Nonnull const folderRec = payloadPtr;
+						cnid = L(folderRec->folderID);
+						isFolder = true;
+					} else if (recordType == kHFSPlusFileRecord && payloadLength >= sizeof(struct HFSPlusCatalogFile)) {
+						struct HFSPlusCatalogFile const *_Nonnull const fileRec = payloadPtr;
+						cnid = L(fileRec->fileID);
+						indexHFSPlusFork(cnid, ImpForkTypeData, &(fileRec->dataFork));
+						indexHFSPlusFork(cnid, ImpForkTypeResource, &(fileRec->resourceFork));
+					} else {
+						//Thread records don't need indexing: the name entries already say what they would.
+						continue;
+					}
+					parentID = L(catalogKeyPtr->parentID);
+					name = [tec stringFromHFSUniStr255:&(catalogKeyPtr->nodeName)];
+				} else {
+					struct HFSCatalogKey const *_Nonnull const catalogKeyPtr = keyPtr;
+					if (recordType == kHFSFolderRecord && payloadLength >= sizeof(struct HFSCatalogFolder)) {
+						struct HFSCatalogFolder const *_Nonnull const folderRec = payloadPtr;
+						cnid = L(folderRec->folderID);
+						isFolder = true;
+					} else if (recordType == kHFSFileRecord && payloadLength >= sizeof(struct HFSCatalogFile)) {
+						struct HFSCatalogFile const *_Nonnull const fileRec = payloadPtr;
+						cnid = L(fileRec->fileID);
+						indexHFSFork(cnid, ImpForkTypeData, L(fileRec->dataLogicalSize), fileRec->dataExtents);
+						indexHFSFork(cnid, ImpForkTypeResource, L(fileRec->rsrcLogicalSize), fileRec->rsrcExtents);
+					} else {
+						continue;
+					}
+					parentID = L(catalogKeyPtr->parentID);
+					name = [tec stringForPascalString:catalogKeyPtr->nodeName];
+				}
+
+				struct ImpCatalogIndexRecordLocation const location = { .cnid = cnid, .nodeIndex = nodeIndex, .recordIndex = recordIdx, .isFolder = isFolder };
+				[recordLocations appendBytes:&location length:sizeof(location)];
+
+				char const *_Nonnull const nameUTF8 = name.UTF8String ?: "";
+				struct ImpCatalogIndexNameEntry const nameEntry = { .parentID = parentID, .cnid = cnid, .nameOffset = (u_int32_t)nameBytes.length, .nameLength = (u_int32_t)strlen(nameUTF8) };
+				[nameBytes appendBytes:nameUTF8 length:nameEntry.nameLength];
+				[nameEntries appendBytes:&nameEntry length:sizeof(nameEntry)];
+			}
+		}
+		return true;
+	}];
+
+	//Catalog order is by parent and name, so only the name entries come out nearly sorted. Put everything in the order the lookups expect.
+	u_int32_t const numItems = (u_int32_t)(recordLocations.length / sizeof(struct ImpCatalogIndexRecordLocation));
+	u_int32_t const numForks = (u_int32_t)(forks.length / sizeof(struct ImpCatalogIndexFork));
+	qsort_b(recordLocations.mutableBytes, numItems, sizeof(struct ImpCatalogIndexRecordLocation), ^int(void const *_Nonnull a, void const *_Nonnull b) {
+		u_int32_t const cnidA = ((struct ImpCatalogIndexRecordLocation const *)a)->cnid, cnidB = ((struct ImpCatalogIndexRecordLocation const *)b)->cnid;
+		return cnidA < cnidB ? -1 : cnidA > cnidB ? 1 : 0;
+	});
+	char const *_Nonnull const allNameBytes = nameBytes.bytes;
+	qsort_b(nameEntries.mutableBytes, numItems, sizeof(struct ImpCatalogIndexNameEntry), ^int(void const *_Nonnull a, void const *_Nonnull b) {
+		struct ImpCatalogIndexNameEntry const *_Nonnull const entryA = a, *_Nonnull const entryB = b;
+		if (entryA->parentID != entryB->parentID) {
+			return entryA->parentID < entryB->parentID ? -1 : 1;
+		}
+		return ImpCatalogIndexCompareNames(allNameBytes + entryA->nameOffset, entryA->nameLength, allNameBytes + entryB->nameOffset, entryB->nameLength);
+	});
+	qsort_b(forks.mutableBytes, numForks, sizeof(struct ImpCatalogIndexFork), ^int(void const *_Nonnull a, void const *_Nonnull b) {
+		struct ImpCatalogIndexFork const *_Nonnull const forkA = a, *_Nonnull const forkB = b;
+		if (forkA->cnid != forkB->cnid) {
+			return forkA->cnid < forkB->cnid ? -1 : 1;
+		}
+		return forkA->forkType < forkB->forkType ? -1 : forkA->forkType > forkB->forkType ? 1 : 0;
+	});
+
+	struct ImpCatalogIndexHeader header = {
+		.signature = ImpCatalogIndexSignature,
+		.version = ImpCatalogIndexVersion,
+		.headerSize = sizeof(header),
+		.numRecordLocations = numItems,
+		.numNameEntries = numItems,
+		.numForks = numForks,
+		.numExtents = numExtents,
+		.numNameBytes = nameBytes.length,
+	};
+	//If the image can't be examined, the identity stays zeroed, so the index works for now but will never be mistaken for current later.
+	ImpCatalogIndexGetIdentity(srcVol, &header.identity);
+
+	NSMutableData *_Nonnull const data = [NSMutableData dataWithCapacity:sizeof(header) + recordLocations.length + nameEntries.length + forks.length + extents.length + nameBytes.length];
+	[data appendBytes:&header length:sizeof(header)];
+	[data appendData:recordLocations];
+	[data appendData:nameEntries];
+	[data appendData:forks];
+	[data appendData:extents];
+	[data appendData:nameBytes];
+
+	ImpCatalogIndex *_Nullable const index = [[self alloc] initWithData:data volume:srcVol];
+	NSAssert(index != nil, @"Freshly built catalog index failed validation; this is a bug");
+	return index;
+}
+
+#pragma mark Lookups
+
+- (NSUInteger) numberOfItems {
+	return _header->numRecordLocations;
+}
+
+- (ImpDehydratedItem *_Nullable) itemWithCatalogNodeID:(HFSCatalogNodeID const)cnid {
+	ImpSourceVolume *_Nullable const srcVol = _volume;
+	if (srcVol == nil) {
+		return nil;
+	}
+
+	//Find the first location whose CNID isn't less than the one we want.
+	u_int32_t low = 0, high = _header->numRecordLocations;
+	while (low < high) {
+		u_int32_t const mid = low + (high - low) / 2;
+		if (_recordLocations[mid].cnid < cnid) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	if (low == _header->numRecordLocations || _recordLocations[low].cnid != cnid) {
+		return nil;
+	}
+	struct ImpCatalogIndexRecordLocation const *_Nonnull const location = &_recordLocations[low];
+
+	ImpBTreeFile *_Nonnull const catalog = srcVol.catalogBTree;
+	if (location->nodeIndex == 0 || ! [catalog isValidIndex:location->nodeIndex]) {
+		return nil;
+	}
+	ImpBTreeNode *_Nonnull const node = [catalog nodeAtIndex:location->nodeIndex];
+	if (location->recordIndex >= node.numberOfRecords) {
+		return nil;
+	}
+	void const *_Nonnull const keyPtr = [node pointerToKeyOfRecordAtIndex:location->recordIndex length:NULL];
+	void const *_Nonnull const payloadPtr = [node pointerToPayloadOfRecordAtIndex:location->recordIndex length:NULL];
+
+	//The identity check should have caught any change to the catalog, but make sure the record is the one we were promised before building an item from it.
+	if ([srcVol isKindOfClass:[ImpHFSPlusSourceVolume class]]) {
+		ImpHFSPlusSourceVolume *_Nonnull const hfsPlusVol = (ImpHFSPlusSourceVolume *)srcVol;
+		if (location->isFolder) {
+			struct HFSPlusCatalogFolder const *_Nonnull const folderRec = payloadPtr;
+			return L(folderRec->folderID) == cnid ? [[ImpDehydratedItem alloc] initWithHFSPlusSourceVolume:hfsPlusVol catalogNodeID:cnid key:keyPtr folderRecord:folderRec] : nil;
+		} else {
+			struct HFSPlusCatalogFile const *_Nonnull const fileRec = payloadPtr;
+			return L(fileRec->fileID) == cnid ? [[ImpDehydratedItem alloc] initWithHFSPlusSourceVolume:hfsPlusVol catalogNodeID:cnid key:keyPtr fileRecord:fileRec] : nil;
+		}
+	} else {
+		ImpHFSSourceVolume *_Nonnull const hfsVol = (ImpHFSSourceVolume *)srcVol;
+		if (location->isFolder) {
+			struct HFSCatalogFolder const *_Nonnull const folderRec = payloadPtr;
+			return L(folderRec->folderID) == cnid ? [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVol catalogNodeID:cnid key:keyPtr folderRecord:folderRec] : nil;
+		} else {
+			struct HFSCatalogFile const *_Nonnull const fileRec = payloadPtr;
+			return L(fileRec->fileID) == cnid ? [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVol catalogNodeID:cnid key:keyPtr fileRecord:fileRec] : nil;
+		}
+	}
+}
+
+- (HFSCatalogNodeID) catalogNodeIDOfItemNamed:(NSString *_Nonnull const)name inFolderWithID:(HFSCatalogNodeID const)parentID {
+	char const *_Nonnull const nameUTF8 = name.UTF8String ?: "";
+	u_int32_t const nameLength = (u_int32_t)strlen(nameUTF8);
+
+	//Find the first entry that isn't less than (parentID, name).
+	u_int32_t low = 0, high = _header->numNameEntries;
+	while (low < high) {
+		u_int32_t const mid = low + (high - low) / 2;
+		struct ImpCatalogIndexNameEntry const *_Nonnull const entry = &_nameEntries[mid];
+		bool const entryIsLess = entry->parentID < parentID || (entry->parentID == parentID && ImpCatalogIndexCompareNames(_nameBytes + entry->nameOffset, entry->nameLength, nameUTF8, nameLength) < 0);
+		if (entryIsLess) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	if (low == _header->numNameEntries) {
+		return 0;
+	}
+	struct ImpCatalogIndexNameEntry const *_Nonnull const entry = &_nameEntries[low];
+	bool const found = entry->parentID == parentID && ImpCatalogIndexCompareNames(_nameBytes + entry->nameOffset, entry->nameLength, nameUTF8, nameLength) == 0;
+	return found ? entry->cnid : 0;
+}
+
+- (void) forEachItemNamed:(NSString *_Nonnull const)name block:(void (^_Nonnull const)(HFSCatalogNodeID const cnid))block {
+	char const *_Nonnull const nameUTF8 = name.UTF8String ?: "";
+	u_int32_t const nameLength = (u_int32_t)strlen(nameUTF8);
+
+	//Names are only sorted within each folder, so this has to look at all of them. It's still just a pass over a flat table, with no catalog records or strings involved.
+	for (u_int32_t i = 0; i < _header->numNameEntries; ++i) {
+		struct ImpCatalogIndexNameEntry const *_Nonnull const entry = &_nameEntries[i];
+		if (entry->nameLength == nameLength && memcmp(_nameBytes + entry->nameOffset, nameUTF8, nameLength) == 0) {
+			block(entry->cnid);
+		}
+	}
+}
+
+- (struct ImpCatalogIndexExtent const *_Nullable) extentsOfFileWithID:(HFSCatalogNodeID const)cnid
+	fork:(ImpForkType const)forkType
+	count:(NSUInteger *_Nonnull const)outNumExtents
+{
+	//Find the first fork that isn't less than (cnid, forkType).
+	u_int32_t low = 0, high = _header->numForks;
+	while (low < high) {
+		u_int32_t const mid = low + (high - low) / 2;
+		struct ImpCatalogIndexFork const *_Nonnull const fork = &_forks[mid];
+		if (fork->cnid < cnid || (fork->cnid == cnid && fork->forkType < forkType)) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	if (low == _header->numForks || _forks[low].cnid != cnid || _forks[low].forkType != forkType) {
+		*outNumExtents = 0;
+		return NULL;
+	}
+	*outNumExtents = _forks[low].numExtents;
+	return _extents + _forks[low].firstExtentIndex;
+}
+
+@end
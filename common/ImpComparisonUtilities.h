@@ -7,6 +7,8 @@
 
 #import <Foundation/Foundation.h>
 
+#import <hfs/hfs_format.h>
+
 typedef NS_ENUM(int8_t, ImpBTreeComparisonResult) {
 	///The key being searched for is less than (should come before) the key found in a node.
 	ImpBTreeComparisonQuarryIsLesser = -1,
@@ -26,3 +28,22 @@ ImpBTreeComparisonResult ImpBTreeCompareHFSPlusCatalogKeys(struct HFSPlusCatalog
 
 ///Implements the case-insensitive Unicode string comparison algorithm defined by TN1150, “HFS Plus Volume Format”.
 NSComparisonResult ImpHFSPlusCompareNames(struct HFSUniStr255 const *_Nonnull const str0, struct HFSUniStr255 const *_Nonnull const str1);
+
+///Maximum number of UTF-16 units in a folded HFS+ name; the same as the maximum length of an HFSUniStr255.
+enum { ImpHFSPlusFoldedNameMaximumLength = 255 };
+
+///An HFS+ name that has been run through TN1150's case folding once, so that it can be compared many times without folding it again. The units are in host byte order, and ignorable characters have been removed.
+struct ImpHFSPlusFoldedName {
+	u_int16_t length;
+	UniChar unicode[ImpHFSPlusFoldedNameMaximumLength];
+};
+
+///Fold an HFS+ name (in big-endian order, as it appears in a catalog key) into a sort key: lowercase each character per TN1150 and drop ignorable characters. outUnits must have room for ImpHFSPlusFoldedNameMaximumLength units. Returns the number of units written, which may be 0 if the name is empty or entirely ignorable.
+///Comparing two names' sort keys with ImpHFSPlusCompareFoldedNames gives the same result as comparing the names themselves with ImpHFSPlusCompareNames.
+NSUInteger ImpHFSPlusFoldName(struct HFSUniStr255 const *_Nonnull const name, UniChar *_Nonnull const outUnits);
+
+///Compare two sort keys produced by ImpHFSPlusFoldName.
+NSComparisonResult ImpHFSPlusCompareFoldedNames(UniChar const *_Nonnull const units0, NSUInteger const length0, UniChar const *_Nonnull const units1, NSUInteger const length1);
+
+///Like ImpBTreeCompareHFSPlusCatalogKeys, but with the quarry's name already folded. Use this when searching for one key among many, so the quarry only gets folded once.
+ImpBTreeComparisonResult ImpBTreeCompareHFSPlusCatalogKeyWithFoldedName(HFSCatalogNodeID const quarryParentID, struct ImpHFSPlusFoldedName const *_Nonnull const quarryName, struct HFSPlusCatalogKey const *_Nonnull const foundCatKeyPtr);
@@ -9,6 +9,8 @@
 
 #import "ImpByteOrder.h"
 
+#import <simd/simd.h>
+
 ///Historically declared in TextUtils.h, but now so deprecated that it's not even in the headers anymore. Could go away at any time, in which case this will need to be replaced with either a clean original implementation or Apple's open-source FastRelString from diskdev_cmds-491.3/fsck_hfs.tproj.
 //NOTE: Must be declared as int32_t, not NSComparisonResult, as the latter is long, which is 64-bit on LP64 systems, and this does not return a 64-bit value. If you declare this as NSComparisonResult, you get INT_MAX rather than -1.
 extern int32_t RelString(ConstStr255Param a, ConstStr255Param b, bool const caseSensitive, bool const diacriticSensitive);
@@ -37,10 +39,9 @@ ImpBTreeComparisonResult ImpBTreeCompareHFSPlusCatalogKeys(struct HFSPlusCatalog
 ///Use my original implementation of the TN1150 algorithm rather than the sample code copied in from the technote's attachment.
 #define ORIGINAL_IMPLEMENTATION 0
 
+static UInt16 tn1150_gLowerCaseTable[256 * 11];
 #if ORIGINAL_IMPLEMENTATION
 static UInt16 tn1150_gLowerCaseTables[11][256];
-#else
-static UInt16 tn1150_gLowerCaseTable[256 * 11];
 #endif
 
 NSComparisonResult ImpHFSPlusCompareNames(struct HFSUniStr255 const *_Nonnull const str0, struct HFSUniStr255 const *_Nonnull const str1) {
@@ -121,6 +122,134 @@ NSComparisonResult ImpHFSPlusCompareNames(struct HFSUniStr255 const *_Nonnull co
 	return c0 < c1 ? NSOrderedAscending : NSOrderedDescending;
 }
 
+#pragma mark Folded names
+
+///Fold eight big-endian units at once, if they are all non-NUL ASCII characters (which are the only ones whose folding is as simple as A-Z → a-z, and none of which are ignorable). Returns false, without touching *outUnits, if any of them isn't.
+static bool ImpHFSPlusFoldASCIIChunk(UniChar const *_Nonnull const bigEndianUnits, simd_ushort8 *_Nonnull const outUnits) {
+	simd_ushort8 const lowestASCII = 0x0001, highestASCII = 0x007f;
+	simd_ushort8 const uppercaseA = 'A', uppercaseZ = 'Z', caseDifference = 'a' - 'A';
+
+	simd_ushort8 units;
+	memcpy(&units, bigEndianUnits, sizeof(units));
+#if __LITTLE_ENDIAN__
+	units = (units << 8) | (units >> 8);
+#endif
+	if (! simd_all((units >= lowestASCII) & (units <= highestASCII))) {
+		return false;
+	}
+	simd_short8 const isUppercase = (units >= uppercaseA) & (units <= uppercaseZ);
+	*outUnits = units + ((simd_ushort8)isUppercase & caseDifference);
+	return true;
+}
+
+///Fold as much of the start of a name as possible eight units at a time, stopping at the first group of eight that isn't all plain ASCII. Returns the number of units folded, which is always a multiple of 8.
+static NSUInteger ImpHFSPlusFoldASCIIPrefix(UniChar const *_Nonnull const bigEndianUnits, NSUInteger const length, UniChar *_Nonnull const outUnits) {
+	NSUInteger idx = 0;
+	simd_ushort8 units;
+	for (; idx + 8 <= length && ImpHFSPlusFoldASCIIChunk(bigEndianUnits + idx, &units); idx += 8) {
+		memcpy(outUnits + idx, &units, sizeof(units));
+	}
+	return idx;
+}
+
+NSUInteger ImpHFSPlusFoldName(struct HFSUniStr255 const *_Nonnull const name, UniChar *_Nonnull const outUnits) {
+	static UInt16 const *_Nonnull const lowercaseTable = tn1150_gLowerCaseTable;
+
+	NSUInteger const length = MIN((NSUInteger)L(name->length), (NSUInteger)ImpHFSPlusFoldedNameMaximumLength);
+	NSUInteger const numASCIIUnits = ImpHFSPlusFoldASCIIPrefix(name->unicode, length, outUnits);
+
+	NSUInteger outLength = numASCIIUnits;
+	for (NSUInteger idx = numASCIIUnits; idx < length; ++idx) {
+		UniChar c = L(name->unicode[idx]);
+		UInt16 const tableValue = lowercaseTable[c >> 8];
+		if (tableValue != 0) {
+			c = lowercaseTable[tableValue + (c & 0x00ff)];
+		}
+		if (c != 0) {
+			outUnits[outLength++] = c;
+		}
+	}
+	return outLength;
+}
+
+NSComparisonResult ImpHFSPlusCompareFoldedNames(UniChar const *_Nonnull const units0, NSUInteger const length0, UniChar const *_Nonnull const units1, NSUInteger const length1) {
+	NSUInteger const commonLength = MIN(length0, length1);
+	NSUInteger idx = 0;
+
+	//Skip over the common prefix eight units at a time, then find the exact point of difference one unit at a time.
+	for (; idx + 8 <= commonLength; idx += 8) {
+		simd_ushort8 chunk0, chunk1;
+		memcpy(&chunk0, units0 + idx, sizeof(chunk0));
+		memcpy(&chunk1, units1 + idx, sizeof(chunk1));
+		if (! simd_all(chunk0 == chunk1)) {
+			break;
+		}
+	}
+	for (; idx < commonLength; ++idx) {
+		if (units0[idx] != units1[idx]) {
+			return units0[idx] < units1[idx] ? NSOrderedAscending : NSOrderedDescending;
+		}
+	}
+
+	//One is a prefix of the other (or they're the same), so the shorter one comes first.
+	if (length0 < length1) return NSOrderedAscending;
+	if (length0 > length1) return NSOrderedDescending;
+	return NSOrderedSame;
+}
+
+ImpBTreeComparisonResult ImpBTreeCompareHFSPlusCatalogKeyWithFoldedName(HFSCatalogNodeID const quarryParentID, struct ImpHFSPlusFoldedName const *_Nonnull const quarryName, struct HFSPlusCatalogKey const *_Nonnull const foundCatKeyPtr) {
+	HFSCatalogNodeID const foundParentID = L(foundCatKeyPtr->parentID);
+	if (quarryParentID > foundParentID) {
+		return ImpBTreeComparisonQuarryIsGreater;
+	}
+	if (quarryParentID < foundParentID) {
+		return ImpBTreeComparisonQuarryIsLesser;
+	}
+
+	static UInt16 const *_Nonnull const lowercaseTable = tn1150_gLowerCaseTable;
+	UniChar const *_Nonnull const quarryUnits = quarryName->unicode;
+	NSUInteger const quarryLength = quarryName->length;
+	UniChar const *_Nonnull const foundUnits = foundCatKeyPtr->nodeName.unicode;
+	NSUInteger const foundLength = MIN((NSUInteger)L(foundCatKeyPtr->nodeName.length), (NSUInteger)ImpHFSPlusFoldedNameMaximumLength);
+
+	//Most comparisons in a search are decided within the first few characters, so the found name is only folded as far as the first difference.
+	//Plain ASCII has no ignorable characters, so while the found name's next eight units are all ASCII, both names advance in lockstep and can be compared a vector at a time. A vector that doesn't match is compared again below, one unit at a time, to find which unit differs.
+	NSUInteger quarryIdx = 0, foundIdx = 0;
+	simd_ushort8 foundChunk;
+	while (quarryIdx + 8 <= quarryLength && foundIdx + 8 <= foundLength && ImpHFSPlusFoldASCIIChunk(foundUnits + foundIdx, &foundChunk)) {
+		simd_ushort8 quarryChunk;
+		memcpy(&quarryChunk, quarryUnits + quarryIdx, sizeof(quarryChunk));
+		if (! simd_all(quarryChunk == foundChunk)) {
+			break;
+		}
+		quarryIdx += 8;
+		foundIdx += 8;
+	}
+
+	for (; foundIdx < foundLength; ++foundIdx) {
+		UniChar c = L(foundUnits[foundIdx]);
+		UInt16 const tableValue = lowercaseTable[c >> 8];
+		if (tableValue != 0) {
+			c = lowercaseTable[tableValue + (c & 0x00ff)];
+		}
+		if (c == 0) {
+			//Ignorable.
+			continue;
+		}
+		if (quarryIdx == quarryLength) {
+			//The quarry is a prefix of the found name, so it comes first.
+			return ImpBTreeComparisonQuarryIsLesser;
+		}
+		UniChar const quarryChar = quarryUnits[quarryIdx++];
+		if (quarryChar != c) {
+			return quarryChar < c ? ImpBTreeComparisonQuarryIsLesser : ImpBTreeComparisonQuarryIsGreater;
+		}
+	}
+
+	//The found name is a prefix of the quarry (or they're the same).
+	return quarryIdx < quarryLength ? ImpBTreeComparisonQuarryIsGreater : ImpBTreeComparisonQuarryIsEqual;
+}
+
 #pragma mark Copied from Apple sample code attached to TN1150
 
 /*!  The lower case table consists of a 256-entry high-byte table followed by
@@ -0,0 +1,41 @@
+//
+//  ImpConversionReport.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-19.
+//
+
+#import <Foundation/Foundation.h>
+
+typedef NS_ENUM(u_int8_t, ImpConversionReportFormat) {
+	ImpConversionReportFormatJSON,
+	ImpConversionReportFormatCSV,
+};
+
+/*!A conversion report records, for each step of a conversion, how long it took (wall-clock and CPU time) and how much work it did, as measured by the performance counters (see ImpPerformanceCounters.h): reads and writes, B-tree node visits, allocator calls, and the most buffer memory in use at any point during the step.
+ *CPU time and the counters are process-wide. That's what you want for a single conversion, since it counts the work of any threads the conversion starts, but if other conversions are running in the same process at the same time, their work will show up in this report too.
+ */
+@interface ImpConversionReport : NSObject
+
+///Start measuring a step. Steps can't overlap; if a step is already being measured, it's ended first.
+- (void) beginStepNamed:(NSString *_Nonnull const)stepName;
+///Stop measuring the current step and record it. succeeded is included in the report, so a step that failed partway can be told apart from one that finished.
+- (void) endStepWithSuccess:(bool const)succeeded;
+
+///One dictionary per step, in the order they were measured. Keys are the column names in columnNames.
+@property(readonly, copy) NSArray <NSDictionary <NSString *, id> *> *_Nonnull steps;
+///The names of each step's fields, in the order they appear in CSV output.
++ (NSArray <NSString *> *_Nonnull) columnNames;
+
+///Guess the format from a path's extension: .csv means CSV; anything else means JSON.
++ (ImpConversionReportFormat) formatForPathExtension:(NSString *_Nonnull const)pathExtension;
+
+///The report as JSON: an object with a "steps" array and a "total" object summing all steps (except for peak buffer bytes, which is the highest of any step).
+- (NSData *_Nonnull) JSONData;
+///Write the report as CSV, one row per step followed by a row named "total".
+- (void) writeCSVToFileHandle:(NSFileHandle *_Nonnull const)fileHandle;
+
+///Write the report to a file in the given format, replacing the file if it exists.
+- (bool) writeToURL:(NSURL *_Nonnull const)url format:(ImpConversionReportFormat const)format error:(NSError *_Nullable *_Nullable const)outError;
+
+@end
@@ -0,0 +1,215 @@
+//
+//  ImpConversionReport.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-19.
+//
+
+#import "ImpConversionReport.h"
+
+#import "ImpPerformanceCounters.h"
+#import "ImpCSVProducer.h"
+
+#import <sys/resource.h>
+#import <time.h>
+
+static NSString *_Nonnull const ImpReportStepKey = @"step";
+static NSString *_Nonnull const ImpReportSucceededKey = @"succeeded";
+static NSString *_Nonnull const ImpReportWallSecondsKey = @"wall_seconds";
+static NSString *_Nonnull const ImpReportUserCPUSecondsKey = @"user_cpu_seconds";
+static NSString *_Nonnull const ImpReportSystemCPUSecondsKey = @"system_cpu_seconds";
+static NSString *_Nonnull const ImpReportReadCallsKey = @"read_calls";
+static NSString *_Nonnull const ImpReportBytesReadKey = @"bytes_read";
+static NSString *_Nonnull const ImpReportWriteCallsKey = @"write_calls";
+static NSString *_Nonnull const ImpReportBytesWrittenKey = @"bytes_written";
+static NSString *_Nonnull const ImpReportBTreeNodeVisitsKey = @"btree_node_visits";
+static NSString *_Nonnull const ImpReportAllocatorCallsKey = @"allocator_calls";
+static NSString *_Nonnull const ImpReportPeakBufferBytesKey = @"peak_buffer_bytes";
+
+static double ImpMonotonicSeconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static double ImpSecondsFromTimeval(struct timeval const tv) {
+	return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+@implementation ImpConversionReport
+{
+	NSMutableArray <NSDictionary <NSString *, id> *> *_Nonnull _steps;
+
+	NSString *_Nullable _currentStepName;
+	double _currentStepStartTime;
+	struct rusage _currentStepStartUsage;
+	struct ImpPerformanceCounterSnapshot _currentStepStartCounters;
+}
+
+- (instancetype _Nonnull) init {
+	if ((self = [super init])) {
+		_steps = [NSMutableArray arrayWithCapacity:4];
+	}
+	return self;
+}
+
++ (NSArray <NSString *> *_Nonnull) columnNames {
+	return @[
+		ImpReportStepKey,
+		ImpReportSucceededKey,
+		ImpReportWallSecondsKey,
+		ImpReportUserCPUSecondsKey,
+		ImpReportSystemCPUSecondsKey,
+		ImpReportReadCallsKey,
+		ImpReportBytesReadKey,
+		ImpReportWriteCallsKey,
+		ImpReportBytesWrittenKey,
+		ImpReportBTreeNodeVisitsKey,
+		ImpReportAllocatorCallsKey,
+		ImpReportPeakBufferBytesKey,
+	];
+}
+
++ (ImpConversionReportFormat) formatForPathExtension:(NSString *_Nonnull const)pathExtension {
+	return [pathExtension caseInsensitiveCompare:@"csv"] == NSOrderedSame ? ImpConversionReportFormatCSV : ImpConversionReportFormatJSON;
+}
+
+#pragma mark Measuring
+
+- (void) beginStepNamed:(NSString *_Nonnull const)stepName {
+	if (_currentStepName != nil) {
+		[self endStepWithSuccess:true];
+	}
+
+	_currentStepName = [stepName copy];
+	ImpPerformanceCountersResetPeakBufferBytes();
+	ImpPerformanceCountersGetSnapshot(&_currentStepStartCounters);
+	getrusage(RUSAGE_SELF, &_currentStepStartUsage);
+	_currentStepStartTime = ImpMonotonicSeconds();
+}
+
+- (void) endStepWithSuccess:(bool const)succeeded {
+	double const endTime = ImpMonotonicSeconds();
+	struct rusage endUsage;
+	getrusage(RUSAGE_SELF, &endUsage);
+	struct ImpPerformanceCounterSnapshot endCounters;
+	ImpPerformanceCountersGetSnapshot(&endCounters);
+
+	if (_currentStepName == nil) {
+		return;
+	}
+
+	struct ImpPerformanceCounterSnapshot const *_Nonnull const start = &_currentStepStartCounters;
+	[_steps addObject:@{
+		ImpReportStepKey: _currentStepName,
+		ImpReportSucceededKey: @(succeeded),
+		ImpReportWallSecondsKey: @(endTime - _currentStepStartTime),
+		ImpReportUserCPUSecondsKey: @(ImpSecondsFromTimeval(endUsage.ru_utime) - ImpSecondsFromTimeval(_currentStepStartUsage.ru_utime)),
+		ImpReportSystemCPUSecondsKey: @(ImpSecondsFromTimeval(endUsage.ru_stime) - ImpSecondsFromTimeval(_currentStepStartUsage.ru_stime)),
+		ImpReportReadCallsKey: @(endCounters.readCalls - start->readCalls),
+		ImpReportBytesReadKey: @(endCounters.bytesRead - start->bytesRead),
+		ImpReportWriteCallsKey: @(endCounters.writeCalls - start->writeCalls),
+		ImpReportBytesWrittenKey: @(endCounters.bytesWritten - start->bytesWritten),
+		ImpReportBTreeNodeVisitsKey: @(endCounters.bTreeNodeVisits - start->bTreeNodeVisits),
+		ImpReportAllocatorCallsKey: @(endCounters.allocatorCalls - start->allocatorCalls),
+		ImpReportPeakBufferBytesKey: @(endCounters.peakBufferBytes),
+	}];
+	_currentStepName = nil;
+}
+
+- (NSArray<NSDictionary<NSString *,id> *> *_Nonnull) steps {
+	return [_steps copy];
+}
+
+#pragma mark Output
+
+///Sum every step's numbers, except for the peak, which is the greatest of any step's. succeeded is true only if every step succeeded.
+- (NSDictionary <NSString *, id> *_Nonnull) totalRow {
+	NSMutableDictionary <NSString *, id> *_Nonnull const total = [NSMutableDictionary dictionaryWithCapacity:[[self class] columnNames].count];
+	total[ImpReportStepKey] = @"total";
+	bool allSucceeded = true;
+	double wallSeconds = 0.0, userCPUSeconds = 0.0, systemCPUSeconds = 0.0;
+	unsigned long long peakBufferBytes = 0;
+	NSArray <NSString *> *_Nonnull const countKeys = @[
+		ImpReportReadCallsKey, ImpReportBytesReadKey,
+		ImpReportWriteCallsKey, ImpReportBytesWrittenKey,
+		ImpReportBTreeNodeVisitsKey, ImpReportAllocatorCallsKey,
+	];
+	unsigned long long counts[countKeys.count];
+	memset(counts, 0, sizeof(counts));
+
+	for (NSDictionary <NSString *, id> *_Nonnull const step in _steps) {
+		allSucceeded = allSucceeded && [step[ImpReportSucceededKey] boolValue];
+		wallSeconds += [step[ImpReportWallSecondsKey] doubleValue];
+		userCPUSeconds += [step[ImpReportUserCPUSecondsKey] doubleValue];
+		systemCPUSeconds += [step[ImpReportSystemCPUSecondsKey] doubleValue];
+		peakBufferBytes = MAX(peakBufferBytes, [step[ImpReportPeakBufferBytesKey] unsignedLongLongValue]);
+		for (NSUInteger i = 0; i < countKeys.count; ++i) {
+			counts[i] += [step[countKeys[i]] unsignedLongLongValue];
+		}
+	}
+
+	total[ImpReportSucceededKey] = @(allSucceeded);
+	total[ImpReportWallSecondsKey] = @(wallSeconds);
+	total[ImpReportUserCPUSecondsKey] = @(userCPUSeconds);
+	total[ImpReportSystemCPUSecondsKey] = @(systemCPUSeconds);
+	total[ImpReportPeakBufferBytesKey] = @(peakBufferBytes);
+	for (NSUInteger i = 0; i < countKeys.count; ++i) {
+		total[countKeys[i]] = @(counts[i]);
+	}
+	return total;
+}
+
+- (NSData *_Nonnull) JSONData {
+	NSDictionary *_Nonnull const report = @{
+		@"steps": _steps,
+		@"total": [self totalRow],
+	};
+	NSError *_Nullable jsonError = nil;
+	NSData *_Nullable const data = [NSJSONSerialization dataWithJSONObject:report options:NSJSONWritingPrettyPrinted | NSJSONWritingSortedKeys error:&jsonError];
+	NSAssert(data != nil, @"Failed to serialize conversion report (this is a bug): %@", jsonError);
+	return data;
+}
+
+- (void) writeCSVToFileHandle:(NSFileHandle *_Nonnull const)fileHandle {
+	NSArray <NSString *> *_Nonnull const columnNames = [[self class] columnNames];
+	ImpCSVProducer *_Nonnull const csvProducer = [[ImpCSVProducer alloc] initWithFileHandle:fileHandle headerRow:columnNames];
+
+	void (^_Nonnull const writeStep)(NSDictionary <NSString *, id> *_Nonnull const) = ^(NSDictionary <NSString *, id> *_Nonnull const step) {
+		NSMutableArray <NSString *> *_Nonnull const row = [NSMutableArray arrayWithCapacity:columnNames.count];
+		for (NSString *_Nonnull const key in columnNames) {
+			id _Nonnull const value = step[key];
+			if ([key isEqualToString:ImpReportSucceededKey]) {
+				[row addObject:[value boolValue] ? @"true" : @"false"];
+			} else if ([key hasSuffix:@"_seconds"]) {
+				[row addObject:[NSString stringWithFormat:@"%.6f", [value doubleValue]]];
+			} else {
+				[row addObject:[value description]];
+			}
+		}
+		[csvProducer writeRow:row];
+	};
+
+	for (NSDictionary <NSString *, id> *_Nonnull const step in _steps) {
+		writeStep(step);
+	}
+	writeStep([self totalRow]);
+}
+
+- (bool) writeToURL:(NSURL *_Nonnull const)url format:(ImpConversionReportFormat const)format error:(NSError *_Nullable *_Nullable const)outError {
+	if (format == ImpConversionReportFormatJSON) {
+		return [[self JSONData] writeToURL:url options:NSDataWritingAtomic error:outError];
+	}
+
+	if (! [[NSData data] writeToURL:url options:0 error:outError]) {
+		return false;
+	}
+	NSFileHandle *_Nullable const fileHandle = [NSFileHandle fileHandleForWritingToURL:url error:outError];
+	if (fileHandle == nil) {
+		return false;
+	}
+	[self writeCSVToFileHandle:fileHandle];
+	return [fileHandle closeAndReturnError:outError];
+}
+
+@end
@@ -9,12 +9,12 @@
 
 #import "ImpTextEncodingConverter.h"
 #import "ImpSizeUtilities.h"
-#import "NSData+ImpMultiplication.h"
 #import "ImpSourceVolume.h"
 #import "ImpHFSSourceVolume.h"
 #import "ImpDestinationVolume.h"
 #import "ImpHFSPlusDestinationVolume.h"
 #import "ImpVirtualFileHandle.h"
+#import "ImpForkCopyEngine.h"
 #import "ImpBTreeFile.h"
 #import "ImpBTreeNode.h"
 #import "ImpBTreeIndexNode.h"
@@ -101,12 +101,9 @@
 
 	struct HFSPlusVolumeHeader *_Nonnull const vh = hfsPlusVol.mutableVolumeHeaderPointer;
 	__block bool hasAnyFiles = false;
-	__block NSUInteger numFilesCopied = 0, numFoldersCopied = 0;
 
 	u_int64_t const volumeLengthInBytes = dstVol.lengthInBytes ?: srcVol.lengthInBytes;
 
-	u_int32_t const bytesPerSourceABlock = (u_int32_t)srcVol.numberOfBytesPerBlock;
-
 	u_int32_t const bytesPerABlock = L(vh->blockSize);
 	u_int32_t const numBlocksInVolume = (u_int32_t)ImpCeilingDivide(volumeLengthInBytes, bytesPerABlock);
 	[hfsPlusVol initializeAllocationBitmapWithBlockSize:bytesPerABlock count:numBlocksInVolume];
@@ -122,7 +119,10 @@
 	[self reportSourceExtentRecordWillNotBeCopied:extentsOverflowFileSourceExtents];
 
 	ImpBTreeFile *_Nonnull const srcCatalog = srcVol.catalogBTree;
-	ImpMutableBTreeFile *_Nonnull const destCatalog = [self convertHFSCatalogFile:srcCatalog];
+	ImpMutableBTreeFile *_Nullable const destCatalog = [self convertHFSCatalogFile:srcCatalog error:outError];
+	if (destCatalog == nil) {
+		return false;
+	}
 	[self reportSourceExtentRecordCopied:catalogFileSourceExtents];
 
 	//Allocate the special files before anything else, so they get placed first on the disk.
@@ -139,7 +139,14 @@
 
 	__block bool copiedEverything = true;
 	bool const copyForkData = self.copyForkData;
-	NSData *_Nullable const placeholderForkData = copyForkData ? nil : self.placeholderForkData;
+	bool const verboseProgress = self.verboseProgress;
+
+	//The catalog walk and block allocation happen on this thread, in order, so the converted catalog comes out the same regardless of how the copies get scheduled. The copy engine only moves blocks.
+	ImpForkCopyEngine *_Nonnull const copyEngine = [[ImpForkCopyEngine alloc] initWithSourceVolume:hfsVol destinationVolume:dstVol];
+	bool const writesPlaceholders = ! copyForkData && self.writesPlaceholderForkData;
+	copyEngine.placeholderBlockData = writesPlaceholders ? self.placeholderForkData : nil;
+	copyEngine.writesForkData = copyForkData || writesPlaceholders;
+	copyEngine.readsInPhysicalOrder = self.readsSourceInPhysicalOrder;
 
 	//Copy all the files over.
 	[srcCatalog walkLeafNodes:^bool(ImpBTreeNode *const _Nonnull srcLeafNode) {
@@ -149,8 +156,6 @@
 			[self convertHFSCatalogKey:keyPtr toHFSPlus:&convertedKey];
 
 			struct HFSUniStr255 *_Nonnull const unicodeNamePtr = &convertedKey.nodeName;
-			NSString *_Nonnull const srcFilename = [srcVol.textEncodingConverter stringForPascalString:keyPtr->nodeName fromHFSCatalogKey:keyPtr];
-			NSString *_Nonnull const dstFilename = [dstVol.textEncodingConverter stringFromHFSUniStr255:unicodeNamePtr];
 
 			ImpBTreeCursor *_Nullable const cursor = [destCatalog searchCatalogTreeForItemWithParentID:convertedKey.parentID unicodeName:unicodeNamePtr];
 			NSAssert(cursor != nil, @"Could not find file “%@” in parent ID %u in the converted catalog, and thus could not copy the file's contents", [srcVol.textEncodingConverter stringFromHFSUniStr255:unicodeNamePtr], L(convertedKey.parentID));
@@ -158,7 +163,15 @@
 			struct HFSPlusCatalogFile *_Nonnull const convertedFilePtr = convertedFileRecData.mutableBytes;
 
 			hasAnyFiles = true;
-			[self deliverProgressUpdateWithOperationDescription:[NSString stringWithFormat:NSLocalizedString(@"Copying file “%@” to “%@”…", @"Conversion progress message"), [srcVol.textEncodingConverter stringByEscapingString:srcFilename], [dstVol.textEncodingConverter stringByEscapingString:dstFilename]]];
+			//Otherwise, progress is reported by the counters alone. Decoding and escaping two names per file is more work than copying many small files.
+			if (verboseProgress) {
+				NSString *_Nonnull const srcFilename = [srcVol.textEncodingConverter stringForPascalString:keyPtr->nodeName fromHFSCatalogKey:keyPtr];
+				NSString *_Nonnull const dstFilename = [dstVol.textEncodingConverter stringFromHFSUniStr255:unicodeNamePtr];
+				[self deliverProgressUpdateWithOperationDescription:[NSString stringWithFormat:NSLocalizedString(@"Copying file “%@” to “%@”…", @"Conversion progress message"), [srcVol.textEncodingConverter stringByEscapingString:srcFilename], [dstVol.textEncodingConverter stringByEscapingString:dstFilename]]];
+			}
+
+			//A file counts as copied once both of its forks have been. Completion blocks are always called on this thread, so this needs no synchronization.
+			__block unsigned numberOfForksStillCopying = 2;
 
 			//Copy the data fork.
 			u_int64_t const dataLogicalLength = L(fileRec->dataLogicalSize);
@@ -175,38 +188,24 @@
 			NSAssert(bytesNotYetAllocatedForData == 0, @"Failed to allocate %llu contiguous bytes in destination volume; ended up with %llu left over", dataLogicalLength, bytesNotYetAllocatedForData);
 //			ImpPrintf(@"Allocated for data fork: #%u to #%u", L(convertedFilePtr->dataFork.extents[0].startBlock), L(convertedFilePtr->dataFork.extents[0].startBlock) + L(convertedFilePtr->dataFork.extents[0].blockCount));
 
-			NSError *_Nullable dataReadError = nil;
-			__block NSError *_Nullable dataWriteError = nil;
-			ImpVirtualFileHandle *_Nonnull const dataFH = [dstVol fileHandleForWritingToExtents:convertedFilePtr->dataFork.extents];
-			__block u_int64_t totalDataBytesWritten = 0;
-			__block u_int32_t totalDataBlocksRead = 0;
-
-			[hfsVol forEachExtentInFileWithID:L(fileRec->fileID)
+			[copyEngine enqueueCopyOfForkWithID:L(fileRec->fileID)
 				fork:ImpForkTypeData
 				forkLogicalLength:dataLogicalLength
 				startingWithExtentsRecord:firstDataExtents
-				readDataOrReturnError:&dataReadError
-				block:^bool(NSData *const  _Nonnull fileData, const u_int64_t logicalLength)
+				toExtents:convertedFilePtr->dataFork.extents
+				completion:^(u_int64_t const totalDataBytesWritten, u_int32_t const totalDataBlocksRead, NSError *_Nullable const dataCopyError)
 			{
-//				ImpPrintf(@"Read file data: %lu physical bytes (%llu length remaining)", fileData.length, logicalLength);
-				NSUInteger const numBlocksThisRead = ImpCeilingDivide(fileData.length, bytesPerSourceABlock);
-				totalDataBlocksRead += numBlocksThisRead;
-				NSInteger const bytesWrittenThisTime = [dataFH writeData:copyForkData ? fileData : [placeholderForkData times_Imp:numBlocksThisRead] error:&dataWriteError];
-//				ImpPrintf(@"Wrote file data: %ld bytes", (long)bytesWrittenThisTime);
-				if (bytesWrittenThisTime >= 0) {
-					totalDataBytesWritten += bytesWrittenThisTime;
-//					ImpPrintf(@"Total written so far: %llu bytes", totalDataBytesWritten);
-					return true;
-				} else {
+				if (dataCopyError != nil) {
 					copiedEverything = false;
-					return false;
+				}
+//				ImpPrintf(@"Final tally: Wrote %llu out of %llu bytes", totalDataBytesWritten, dataLogicalLength);
+				NSAssert(totalDataBytesWritten == dataPhysicalLength, @"Failed to copy all data fork bytes due to %@: should have written %llu, but actually wrote %llu", dataCopyError, dataPhysicalLength, totalDataBytesWritten);
+				[self reportSourceBlocksCopied:totalDataBlocksRead];
+				[self reportBytesCopied:totalDataBytesWritten];
+				if (--numberOfForksStillCopying == 0) {
+					[self reportFilesCopied:1];
 				}
 			}];
-			[dataFH closeFile];
-
-//			ImpPrintf(@"Final tally: Wrote %llu out of %llu bytes", totalDataBytesWritten, dataLogicalLength);
-			NSAssert(totalDataBytesWritten == dataPhysicalLength, @"Failed to %@ all data fork bytes due to %@: should have written %llu, but actually wrote %llu", dataReadError != nil ? @"read" : dataWriteError != nil ? @"write" : @"copy", dataReadError ?: dataWriteError, dataPhysicalLength, totalDataBytesWritten);
-			[self reportSourceBlocksCopied:totalDataBlocksRead];
 
 			S(convertedFilePtr->dataFork.logicalSize, dataLogicalLength);
 			u_int64_t const totalDataBlocks = ImpNumberOfBlocksInHFSPlusExtentRecord(convertedFilePtr->dataFork.extents);
@@ -221,37 +220,23 @@
 			NSAssert(bytesNotYetAllocatedForRsrc == 0, @"Failed to allocate %llu contiguous bytes in destination volume; ended up with %llu left over", rsrcLogicalLength, bytesNotYetAllocatedForRsrc);
 //			ImpPrintf(@"Allocated for resource fork: #%u to #%u", L(convertedFilePtr->resourceFork.extents[0].startBlock), L(convertedFilePtr->resourceFork.extents[0].startBlock) + L(convertedFilePtr->resourceFork.extents[0].blockCount));
 
-			NSError *_Nullable rsrcReadError = nil;
-			__block NSError *_Nullable rsrcWriteError = nil;
-			ImpVirtualFileHandle *_Nonnull const rsrcFH = [dstVol fileHandleForWritingToExtents:convertedFilePtr->resourceFork.extents];
-			__block u_int64_t totalRsrcBytesWritten = 0;
-			__block u_int32_t totalRsrcBlocksRead = 0;
-
-			[hfsVol forEachExtentInFileWithID:L(fileRec->fileID)
+			[copyEngine enqueueCopyOfForkWithID:L(fileRec->fileID)
 				fork:ImpForkTypeResource
 				forkLogicalLength:rsrcLogicalLength
 				startingWithExtentsRecord:firstRsrcExtents
-				readDataOrReturnError:&rsrcReadError
-				block:^bool(NSData *const  _Nonnull fileData, const u_int64_t logicalLength)
+				toExtents:convertedFilePtr->resourceFork.extents
+				completion:^(u_int64_t const totalRsrcBytesWritten, u_int32_t const totalRsrcBlocksRead, NSError *_Nullable const rsrcCopyError)
 			{
-				NSUInteger const numBlocksThisRead = ImpCeilingDivide(fileData.length, bytesPerSourceABlock);
-				totalRsrcBlocksRead += numBlocksThisRead;
-				NSInteger const bytesWrittenThisTime = [rsrcFH writeData:copyForkData ? fileData : [placeholderForkData times_Imp:numBlocksThisRead] error:&rsrcWriteError];
-				if (bytesWrittenThisTime >= 0) {
-					totalRsrcBytesWritten += bytesWrittenThisTime;
-					return true;
-				} else {
+				if (rsrcCopyError != nil) {
 					copiedEverything = false;
-					return false;
+				}
+				NSAssert(totalRsrcBytesWritten == rsrcPhysicalLength, @"Failed to copy all resource fork bytes due to %@: should have written %llu, but actually wrote %llu", rsrcCopyError, rsrcPhysicalLength, totalRsrcBytesWritten);
+				[self reportSourceBlocksCopied:totalRsrcBlocksRead];
+				[self reportBytesCopied:totalRsrcBytesWritten];
+				if (--numberOfForksStillCopying == 0) {
+					[self reportFilesCopied:1];
 				}
 			}];
-			[rsrcFH closeFile];
-
-			NSAssert(totalRsrcBytesWritten == rsrcPhysicalLength, @"Failed to %@ all resource fork bytes due to %@: should have written %llu, but actually wrote %llu", rsrcReadError != nil ? @"read" : rsrcWriteError != nil ? @"write" : @"copy", rsrcReadError ?: rsrcWriteError, rsrcPhysicalLength, totalRsrcBytesWritten);
-
-//			ImpPrintf(@"After copy: Copied %u blocks + %u blocks = %u blocks from the input volume.", totalDataBlocksRead, totalRsrcBlocksRead, totalDataBlocksRead + totalRsrcBlocksRead);
-//			ImpPrintf(@"After copy: This file's lengths in the output volume are DF %llu bytes, RF %llu bytes. Physical sizes %llu blocks + %llu blocks = %llu blocks.", dataLogicalLength, rsrcLogicalLength, ImpNumberOfBlocksInHFSPlusExtentRecord(convertedFilePtr->dataFork.extents), ImpNumberOfBlocksInHFSPlusExtentRecord(convertedFilePtr->resourceFork.extents), ImpNumberOfBlocksInHFSPlusExtentRecord(convertedFilePtr->dataFork.extents) + ImpNumberOfBlocksInHFSPlusExtentRecord(convertedFilePtr->resourceFork.extents));
-			[self reportSourceBlocksCopied:totalRsrcBlocksRead];
 
 			S(convertedFilePtr->resourceFork.logicalSize, rsrcLogicalLength);
 			u_int64_t const totalRsrcBlocks = ImpNumberOfBlocksInHFSPlusExtentRecord(convertedFilePtr->resourceFork.extents);
@@ -261,22 +246,24 @@
 
 			cursor.payloadData = convertedFileRecData;
 
-			++numFilesCopied;
 			keepGoing = true;
 		}
 			folder:^(const struct HFSCatalogKey *const  _Nonnull keyPtr, const struct  HFSCatalogFolder *const _Nonnull fileRec) {
 			//The folder gets “copied” as part of copying the catalog, so we don't have anything to do here but bump the counter.
-			++numFoldersCopied;
+			//The root folder isn't counted in numberOfFolders, so leave it out here too.
+			if (L(keyPtr->parentID) != kHFSRootParentID) {
+				[self reportFoldersCopied:1];
+			}
 		}
 			thread:nil
 		];
 		return keepGoing;
 	}];
 
-	//One of the folders in the catalog is the root of the volume, which isn't counted in numberOfFolders, so decrement that back out.
-	--numFoldersCopied;
+	//Now actually copy the forks' contents. Orphan recovery relies on knowing which blocks were read, so every copy needs to have finished before we go looking for orphans.
+	[copyEngine waitUntilAllCopiesHaveFinished];
 
-	[self deliverProgressUpdateWithOperationDescription:[NSString stringWithFormat:NSLocalizedString(@"Copied %lu of %lu files and %lu of %lu folders", @"Conversion progress message"), numFilesCopied, srcVol.numberOfFiles, numFoldersCopied, srcVol.numberOfFolders]];
+	[self deliverProgressUpdateWithOperationDescription:[NSString stringWithFormat:NSLocalizedString(@"Copied %llu of %lu files and %llu of %lu folders", @"Conversion progress message"), self.numberOfFilesCopied, srcVol.numberOfFiles, self.numberOfFoldersCopied, srcVol.numberOfFolders]];
 
 	bool const shouldTryToRecoverOrphanedData = true;
 	NSUInteger const numOrphanedSrcBlocks = [srcVol numberOfBlocksThatAreAllocatedButHaveNotBeenAccessed];
@@ -297,18 +284,31 @@
 			ImpPrintf(@"Failed to allocate %u blocks for the rescued blocks file.", numDstBlocks32);
 		} else {
 			ImpVirtualFileHandle *_Nonnull const orphanedBlocksFH = [dstVol fileHandleForWritingToExtents:rescuedBlocksExtents];
+			__block bool wroteOrphanedBlocks = true;
+			__block NSError *_Nullable orphanedBlocksError = nil;
 			[srcVol findExtentsThatAreAllocatedButHaveNotBeenAccessed:^(NSRange const extent) {
+				if (! wroteOrphanedBlocks) {
+					return;
+				}
 				struct HFSExtentDescriptor orphanedExtent;
 				S(orphanedExtent.startBlock, (u_int16_t)extent.location);
 				S(orphanedExtent.blockCount, (u_int16_t)extent.length);
-				NSData *_Nonnull const recoveredBlocks = [hfsVol readDataFromFileDescriptor:srcVol.fileDescriptor
+				NSData *_Nullable const recoveredBlocks = [hfsVol readDataFromFileDescriptor:srcVol.fileDescriptor
 					logicalLength:physicalLength
 					extents:&orphanedExtent
 					numExtents:1
-					error:outError];
-				[orphanedBlocksFH writeData:recoveredBlocks error:outError];
+					error:&orphanedBlocksError];
+				wroteOrphanedBlocks = recoveredBlocks != nil && [orphanedBlocksFH writeData:recoveredBlocks error:&orphanedBlocksError] == (NSInteger)recoveredBlocks.length;
 			}];
-			[orphanedBlocksFH closeFile];
+			//The file handle holds on to anything short of a whole block until it's closed, so closing it is where the last of the rescued data actually gets written.
+			wroteOrphanedBlocks = [orphanedBlocksFH closeFileAndReturnError:&orphanedBlocksError] && wroteOrphanedBlocks;
+			if (! wroteOrphanedBlocks) {
+				ImpPrintf(@"Failed to write the rescued blocks file: %@", orphanedBlocksError.localizedDescription);
+				if (outError != NULL) {
+					*outError = orphanedBlocksError;
+				}
+				return false;
+			}
 			//We set this extent as the data for *both* the data and resource forks, because if the recovered data is in fact a resource map (as has happened with at least one real volume!) then having it in the resource fork makes it much easier to recover it on a (real or emulated) vintage system.
 			[destCatalog setExtentRecord:rescuedBlocksExtentsPtr
 				forFork:ImpForkTypeData
@@ -331,16 +331,14 @@
 	__block NSError *_Nullable catWriteError = nil;
 	[destCatalog serializeToData:^(NSData *const  _Nonnull data) {
 		ImpVirtualFileHandle *_Nonnull const catFH = [dstVol fileHandleForWritingToExtents:vh->catalogFile.extents];
-		wroteCatalog = [catFH writeData:data error:&catWriteError];
-		[catFH closeFile];
+		wroteCatalog = [catFH writeData:data error:&catWriteError] == (NSInteger)data.length && [catFH closeFileAndReturnError:&catWriteError];
 	}];
 
 	__block bool wroteExtentsOverflow = false;
 	__block NSError *_Nullable extWriteError = nil;
 	[destExtentsOverflow serializeToData:^(NSData *const  _Nonnull data) {
 		ImpVirtualFileHandle *_Nonnull const extFH = [dstVol fileHandleForWritingToExtents:vh->extentsFile.extents];
-		wroteExtentsOverflow = [extFH writeData:data error:&extWriteError];
-		[extFH closeFile];
+		wroteExtentsOverflow = [extFH writeData:data error:&extWriteError] == (NSInteger)data.length && [extFH closeFileAndReturnError:&extWriteError];
 	}];
 
 	S(vh->totalBlocks, numBlocksInVolume);
@@ -353,6 +351,9 @@
 	}
 
 	copiedEverything = copiedEverything && wroteCatalog && wroteExtentsOverflow;
+	if (! (wroteCatalog && wroteExtentsOverflow) && outError != NULL) {
+		*outError = wroteCatalog ? extWriteError : catWriteError;
+	}
 
 	[srcVol reportBlocksThatAreAllocatedButHaveNotBeenAccessed];
 
@@ -73,6 +73,8 @@ typedef NS_ENUM(NSUInteger, ImpDehydratedItemType) {
 @property(nonatomic, readonly) u_int64_t dataForkLogicalLength;
 ///The logical length of the file's resource fork as a number of bytes. Returns 0 for folders.
 @property(nonatomic, readonly) u_int64_t resourceForkLogicalLength;
+///The number of items directly within the folder, according to its catalog record. Unlike countOfChildren, this doesn't require the item to be part of a hierarchy. Returns 0 for files.
+@property(nonatomic, readonly) u_int32_t valence;
 
 ///The short version string from the item's 'vers' resource ID 1, if such a resource exists. Returns nil if there is no such resource or if the item is a folder. The string may be empty.
 - (NSString *_Nullable const) shortVersionString;
@@ -82,11 +84,13 @@ typedef NS_ENUM(NSUInteger, ImpDehydratedItemType) {
 ///Reconstruct the path to the item from the volume's catalog. Returns an array of item names, starting with the volume name, that, if joined by colons, will form an HFS path.
 - (NSArray <NSString *> *_Nonnull const) path;
 
-///Returns an NSData containing the data from either the data fork or the resource fork. Returns nil if whichFork is invalid or the item is not a file.
+///Returns an NSData containing the data from either the data fork or the resource fork. Returns nil if whichFork is invalid or the item is not a file. This holds the whole fork in memory, so it's meant for forks that need to be looked at all at once, like resource forks being parsed; rehydrating a file streams its forks instead.
 - (NSData *_Nullable const) rehydrateForkContents:(ImpForkType)whichFork;
 
 ///Create a real file or folder with the same contents and (as much as possible) metadata as the dehydrated item. Folders get rehydrated recursively, with all of their sub-items. Note that this must be the URL of the item to be created (i.e., parent directory + nameFromEncoding:).
 - (bool) rehydrateAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL error:(NSError *_Nullable *_Nonnull const)outError;
+///Like rehydrateAtRealWorldURL:error:, but a folder's files are rehydrated up to numberOfWorkers at a time. The folder hierarchy is created first, and the folders' dates are restored once every file has been rehydrated. rehydrateAtRealWorldURL:error: is the same as passing 1.
+- (bool) rehydrateAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL numberOfWorkers:(NSUInteger const)numberOfWorkers error:(NSError *_Nullable *_Nonnull const)outError;
 
 ///Create a real file or folder with the same contents and (as much as possible) metadata as the dehydrated item. Folders get rehydrated recursively, with all of their sub-items. The item's filename will be converted to Unicode and appended to realWorldParentURL.
 - (bool) rehydrateIntoRealWorldDirectoryAtURL:(NSURL *_Nonnull const)realWorldParentURL error:(NSError *_Nullable *_Nonnull const)outError;
@@ -96,6 +100,9 @@ typedef NS_ENUM(NSUInteger, ImpDehydratedItemType) {
 ///From an HFS volume, create a hierarchy of ImpDehydratedItems representing the files and folders on that volume. Returns the root directory.
 + (instancetype _Nonnull) rootDirectoryOfHFSVolume:(ImpSourceVolume *_Nonnull const)hfsVol;
 
+///From an HFS volume, call the block with an ImpDehydratedItem for every file and folder on that volume, in a single pass through the catalog. Items come in catalog order, which keeps each folder's contents together (starting with the root directory) but doesn't follow the hierarchy. Each item is created as its record is read and has no children, so, unlike rootDirectoryOfHFSVolume:, this never holds onto the whole hierarchy. Each folder's path is remembered by the volume as the folder goes by, so asking items for their paths is cheap. Return false from the block to stop.
++ (void) forEachItemInHFSVolume:(ImpSourceVolume *_Nonnull const)srcVol block:(bool (^_Nonnull const)(ImpDehydratedItem *_Nonnull const item))block;
+
 ///Only present on dehydrated folders created by rootDirectoryOfHFSVolume:. Contains all of the files and folders that are immediate children of this folder (i.e., whose parent is this folder).
 @property(nullable, nonatomic, readonly, copy) NSArray <ImpDehydratedItem *> *children;
 - (NSUInteger) countOfChildren;
@@ -106,5 +113,7 @@ typedef NS_ENUM(NSUInteger, ImpDehydratedItemType) {
 
 ///Used by ImpHFSLister to print directory hierarchies to the terminal. This is, effectively, the real implementation of the list command.
 - (void) printDirectoryHierarchy_asPaths:(bool)printAbsolutePaths;
+///Like printDirectoryHierarchy_asPaths: with absolute paths, but prints each item as soon as it's read from the catalog, using forEachItemInHFSVolume:block:. Output starts right away and memory use doesn't grow with the number of items, at the cost of listing folders in catalog order rather than hierarchy order.
++ (void) printCatalogOfHFSVolume:(ImpSourceVolume *_Nonnull const)srcVol;
 
 @end
@@ -8,6 +8,8 @@
 #import "ImpDehydratedItem.h"
 
 #import <os/overflow.h>
+#import <os/lock.h>
+#import <stdatomic.h>
 
 #import "ImpTextEncodingConverter.h"
 #import "ImpByteOrder.h"
@@ -19,6 +21,9 @@
 #import "ImpBTreeFile.h"
 #import "ImpBTreeNode.h"
 #import "ImpDehydratedResourceFork.h"
+#import "ImpPerformanceCounters.h"
+#import "ImpTrace.h"
+#import "ImpCatalogIndex.h"
 
 typedef NS_ENUM(u_int64_t, ImpVolumeSizeThreshold) {
 	//Rough estimates just for icon selection purposes.
@@ -27,15 +32,37 @@ typedef NS_ENUM(u_int64_t, ImpVolumeSizeThreshold) {
 	dvdMaxSize = 10ULL * 1048576ULL * 1024ULL,
 };
 
+enum {
+	///Forks are read this much at a time (rounded down to a whole number of blocks) when they're being rehydrated, so rehydrating a file takes the same amount of memory however big it is.
+	ImpRehydrationBufferSize = 1048576,
+};
+
 @interface ImpDehydratedItem ()
 
 - (bool) rehydrateFileAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL error:(NSError *_Nullable *_Nonnull const)outError;
-- (bool) rehydrateFolderAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL error:(NSError *_Nullable *_Nonnull const)outError;
+///Read a fork's contents a buffer at a time, calling the block with each piece in order, and stopping if it returns false. Only the fork's logical length is delivered. The buffer is reused, so the block must be done with the bytes before it returns. Returns false if any read failed, the fork couldn't be read in full, or the block returned false.
+- (bool) streamForkContents:(ImpForkType const)whichFork
+	toBlock:(bool (^_Nonnull const)(void const *_Nonnull const bytes, size_t const length))block
+	error:(NSError *_Nullable *_Nonnull const)outError;
+- (bool) rehydrateFolderAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL numberOfWorkers:(NSUInteger const)numberOfWorkers error:(NSError *_Nullable *_Nonnull const)outError;
 
 @property(nullable, nonatomic, readwrite, copy) NSArray <ImpDehydratedItem *> *children;
 
 @end
 
+///The folders and files under a folder being rehydrated, each with the real-world URL it's to be rehydrated at. Folders are in the order they were created, parents before their subfolders.
+@interface ImpRehydrationPlan : NSObject
+
+@property(readonly) NSMutableArray <ImpDehydratedItem *> *_Nonnull folders;
+@property(readonly) NSMutableArray <NSURL *> *_Nonnull folderURLs;
+@property(readonly) NSMutableArray <ImpDehydratedItem *> *_Nonnull files;
+@property(readonly) NSMutableArray <NSURL *> *_Nonnull fileURLs;
+
+- (void) addFolder:(ImpDehydratedItem *_Nonnull const)folder atRealWorldURL:(NSURL *_Nonnull const)realWorldURL;
+- (void) addFile:(ImpDehydratedItem *_Nonnull const)file atRealWorldURL:(NSURL *_Nonnull const)realWorldURL;
+
+@end
+
 static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z timeIntervalSinceReferenceDate
 
 @implementation ImpDehydratedItem
@@ -347,113 +374,197 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 		return L(fileRec->rsrcLogicalSize);
 	}
 }
+- (u_int32_t) valence {
+	if (! self.isDirectory) {
+		return 0;
+	}
+	if (_isHFSPlus) {
+		struct HFSPlusCatalogFolder const *_Nonnull const folderRec = self.hfsFolderCatalogRecordData.bytes;
+		return L(folderRec->valence);
+	} else {
+		struct HFSCatalogFolder const *_Nonnull const folderRec = self.hfsFolderCatalogRecordData.bytes;
+		return L(folderRec->valence);
+	}
+}
 
-///Search the catalog for parent items until reaching the volume root, then return the path so constructed.
+///Look up the path to the item's parent folder (which the volume remembers, so siblings and cousins don't search the catalog all over again), then add the item's own name.
 - (NSArray <NSString *> *_Nonnull const) path {
 	if (_cachedPath == nil) {
-		NSMutableArray <NSString *> *_Nonnull const path = [NSMutableArray arrayWithCapacity:8];
-		[path addObject:self.name];
-
-		ImpBTreeFile *_Nonnull const catalog = self.sourceVolume.catalogBTree;
-		NSData *_Nullable keyData = nil;
-		HFSCatalogNodeID nextParentID = self.parentFolderID;
-		NSData *_Nullable threadRecordData = nil;
-
-		//Keep ascending directories until we reach kHFSRootParentID, which is the parent of the root directory.
-		if (_isHFSPlus) {
-			struct HFSUniStr255 emptyName = { .length = 0 };
-			while (nextParentID != kHFSRootParentID && [catalog searchCatalogTreeForItemWithParentID:nextParentID unicodeName:&emptyName getRecordKeyData:&keyData threadRecordData:&threadRecordData]) {
-				struct HFSPlusCatalogThread const *_Nonnull const threadPtr = threadRecordData.bytes;
-				NSString *_Nonnull const name = [_tec stringFromHFSUniStr255:&(threadPtr->nodeName)];
-				[path insertObject:name atIndex:0];
-				nextParentID = L(threadPtr->parentID);
-			}
-		} else {
-			while (nextParentID != kHFSRootParentID && [catalog searchCatalogTreeForItemWithParentID:nextParentID name:"\p" getRecordKeyData:&keyData threadRecordData:&threadRecordData]) {
-				struct HFSCatalogThread const *_Nonnull const threadPtr = threadRecordData.bytes;
-				NSString *_Nonnull const name = [_tec stringForPascalString:threadPtr->nodeName];
-				[path insertObject:name atIndex:0];
-				nextParentID = L(threadPtr->parentID);
-			}
-		}
-
-		_cachedPath = path;
+		NSArray <NSString *> *_Nonnull const parentPath = [self.sourceVolume pathComponentsOfFolderWithID:self.parentFolderID] ?: @[];
+		_cachedPath = [parentPath arrayByAddingObject:self.name];
 	}
 
 	return _cachedPath;
 }
 
-- (NSData *_Nullable const) rehydrateForkContents:(ImpForkType)whichFork {
+///Look up a fork's logical length and initial extent record in the item's catalog record. Exactly one of the extent records is set, depending on whether the item is from an HFS or HFS+ volume. Returns false if the item is not a file or whichFork is invalid.
+- (bool) getLogicalLength:(u_int64_t *_Nonnull const)outLogicalLength
+	extents:(struct HFSExtentDescriptor const *_Nullable *_Nonnull const)outExtents
+	bigExtents:(struct HFSPlusExtentDescriptor const *_Nullable *_Nonnull const)outBigExtents
+	ofFork:(ImpForkType const)whichFork
+{
 	if (self.isDirectory) {
-		return nil;
+		return false;
 	}
 
-	ImpSourceVolume *_Nonnull const srcVolume = self.sourceVolume;
-	ImpHFSSourceVolume *_Nonnull const hfsVolume = [srcVolume isKindOfClass:[ImpHFSSourceVolume class]] ? (ImpHFSSourceVolume *)srcVolume : nil;
-	ImpHFSPlusSourceVolume *_Nullable const hfsPlusVolume = [srcVolume isKindOfClass:[ImpHFSPlusSourceVolume class]] ? (ImpHFSPlusSourceVolume *)srcVolume : nil;
-
 	NSData *_Nonnull const fileRecData = self.hfsFileCatalogRecordData;
 	struct HFSCatalogFile const *_Nullable const hfsFileRec = _isHFSPlus ? NULL : fileRecData.bytes;
 	struct HFSPlusCatalogFile const *_Nullable const hfsPlusFileRec = _isHFSPlus ? fileRecData.bytes : NULL;
 
-	u_int64_t logicalLength = 0;
-	struct HFSExtentDescriptor const *_Nullable extents = NULL;
-	struct HFSPlusExtentDescriptor const *_Nullable extentsPlus = NULL;
+	*outExtents = NULL;
+	*outBigExtents = NULL;
 	switch (whichFork) {
 		case ImpForkTypeData:
 			if (_isHFSPlus) {
-				logicalLength = L(hfsPlusFileRec->dataFork.logicalSize);
-				extentsPlus = hfsPlusFileRec->dataFork.extents;
+				*outLogicalLength = L(hfsPlusFileRec->dataFork.logicalSize);
+				*outBigExtents = hfsPlusFileRec->dataFork.extents;
 			} else {
-				logicalLength = L(hfsFileRec->dataLogicalSize);
-				extents = hfsFileRec->dataExtents;
+				*outLogicalLength = L(hfsFileRec->dataLogicalSize);
+				*outExtents = hfsFileRec->dataExtents;
 			}
-			break;
+			return true;
 
 		case ImpForkTypeResource:
 			if (_isHFSPlus) {
-				logicalLength = L(hfsPlusFileRec->resourceFork.logicalSize);
-				extentsPlus = hfsPlusFileRec->resourceFork.extents;
+				*outLogicalLength = L(hfsPlusFileRec->resourceFork.logicalSize);
+				*outBigExtents = hfsPlusFileRec->resourceFork.extents;
 			} else {
-				logicalLength = L(hfsFileRec->rsrcLogicalSize);
-				extents = hfsFileRec->rsrcExtents;
+				*outLogicalLength = L(hfsFileRec->rsrcLogicalSize);
+				*outExtents = hfsFileRec->rsrcExtents;
 			}
-			break;
+			return true;
 
 		default:
-			return nil;
+			return false;
 	}
+}
 
-	NSMutableData *_Nonnull const forkContents = [NSMutableData dataWithCapacity:logicalLength];
-	bool (^_Nonnull const appendBlock)(NSData *_Nonnull const fileData, u_int64_t const logicalLengthRemaining) = ^bool(NSData *_Nonnull const fileData, u_int64_t const logicalLengthRemaining) {
-		[forkContents appendData:fileData];
-		return true;
-	};
+- (bool) streamForkContents:(ImpForkType const)whichFork
+	toBlock:(bool (^_Nonnull const)(void const *_Nonnull const bytes, size_t const length))block
+	error:(NSError *_Nullable *_Nonnull const)outError
+{
+	u_int64_t logicalLength = 0;
+	struct HFSExtentDescriptor const *_Nullable extents = NULL;
+	struct HFSPlusExtentDescriptor const *_Nullable bigExtents = NULL;
+	if (! [self getLogicalLength:&logicalLength extents:&extents bigExtents:&bigExtents ofFork:whichFork]) {
+		if (outError != NULL) {
+			*outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadInvalidFileNameError userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Can't read a fork of something that isn't a file", @"") }];
+		}
+		return false;
+	}
 
-	//TODO: This still swallows the error on GUI clients.
-	NSError *_Nullable readError = nil;
+	ImpSourceVolume *_Nonnull const srcVolume = self.sourceVolume;
+	int const readFD = srcVolume.fileDescriptor;
+	u_int32_t const blockSize = srcVolume.numberOfBytesPerBlock;
+	u_int32_t const blocksPerBuffer = (u_int32_t)MAX(1, ImpRehydrationBufferSize / blockSize);
+	//A mapped source hands out views of the mapping, so it doesn't need a buffer at all.
+	bool const mappedSource = srcVolume.usesMemoryMapping;
+	u_int64_t const bufferSize = mappedSource ? 0 : (u_int64_t)blocksPerBuffer * blockSize;
+	NSMutableData *_Nonnull const buffer = [NSMutableData dataWithLength:bufferSize];
+	ImpPerformanceBufferAllocated(bufferSize);
+
+	__block u_int64_t logicalBytesDelivered = 0;
+	__block bool delivered = true;
+	__block NSError *_Nullable readError = nil;
+	u_int64_t (^_Nonnull const streamOneExtent)(u_int32_t const startBlock, u_int32_t const blockCount) = ^u_int64_t(u_int32_t const startBlock, u_int32_t const blockCount) {
+		u_int64_t const physicalLength = (u_int64_t)blockCount * blockSize;
+		for (u_int32_t blocksDone = 0; blocksDone < blockCount && logicalBytesDelivered < logicalLength; ) {
+			u_int32_t const numBlocks = MIN(blocksPerBuffer, blockCount - blocksDone);
+			u_int64_t amtRead = 0;
+			void const *_Nullable bytes = NULL;
+			NSData *_Nullable chunk = nil;
+			if (mappedSource) {
+				chunk = [srcVolume mappedDataForBlocksStartingAt:startBlock + blocksDone count:numBlocks error:&readError];
+				bytes = chunk.bytes;
+				amtRead = chunk.length;
+			} else {
+				//Only the last piece of an extent can be shorter than the buffer; shrinking the length doesn't give up the buffer's storage.
+				buffer.length = (NSUInteger)numBlocks * blockSize;
+				if ([srcVolume readIntoData:buffer atOffset:0 fromFileDescriptor:readFD startBlock:startBlock + blocksDone blockCount:numBlocks actualAmountRead:&amtRead error:&readError]) {
+					bytes = buffer.bytes;
+				}
+			}
+			if (bytes == NULL || amtRead == 0) {
+				delivered = false;
+				return 0;
+			}
 
-	u_int64_t totalLengthRead = 0;
-	if (_isHFSPlus) {
-		totalLengthRead = [hfsPlusVolume forEachExtentInFileWithID:self.catalogNodeID
+			//Only deliver the fork's logical contents, not whatever's in the rest of its last block.
+			size_t const length = (size_t)MIN(amtRead, logicalLength - logicalBytesDelivered);
+			if (! block(bytes, length)) {
+				delivered = false;
+				return 0;
+			}
+			logicalBytesDelivered += length;
+			blocksDone += numBlocks;
+		}
+		//Extents allocated past the end of the fork are skipped, but still count as consumed so the walk doesn't stop early.
+		return physicalLength;
+	};
+
+	ImpCatalogIndex *_Nullable const catalogIndex = srcVolume.catalogIndex;
+	NSUInteger numIndexedExtents = 0;
+	struct ImpCatalogIndexExtent const *_Nullable const indexedExtents = [catalogIndex extentsOfFileWithID:self.catalogNodeID fork:whichFork count:&numIndexedExtents];
+	if (indexedExtents != NULL) {
+		//The index already has every extent, overflow and all, so there's no need to look in the extents overflow file.
+		for (NSUInteger i = 0; i < numIndexedExtents && delivered && logicalBytesDelivered < logicalLength; ++i) {
+			streamOneExtent(indexedExtents[i].startBlock, indexedExtents[i].blockCount);
+		}
+	} else if (bigExtents != NULL) {
+		ImpHFSPlusSourceVolume *_Nonnull const hfsPlusVolume = (ImpHFSPlusSourceVolume *)srcVolume;
+		[hfsPlusVolume forEachExtentInFileWithID:self.catalogNodeID
 			fork:whichFork
 			forkLogicalLength:logicalLength
-			startingWithBigExtentsRecord:extentsPlus
-			readDataOrReturnError:&readError
-			block:appendBlock];
+			startingWithBigExtentsRecord:bigExtents
+			block:^u_int64_t(struct HFSPlusExtentDescriptor const *_Nonnull const oneExtent, u_int64_t const logicalBytesRemaining) {
+				return streamOneExtent(L(oneExtent->startBlock), L(oneExtent->blockCount));
+			}];
 	} else {
-		totalLengthRead = [hfsVolume forEachExtentInFileWithID:self.catalogNodeID
+		ImpHFSSourceVolume *_Nonnull const hfsVolume = (ImpHFSSourceVolume *)srcVolume;
+		[hfsVolume forEachExtentInFileWithID:self.catalogNodeID
 			fork:whichFork
 			forkLogicalLength:logicalLength
 			startingWithExtentsRecord:extents
-			readDataOrReturnError:&readError
-			block:appendBlock];
+			block:^u_int64_t(struct HFSExtentDescriptor const *_Nonnull const oneExtent, u_int64_t const logicalBytesRemaining) {
+				return streamOneExtent(L(oneExtent->startBlock), L(oneExtent->blockCount));
+			}];
+	}
+	ImpPerformanceBufferFreed(bufferSize);
+
+	if (delivered && logicalBytesDelivered < logicalLength) {
+		delivered = false;
+		readError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Failed to read %llu bytes; got %llu bytes instead", @""), logicalLength, logicalBytesDelivered] }];
+	}
+	if (! delivered && readError != nil && outError != NULL) {
+		*outError = readError;
+	}
+	return delivered;
+}
+
+- (NSData *_Nullable const) rehydrateForkContents:(ImpForkType)whichFork {
+	if (self.isDirectory) {
+		return nil;
+	}
+
+	u_int64_t logicalLength = 0;
+	struct HFSExtentDescriptor const *_Nullable extents = NULL;
+	struct HFSPlusExtentDescriptor const *_Nullable bigExtents = NULL;
+	if (! [self getLogicalLength:&logicalLength extents:&extents bigExtents:&bigExtents ofFork:whichFork]) {
+		return nil;
 	}
 
-	if (totalLengthRead == logicalLength) {
+	NSMutableData *_Nonnull const forkContents = [NSMutableData dataWithCapacity:logicalLength];
+	//TODO: This still swallows the error on GUI clients.
+	NSError *_Nullable readError = nil;
+	bool const readAll = [self streamForkContents:whichFork toBlock:^bool(void const *_Nonnull const bytes, size_t const length) {
+		[forkContents appendBytes:bytes length:length];
+		return true;
+	} error:&readError];
+
+	if (readAll) {
 		return forkContents;
 	} else {
-		ImpPrintf(@"Failed to read %llu bytes; got %llu bytes instead", logicalLength, totalLengthRead);
+		ImpPrintf(@"%@", readError.localizedDescription);
 		return nil;
 	}
 }
@@ -462,6 +573,9 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 	return [self rehydrateAtRealWorldURL:[realWorldParentURL URLByAppendingPathComponent:self.name isDirectory:self.isDirectory] error:outError];
 }
 - (bool) rehydrateAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL error:(NSError *_Nullable *_Nonnull const)outError {
+	return [self rehydrateAtRealWorldURL:realWorldURL numberOfWorkers:1 error:outError];
+}
+- (bool) rehydrateAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL numberOfWorkers:(NSUInteger const)numberOfWorkers error:(NSError *_Nullable *_Nonnull const)outError {
 	NSError *_Nullable reachabilityCheckError = nil;
 	bool const alreadyExists = [realWorldURL checkResourceIsReachableAndReturnError:&reachabilityCheckError];
 	if (alreadyExists) {
@@ -476,9 +590,12 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 	}
 
 	if (self.isDirectory) {
-		return [self rehydrateFolderAtRealWorldURL:realWorldURL error:outError];
+		return [self rehydrateFolderAtRealWorldURL:realWorldURL numberOfWorkers:numberOfWorkers error:outError];
 	} else {
-		return [self rehydrateFileAtRealWorldURL:realWorldURL error:outError];
+		ImpTraceTimestamp const traceStart = ImpTraceBegin();
+		bool const rehydrated = [self rehydrateFileAtRealWorldURL:realWorldURL error:outError];
+		ImpTraceEndWithArguments(traceStart, "extraction", "Rehydrate file", "cnid", self.catalogNodeID, "bytes", self.dataForkLogicalLength + self.resourceForkLogicalLength);
+		return rehydrated;
 	}
 }
 
@@ -486,9 +603,6 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 	ImpSourceVolume *_Nullable const srcVolume = self.sourceVolume;
 	NSAssert(srcVolume != nil, @"Can't rehydrate a file from no volume. This is likely an internal inconsistency error and therefore a bug.");
 
-	ImpHFSSourceVolume *_Nonnull const hfsVolume = [srcVolume isKindOfClass:[ImpHFSSourceVolume class]] ? (ImpHFSSourceVolume *)srcVolume : nil;
-	ImpHFSPlusSourceVolume *_Nullable const hfsPlusVolume = [srcVolume isKindOfClass:[ImpHFSPlusSourceVolume class]] ? (ImpHFSPlusSourceVolume *)srcVolume : nil;
-
 	struct HFSCatalogFile const *_Nonnull const fileRec = (struct HFSCatalogFile const *_Nonnull const)self.hfsFileCatalogRecordData.bytes;
 	struct HFSPlusCatalogFile const *_Nonnull const fileRecPlus = (struct HFSPlusCatalogFile const *_Nonnull const)self.hfsFileCatalogRecordData.bytes;
 
@@ -615,78 +729,41 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 
 	//OK! Both forks are the lengths we need them to be. Time to start copying in data!
 
-	__block bool allWritesSucceeded = true; //Defaults to true in case the fork is empty so we encounter no extents.
+	//Each fork is streamed through one buffer-sized piece at a time, so even a huge fork takes no more memory than a small one.
 	__block NSError *_Nullable writeError = nil;
-	bool (^_Nonnull const writeDataForkBlock)(NSData *_Nonnull const fileData, u_int64_t const logicalLength) = ^bool(NSData *_Nonnull const fileData, u_int64_t const logicalLength)
-	{
-		OSStatus const dataWriteErr = FSWriteFork(dataForkRefnum, fsAtMark, noCacheMask, fileData.length, fileData.bytes, /*actualCount*/ NULL);
-		allWritesSucceeded = allWritesSucceeded && (dataWriteErr == noErr);
+	NSError *_Nullable readError = nil;
+	bool const wroteDataFork = [self streamForkContents:ImpForkTypeData toBlock:^bool(void const *_Nonnull const bytes, size_t const length) {
+		OSStatus const dataWriteErr = FSWriteFork(dataForkRefnum, fsAtMark, noCacheMask, length, bytes, /*actualCount*/ NULL);
 		if (dataWriteErr != noErr) {
 			writeError = [NSError errorWithDomain:NSOSStatusErrorDomain code:dataWriteErr userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Can't write to data fork of file “%@”", @""), name ]}];
 		}
-		return allWritesSucceeded;
-	};
-	if (_isHFSPlus) {
-		[hfsPlusVolume forEachExtentInFileWithID:self.catalogNodeID
-			fork:ImpForkTypeData
-			forkLogicalLength:dataForkSize
-			startingWithBigExtentsRecord:fileRecPlus->dataFork.extents
-			readDataOrReturnError:outError
-			block:writeDataForkBlock];
-	} else {
-		[hfsVolume forEachExtentInFileWithID:self.catalogNodeID
-			fork:ImpForkTypeData
-			forkLogicalLength:dataForkSize
-			startingWithExtentsRecord:fileRec->dataExtents
-			readDataOrReturnError:outError
-			block:writeDataForkBlock];
-	}
+		return dataWriteErr == noErr;
+	} error:&readError];
 	FSSetForkSize(dataForkRefnum, fsFromStart, dataForkSize);
 	FSCloseFork(dataForkRefnum);
-	if (writeError != nil) {
+	if (! wroteDataFork) {
+		FSCloseFork(rsrcForkRefnum);
 		if (outError != NULL) {
-			*outError = writeError;
+			*outError = writeError ?: readError;
 		}
 		return false;
 	}
-	if (! allWritesSucceeded) {
-		if (outError != NULL) {
-			*outError = writeError;
-			return false;
-		}
-	}
+
 	//Now do that again, but for the resource fork.
-	bool (^_Nonnull const writeRsrcForkBlock)(NSData *_Nonnull const fileData, u_int64_t const logicalLength) = ^bool(NSData *_Nonnull const fileData, u_int64_t const logicalLength)
-	{
-		OSStatus rsrcWriteErr = FSWriteFork(rsrcForkRefnum, fsAtMark, noCacheMask, fileData.length, fileData.bytes, /*actualCount*/ NULL);
-		allWritesSucceeded = allWritesSucceeded && (rsrcWriteErr == noErr);
+	bool const wroteRsrcFork = [self streamForkContents:ImpForkTypeResource toBlock:^bool(void const *_Nonnull const bytes, size_t const length) {
+		OSStatus const rsrcWriteErr = FSWriteFork(rsrcForkRefnum, fsAtMark, noCacheMask, length, bytes, /*actualCount*/ NULL);
 		if (rsrcWriteErr != noErr) {
 			writeError = [NSError errorWithDomain:NSOSStatusErrorDomain code:rsrcWriteErr userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Can't write to resource fork of file “%@”", @""), name ]}];
 		}
-		return allWritesSucceeded;
-	};
-	if (_isHFSPlus) {
-		[hfsPlusVolume forEachExtentInFileWithID:self.catalogNodeID
-			fork:ImpForkTypeResource
-			forkLogicalLength:rsrcForkSize
-			startingWithBigExtentsRecord:fileRecPlus->resourceFork.extents
-			readDataOrReturnError:outError
-			block:writeRsrcForkBlock];
-	} else {
-		[hfsVolume forEachExtentInFileWithID:self.catalogNodeID
-			fork:ImpForkTypeResource
-			forkLogicalLength:rsrcForkSize
-			startingWithExtentsRecord:fileRec->rsrcExtents
-			readDataOrReturnError:outError
-			block:writeRsrcForkBlock];
-	}
+		return rsrcWriteErr == noErr;
+	} error:&readError];
 	FSSetForkSize(rsrcForkRefnum, fsFromStart, rsrcForkSize);
 	FSCloseFork(rsrcForkRefnum);
-	if (! allWritesSucceeded) {
+	if (! wroteRsrcFork) {
 		if (outError != NULL) {
-			*outError = writeError;
-			return false;
+			*outError = writeError ?: readError;
 		}
+		return false;
 	}
 
 	//If we made it this far, we have copied the data and resource forks.
@@ -713,143 +790,257 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 
 	return wroteData && wroteMetadata;
 }
-- (bool) rehydrateFolderAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL error:(NSError *_Nullable *_Nonnull const)outError {
+- (bool) rehydrateFolderAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL numberOfWorkers:(NSUInteger const)numberOfWorkers error:(NSError *_Nullable *_Nonnull const)outError {
+	//This happens in three passes. First, walk the catalog and create every folder in the hierarchy, noting the files as we go. Then rehydrate the files, several at a time; every folder already exists, so they can be created in any order. Creating those files bumps each folder's modification date, so the last pass puts every folder's dates back.
+	ImpRehydrationPlan *_Nonnull const plan = [ImpRehydrationPlan new];
+	if (! [self createFolderHierarchyAtRealWorldURL:realWorldURL plan:plan error:outError]) {
+		return false;
+	}
+
+	if (! [[self class] rehydrateFilesInPlan:plan numberOfWorkers:numberOfWorkers error:outError]) {
+		return false;
+	}
+
+	//Folders were added parents-first, so going backward finishes each folder's subfolders before the folder itself.
+	NSArray <ImpDehydratedItem *> *_Nonnull const folders = plan.folders;
+	NSArray <NSURL *> *_Nonnull const folderURLs = plan.folderURLs;
+	for (NSUInteger i = folders.count; i > 0; --i) {
+		if (! [folders[i - 1] restoreFolderDatesAtRealWorldURL:folderURLs[i - 1] error:outError]) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+///Create this folder and, recursively, all of its subfolders, adding each folder and file to the plan. Files are not rehydrated yet. The folders are created with busy dates, which restoreFolderDatesAtRealWorldURL:error: will replace.
+- (bool) createFolderHierarchyAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL plan:(ImpRehydrationPlan *_Nonnull const)plan error:(NSError *_Nullable *_Nonnull const)outError {
 	ImpSourceVolume *_Nullable const srcVol = self.sourceVolume;
 	NSAssert(srcVol != nil, @"Can't rehydrate a folder from no volume. This is likely an internal inconsistency error and therefore a bug.");
 
 	ImpHFSSourceVolume *_Nonnull const hfsVolume = [srcVol isKindOfClass:[ImpHFSSourceVolume class]] ? (ImpHFSSourceVolume *)srcVol : nil;
-	ImpHFSPlusSourceVolume *_Nullable const hfsPlusVolume = [srcVol isKindOfClass:[ImpHFSPlusSourceVolume class]] ? (ImpHFSPlusSourceVolume *)srcVol : nil;
 	NSAssert(hfsVolume != nil, @"Can't rehydrate from non-HFS volumes yet.");
 
-	struct HFSCatalogFolder const *_Nonnull const folderRec = (struct HFSCatalogFolder const *_Nonnull const)self.hfsFolderCatalogRecordData.bytes;
+	if (! [self createFolderAtRealWorldURL:realWorldURL error:outError]) {
+		return false;
+	}
+	[plan addFolder:self atRealWorldURL:realWorldURL];
 
-	bool wroteChildren = true; //TODO: Come up with a better way to distinguish “wrote no children because the folder was empty” and “wrote no children because failure” (or, for that matter, “wrote some children but then failure”).
-	bool wroteMetadata = false;
+	ImpTextEncodingConverter *_Nonnull const tec = _tec;
+
+	__block bool anyCreationFailed = false;
+	__block NSError *_Nullable creationError = nil;
+
+	//For each item in the dehydrated directory, plan to rehydrate it, too.
+	@autoreleasepool {
+		[srcVol.catalogBTree forEachItemInHFSDirectory:self.catalogNodeID
+		file:^bool(struct HFSCatalogKey const *_Nonnull const keyPtr, struct HFSCatalogFile const *_Nonnull const fileRec) {
+			HFSCatalogNodeID const fileID = L(fileRec->fileID);
+			ImpDehydratedItem *_Nonnull const dehydratedFile = [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVolume
+				catalogNodeID:fileID
+				key:keyPtr
+				fileRecord:fileRec];
+			NSString *_Nonnull const filename = [[tec stringForPascalString:keyPtr->nodeName fromHFSCatalogKey:keyPtr] stringByReplacingOccurrencesOfString:@"/" withString:@":"];
+			NSURL *_Nonnull const fileURL = [realWorldURL URLByAppendingPathComponent:filename isDirectory:false];
+			[plan addFile:dehydratedFile atRealWorldURL:fileURL];
+			return true;
+		}
+		folder:^bool(struct HFSCatalogKey const *_Nonnull const keyPtr, struct HFSCatalogFolder const *_Nonnull const subfolderRec) {
+			ImpDehydratedItem *_Nonnull const dehydratedSubfolder = [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVolume catalogNodeID:L(subfolderRec->folderID) key:keyPtr folderRecord:subfolderRec];
+			NSString *_Nonnull const subfolderName = [[tec stringForPascalString:keyPtr->nodeName] stringByReplacingOccurrencesOfString:@"/" withString:@":"];
+			NSURL *_Nonnull const subfolderURL = [realWorldURL URLByAppendingPathComponent:subfolderName isDirectory:true];
+			ImpPrintf(@"Rehydrating descendant 📁 “%@”", subfolderName);
+			bool const created = [dehydratedSubfolder createFolderHierarchyAtRealWorldURL:subfolderURL plan:plan error:&creationError];
+			if (! created) {
+				ImpPrintf(@"Failure in rehydrating descendant 📁 “%@”", subfolderName);
+				anyCreationFailed = true;
+			}
+			return created;
+		}];
+	}
+
+	if (anyCreationFailed) {
+		if (outError != NULL) {
+			*outError = creationError;
+		}
+		return false;
+	}
+	return true;
+}
+
+///Rehydrate every file in the plan, using up to numberOfWorkers threads. Each file's parent folder must already exist. Once any file fails, no more are started, and the first failure's error is returned.
++ (bool) rehydrateFilesInPlan:(ImpRehydrationPlan *_Nonnull const)plan numberOfWorkers:(NSUInteger const)numberOfWorkers error:(NSError *_Nullable *_Nonnull const)outError {
+	NSArray <ImpDehydratedItem *> *_Nonnull const files = [plan.files copy];
+	NSArray <NSURL *> *_Nonnull const fileURLs = [plan.fileURLs copy];
+	NSUInteger const numFiles = files.count;
+	if (numFiles == 0) {
+		return true;
+	}
+
+	__block _Atomic NSUInteger nextFileIndex = 0;
+	__block atomic_bool anyRehydrationFailed = false;
+	__block os_unfair_lock errorLock = OS_UNFAIR_LOCK_INIT;
+	__block NSError *_Nullable firstRehydrationError = nil;
+
+	void (^_Nonnull const worker)(void) = ^{
+		NSUInteger fileIdx;
+		while (! atomic_load_explicit(&anyRehydrationFailed, memory_order_relaxed) && (fileIdx = atomic_fetch_add(&nextFileIndex, 1)) < numFiles) { @autoreleasepool {
+			ImpDehydratedItem *_Nonnull const dehydratedFile = files[fileIdx];
+			NSURL *_Nonnull const fileURL = fileURLs[fileIdx];
+			NSString *_Nonnull const escapedFilename = [dehydratedFile->_tec stringByEscapingString:fileURL.lastPathComponent];
+			ImpPrintf(@"Rehydrating descendant 📄 “%@”", escapedFilename);
+
+			NSError *_Nullable rehydrationError = nil;
+			ImpTraceTimestamp const traceStart = ImpTraceBegin();
+			bool const rehydrated = [dehydratedFile rehydrateFileAtRealWorldURL:fileURL error:&rehydrationError];
+			ImpTraceEndWithArguments(traceStart, "extraction", "Rehydrate file", "cnid", dehydratedFile.catalogNodeID, "bytes", dehydratedFile.dataForkLogicalLength + dehydratedFile.resourceForkLogicalLength);
+			if (! rehydrated) {
+				ImpPrintf(@"Failure in rehydrating descendant 📄 “%@”: %@", escapedFilename, rehydrationError);
+				os_unfair_lock_lock(&errorLock);
+				if (firstRehydrationError == nil) {
+					firstRehydrationError = rehydrationError;
+				}
+				os_unfair_lock_unlock(&errorLock);
+				atomic_store(&anyRehydrationFailed, true);
+			}
+		} }
+	};
+
+	NSUInteger const numWorkers = MAX(1, MIN(numberOfWorkers, numFiles));
+	if (numWorkers == 1) {
+		worker();
+	} else {
+		//Most of the time spent rehydrating a small file is spent waiting on the File Manager to create it and set its metadata, so running several at once hides most of that latency.
+		dispatch_queue_t _Nonnull const workerQueue = dispatch_get_global_queue(QOS_CLASS_USER_INITIATED, 0);
+		dispatch_group_t _Nonnull const workers = dispatch_group_create();
+		for (NSUInteger workerIdx = 0; workerIdx < numWorkers; ++workerIdx) {
+			dispatch_group_async(workers, workerQueue, worker);
+		}
+		dispatch_group_wait(workers, DISPATCH_TIME_FOREVER);
+	}
+
+	if (atomic_load(&anyRehydrationFailed)) {
+		if (outError != NULL) {
+			*outError = firstRehydrationError;
+		}
+		return false;
+	}
+	return true;
+}
+
+///Create the folder itself, with most of its metadata, but not its contents. Its creation date is set to a busy marker until restoreFolderDatesAtRealWorldURL:error: is called.
+- (bool) createFolderAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL error:(NSError *_Nullable *_Nonnull const)outError {
+	struct HFSCatalogFolder const *_Nonnull const folderRec = (struct HFSCatalogFolder const *_Nonnull const)self.hfsFolderCatalogRecordData.bytes;
 
 	//Realistically, we have to use the File Manager.
 	//The alternative is using NSURL, which wouldn't enable us to rehydrate certain metadata, such as the Locked checkbox. (For files, it has even more problems, noted above.)
-	//So we're using deprecated API for want of an alternative. That means both methods that use such API need to silence the deprecated-API warnings.
+	//So we're using deprecated API for want of an alternative. That means every method that uses such API needs to silence the deprecated-API warnings.
 #pragma clang diagnostic push
 #pragma clang diagnostic ignored "-Wdeprecated-declarations"
 
 	FSRef parentRef;
-	if (CFURLGetFSRef((__bridge CFURLRef)realWorldURL.URLByDeletingLastPathComponent, &parentRef)) {
-		NSString *_Nonnull const name = [realWorldURL.lastPathComponent stringByReplacingOccurrencesOfString:@":" withString:@"/"];
-		HFSUniStr255 name255 = { .length = (u_int16_t)name.length };
-		if (name255.length > 255) name255.length = 255;
-		[name getCharacters:name255.unicode range:(NSRange){ 0, name255.length }];
-
-		struct FolderInfo const *_Nonnull const sourceFinderInfo = (struct FolderInfo const *_Nonnull const)&(folderRec->userInfo);
-		struct FolderInfo swappedFinderInfo = {
-			.windowBounds = {
-				.top = L(sourceFinderInfo->windowBounds.top),
-				.left = L(sourceFinderInfo->windowBounds.left),
-				.bottom = L(sourceFinderInfo->windowBounds.bottom),
-				.right = L(sourceFinderInfo->windowBounds.right),
-			},
-			.finderFlags = L(sourceFinderInfo->finderFlags),
-			.location = {
-				.h = L(sourceFinderInfo->location.h),
-				.v = L(sourceFinderInfo->location.v),
-			},
-			.reservedField = L(sourceFinderInfo->reservedField),
-		};
-		struct ExtendedFolderInfo const *_Nonnull const sourceExtFinderInfo = (struct ExtendedFolderInfo const *_Nonnull const)&(folderRec->finderInfo);
-		struct ExtendedFolderInfo swappedExtFinderInfo = {
-			.scrollPosition = {
-				.h = L(sourceExtFinderInfo->scrollPosition.h),
-				.v = L(sourceExtFinderInfo->scrollPosition.v),
-			},
-			.reserved1 = L(sourceExtFinderInfo->reserved1),
-			.extendedFinderFlags = L(sourceExtFinderInfo->extendedFinderFlags),
-			.reserved2 = L(sourceExtFinderInfo->reserved2),
-			.putAwayFolderID = L(sourceExtFinderInfo->putAwayFolderID),
-		};
-
-		struct FSCatalogInfo catInfo = {
-			.nodeFlags = (L(folderRec->flags) & ~kFSNodeLockedMask),
-			.createDate = {
-				.lowSeconds = kMagicBusyCreationDate,//L(folderRec->createDate),
-			},
-			.contentModDate = {
-				.lowSeconds = L(folderRec->modifyDate),
-			},
-		};
-		memcpy(&(catInfo.finderInfo), &swappedFinderInfo, sizeof(catInfo.finderInfo));
-		memcpy(&(catInfo.extFinderInfo), &swappedExtFinderInfo, sizeof(catInfo.extFinderInfo));
-		FSCatalogInfoBitmap const whichInfo = kFSCatInfoNodeFlags | kFSCatInfoCreateDate | kFSCatInfoContentMod | kFSCatInfoFinderInfo | kFSCatInfoFinderXInfo;
-
-		OSStatus err;
-		FSRef ref;
-		UInt32 newDirID;
-		err = FSCreateDirectoryUnicode(&parentRef, name255.length, name255.unicode, whichInfo, &catInfo, &ref, /*newSpec*/ NULL, &newDirID);
-		if (err != noErr) {
-			if (outError != NULL) {
-				*outError = [NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Can't create directory “%@”", @""), name ]}];
-			}
-			return false;
+	if (! CFURLGetFSRef((__bridge CFURLRef)realWorldURL.URLByDeletingLastPathComponent, &parentRef)) {
+		if (outError != NULL) {
+			*outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteInvalidFileNameError userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Couldn't look up parent for destination path %@; check for typoes", @""), realWorldURL.path] }];
 		}
+		return false;
+	}
+
+	NSString *_Nonnull const name = [realWorldURL.lastPathComponent stringByReplacingOccurrencesOfString:@":" withString:@"/"];
+	HFSUniStr255 name255 = { .length = (u_int16_t)name.length };
+	if (name255.length > 255) name255.length = 255;
+	[name getCharacters:name255.unicode range:(NSRange){ 0, name255.length }];
 
-		ImpTextEncodingConverter *_Nonnull const tec = _tec;
+	struct FolderInfo const *_Nonnull const sourceFinderInfo = (struct FolderInfo const *_Nonnull const)&(folderRec->userInfo);
+	struct FolderInfo swappedFinderInfo = {
+		.windowBounds = {
+			.top = L(sourceFinderInfo->windowBounds.top),
+			.left = L(sourceFinderInfo->windowBounds.left),
+			.bottom = L(sourceFinderInfo->windowBounds.bottom),
+			.right = L(sourceFinderInfo->windowBounds.right),
+		},
+		.finderFlags = L(sourceFinderInfo->finderFlags),
+		.location = {
+			.h = L(sourceFinderInfo->location.h),
+			.v = L(sourceFinderInfo->location.v),
+		},
+		.reservedField = L(sourceFinderInfo->reservedField),
+	};
+	struct ExtendedFolderInfo const *_Nonnull const sourceExtFinderInfo = (struct ExtendedFolderInfo const *_Nonnull const)&(folderRec->finderInfo);
+	struct ExtendedFolderInfo swappedExtFinderInfo = {
+		.scrollPosition = {
+			.h = L(sourceExtFinderInfo->scrollPosition.h),
+			.v = L(sourceExtFinderInfo->scrollPosition.v),
+		},
+		.reserved1 = L(sourceExtFinderInfo->reserved1),
+		.extendedFinderFlags = L(sourceExtFinderInfo->extendedFinderFlags),
+		.reserved2 = L(sourceExtFinderInfo->reserved2),
+		.putAwayFolderID = L(sourceExtFinderInfo->putAwayFolderID),
+	};
 
-		__block bool anyRehydrationFailed = false;
-		__block NSError *_Nullable rehydrationError = nil;
+	struct FSCatalogInfo catInfo = {
+		.nodeFlags = (L(folderRec->flags) & ~kFSNodeLockedMask),
+		.createDate = {
+			.lowSeconds = kMagicBusyCreationDate,//L(folderRec->createDate),
+		},
+		.contentModDate = {
+			.lowSeconds = L(folderRec->modifyDate),
+		},
+	};
+	memcpy(&(catInfo.finderInfo), &swappedFinderInfo, sizeof(catInfo.finderInfo));
+	memcpy(&(catInfo.extFinderInfo), &swappedExtFinderInfo, sizeof(catInfo.extFinderInfo));
+	FSCatalogInfoBitmap const whichInfo = kFSCatInfoNodeFlags | kFSCatInfoCreateDate | kFSCatInfoContentMod | kFSCatInfoFinderInfo | kFSCatInfoFinderXInfo;
 
-		//For each item in the dehydrated directory, rehydrate it, too.
-		//(Ugh, this might cost a ton of FSRefs.)
-		@autoreleasepool {
-			[srcVol.catalogBTree forEachItemInHFSDirectory:self.catalogNodeID
-			file:^bool(struct HFSCatalogKey const *_Nonnull const keyPtr, struct HFSCatalogFile const *_Nonnull const fileRec) {
-				HFSCatalogNodeID const fileID = L(fileRec->fileID);
-				ImpDehydratedItem *_Nonnull const dehydratedFile = [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVolume
-					catalogNodeID:fileID
-					key:keyPtr
-					fileRecord:fileRec];
-				NSString *_Nonnull const filename = [[tec stringForPascalString:keyPtr->nodeName fromHFSCatalogKey:keyPtr] stringByReplacingOccurrencesOfString:@"/" withString:@":"];
-				NSURL *_Nonnull const fileURL = [realWorldURL URLByAppendingPathComponent:filename isDirectory:false];
-				ImpPrintf(@"Rehydrating descendant 📄 “%@”", [tec stringByEscapingString:filename]);
-				bool const rehydrated = [dehydratedFile rehydrateFileAtRealWorldURL:fileURL error:&rehydrationError];
-				if (! rehydrated) {
-					ImpPrintf(@"Failure in rehydrating descendant 📄 “%@”: %@", [tec stringByEscapingString:filename], rehydrationError);
-					anyRehydrationFailed = true;
-				}
-				return rehydrated;
-			}
-			folder:^bool(struct HFSCatalogKey const *_Nonnull const keyPtr, struct HFSCatalogFolder const *_Nonnull const subfolderRec) {
-				ImpDehydratedItem *_Nonnull const dehydratedSubfolder = [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVolume catalogNodeID:L(subfolderRec->folderID) key:keyPtr folderRecord:subfolderRec];
-				NSString *_Nonnull const subfolderName = [[tec stringForPascalString:keyPtr->nodeName] stringByReplacingOccurrencesOfString:@"/" withString:@":"];
-				NSURL *_Nonnull const subfolderURL = [realWorldURL URLByAppendingPathComponent:subfolderName isDirectory:true];
-				ImpPrintf(@"Rehydrating descendant 📁 “%@”", subfolderName);
-				bool const rehydrated = [dehydratedSubfolder rehydrateFolderAtRealWorldURL:subfolderURL error:&rehydrationError];
-				if (! rehydrated) {
-					ImpPrintf(@"%@ in rehydrating descendant 📁 “%@”", rehydrated ? @"Success" : @"Failure", subfolderName);
-					anyRehydrationFailed = true;
-				}
-				return rehydrated;
-			}];
+	FSRef ref;
+	UInt32 newDirID;
+	OSStatus const err = FSCreateDirectoryUnicode(&parentRef, name255.length, name255.unicode, whichInfo, &catInfo, &ref, /*newSpec*/ NULL, &newDirID);
+	if (err != noErr) {
+		if (outError != NULL) {
+			*outError = [NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Can't create directory “%@”", @""), name ]}];
 		}
+		return false;
+	}
 
-		if (anyRehydrationFailed && outError != NULL) {
-			*outError = rehydrationError;
-			return false;
+#pragma clang diagnostic pop
+
+	return true;
+}
+
+///Replace the busy creation date set by createFolderAtRealWorldURL:error: with the real one, and restore the modification date that adding the folder's contents will have changed.
+- (bool) restoreFolderDatesAtRealWorldURL:(NSURL *_Nonnull const)realWorldURL error:(NSError *_Nullable *_Nonnull const)outError {
+	struct HFSCatalogFolder const *_Nonnull const folderRec = (struct HFSCatalogFolder const *_Nonnull const)self.hfsFolderCatalogRecordData.bytes;
+
+#pragma clang diagnostic push
+#pragma clang diagnostic ignored "-Wdeprecated-declarations"
+
+	FSRef ref;
+	if (! CFURLGetFSRef((__bridge CFURLRef)realWorldURL, &ref)) {
+		if (outError != NULL) {
+			*outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileNoSuchFileError userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Couldn't find rehydrated directory %@ to set its dates", @""), realWorldURL.path] }];
 		}
+		return false;
+	}
 
-		catInfo.createDate.lowSeconds = L(folderRec->createDate);
-		FSCatalogInfoBitmap const whichInfo2 = kFSCatInfoCreateDate | kFSCatInfoContentMod;
-		err = FSSetCatalogInfo(&ref, whichInfo2, &catInfo);
-		if (err == noErr) {
-			wroteMetadata = true;
-		} else {
-			if (outError != NULL) {
-				*outError = [NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Can't set metadata of directory “%@”", @""), name ]}];
-			}
-			return false;
+	struct FSCatalogInfo const catInfo = {
+		.createDate = {
+			.lowSeconds = L(folderRec->createDate),
+		},
+		.contentModDate = {
+			.lowSeconds = L(folderRec->modifyDate),
+		},
+	};
+	FSCatalogInfoBitmap const whichInfo = kFSCatInfoCreateDate | kFSCatInfoContentMod;
+	OSStatus const err = FSSetCatalogInfo(&ref, whichInfo, &catInfo);
+	if (err != noErr) {
+		if (outError != NULL) {
+			*outError = [NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Can't set metadata of directory “%@”", @""), [realWorldURL.lastPathComponent stringByReplacingOccurrencesOfString:@":" withString:@"/"] ]}];
 		}
+		return false;
 	}
 
 #pragma clang diagnostic pop
 
-	return (wroteChildren && wroteMetadata);
+	return true;
 }
 
 #pragma mark Directory trees
@@ -1020,6 +1211,132 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 	return dehydratedFolders[@(kHFSRootFolderID)];
 }
 
++ (void) forEachItemInHFSVolume:(ImpSourceVolume *_Nonnull const)srcVol block:(bool (^_Nonnull const)(ImpDehydratedItem *_Nonnull const item))block {
+	ImpBTreeFile *_Nonnull const catalog = srcVol.catalogBTree;
+
+	ImpHFSSourceVolume *_Nonnull const hfsVolume = [srcVol isKindOfClass:[ImpHFSSourceVolume class]] ? (ImpHFSSourceVolume *)srcVol : nil;
+	ImpHFSPlusSourceVolume *_Nullable const hfsPlusVolume = [srcVol isKindOfClass:[ImpHFSPlusSourceVolume class]] ? (ImpHFSPlusSourceVolume *)srcVol : nil;
+
+	__block bool keepIterating = true;
+	bool (^_Nonnull const visitItem)(ImpDehydratedItem *_Nonnull const item) = ^bool(ImpDehydratedItem *_Nonnull const item) {
+		if (item.isDirectory) {
+			//The catalog is sorted by parent ID, and folders generally have higher CNIDs than their parents, so this folder's contents (and its subfolders) will usually come along later and find its path already worked out.
+			[srcVol rememberPathComponents:item.path ofFolderWithID:item.catalogNodeID];
+		}
+		return block(item);
+	};
+
+	//Each leaf node is only needed long enough to make items from its records, so don't leave one cached for every leaf in the catalog.
+	[catalog walkLeafNodesWithoutCaching:^bool(ImpBTreeNode *const  _Nonnull node) {
+		@autoreleasepool {
+			[node forEachHFSCatalogRecord_file:^(const struct HFSCatalogKey *const  _Nonnull catalogKeyPtr, const struct HFSCatalogFile *const _Nonnull fileRec) {
+				if (keepIterating) {
+					keepIterating = visitItem([[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVolume catalogNodeID:L(fileRec->fileID) key:catalogKeyPtr fileRecord:fileRec]);
+				}
+			} folder:^(const struct HFSCatalogKey *const  _Nonnull catalogKeyPtr, const struct HFSCatalogFolder *const _Nonnull folderRec) {
+				if (keepIterating) {
+					keepIterating = visitItem([[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVolume catalogNodeID:L(folderRec->folderID) key:catalogKeyPtr folderRecord:folderRec]);
+				}
+			} thread:nil];
+
+			[node forEachHFSPlusCatalogRecord_file:^(struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSPlusCatalogFile const *_Nonnull const fileRec) {
+				if (keepIterating) {
+					keepIterating = visitItem([[ImpDehydratedItem alloc] initWithHFSPlusSourceVolume:hfsPlusVolume catalogNodeID:L(fileRec->fileID) key:catalogKeyPtr fileRecord:fileRec]);
+				}
+			} folder:^(struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSPlusCatalogFolder const *_Nonnull const folderRec) {
+				if (keepIterating) {
+					keepIterating = visitItem([[ImpDehydratedItem alloc] initWithHFSPlusSourceVolume:hfsPlusVolume catalogNodeID:L(folderRec->folderID) key:catalogKeyPtr folderRecord:folderRec]);
+				}
+			} thread:nil];
+		}
+
+		return keepIterating;
+	}];
+}
+
+///Print the volume's name, dates, and capacity, as the preamble to a listing. Only meaningful on the root directory.
+- (void) printVolumeSummary {
+	ImpSourceVolume *_Nullable const volume = self.sourceVolume;
+
+	ImpDehydratedItem *_Nonnull const rootDirectory = self;
+	ImpPrintf(@"Volume name:\t%@", rootDirectory.name);
+	ImpPrintf(@"Created:\t%@", rootDirectory.creationDate);
+	ImpPrintf(@"Last modified:\t%@", rootDirectory.modificationDate);
+
+	NSByteCountFormatter *_Nonnull const bcf = [NSByteCountFormatter new];
+	NSNumberFormatter *_Nonnull const fmtr = [NSNumberFormatter new];
+	fmtr.numberStyle = NSNumberFormatterDecimalStyle;
+	fmtr.hasThousandSeparators = true;
+
+	NSUInteger volumeCapacity = 0;
+	NSUInteger const blockSize = volume.numberOfBytesPerBlock;
+	NSUInteger const numBlocksTotal = volume.numberOfBlocksTotal;
+	if (os_mul_overflow(blockSize, numBlocksTotal, &volumeCapacity)) {
+		ImpPrintf(@"Capacity:\t%@ (%@ blocks of %@ bytes each)", @"huge", [fmtr stringFromNumber:@(numBlocksTotal)], [fmtr stringFromNumber:@(blockSize)]);
+	} else {
+		ImpPrintf(@"Capacity:\t%@ (%@ bytes across %@ blocks)", [bcf stringFromByteCount:volumeCapacity], [fmtr stringFromNumber:@(volumeCapacity)], [fmtr stringFromNumber:@(numBlocksTotal)]);
+	}
+	NSUInteger const blocksUsed = volume.numberOfBlocksUsed;
+	NSUInteger const bytesUsed = blockSize * blocksUsed;
+	ImpPrintf(@"Used:\t%@ (%@ bytes across %@ blocks)", [bcf stringFromByteCount:bytesUsed], [fmtr stringFromNumber:@(bytesUsed)], [fmtr stringFromNumber:@(blocksUsed)]);
+	NSUInteger const blocksFree = volume.numberOfBlocksFree;
+	NSUInteger const bytesFree = blockSize * blocksFree;
+	ImpPrintf(@"Free:\t%@ (%@ bytes across %@ blocks)", [bcf stringFromByteCount:bytesFree], [fmtr stringFromNumber:@(bytesFree)], [fmtr stringFromNumber:@(blocksFree)]);
+	ImpPrintf(@"");
+}
+
++ (void) printCatalogOfHFSVolume:(ImpSourceVolume *_Nonnull const)srcVol {
+	NSNumberFormatter *_Nonnull const fmtr = [NSNumberFormatter new];
+	fmtr.numberStyle = NSNumberFormatterDecimalStyle;
+	fmtr.hasThousandSeparators = true;
+
+	__block bool printedTableHeader = false;
+	__block u_int64_t totalDF = 0, totalRF = 0, totalTotal = 0;
+	//The current run of siblings. Every item in it has the same parent, so its path only needs to be looked up once.
+	__block HFSCatalogNodeID currentParentID = 0;
+	__block NSString *_Nullable currentParentPathStr = nil;
+	[self forEachItemInHFSVolume:srcVol block:^bool(ImpDehydratedItem *_Nonnull const item) {
+		if (! printedTableHeader) {
+			//The root directory comes first in the catalog, so this is our chance to introduce the volume.
+			if (item.type == ImpDehydratedItemTypeVolume) {
+				[item printVolumeSummary];
+			}
+			ImpPrintf(@"%@   \tData size\tRsrc size\tTotal size", @"Path");
+			ImpPrintf(@"═══════\t═════════\t═════════\t═════════");
+			printedTableHeader = true;
+		}
+
+		HFSCatalogNodeID const parentID = item.parentFolderID;
+		if (currentParentPathStr == nil || parentID != currentParentID) {
+			NSArray <NSString *> *_Nonnull const parentPath = [srcVol pathComponentsOfFolderWithID:parentID];
+			currentParentPathStr = parentPath.count > 0 ? [[parentPath componentsJoinedByString:@":"] stringByAppendingString:@":"] : @"";
+			currentParentID = parentID;
+		}
+		NSString *_Nonnull const pathStr = [currentParentPathStr stringByAppendingString:item.name];
+
+		switch (item.type) {
+			case ImpDehydratedItemTypeFile: {
+				u_int64_t const sizeDF = item.dataForkLogicalLength, sizeRF = item.resourceForkLogicalLength, sizeTotal = sizeDF + sizeRF;
+				totalDF += sizeDF;
+				totalRF += sizeRF;
+				totalTotal += sizeTotal;
+				ImpPrintf(@"%@\t%9@\t%9@\t%9@", pathStr, [fmtr stringFromNumber:@(sizeDF)], [fmtr stringFromNumber:@(sizeRF)], [fmtr stringFromNumber:@(sizeTotal)]);
+				break;
+			}
+			case ImpDehydratedItemTypeFolder:
+			case ImpDehydratedItemTypeVolume:
+				ImpPrintf(@"%@: contains %lu items", pathStr, (unsigned long)item.valence);
+				break;
+			default:
+				ImpPrintf(@"%@", pathStr);
+				break;
+		}
+		return true;
+	}];
+	ImpPrintf(@"═══════\t═════════\t═════════\t═════════");
+	ImpPrintf(@"%@\t%9@\t%9@\t%9@", @"Total", [fmtr stringFromNumber:@(totalDF)], [fmtr stringFromNumber:@(totalRF)], [fmtr stringFromNumber:@(totalTotal)]);
+}
+
 - (void) printDirectoryHierarchy_asPaths:(bool)printAbsolutePaths {
 	NSString *_Nonnull (^firstColumnForItem)(ImpDehydratedItem *_Nonnull const item, NSUInteger const depth) = (
 		printAbsolutePaths
@@ -1053,31 +1370,12 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 	ImpSourceVolume *_Nullable const volume = self.sourceVolume;
 
 	ImpDehydratedItem *_Nonnull const rootDirectory = self;
-	ImpPrintf(@"Volume name:\t%@", rootDirectory.name);
-	ImpPrintf(@"Created:\t%@", rootDirectory.creationDate);
-	ImpPrintf(@"Last modified:\t%@", rootDirectory.modificationDate);
+	[rootDirectory printVolumeSummary];
 
-	NSByteCountFormatter *_Nonnull const bcf = [NSByteCountFormatter new];
 	NSNumberFormatter *_Nonnull const fmtr = [NSNumberFormatter new];
 	fmtr.numberStyle = NSNumberFormatterDecimalStyle;
 	fmtr.hasThousandSeparators = true;
 
-	NSUInteger volumeCapacity = 0;
-	NSUInteger const blockSize = volume.numberOfBytesPerBlock;
-	NSUInteger const numBlocksTotal = volume.numberOfBlocksTotal;
-	if (os_mul_overflow(blockSize, numBlocksTotal, &volumeCapacity)) {
-		ImpPrintf(@"Capacity:\t%@ (%@ blocks of %@ bytes each)", @"huge", [fmtr stringFromNumber:@(numBlocksTotal)], [fmtr stringFromNumber:@(blockSize)]);
-	} else {
-		ImpPrintf(@"Capacity:\t%@ (%@ bytes across %@ blocks)", [bcf stringFromByteCount:volumeCapacity], [fmtr stringFromNumber:@(volumeCapacity)], [fmtr stringFromNumber:@(numBlocksTotal)]);
-	}
-	NSUInteger const blocksUsed = volume.numberOfBlocksUsed;
-	NSUInteger const bytesUsed = blockSize * blocksUsed;
-	ImpPrintf(@"Used:\t%@ (%@ bytes across %@ blocks)", [bcf stringFromByteCount:bytesUsed], [fmtr stringFromNumber:@(bytesUsed)], [fmtr stringFromNumber:@(blocksUsed)]);
-	NSUInteger const blocksFree = volume.numberOfBlocksFree;
-	NSUInteger const bytesFree = blockSize * blocksFree;
-	ImpPrintf(@"Free:\t%@ (%@ bytes across %@ blocks)", [bcf stringFromByteCount:bytesFree], [fmtr stringFromNumber:@(bytesFree)], [fmtr stringFromNumber:@(blocksFree)]);
-	ImpPrintf(@"");
-
 	ImpPrintf(@"%@   \tData size\tRsrc size\tTotal size", printAbsolutePaths ? @"Path" : @"Name");
 	ImpPrintf(@"═══════\t═════════\t═════════\t═════════");
 
@@ -1143,3 +1441,26 @@ static NSTimeInterval hfsEpochTISRD = -3061152000.0; //1904-01-01T00:00:00Z time
 }
 
 @end
+
+@implementation ImpRehydrationPlan
+
+- (instancetype _Nonnull) init {
+	if ((self = [super init])) {
+		_folders = [NSMutableArray new];
+		_folderURLs = [NSMutableArray new];
+		_files = [NSMutableArray new];
+		_fileURLs = [NSMutableArray new];
+	}
+	return self;
+}
+
+- (void) addFolder:(ImpDehydratedItem *_Nonnull const)folder atRealWorldURL:(NSURL *_Nonnull const)realWorldURL {
+	[_folders addObject:folder];
+	[_folderURLs addObject:realWorldURL];
+}
+- (void) addFile:(ImpDehydratedItem *_Nonnull const)file atRealWorldURL:(NSURL *_Nonnull const)realWorldURL {
+	[_files addObject:file];
+	[_fileURLs addObject:realWorldURL];
+}
+
+@end
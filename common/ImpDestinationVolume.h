@@ -31,6 +31,18 @@
 ///Returns the size in bytes of each allocation block. Undefined if this hasn't been set yet.
 @property(nonatomic, readonly) u_int32_t numberOfBytesPerBlock;
 
+///If true, blocks of data that are entirely zero are not written to the backing file. Where the file is known to read as zeroes wherever it hasn't been written (see prepareBackingFileWithPreallocation:error:), those blocks are skipped, leaving holes in a sparse file; elsewhere, a hole is punched in their place, or if that isn't possible, the zeroes are written after all. Default is false.
+@property bool writesSparseOutput;
+
+/*!Get a regular file ready to receive the volume: extend it to the volume's full length, so any ranges that are never written are holes, and if preallocate is true, ask the file system to reserve space for the whole thing up front (contiguously, if it can) so the image doesn't get fragmented as it's filled in.
+ * Preallocating works against sparseness, since the reserved space stays reserved whether it's written or not. It's best saved for volumes that are mostly full.
+ * Does nothing if the backing file is a device. Returns false if the file could not be extended; failing to preallocate is not an error.
+ */
+- (bool) prepareBackingFileWithPreallocation:(bool const)preallocate error:(NSError *_Nullable *_Nullable const)outError;
+
+///Write bytes to the backing file as they are, even if they're all zero. When writesSparseOutput is true, anything written to the backing file other than through writeBytes:length:atOffsetInFile:, writeData:…, or a file handle from this volume (such as the volume header) must go through here, so that the range it was written to isn't later mistaken for a hole. Returns the number of bytes written, or -1 if nothing could be written.
+- (int64_t) writeBytesWithoutSkippingZeroes:(void const *_Nonnull const)bytes length:(u_int64_t const)length atOffsetInFile:(off_t const)offsetInFile;
+
 ///The total number of allocation blocks in the volume, according to the volume header.
 - (NSUInteger) numberOfBlocksTotal;
 
@@ -47,6 +59,9 @@
 
 #pragma mark Writing fork contents
 
+///Write bytes to the backing file at an offset from the start of the file (not the volume). Honors writesSparseOutput. Returns the number of bytes written (counting any zero blocks skipped or punched out), which may be short, or a negative number with errno set if a write failed. This is the primitive underneath the methods below, and ImpVirtualFileHandle; it does not change any state in the volume, so it is safe to call from multiple threads.
+- (int64_t) writeBytes:(void const *_Nonnull const)bytes length:(u_int64_t const)length atOffsetInFile:(off_t const)offsetInFile;
+
 ///Create a file handle for writing fork contents to the extents in the given extent record. extentRecPtr must point to kHFSPlusExtentDensity file descriptors.
 - (ImpVirtualFileHandle *_Nonnull const) fileHandleForWritingToExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)extentRecPtr;
 
@@ -71,6 +86,17 @@
 	toExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)extentRec
 	error:(NSError *_Nullable *_Nullable const)outError;
 
+/*!Writes data to the backing file descriptor at a given offset into the fork described by an HFS+ extent record. Returns the number of bytes that were written.
+ * Unlike the methods above, this does not require the data to start at the beginning of an extent: offsetInFork is mapped through the extents in the record to the right place in the volume, and the write is split across extents as needed. This is for writers that fill in a fork out of order, such as ImpForkCopyEngine.
+ * extentRec *must* point to an HFSPlusExtentRecord (an array of eight extent descriptors). If the extents are too short to hold all of the data, this method writes as much as fits and returns that amount.
+ * This method does not change any state in the volume, so it can safely be called from multiple threads at once as long as the writes don't overlap.
+ * Returns a negative number if the underlying write system call did.
+ */
+- (int64_t) writeData:(NSData *_Nonnull const)data
+	toExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)extentRec
+	atOffsetInFork:(u_int64_t)offsetInFork
+	error:(NSError *_Nullable *_Nullable const)outError;
+
 #pragma mark Writing volume structures
 
 ///Write a temporary preamble to the destination file's first 3 * kISOStandardBlockSize bytes that includes the converted volume header in the wrong location (so it won't mount), as well as explanatory text that says if you're reading this, the conversion failed. This preamble must be overwritten with the real preamble as the last step in conversion.
@@ -11,9 +11,14 @@
 #import "ImpByteOrder.h"
 #import "ImpPrintf.h"
 #import "ImpSizeUtilities.h"
+#import "ImpPerformanceCounters.h"
+#import "ImpTrace.h"
 
+#import <fcntl.h>
+#import <os/lock.h>
 #import <sys/stat.h>
 #import <hfs/hfs_format.h>
+#import <simd/simd.h>
 
 //For implementing the read side
 #import "ImpTextEncodingConverter.h"
@@ -21,7 +26,34 @@
 
 #import "ImpVirtualFileHandle.h"
 
+///Returns true if every byte in the buffer is zero. Looks at 128 bytes at a time, in four vectors ORed together.
+static bool ImpIsAllZeroes(void const *_Nonnull const bytes, size_t const length) {
+	unsigned char const *_Nonnull const bytesPtr = bytes;
+	size_t offset = 0;
+	for (; offset + 4 * sizeof(simd_ulong4) <= length; offset += 4 * sizeof(simd_ulong4)) {
+		simd_ulong4 chunks[4];
+		memcpy(chunks, bytesPtr + offset, sizeof(chunks));
+		if (simd_any((chunks[0] | chunks[1] | chunks[2] | chunks[3]) != 0)) {
+			return false;
+		}
+	}
+	for (; offset < length; ++offset) {
+		if (bytesPtr[offset] != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
 @implementation ImpDestinationVolume
+{
+	///Set by prepareBackingFileWithPreallocation:error: if the backing file was empty, meaning everything we haven't written is a hole.
+	bool _unwrittenRangesReadAsZeroes;
+	///Byte ranges of the backing file that have been written to, so a run of zeroes is only skipped if nothing has been written there before. (Some ranges are written more than once, such as the temporary preamble and volume header, which are later overwritten with the real thing.) Only kept if _unwrittenRangesReadAsZeroes is true.
+	NSMutableIndexSet *_Nullable _writtenRanges;
+	///Fork contents are written from several threads at once. Guards _writtenRanges.
+	os_unfair_lock _writtenRangesLock;
+}
 
 - (void) impluseBugDetected_messageSentToAbstractClass {
 	NSAssert(false, @"Message %s sent to instance of class %@, which hasn't implemented it (instance of abstract class, method not overridden, or super called when it shouldn't have been)", sel_getName(_cmd), [self class]);
@@ -33,11 +65,12 @@
 {
 	if ((self = [super init])) {
 		_fileDescriptor = writeFD;
+		_writtenRangesLock = OS_UNFAIR_LOCK_INIT;
 
 		_startOffsetInBytes = startOffsetInBytes;
 		_lengthInBytes = lengthInBytes;
 
-		self.textEncodingConverter = [[ImpTextEncodingConverter alloc] initWithHFSTextEncoding:kTextEncodingMacRoman];
+		self.textEncodingConverter = [ImpTextEncodingConverter converterWithHFSTextEncoding:kTextEncodingMacRoman];
 	}
 	return self;
 }
@@ -47,6 +80,35 @@
 	return false;
 }
 
+- (bool) prepareBackingFileWithPreallocation:(bool const)preallocate error:(NSError *_Nullable *_Nullable const)outError {
+	struct stat sb;
+	if (fstat(_fileDescriptor, &sb) != 0 || ! S_ISREG(sb.st_mode)) {
+		return true;
+	}
+	_unwrittenRangesReadAsZeroes = (sb.st_size == 0);
+	_writtenRanges = _unwrittenRangesReadAsZeroes ? [NSMutableIndexSet new] : nil;
+
+	off_t const totalLength = (off_t)(_startOffsetInBytes + self.lengthInBytes);
+	if (preallocate && sb.st_size < totalLength) {
+		//This has to come before extending the file, since it allocates from the file's current physical end.
+		fstore_t store = { .fst_flags = F_ALLOCATECONTIG | F_ALLOCATEALL, .fst_posmode = F_PEOFPOSMODE, .fst_offset = 0, .fst_length = totalLength - sb.st_size };
+		if (fcntl(_fileDescriptor, F_PREALLOCATE, &store) != 0) {
+			//Couldn't get it all in one piece. Settle for getting it at all.
+			store.fst_flags = F_ALLOCATEALL;
+			fcntl(_fileDescriptor, F_PREALLOCATE, &store);
+		}
+	}
+
+	if (sb.st_size < totalLength && ftruncate(_fileDescriptor, totalLength) != 0) {
+		NSError *_Nonnull const extendError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Could not extend the destination file to 0x%llx bytes", @""), (unsigned long long)totalLength] }];
+		if (outError != NULL) {
+			*outError = extendError;
+		}
+		return false;
+	}
+	return true;
+}
+
 #pragma mark Block allocation
 
 + (u_int32_t) optimalAllocationBlockSizeForVolumeLength:(u_int64_t)numBytes {
@@ -74,6 +136,83 @@
 	return [[ImpVirtualFileHandle alloc] initWithVolume:self extents:extentRecPtr];
 }
 
+///Remember that a range of the backing file has been written to, so that it's no longer assumed to read as zeroes.
+- (void) noteWriteAtOffsetInFile:(off_t const)offsetInFile length:(u_int64_t const)length {
+	if (_writtenRanges == nil || length == 0) {
+		return;
+	}
+	os_unfair_lock_lock(&_writtenRangesLock);
+	[_writtenRanges addIndexesInRange:(NSRange){ (NSUInteger)offsetInFile, (NSUInteger)length }];
+	os_unfair_lock_unlock(&_writtenRangesLock);
+}
+///Returns true if nothing has ever been written to any part of this range of the backing file, which is known to read as zeroes wherever it hasn't been written.
+- (bool) rangeOfFileIsUnwrittenAtOffset:(off_t const)offsetInFile length:(u_int64_t const)length {
+	if (_writtenRanges == nil) {
+		return false;
+	}
+	os_unfair_lock_lock(&_writtenRangesLock);
+	bool const anyWritten = [_writtenRanges intersectsIndexesInRange:(NSRange){ (NSUInteger)offsetInFile, (NSUInteger)length }];
+	os_unfair_lock_unlock(&_writtenRangesLock);
+	return ! anyWritten;
+}
+
+///Replace a range of the backing file with a hole. Returns false if the file system can't do that (or can't do it for this range, e.g., because it isn't aligned to the file system's block size), in which case the caller should write zeroes instead.
+- (bool) punchHoleAtOffsetInFile:(off_t const)offsetInFile length:(u_int64_t const)length {
+	if ([self rangeOfFileIsUnwrittenAtOffset:offsetInFile length:length]) {
+		//Nothing has been written here, so it's already a hole.
+		return true;
+	}
+	fpunchhole_t const punch = { .fp_flags = 0, .reserved = 0, .fp_offset = offsetInFile, .fp_length = (off_t)length };
+	return fcntl(_fileDescriptor, F_PUNCHHOLE, &punch) == 0;
+}
+
+- (int64_t) writeBytes:(void const *_Nonnull const)bytes length:(u_int64_t const)length atOffsetInFile:(off_t const)offsetInFile {
+	ImpTraceTimestamp const traceStart = ImpTraceBegin();
+	int64_t const amtWritten = [self writeBytesPossiblySparsely:bytes length:length atOffsetInFile:offsetInFile];
+	ImpTraceEndWithArguments(traceStart, "io", "Write", "offset", (u_int64_t)offsetInFile, "length", length);
+	return amtWritten;
+}
+///Does the actual work of writeBytes:length:atOffsetInFile:, which wraps this in a trace span.
+- (int64_t) writeBytesPossiblySparsely:(void const *_Nonnull const)bytes length:(u_int64_t const)length atOffsetInFile:(off_t const)offsetInFile {
+	if (! self.writesSparseOutput) {
+		return [self writeBytesWithoutSkippingZeroes:bytes length:length atOffsetInFile:offsetInFile];
+	}
+
+	//Split the data into runs of blocks that are all zero and runs of blocks that aren't. Write the latter; leave holes for the former.
+	u_int64_t const blockSize = self.numberOfBytesPerBlock;
+	u_int64_t offset = 0;
+	while (offset < length) {
+		bool const runIsZeroes = ImpIsAllZeroes(bytes + offset, MIN(blockSize, length - offset));
+		u_int64_t runEnd = offset + MIN(blockSize, length - offset);
+		while (runEnd < length && ImpIsAllZeroes(bytes + runEnd, MIN(blockSize, length - runEnd)) == runIsZeroes) {
+			runEnd += MIN(blockSize, length - runEnd);
+		}
+		u_int64_t const runLength = runEnd - offset;
+
+		if (runIsZeroes && [self punchHoleAtOffsetInFile:offsetInFile + (off_t)offset length:runLength]) {
+			offset = runEnd;
+			continue;
+		}
+
+		int64_t const amtWritten = [self writeBytesWithoutSkippingZeroes:bytes + offset length:runLength atOffsetInFile:offsetInFile + (off_t)offset];
+		if (amtWritten < 0) {
+			return offset > 0 ? (int64_t)offset : amtWritten;
+		}
+		offset += (u_int64_t)amtWritten;
+		if ((u_int64_t)amtWritten < runLength) {
+			break;
+		}
+	}
+	return (int64_t)offset;
+}
+- (int64_t) writeBytesWithoutSkippingZeroes:(void const *_Nonnull const)bytes length:(u_int64_t const)length atOffsetInFile:(off_t const)offsetInFile {
+	int64_t const amtWritten = ImpPwrite(_fileDescriptor, bytes, length, offsetInFile);
+	if (amtWritten > 0) {
+		[self noteWriteAtOffsetInFile:offsetInFile length:(u_int64_t)amtWritten];
+	}
+	return amtWritten;
+}
+
 - (int64_t)writeData:(NSData *const)data startingFrom:(u_int64_t)offsetInData toExtent:(const struct HFSPlusExtentDescriptor *const)oneExtent error:(NSError * _Nullable __autoreleasing *const)outError {
 	void const *_Nonnull const bytesPtr = data.bytes;
 
@@ -95,7 +234,7 @@
 	u_int64_t const volumeStartInBytes = self.startOffsetInBytes;
 	off_t const extentStartInBytes = L(oneExtent->startBlock) * self.numberOfBytesPerBlock;
 //	ImpPrintf(@"Writing %lu bytes to output volume starting at a-block #%u (output file offset %llu bytes)", data.length, L(oneExtent->startBlock), volumeStartInBytes + extentStartInBytes);
-	int64_t const amtWritten = pwrite(_fileDescriptor, bytesPtr + offsetInData, bytesToWrite, volumeStartInBytes + extentStartInBytes);
+	int64_t const amtWritten = [self writeBytes:bytesPtr + offsetInData length:bytesToWrite atOffsetInFile:volumeStartInBytes + extentStartInBytes];
 
 	if (amtWritten < 0) {
 		NSError *_Nonnull const writeError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Failed to write 0x%llx (%llu) bytes (range of data { %llu, %lu }) starting at 0x%llx bytes", @""), bytesToWrite, bytesToWrite, offsetInData, data.length, extentStartInBytes] }];
@@ -121,6 +260,66 @@
 	return totalWritten;
 }
 
+///Map a range of bytes in a fork onto the volume, calling the block once for each piece that falls in a different extent. The block receives the offset in the backing file at which the piece starts, the offset of the piece within the range, and its length, and returns the number of bytes it handled or a negative number on error. Returns the total of what the block returned, or the first negative number.
+- (int64_t) forEachPieceOfRangeInFork:(u_int64_t const)offsetInFork
+	length:(u_int64_t const)length
+	inExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)extentRec
+	block:(int64_t (^_Nonnull const NS_NOESCAPE)(off_t const offsetInFile, u_int64_t const offsetInRange, u_int64_t const pieceLength))block
+{
+	u_int64_t const blockSize = self.numberOfBytesPerBlock;
+	u_int64_t const volumeStartInBytes = self.startOffsetInBytes;
+
+	int64_t total = 0;
+	u_int64_t extentStartInFork = 0;
+	for (NSUInteger i = 0; i < kHFSPlusExtentDensity && (u_int64_t)total < length; ++i) {
+		u_int64_t const extentLengthInBytes = L(extentRec[i].blockCount) * blockSize;
+		if (extentLengthInBytes == 0) {
+			break;
+		}
+		u_int64_t const extentEndInFork = extentStartInFork + extentLengthInBytes;
+		u_int64_t const pieceStartInFork = offsetInFork + total;
+		if (pieceStartInFork < extentEndInFork) {
+			u_int64_t const offsetIntoExtent = pieceStartInFork - extentStartInFork;
+			u_int64_t const bytesRemainingInRange = length - total;
+			u_int64_t const bytesRemainingInExtent = extentLengthInBytes - offsetIntoExtent;
+			u_int64_t const pieceLength = bytesRemainingInRange < bytesRemainingInExtent ? bytesRemainingInRange : bytesRemainingInExtent;
+			off_t const pieceStartInVolume = L(extentRec[i].startBlock) * blockSize + offsetIntoExtent;
+
+			int64_t const amtHandled = block(volumeStartInBytes + pieceStartInVolume, total, pieceLength);
+			if (amtHandled < 0) {
+				return amtHandled;
+			}
+			total += amtHandled;
+			if ((u_int64_t)amtHandled < pieceLength) {
+				//Short write (disk full?). Report what we got.
+				break;
+			}
+		}
+		extentStartInFork = extentEndInFork;
+	}
+
+	return total;
+}
+
+- (int64_t) writeData:(NSData *_Nonnull const)data
+	toExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)extentRec
+	atOffsetInFork:(u_int64_t)offsetInFork
+	error:(NSError *_Nullable *_Nullable const)outError
+{
+	void const *_Nonnull const bytesPtr = data.bytes;
+
+	return [self forEachPieceOfRangeInFork:offsetInFork length:data.length inExtents:extentRec block:^int64_t(off_t const offsetInFile, u_int64_t const offsetInRange, u_int64_t const pieceLength) {
+		int64_t const amtWritten = [self writeBytes:bytesPtr + offsetInRange length:pieceLength atOffsetInFile:offsetInFile];
+		if (amtWritten < 0) {
+			NSError *_Nonnull const writeError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Failed to write 0x%llx (%llu) bytes at fork offset 0x%llx starting at 0x%llx bytes", @""), pieceLength, pieceLength, offsetInFork + offsetInRange, offsetInFile] }];
+			if (outError != NULL) {
+				*outError = writeError;
+			}
+		}
+		return amtWritten;
+	}];
+}
+
 #pragma mark Accessors
 
 - (off_t) offsetOfFirstAllocationBlock {
@@ -0,0 +1,22 @@
+//
+//  ImpFileTransfer.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-09.
+//
+
+#ifndef ImpFileTransfer_h
+#define ImpFileTransfer_h
+
+#import <Foundation/Foundation.h>
+
+///Pass as the length to ImpTransferBytes to copy until end of file.
+#define ImpTransferBytesToEndOfFile UINT64_MAX
+
+/*!Copy length bytes, unchanged, from readFD starting at readOffset to writeFD starting at writeOffset, through a buffer of modest size. Neither file descriptor's file mark is used or changed.
+ * (Darwin's clonefile(2) and fcopyfile(3) only work on whole files, so there's no way to have the kernel copy a range into the middle of an existing file, such as a volume being converted.)
+ * If length is ImpTransferBytesToEndOfFile, copies until the end of the input and succeeds however much that was. Otherwise, reaching the end of the input before length bytes have been copied is an error (NSFileReadCorruptFileError in NSCocoaErrorDomain; read and write failures are reported in NSPOSIXErrorDomain). Returns true on success, false on error. If outAmountTransferred is non-NULL, it will be set to the number of bytes copied either way.
+ */
+bool ImpTransferBytes(int const readFD, off_t const readOffset, int const writeFD, off_t const writeOffset, u_int64_t const length, u_int64_t *_Nullable const outAmountTransferred, NSError *_Nullable *_Nullable const outError);
+
+#endif /* ImpFileTransfer_h */
@@ -0,0 +1,69 @@
+//
+//  ImpFileTransfer.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-09.
+//
+
+#import "ImpFileTransfer.h"
+
+#import "ImpPerformanceCounters.h"
+
+#import <unistd.h>
+
+enum {
+	///Size of the transfer buffer. Large enough that syscall overhead is negligible; small enough not to matter for memory.
+	ImpFileTransferBufferSize = 1024 * 1024,
+};
+
+static NSError *_Nonnull ImpFileTransferError(int const errorNumber, char const *_Nonnull const operation, off_t const readOffset, off_t const writeOffset) {
+	return [NSError errorWithDomain:NSPOSIXErrorDomain code:errorNumber userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Failed to copy data (%s from offset %lld to offset %lld)", @"File transfer error"), operation, (long long)readOffset, (long long)writeOffset] }];
+}
+
+bool ImpTransferBytes(int const readFD, off_t const readOffset, int const writeFD, off_t const writeOffset, u_int64_t const length, u_int64_t *_Nullable const outAmountTransferred, NSError *_Nullable *_Nullable const outError) {
+	u_int64_t totalTransferred = 0;
+
+	NSMutableData *_Nonnull const bufferData = [NSMutableData dataWithLength:ImpFileTransferBufferSize];
+	void *_Nonnull const buf = bufferData.mutableBytes;
+	ImpPerformanceBufferAllocated(ImpFileTransferBufferSize);
+	while (totalTransferred < length) {
+		u_int64_t const remaining = length - totalTransferred;
+		size_t const chunkSize = remaining < ImpFileTransferBufferSize ? (size_t)remaining : ImpFileTransferBufferSize;
+		off_t const readPos = readOffset + (off_t)totalTransferred;
+		off_t const writePos = writeOffset + (off_t)totalTransferred;
+
+		ssize_t const amtRead = ImpPread(readFD, buf, chunkSize, readPos);
+		if (amtRead < 0) {
+			if (outError != NULL) *outError = ImpFileTransferError(errno, "read", readPos, writePos);
+			if (outAmountTransferred != NULL) *outAmountTransferred = totalTransferred;
+			ImpPerformanceBufferFreed(ImpFileTransferBufferSize);
+			return false;
+		}
+		if (amtRead == 0) {
+			if (length != ImpTransferBytesToEndOfFile) {
+				if (outError != NULL) *outError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Unexpected end of file copying data from offset %lld; copied %llu of %llu bytes", @"File transfer error"), (long long)readPos, totalTransferred, length] }];
+				if (outAmountTransferred != NULL) *outAmountTransferred = totalTransferred;
+				ImpPerformanceBufferFreed(ImpFileTransferBufferSize);
+				return false;
+			}
+			break;
+		}
+
+		ssize_t amtWrittenThisChunk = 0;
+		while (amtWrittenThisChunk < amtRead) {
+			ssize_t const amtWritten = ImpPwrite(writeFD, buf + amtWrittenThisChunk, (size_t)(amtRead - amtWrittenThisChunk), writePos + amtWrittenThisChunk);
+			if (amtWritten < 0) {
+				if (outError != NULL) *outError = ImpFileTransferError(errno, "write", readPos, writePos + amtWrittenThisChunk);
+				if (outAmountTransferred != NULL) *outAmountTransferred = totalTransferred + (u_int64_t)amtWrittenThisChunk;
+				ImpPerformanceBufferFreed(ImpFileTransferBufferSize);
+				return false;
+			}
+			amtWrittenThisChunk += amtWritten;
+		}
+		totalTransferred += (u_int64_t)amtRead;
+	}
+	ImpPerformanceBufferFreed(ImpFileTransferBufferSize);
+
+	if (outAmountTransferred != NULL) *outAmountTransferred = totalTransferred;
+	return true;
+}
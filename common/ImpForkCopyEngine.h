@@ -0,0 +1,60 @@
+//
+//  ImpForkCopyEngine.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-02.
+//
+
+#import <Foundation/Foundation.h>
+
+#import <hfs/hfs_format.h>
+
+#import "ImpForkUtilities.h"
+
+@class ImpHFSSourceVolume;
+@class ImpDestinationVolume;
+
+///Called when every block of a fork has been read and written (or the copy has failed). bytesWritten is the total number of bytes written to the destination extents, which for a successful copy will equal the fork's physical length in the source volume. blocksRead is the number of source allocation blocks that were read. error is non-nil if any read or write failed, in which case the rest of the fork was not copied.
+typedef void (^ImpForkCopyCompletionBlock)(u_int64_t const bytesWritten, u_int32_t const blocksRead, NSError *_Nullable const error);
+
+/*!An ImpForkCopyEngine copies fork contents from an HFS volume into already-allocated extents in a destination volume, using a pool of reader and writer workers so that reading the source, writing the destination, and walking the catalog all happen at the same time.
+ * The caller (e.g., a converter) stays in charge of everything that has to happen in order: walking the catalog, allocating destination extents, and updating catalog records. It hands each fork to the engine, which resolves the fork's source extents (including any in the extents overflow file) on the calling thread, then breaks them up into buffer-sized chunks for the workers. Since each fork's destination extents are already allocated and don't overlap any other fork's, chunks can be read and written in any order.
+ * The number of buffers in flight is bounded; when they're all in use, enqueueing blocks until a worker frees one up.
+ * Completion blocks are always called on the thread that enqueues copies, from within either enqueueCopyOfForkWithID:… or waitUntilAllCopiesHaveFinished. They may be called in a different order from the order forks were enqueued in.
+ */
+@interface ImpForkCopyEngine : NSObject
+
+- (instancetype _Nonnull) initWithSourceVolume:(ImpHFSSourceVolume *_Nonnull const)srcVol destinationVolume:(ImpDestinationVolume *_Nonnull const)dstVol;
+
+///Number of workers reading from the source volume. Default is 2. Must be set before the first fork is enqueued.
+@property(nonatomic) NSUInteger numberOfReaders;
+///Number of workers writing to the destination volume. Default is 2. Must be set before the first fork is enqueued.
+@property(nonatomic) NSUInteger numberOfWriters;
+///Maximum number of buffers that can be in flight (being read into, waiting to be written, or being written) at once. Default is 16. Must be set before the first fork is enqueued.
+@property(nonatomic) NSUInteger numberOfBuffers;
+///Size of each buffer. Will be rounded up to a multiple of the source volume's block size. Default is 1 MiB. Must be set before the first fork is enqueued.
+@property(nonatomic) NSUInteger bytesPerBuffer;
+
+/*!If true, enqueueing a fork only records where its blocks are; nothing is read until waitUntilAllCopiesHaveFinished. At that point, every planned piece of every fork is sorted by its start block in the source volume, physically adjacent pieces are merged into reads of up to one buffer, and the reads are issued in ascending order from a single reader, so the source is swept front to back once rather than visited in catalog order. Writers still scatter each piece to its own fork's destination extents.
+ * This is a big win for sources where seeking is expensive (optical media, old spinning disks), at the cost of delaying all completion blocks until the sweep. Default is false. Must be set before the first fork is enqueued.
+ */
+@property(nonatomic) bool readsInPhysicalOrder;
+
+///If non-nil, every block read from the source is replaced with this data before being written. Must be exactly one source block long. Used when the converter has been told not to copy fork data. (The source blocks are still read, so that they're counted as accessed for the purpose of orphan recovery.)
+@property(nonatomic, copy) NSData *_Nullable placeholderBlockData;
+
+///If false, nothing is written to the destination: each fork's source blocks are checked and counted as accessed (for orphan recovery) but not read, and its destination extents are left as they are, which in a sparse destination means holes. Forks are reported as completely written. Default is true. Used for metadata-only conversions.
+@property(nonatomic) bool writesForkData;
+
+///Copy a fork into the given extents. The extent record is copied, so the caller is free to change or release it once this method returns. The completion block will be called once every chunk of the fork has been copied.
+- (void) enqueueCopyOfForkWithID:(HFSCatalogNodeID const)cnid
+	fork:(ImpForkType const)forkType
+	forkLogicalLength:(u_int64_t const)forkLength
+	startingWithExtentsRecord:(struct HFSExtentDescriptor const *_Nonnull const)hfsExtRec
+	toExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)hfsPlusExtRec
+	completion:(ImpForkCopyCompletionBlock _Nonnull const)completion;
+
+///Block until every enqueued copy has finished (in physical-order mode, first performing the sweep), calling each remaining completion block. You must call this before doing anything that depends on the forks' contents having been copied, such as orphan recovery or flushing the destination volume.
+- (void) waitUntilAllCopiesHaveFinished;
+
+@end
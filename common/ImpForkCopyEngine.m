@@ -0,0 +1,421 @@
+//
+//  ImpForkCopyEngine.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-02.
+//
+
+#import "ImpForkCopyEngine.h"
+
+#import "ImpByteOrder.h"
+#import "ImpSizeUtilities.h"
+#import "NSData+ImpSubdata.h"
+#import "ImpPerformanceCounters.h"
+#import "ImpHFSSourceVolume.h"
+#import "ImpDestinationVolume.h"
+
+#import <os/lock.h>
+
+///One fork being copied. All mutable state is guarded by the engine's lock.
+@interface ImpForkCopyJob : NSObject
+{
+	@public
+	HFSPlusExtentRecord _destinationExtents;
+}
+
+@property(copy) ImpForkCopyCompletionBlock completion;
+@property u_int64_t bytesWritten;
+@property u_int32_t blocksRead;
+@property NSUInteger numberOfChunksOutstanding;
+@property bool hasEnqueuedAllChunks;
+@property(strong) NSError *_Nullable error;
+
+@end
+
+@implementation ImpForkCopyJob
+@end
+
+///A piece of one fork's source extent, no larger than one buffer. A run is one or more segments that are physically contiguous in the source volume, and so can be read with a single pread.
+struct ImpForkCopySegment {
+	NSUInteger jobIndex;
+	u_int32_t startBlock;
+	u_int32_t blockCount;
+	u_int64_t offsetInFork;
+};
+
+static int ImpCompareForkCopySegmentsByStartBlock(void const *_Nonnull const a, void const *_Nonnull const b) {
+	struct ImpForkCopySegment const *_Nonnull const segA = a;
+	struct ImpForkCopySegment const *_Nonnull const segB = b;
+	if (segA->startBlock != segB->startBlock) {
+		return segA->startBlock < segB->startBlock ? -1 : +1;
+	}
+	if (segA->jobIndex != segB->jobIndex) {
+		return segA->jobIndex < segB->jobIndex ? -1 : +1;
+	}
+	return 0;
+}
+
+@implementation ImpForkCopyEngine
+{
+	ImpHFSSourceVolume *_Nonnull _sourceVolume;
+	ImpDestinationVolume *_Nonnull _destinationVolume;
+
+	NSArray <dispatch_queue_t> *_Nullable _readerQueues;
+	NSArray <dispatch_queue_t> *_Nullable _writerQueues;
+	NSUInteger _nextReaderIndex, _nextWriterIndex;
+	dispatch_group_t _Nonnull _inFlightGroup;
+
+	dispatch_semaphore_t _Nullable _buffersAvailable;
+	NSMutableArray <NSMutableData *> *_Nullable _bufferPool;
+	u_int32_t _blocksPerBuffer;
+
+	//For physical-order mode. Jobs are held here until their segments have been dispatched.
+	NSMutableArray <ImpForkCopyJob *> *_Nonnull _plannedJobs;
+	NSMutableData *_Nonnull _plannedSegments;
+
+	os_unfair_lock _lock;
+	NSMutableArray <ImpForkCopyJob *> *_Nonnull _completedJobs;
+}
+
+- (instancetype _Nonnull) initWithSourceVolume:(ImpHFSSourceVolume *_Nonnull const)srcVol destinationVolume:(ImpDestinationVolume *_Nonnull const)dstVol {
+	if ((self = [super init])) {
+		_sourceVolume = srcVol;
+		_destinationVolume = dstVol;
+
+		_numberOfReaders = 2;
+		_numberOfWriters = 2;
+		_numberOfBuffers = 16;
+		_bytesPerBuffer = 1024 * 1024;
+		_writesForkData = true;
+
+		_inFlightGroup = dispatch_group_create();
+		_plannedJobs = [NSMutableArray new];
+		_plannedSegments = [NSMutableData new];
+		_lock = OS_UNFAIR_LOCK_INIT;
+		_completedJobs = [NSMutableArray new];
+	}
+	return self;
+}
+
+- (void) dealloc {
+	if (_bufferPool != nil) {
+		ImpPerformanceBufferFreed(_numberOfBuffers * (u_int64_t)_blocksPerBuffer * _sourceVolume.numberOfBytesPerBlock);
+	}
+}
+
+///Create the worker queues and buffer pool, if we haven't already. Called on the first enqueue, after the client has had a chance to change the settings.
+- (void) startWorkersIfNeeded {
+	if (_bufferPool != nil) {
+		return;
+	}
+
+	NSAssert(_numberOfReaders > 0 && _numberOfWriters > 0 && _numberOfBuffers > 0, @"Fork copy engine needs at least one reader, one writer, and one buffer (has %lu, %lu, and %lu)", _numberOfReaders, _numberOfWriters, _numberOfBuffers);
+
+	dispatch_queue_attr_t _Nonnull const attr = dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0);
+	NSMutableArray <dispatch_queue_t> *_Nonnull const readerQueues = [NSMutableArray arrayWithCapacity:_numberOfReaders];
+	for (NSUInteger i = 0; i < _numberOfReaders; ++i) {
+		[readerQueues addObject:dispatch_queue_create("org.boredzo.impluse.fork-copy.reader", attr)];
+	}
+	_readerQueues = readerQueues;
+	NSMutableArray <dispatch_queue_t> *_Nonnull const writerQueues = [NSMutableArray arrayWithCapacity:_numberOfWriters];
+	for (NSUInteger i = 0; i < _numberOfWriters; ++i) {
+		[writerQueues addObject:dispatch_queue_create("org.boredzo.impluse.fork-copy.writer", attr)];
+	}
+	_writerQueues = writerQueues;
+
+	u_int32_t const srcBlockSize = _sourceVolume.numberOfBytesPerBlock;
+	NSAssert(_placeholderBlockData == nil || _placeholderBlockData.length == srcBlockSize, @"Placeholder data must be exactly one source block (%u bytes), not %lu bytes", srcBlockSize, _placeholderBlockData.length);
+	u_int64_t const blocksPerBuffer = ImpCeilingDivide(_bytesPerBuffer, srcBlockSize);
+	_blocksPerBuffer = blocksPerBuffer > UINT16_MAX ? UINT16_MAX : (blocksPerBuffer > 0 ? (u_int32_t)blocksPerBuffer : 1);
+
+	_bufferPool = [NSMutableArray arrayWithCapacity:_numberOfBuffers];
+	for (NSUInteger i = 0; i < _numberOfBuffers; ++i) {
+		[_bufferPool addObject:[NSMutableData dataWithCapacity:_blocksPerBuffer * srcBlockSize]];
+	}
+	ImpPerformanceBufferAllocated(_numberOfBuffers * (u_int64_t)_blocksPerBuffer * srcBlockSize);
+	_buffersAvailable = dispatch_semaphore_create((long)_numberOfBuffers);
+}
+
+#pragma mark Buffers
+
+///Blocks until a buffer is available.
+- (NSMutableData *_Nonnull) checkOutBuffer {
+	dispatch_semaphore_wait(_buffersAvailable, DISPATCH_TIME_FOREVER);
+	os_unfair_lock_lock(&_lock);
+	NSMutableData *_Nonnull const buffer = _bufferPool.lastObject;
+	[_bufferPool removeLastObject];
+	os_unfair_lock_unlock(&_lock);
+	return buffer;
+}
+
+- (void) checkInBuffer:(NSMutableData *_Nonnull const)buffer {
+	os_unfair_lock_lock(&_lock);
+	[_bufferPool addObject:buffer];
+	os_unfair_lock_unlock(&_lock);
+	dispatch_semaphore_signal(_buffersAvailable);
+}
+
+#pragma mark Copying
+
+- (void) enqueueCopyOfForkWithID:(HFSCatalogNodeID const)cnid
+	fork:(ImpForkType const)forkType
+	forkLogicalLength:(u_int64_t const)forkLength
+	startingWithExtentsRecord:(struct HFSExtentDescriptor const *_Nonnull const)hfsExtRec
+	toExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)hfsPlusExtRec
+	completion:(ImpForkCopyCompletionBlock _Nonnull const)completion
+{
+	[self startWorkersIfNeeded];
+
+	ImpForkCopyJob *_Nonnull const job = [ImpForkCopyJob new];
+	memcpy(job->_destinationExtents, hfsPlusExtRec, sizeof(job->_destinationExtents));
+	job.completion = completion;
+
+	bool const readsInPhysicalOrder = self.readsInPhysicalOrder;
+	NSUInteger const jobIndex = _plannedJobs.count;
+	if (readsInPhysicalOrder) {
+		[_plannedJobs addObject:job];
+	}
+
+	u_int32_t const srcBlockSize = _sourceVolume.numberOfBytesPerBlock;
+	u_int32_t const blocksPerBuffer = _blocksPerBuffer;
+	__block u_int64_t offsetInFork = 0;
+	__block NSUInteger numSegments = 0;
+
+	//Resolving extents (which may involve searching the extents overflow file) happens here, on the client's thread. Only reading and writing blocks happens on the workers.
+	[_sourceVolume forEachExtentInFileWithID:cnid
+		fork:forkType
+		forkLogicalLength:forkLength
+		startingWithExtentsRecord:hfsExtRec
+		block:^u_int64_t(struct HFSExtentDescriptor const *_Nonnull const oneExtent, u_int64_t logicalBytesRemaining)
+	{
+		u_int32_t startBlock = L(oneExtent->startBlock);
+		u_int32_t blocksRemaining = L(oneExtent->blockCount);
+		while (blocksRemaining > 0) {
+			u_int32_t const numBlocks = blocksRemaining < blocksPerBuffer ? blocksRemaining : blocksPerBuffer;
+			struct ImpForkCopySegment const segment = {
+				.jobIndex = jobIndex,
+				.startBlock = startBlock,
+				.blockCount = numBlocks,
+				.offsetInFork = offsetInFork,
+			};
+			++numSegments;
+			if (readsInPhysicalOrder) {
+				[self->_plannedSegments appendBytes:&segment length:sizeof(segment)];
+			} else {
+				os_unfair_lock_lock(&self->_lock);
+				job.numberOfChunksOutstanding = job.numberOfChunksOutstanding + 1;
+				os_unfair_lock_unlock(&self->_lock);
+				[self dispatchRunOfSegments:&segment count:1 jobs:@[ job ] readerQueue:nil];
+			}
+			startBlock += numBlocks;
+			blocksRemaining -= numBlocks;
+			offsetInFork += numBlocks * (u_int64_t)srcBlockSize;
+		}
+		return L(oneExtent->blockCount) * (u_int64_t)srcBlockSize;
+	}];
+
+	os_unfair_lock_lock(&_lock);
+	if (readsInPhysicalOrder) {
+		//None of this job's segments have been dispatched yet, so nothing else can be touching its count.
+		job.numberOfChunksOutstanding = numSegments;
+	}
+	job.hasEnqueuedAllChunks = true;
+	if (job.numberOfChunksOutstanding == 0) {
+		[_completedJobs addObject:job];
+	}
+	os_unfair_lock_unlock(&_lock);
+
+	[self deliverCompletedCopies];
+}
+
+///Sort every planned segment by where it is in the source volume, coalesce physically adjacent segments into runs of up to one buffer, and dispatch those runs in ascending order. All reads go through one reader so the source sees a single forward sweep.
+- (void) dispatchPlannedSegments {
+	NSUInteger const numSegments = _plannedSegments.length / sizeof(struct ImpForkCopySegment);
+	if (numSegments == 0) {
+		[_plannedJobs removeAllObjects];
+		return;
+	}
+
+	struct ImpForkCopySegment *_Nonnull const segments = _plannedSegments.mutableBytes;
+	qsort(segments, numSegments, sizeof(struct ImpForkCopySegment), ImpCompareForkCopySegmentsByStartBlock);
+
+	dispatch_queue_t _Nonnull const sweepQueue = _readerQueues.firstObject;
+	u_int32_t const blocksPerBuffer = _blocksPerBuffer;
+	NSMutableArray <ImpForkCopyJob *> *_Nonnull const runJobs = [NSMutableArray new];
+
+	NSUInteger runStart = 0;
+	while (runStart < numSegments) {
+		u_int32_t runBlockCount = segments[runStart].blockCount;
+		[runJobs removeAllObjects];
+		[runJobs addObject:_plannedJobs[segments[runStart].jobIndex]];
+
+		NSUInteger runEnd = runStart + 1;
+		while (runEnd < numSegments
+			&& segments[runEnd].startBlock == segments[runEnd - 1].startBlock + segments[runEnd - 1].blockCount
+			&& runBlockCount + segments[runEnd].blockCount <= blocksPerBuffer
+		) {
+			runBlockCount += segments[runEnd].blockCount;
+			[runJobs addObject:_plannedJobs[segments[runEnd].jobIndex]];
+			++runEnd;
+		}
+
+		[self dispatchRunOfSegments:segments + runStart count:runEnd - runStart jobs:[runJobs copy] readerQueue:sweepQueue];
+		runStart = runEnd;
+	}
+
+	[_plannedSegments setLength:0];
+	[_plannedJobs removeAllObjects];
+}
+
+///Read a run of physically contiguous segments in one go, then write each segment to its own fork. jobs[i] is the job that segments[i] belongs to. If readerQueue is nil, the next reader in rotation will be used.
+- (void) dispatchRunOfSegments:(struct ImpForkCopySegment const *_Nonnull const)segmentsPtr
+	count:(NSUInteger const)numSegments
+	jobs:(NSArray <ImpForkCopyJob *> *_Nonnull const)jobs
+	readerQueue:(dispatch_queue_t _Nullable)readerQueue
+{
+	if (readerQueue == nil) {
+		readerQueue = _readerQueues[_nextReaderIndex++ % _readerQueues.count];
+	}
+	dispatch_queue_t _Nonnull const writerQueue = _writerQueues[_nextWriterIndex++ % _writerQueues.count];
+	ImpHFSSourceVolume *_Nonnull const srcVol = _sourceVolume;
+	ImpDestinationVolume *_Nonnull const dstVol = _destinationVolume;
+	NSData *_Nullable const placeholderBlockData = _placeholderBlockData;
+	bool const writesForkData = _writesForkData;
+	//Runs that aren't going to be written aren't read either, so they don't need to tie up a buffer.
+	NSMutableData *_Nullable const buffer = writesForkData ? [self checkOutBuffer] : nil;
+	//Give the client a chance to hear about finished forks while we're waiting around for buffers.
+	[self deliverCompletedCopies];
+
+	NSData *_Nonnull const segmentsData = [NSData dataWithBytes:segmentsPtr length:numSegments * sizeof(struct ImpForkCopySegment)];
+	u_int32_t const startBlock = segmentsPtr[0].startBlock;
+	u_int32_t blockCount = 0;
+	for (NSUInteger i = 0; i < numSegments; ++i) {
+		blockCount += segmentsPtr[i].blockCount;
+	}
+
+	dispatch_group_async(_inFlightGroup, readerQueue, ^{ @autoreleasepool {
+		struct ImpForkCopySegment const *_Nonnull const segments = segmentsData.bytes;
+
+		//If every job in this run has already failed, don't bother reading.
+		bool anyJobStillViable = false;
+		os_unfair_lock_lock(&self->_lock);
+		for (ImpForkCopyJob *_Nonnull const job in jobs) {
+			anyJobStillViable = anyJobStillViable || job.error == nil;
+		}
+		os_unfair_lock_unlock(&self->_lock);
+		if (! anyJobStillViable) {
+			[self finishSegments:segments count:numSegments ofJobs:jobs bytesWritten:NULL error:nil];
+			if (buffer != nil) {
+				[self checkInBuffer:buffer];
+			}
+			return;
+		}
+
+		u_int32_t const srcBlockSize = srcVol.numberOfBytesPerBlock;
+
+		if (! writesForkData) {
+			NSError *_Nullable checkError = nil;
+			if (! [srcVol prepareToTransferBlocksStartingAt:startBlock count:blockCount error:&checkError]) {
+				[self finishSegments:segments count:numSegments ofJobs:jobs bytesWritten:NULL error:checkError];
+				return;
+			}
+			u_int64_t bytesWrittenPerSegment[numSegments];
+			for (NSUInteger i = 0; i < numSegments; ++i) {
+				bytesWrittenPerSegment[i] = segments[i].blockCount * (u_int64_t)srcBlockSize;
+			}
+			[self finishSegments:segments count:numSegments ofJobs:jobs bytesWritten:bytesWrittenPerSegment error:nil];
+			return;
+		}
+
+		NSUInteger const numBytes = blockCount * (NSUInteger)srcBlockSize;
+		[buffer setLength:numBytes];
+
+		u_int64_t amtRead = 0;
+		NSError *_Nullable readError = nil;
+		bool const readSucceeded = [srcVol readIntoData:buffer
+			atOffset:0
+			fromFileDescriptor:srcVol.fileDescriptor
+			startBlock:startBlock
+			blockCount:blockCount
+			actualAmountRead:&amtRead
+			error:&readError];
+		if (! readSucceeded) {
+			[self finishSegments:segments count:numSegments ofJobs:jobs bytesWritten:NULL error:readError];
+			[self checkInBuffer:buffer];
+			return;
+		}
+		if (amtRead < numBytes) {
+			//Short read (truncated image?). Don't let whatever was in this buffer last time leak into the destination.
+			memset(buffer.mutableBytes + amtRead, 0, numBytes - amtRead);
+		}
+		if (placeholderBlockData != nil) {
+			void *_Nonnull const bytes = buffer.mutableBytes;
+			for (u_int32_t i = 0; i < blockCount; ++i) {
+				memcpy(bytes + i * (NSUInteger)srcBlockSize, placeholderBlockData.bytes, srcBlockSize);
+			}
+		}
+
+		dispatch_group_async(self->_inFlightGroup, writerQueue, ^{ @autoreleasepool {
+			NSUInteger offsetInBuffer = 0;
+			for (NSUInteger i = 0; i < numSegments; ++i) {
+				NSUInteger const segmentLength = segments[i].blockCount * (NSUInteger)srcBlockSize;
+				NSData *_Nonnull const segmentData = [buffer dangerouslyFastSubdataWithRange_Imp:(NSRange){ offsetInBuffer, segmentLength }];
+				ImpForkCopyJob *_Nonnull const job = jobs[i];
+				//Each segment is finished on its own, so a failed write is charged to the fork it was writing, not every fork that happened to share the read.
+				NSError *_Nullable writeError = nil;
+				int64_t const amtWritten = [dstVol writeData:segmentData toExtents:job->_destinationExtents atOffsetInFork:segments[i].offsetInFork error:&writeError];
+				u_int64_t const bytesWritten = amtWritten > 0 ? (u_int64_t)amtWritten : 0;
+				[self finishSegments:segments + i count:1 ofJobs:@[ job ] bytesWritten:&bytesWritten error:amtWritten < 0 ? writeError : nil];
+				offsetInBuffer += segmentLength;
+			}
+			[self checkInBuffer:buffer];
+		}});
+	}});
+}
+
+///Called on a worker when it's done with a run, whether it succeeded or not. If bytesWritten is NULL, the run was not read (due to error or an earlier failure) and nothing was written.
+- (void) finishSegments:(struct ImpForkCopySegment const *_Nonnull const)segments
+	count:(NSUInteger const)numSegments
+	ofJobs:(NSArray <ImpForkCopyJob *> *_Nonnull const)jobs
+	bytesWritten:(u_int64_t const *_Nullable const)bytesWrittenPerSegment
+	error:(NSError *_Nullable const)error
+{
+	os_unfair_lock_lock(&_lock);
+	for (NSUInteger i = 0; i < numSegments; ++i) {
+		ImpForkCopyJob *_Nonnull const job = jobs[i];
+		if (bytesWrittenPerSegment != NULL) {
+			job.bytesWritten = job.bytesWritten + bytesWrittenPerSegment[i];
+			job.blocksRead = job.blocksRead + segments[i].blockCount;
+		}
+		if (error != nil && job.error == nil) {
+			job.error = error;
+		}
+		job.numberOfChunksOutstanding = job.numberOfChunksOutstanding - 1;
+		if (job.hasEnqueuedAllChunks && job.numberOfChunksOutstanding == 0) {
+			[_completedJobs addObject:job];
+		}
+	}
+	os_unfair_lock_unlock(&_lock);
+}
+
+///Call the completion blocks of any jobs that have finished since the last time. Must be called on the client's thread.
+- (void) deliverCompletedCopies {
+	os_unfair_lock_lock(&_lock);
+	NSArray <ImpForkCopyJob *> *_Nonnull const completedJobs = [_completedJobs copy];
+	[_completedJobs removeAllObjects];
+	os_unfair_lock_unlock(&_lock);
+
+	for (ImpForkCopyJob *_Nonnull const job in completedJobs) {
+		job.completion(job.bytesWritten, job.blocksRead, job.error);
+	}
+}
+
+- (void) waitUntilAllCopiesHaveFinished {
+	if (_bufferPool != nil) {
+		[self dispatchPlannedSegments];
+	}
+	dispatch_group_wait(_inFlightGroup, DISPATCH_TIME_FOREVER);
+	[self deliverCompletedCopies];
+}
+
+@end
@@ -0,0 +1,41 @@
+//
+//  ImpFreeExtentIndex.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-18.
+//
+
+#import <Foundation/Foundation.h>
+
+@class ImpAllocationBitmap;
+
+/*!A free-extent index tracks the unallocated space on a volume as a list of maximal runs of free blocks, so an allocator can find room without scanning the bitmap.
+ *The runs are kept in two sorted lists: one by start block (for first-fit searches, and for merging a freed range with its neighbors) and one by length (for best-fit searches). Finding the smallest run that will hold a request is a binary search. Adding or removing a run is a binary search plus a move of the entries after it, which is cheap because a volume being written from scratch has very few free runs at any given time.
+ *Ranges are in allocation blocks. The index doesn't know how big the volume is; it only knows what it's been told is free.
+ */
+@interface ImpFreeExtentIndex : NSObject
+
+///Create an index in which nothing is free.
+- (instancetype _Nonnull) init;
+
+///Create an index of every run of clear bits in a bitmap.
+- (instancetype _Nonnull) initWithFreeBlocksInBitmap:(ImpAllocationBitmap *_Nonnull const)bitmap;
+
+@property(readonly) NSUInteger numberOfFreeExtents;
+
+///Record that the blocks in this range are now free. The range is merged with any free runs it overlaps or abuts.
+- (void) addFreeRange:(NSRange const)range;
+
+///Record that the blocks in this range are now in use. Any parts of the range that weren't free are ignored, so the range can span blocks that were already allocated.
+- (void) removeRange:(NSRange const)range;
+
+///First fit: Returns the lowest-addressed free run, clipped to searchRange, that is at least minLength blocks long. The returned range may be longer than minLength. Returns a range with location NSNotFound if there is none.
+- (NSRange) firstFreeRangeInRange:(NSRange const)searchRange minimumLength:(NSUInteger const)minLength;
+
+///Best fit: Returns the shortest free run that is at least minLength blocks long (the lowest-addressed one, if there's a tie). Returns a range with location NSNotFound if there is none.
+- (NSRange) smallestFreeRangeWithMinimumLength:(NSUInteger const)minLength;
+
+///Returns the longest free run (the highest-addressed one, if there's a tie), or a range with location NSNotFound if nothing is free.
+- (NSRange) largestFreeRange;
+
+@end
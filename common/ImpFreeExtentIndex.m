@@ -0,0 +1,233 @@
+//
+//  ImpFreeExtentIndex.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-18.
+//
+
+#import "ImpFreeExtentIndex.h"
+
+#import "ImpAllocationBitmap.h"
+
+///One run of free blocks, in host byte order.
+struct ImpFreeExtent {
+	u_int32_t startBlock;
+	u_int32_t blockCount;
+};
+
+static inline u_int64_t ImpFreeExtentEnd(struct ImpFreeExtent const extent) {
+	return (u_int64_t)extent.startBlock + extent.blockCount;
+}
+
+///Order by length, then by start block, so that every extent has a unique position in the by-length list.
+static int ImpCompareFreeExtentsByLength(struct ImpFreeExtent const a, struct ImpFreeExtent const b) {
+	if (a.blockCount != b.blockCount) {
+		return a.blockCount < b.blockCount ? -1 : +1;
+	}
+	if (a.startBlock != b.startBlock) {
+		return a.startBlock < b.startBlock ? -1 : +1;
+	}
+	return 0;
+}
+static int ImpQSortCompareFreeExtentsByLength(void const *_Nonnull a, void const *_Nonnull b) {
+	return ImpCompareFreeExtentsByLength(*(struct ImpFreeExtent const *)a, *(struct ImpFreeExtent const *)b);
+}
+
+///Returns the index of the first extent that starts at or after startBlock.
+static NSUInteger ImpLowerBoundByStart(struct ImpFreeExtent const *_Nonnull const extents, NSUInteger const count, u_int64_t const startBlock) {
+	NSUInteger low = 0, high = count;
+	while (low < high) {
+		NSUInteger const mid = low + (high - low) / 2;
+		if (extents[mid].startBlock < startBlock) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+///Returns the index of the first extent that sorts at or after the quarry in the by-length order.
+static NSUInteger ImpLowerBoundByLength(struct ImpFreeExtent const *_Nonnull const extents, NSUInteger const count, struct ImpFreeExtent const quarry) {
+	NSUInteger low = 0, high = count;
+	while (low < high) {
+		NSUInteger const mid = low + (high - low) / 2;
+		if (ImpCompareFreeExtentsByLength(extents[mid], quarry) < 0) {
+			low = mid + 1;
+		} else {
+			high = mid;
+		}
+	}
+	return low;
+}
+
+static inline NSRange ImpRangeFromFreeExtent(struct ImpFreeExtent const extent) {
+	return (NSRange){ extent.startBlock, extent.blockCount };
+}
+
+@implementation ImpFreeExtentIndex
+{
+	///Array of struct ImpFreeExtent, sorted by start block. Extents never overlap or abut; adjacent free ranges are always merged.
+	NSMutableData *_Nonnull _extentsByStartData;
+	///The same extents, sorted by length (see ImpCompareFreeExtentsByLength).
+	NSMutableData *_Nonnull _extentsByLengthData;
+}
+
+- (instancetype _Nonnull) init {
+	if ((self = [super init])) {
+		_extentsByStartData = [NSMutableData data];
+		_extentsByLengthData = [NSMutableData data];
+	}
+	return self;
+}
+
+- (instancetype _Nonnull) initWithFreeBlocksInBitmap:(ImpAllocationBitmap *_Nonnull const)bitmap {
+	if ((self = [self init])) {
+		NSUInteger const numBits = bitmap.numberOfBits;
+		NSRange searchRange = { 0, numBits };
+		NSRange freeRange;
+		//Runs come out of the bitmap in order and already separated by allocated blocks, so they can just be appended.
+		while (searchRange.length > 0 && (freeRange = [bitmap rangeOfFirstRunOfClearBitsInRange:searchRange maximumLength:NSUIntegerMax]).location != NSNotFound) {
+			struct ImpFreeExtent const extent = { (u_int32_t)freeRange.location, (u_int32_t)freeRange.length };
+			[_extentsByStartData appendBytes:&extent length:sizeof(extent)];
+
+			NSUInteger const nextLocation = NSMaxRange(freeRange);
+			searchRange = (NSRange){ nextLocation, numBits - nextLocation };
+		}
+
+		[_extentsByLengthData setData:_extentsByStartData];
+		qsort(_extentsByLengthData.mutableBytes, self.numberOfFreeExtents, sizeof(struct ImpFreeExtent), ImpQSortCompareFreeExtentsByLength);
+	}
+	return self;
+}
+
+- (NSString *_Nonnull) description {
+	return [NSString stringWithFormat:@"<%@ %p with %lu free extents; largest is %@>", self.class, self, (unsigned long)self.numberOfFreeExtents, self.numberOfFreeExtents > 0 ? NSStringFromRange(self.largestFreeRange) : @"(none)"];
+}
+
+- (NSUInteger) numberOfFreeExtents {
+	return _extentsByStartData.length / sizeof(struct ImpFreeExtent);
+}
+
+#pragma mark Maintaining the lists
+
+- (void) insertExtent:(struct ImpFreeExtent const)extent atIndexInStartList:(NSUInteger const)idx {
+	[_extentsByStartData replaceBytesInRange:(NSRange){ idx * sizeof(extent), 0 } withBytes:&extent length:sizeof(extent)];
+
+	struct ImpFreeExtent const *_Nonnull const byLength = _extentsByLengthData.bytes;
+	NSUInteger const lengthIdx = ImpLowerBoundByLength(byLength, _extentsByLengthData.length / sizeof(extent), extent);
+	[_extentsByLengthData replaceBytesInRange:(NSRange){ lengthIdx * sizeof(extent), 0 } withBytes:&extent length:sizeof(extent)];
+}
+
+///Remove extents [startIdx, endIdx) from the start list, and each of them from the length list.
+- (void) removeExtentsInStartListFromIndex:(NSUInteger const)startIdx toIndex:(NSUInteger const)endIdx {
+	struct ImpFreeExtent const *_Nonnull const byStart = _extentsByStartData.bytes;
+	for (NSUInteger i = startIdx; i < endIdx; ++i) {
+		struct ImpFreeExtent const *_Nonnull const byLength = _extentsByLengthData.bytes;
+		NSUInteger const lengthIdx = ImpLowerBoundByLength(byLength, _extentsByLengthData.length / sizeof(*byLength), byStart[i]);
+		NSAssert(lengthIdx < _extentsByLengthData.length / sizeof(*byLength) && ImpCompareFreeExtentsByLength(byLength[lengthIdx], byStart[i]) == 0, @"Free extent { %u, %u } is missing from the by-length list", byStart[i].startBlock, byStart[i].blockCount);
+		[_extentsByLengthData replaceBytesInRange:(NSRange){ lengthIdx * sizeof(*byLength), sizeof(*byLength) } withBytes:NULL length:0];
+	}
+	[_extentsByStartData replaceBytesInRange:(NSRange){ startIdx * sizeof(*byStart), (endIdx - startIdx) * sizeof(*byStart) } withBytes:NULL length:0];
+}
+
+///Returns the index in the start list of the first extent that ends after startBlock (i.e., that contains or follows it). If abutting is true, an extent that ends exactly at startBlock counts too.
+- (NSUInteger) indexOfFirstExtentEndingAfter:(u_int64_t const)startBlock orAbutting:(bool const)abutting {
+	struct ImpFreeExtent const *_Nonnull const byStart = _extentsByStartData.bytes;
+	NSUInteger idx = ImpLowerBoundByStart(byStart, self.numberOfFreeExtents, startBlock);
+	if (idx > 0) {
+		u_int64_t const previousEnd = ImpFreeExtentEnd(byStart[idx - 1]);
+		if (previousEnd > startBlock || (abutting && previousEnd == startBlock)) {
+			--idx;
+		}
+	}
+	return idx;
+}
+
+- (void) addFreeRange:(NSRange const)range {
+	if (range.length == 0) {
+		return;
+	}
+
+	u_int64_t newStart = range.location, newEnd = NSMaxRange(range);
+	NSUInteger const firstIdx = [self indexOfFirstExtentEndingAfter:newStart orAbutting:true];
+	NSUInteger const count = self.numberOfFreeExtents;
+	struct ImpFreeExtent const *_Nonnull const byStart = _extentsByStartData.bytes;
+	NSUInteger endIdx = firstIdx;
+	while (endIdx < count && byStart[endIdx].startBlock <= newEnd) {
+		newStart = MIN(newStart, (u_int64_t)byStart[endIdx].startBlock);
+		newEnd = MAX(newEnd, ImpFreeExtentEnd(byStart[endIdx]));
+		++endIdx;
+	}
+
+	[self removeExtentsInStartListFromIndex:firstIdx toIndex:endIdx];
+	struct ImpFreeExtent const merged = { (u_int32_t)newStart, (u_int32_t)(newEnd - newStart) };
+	[self insertExtent:merged atIndexInStartList:firstIdx];
+}
+
+- (void) removeRange:(NSRange const)range {
+	if (range.length == 0) {
+		return;
+	}
+
+	u_int64_t const removeStart = range.location, removeEnd = NSMaxRange(range);
+	NSUInteger const firstIdx = [self indexOfFirstExtentEndingAfter:removeStart orAbutting:false];
+	NSUInteger const count = self.numberOfFreeExtents;
+	struct ImpFreeExtent const *_Nonnull const byStart = _extentsByStartData.bytes;
+
+	//At most two pieces survive: whatever of the first overlapping extent lies before the range, and whatever of the last lies after it.
+	struct ImpFreeExtent leftover[2];
+	NSUInteger numLeftovers = 0;
+	NSUInteger endIdx = firstIdx;
+	while (endIdx < count && byStart[endIdx].startBlock < removeEnd) {
+		struct ImpFreeExtent const extent = byStart[endIdx];
+		if (extent.startBlock < removeStart) {
+			leftover[numLeftovers++] = (struct ImpFreeExtent){ extent.startBlock, (u_int32_t)(removeStart - extent.startBlock) };
+		}
+		if (ImpFreeExtentEnd(extent) > removeEnd) {
+			leftover[numLeftovers++] = (struct ImpFreeExtent){ (u_int32_t)removeEnd, (u_int32_t)(ImpFreeExtentEnd(extent) - removeEnd) };
+		}
+		++endIdx;
+	}
+
+	[self removeExtentsInStartListFromIndex:firstIdx toIndex:endIdx];
+	for (NSUInteger i = 0; i < numLeftovers; ++i) {
+		[self insertExtent:leftover[i] atIndexInStartList:firstIdx + i];
+	}
+}
+
+#pragma mark Searching
+
+- (NSRange) firstFreeRangeInRange:(NSRange const)searchRange minimumLength:(NSUInteger const)minLength {
+	u_int64_t const searchStart = searchRange.location, searchEnd = NSMaxRange(searchRange);
+	NSUInteger const count = self.numberOfFreeExtents;
+	struct ImpFreeExtent const *_Nonnull const byStart = _extentsByStartData.bytes;
+	for (NSUInteger idx = [self indexOfFirstExtentEndingAfter:searchStart orAbutting:false]; idx < count && byStart[idx].startBlock < searchEnd; ++idx) {
+		u_int64_t const clippedStart = MAX((u_int64_t)byStart[idx].startBlock, searchStart);
+		u_int64_t const clippedEnd = MIN(ImpFreeExtentEnd(byStart[idx]), searchEnd);
+		if (clippedEnd - clippedStart >= minLength) {
+			return (NSRange){ (NSUInteger)clippedStart, (NSUInteger)(clippedEnd - clippedStart) };
+		}
+	}
+	return (NSRange){ NSNotFound, 0 };
+}
+
+- (NSRange) smallestFreeRangeWithMinimumLength:(NSUInteger const)minLength {
+	if (minLength > UINT32_MAX) {
+		return (NSRange){ NSNotFound, 0 };
+	}
+
+	NSUInteger const count = self.numberOfFreeExtents;
+	struct ImpFreeExtent const *_Nonnull const byLength = _extentsByLengthData.bytes;
+	struct ImpFreeExtent const quarry = { 0, (u_int32_t)minLength };
+	NSUInteger const idx = ImpLowerBoundByLength(byLength, count, quarry);
+	return idx < count ? ImpRangeFromFreeExtent(byLength[idx]) : (NSRange){ NSNotFound, 0 };
+}
+
+- (NSRange) largestFreeRange {
+	NSUInteger const count = self.numberOfFreeExtents;
+	struct ImpFreeExtent const *_Nonnull const byLength = _extentsByLengthData.bytes;
+	return count > 0 ? ImpRangeFromFreeExtent(byLength[count - 1]) : (NSRange){ NSNotFound, 0 };
+}
+
+@end
@@ -44,6 +44,7 @@
 	probe.verbose = true;
 	[probe findVolumes:^(const u_int64_t startOffsetInBytes, const u_int64_t lengthInBytes, Class  _Nullable const __unsafe_unretained volumeClass) {
 		ImpSourceVolume *_Nonnull const srcVol = [[volumeClass alloc] initWithFileDescriptor:readFD startOffsetInBytes:startOffsetInBytes lengthInBytes:lengthInBytes textEncoding:self.hfsTextEncoding];
+		srcVol.usesMemoryMapping = true;
 		analyzed = [self analyzeVolume:srcVol error:&analysisError] || analyzed;
 	}];
 
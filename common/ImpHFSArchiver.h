@@ -49,6 +49,9 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 ///The file system to create. Defaults to ImpArchiveVolumeFormatHFSClassic.
 @property(copy) ImpArchiveVolumeFormat _Nonnull volumeFormat;
 
+///If nonzero, build the catalog within about this many bytes of working memory, spilling sorted batches of records to temporary files instead of sorting them all at once. Default is 0 (no limit).
+@property NSUInteger catalogMemoryBudgetInBytes;
+
 ///Write the created HFS volume to this device. (Does not actually need to be a device; indeed, for this purpose, it'll usually be a regular file.)
 @property(copy) NSURL *_Nullable destinationDevice;
 
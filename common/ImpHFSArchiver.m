@@ -17,6 +17,7 @@
 #import "ImpBTreeHeaderNode.h"
 #import "ImpHFSPlusDestinationVolume.h"
 #import "ImpVirtualFileHandle.h"
+#import "ImpTrace.h"
 
 ImpArchiveVolumeFormat _Nonnull const ImpArchiveVolumeFormatHFSClassic = @"HFS";
 ImpArchiveVolumeFormat _Nonnull const ImpArchiveVolumeFormatHFSPlus = @"HFS+";
@@ -154,6 +155,7 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 	}
 
 	ImpCatalogBuilder *_Nonnull const catBuilder = [[ImpCatalogBuilder alloc] initWithBTreeVersion:catalogVersion bytesPerNode:catBytesPerNode expectedNumberOfItems:numItems];
+	catBuilder.memoryBudgetInBytes = self.catalogMemoryBudgetInBytes;
 	//TODO: Need to support multiple text encoding converters, particularly for HFS.
 	ImpTextEncodingConverter *_Nonnull const tec = self.textEncodingConverter ?: [[ImpTextEncodingConverter alloc] initWithHFSTextEncoding:kTextEncodingMacRoman];
 
@@ -161,6 +163,22 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 
 	NSMutableDictionary <ImpHydratedFile *, ImpCatalogItem *> *_Nonnull const catalogItemsForFiles = [NSMutableDictionary dictionaryWithCapacity:allItems.count];
 	NSMutableArray <ImpHydratedFile *> *_Nonnull const allFiles = [NSMutableArray arrayWithCapacity:allItems.count];
+
+	//The catalog builder copies every key and record into its own storage, so we can fill out the same four buffers for every item rather than allocating four new ones each time.
+	size_t const catalogKeySize = isHFSPlus ? sizeof(struct HFSPlusCatalogKey) : sizeof(struct HFSCatalogKey);
+	size_t const folderRecSize = isHFSPlus ? sizeof(struct HFSPlusCatalogFolder) : sizeof(struct HFSCatalogFolder);
+	size_t const fileRecSize = isHFSPlus ? sizeof(struct HFSPlusCatalogFile) : sizeof(struct HFSCatalogFile);
+	size_t const threadRecSize = isHFSPlus ? sizeof(struct HFSPlusCatalogThread) : sizeof(struct HFSCatalogThread);
+	NSMutableData *_Nonnull const scratchKey = [NSMutableData dataWithCapacity:catalogKeySize];
+	NSMutableData *_Nonnull const scratchRec = [NSMutableData dataWithCapacity:MAX(folderRecSize, fileRecSize)];
+	NSMutableData *_Nonnull const scratchThreadKey = [NSMutableData dataWithCapacity:catalogKeySize];
+	NSMutableData *_Nonnull const scratchThreadRec = [NSMutableData dataWithCapacity:threadRecSize];
+	//Empty a scratch buffer and zero-fill it to the given length, since the fill-out methods expect to start from zeroes and may have shortened the buffer last time.
+	NSMutableData *_Nonnull (^_Nonnull const resetScratch)(NSMutableData *_Nonnull const, size_t const) = ^NSMutableData *_Nonnull(NSMutableData *_Nonnull const scratch, size_t const length) {
+		scratch.length = 0;
+		scratch.length = length;
+		return scratch;
+	};
 	for (ImpHydratedItem *_Nonnull const item in allItems) {
 		item.textEncodingConverter = tec;
 		//This has to be conditional because the root item already has a CNID.
@@ -173,10 +191,10 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 			ImpHydratedFolder *_Nonnull const folder = (ImpHydratedFolder *)item;
 			++numFolders;
 
-			NSMutableData *_Nonnull const folderKey = [NSMutableData dataWithLength:isHFSPlus ? sizeof(struct HFSPlusCatalogKey) : sizeof(struct HFSCatalogKey)];
-			NSMutableData *_Nonnull const folderRec = [NSMutableData dataWithLength:isHFSPlus ? sizeof(struct HFSPlusCatalogFolder) : sizeof(struct HFSCatalogFolder)];
-			NSMutableData *_Nonnull const folderThreadKey = [NSMutableData dataWithLength:isHFSPlus ? sizeof(struct HFSPlusCatalogKey) : sizeof(struct HFSCatalogKey)];
-			NSMutableData *_Nonnull const folderThreadRec = [NSMutableData dataWithLength:isHFSPlus ? sizeof(struct HFSPlusCatalogThread) : sizeof(struct HFSCatalogThread)];
+			NSMutableData *_Nonnull const folderKey = resetScratch(scratchKey, catalogKeySize);
+			NSMutableData *_Nonnull const folderRec = resetScratch(scratchRec, folderRecSize);
+			NSMutableData *_Nonnull const folderThreadKey = resetScratch(scratchThreadKey, catalogKeySize);
+			NSMutableData *_Nonnull const folderThreadRec = resetScratch(scratchThreadRec, threadRecSize);
 			if (isHFSPlus) {
 				bool const filledOutFolderRec = [folder fillOutHFSPlusCatalogKey:folderKey hfsPlusCatalogFolder:folderRec error:outError];
 				[folder fillOutHFSPlusCatalogKey:folderThreadKey hfsPlusCatalogFolderThread:folderThreadRec];
@@ -214,10 +232,10 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 				numBlocksInVolume += ImpCeilingDivide(rsrcForkLogicalLength, blockSize);
 			}
 
-			NSMutableData *_Nonnull const fileKey = [NSMutableData dataWithLength:isHFSPlus ? sizeof(struct HFSPlusCatalogKey) : sizeof(struct HFSCatalogKey)];
-			NSMutableData *_Nonnull const fileRec = [NSMutableData dataWithLength:isHFSPlus ? sizeof(struct HFSPlusCatalogFile) : sizeof(struct HFSCatalogFile)];
-			NSMutableData *_Nonnull const fileThreadKey = [NSMutableData dataWithLength:isHFSPlus ? sizeof(struct HFSPlusCatalogKey) : sizeof(struct HFSCatalogKey)];
-			NSMutableData *_Nonnull const fileThreadRec = [NSMutableData dataWithLength:isHFSPlus ? sizeof(struct HFSPlusCatalogThread) : sizeof(struct HFSCatalogThread)];
+			NSMutableData *_Nonnull const fileKey = resetScratch(scratchKey, catalogKeySize);
+			NSMutableData *_Nonnull const fileRec = resetScratch(scratchRec, fileRecSize);
+			NSMutableData *_Nonnull const fileThreadKey = resetScratch(scratchThreadKey, catalogKeySize);
+			NSMutableData *_Nonnull const fileThreadRec = resetScratch(scratchThreadRec, threadRecSize);
 			if (isHFSPlus) {
 				bool const filledOutFileRec = [file fillOutHFSPlusCatalogKey:fileKey hfsPlusCatalogFile:fileRec error:outError];
 				[file fillOutHFSPlusCatalogKey:fileThreadKey hfsPlusCatalogFileThread:fileThreadRec];
@@ -486,13 +504,17 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 		[file setDataForkHFSPlusExtentRecord:dataExtents];
 		[file setResourceForkHFSPlusExtentRecord:rsrcExtents];
 
-		NSMutableData *_Nonnull const fileRecData = catItem.destinationRecord;
 		//TODO: In theory, this should be the hydrated item's job. Maybe a new method to just copy its extents into an existing file record.
-		struct HFSPlusCatalogFile *_Nonnull const fileRecPtr = fileRecData.mutableBytes;
-		memcpy(fileRecPtr->dataFork.extents, dataExtents, sizeof(fileRecPtr->dataFork.extents));
-		S(fileRecPtr->dataFork.totalBlocks, (u_int32_t)ImpNumberOfBlocksInHFSPlusExtentRecord(dataExtents));
-		memcpy(fileRecPtr->resourceFork.extents, rsrcExtents, sizeof(fileRecPtr->resourceFork.extents));
-		S(fileRecPtr->resourceFork.totalBlocks, (u_int32_t)ImpNumberOfBlocksInHFSPlusExtentRecord(rsrcExtents));
+		//(Blocks can't capture arrays, so take pointers to the extent records.)
+		struct HFSPlusExtentDescriptor const *_Nonnull const dataExtentsPtr = dataExtents;
+		struct HFSPlusExtentDescriptor const *_Nonnull const rsrcExtentsPtr = rsrcExtents;
+		[catItem reviseDestinationRecord:^(void *_Nonnull const bytes, NSUInteger const length) {
+			struct HFSPlusCatalogFile *_Nonnull const fileRecPtr = bytes;
+			memcpy(fileRecPtr->dataFork.extents, dataExtentsPtr, sizeof(fileRecPtr->dataFork.extents));
+			S(fileRecPtr->dataFork.totalBlocks, (u_int32_t)ImpNumberOfBlocksInHFSPlusExtentRecord(dataExtentsPtr));
+			memcpy(fileRecPtr->resourceFork.extents, rsrcExtentsPtr, sizeof(fileRecPtr->resourceFork.extents));
+			S(fileRecPtr->resourceFork.totalBlocks, (u_int32_t)ImpNumberOfBlocksInHFSPlusExtentRecord(rsrcExtentsPtr));
+		}];
 		if (file.assignedItemID == 41) {
 			ImpPrintf(@"Beep boop!");
 		}
@@ -516,8 +538,6 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 			HFSPlusExtentRecord extents;
 			__block NSError *_Nullable copyError = nil;
 			ImpVirtualFileHandle *_Nullable writeFH = nil;
-			NSMutableData *_Nonnull const fileRecData = [catalogItemsForFiles[file] destinationRecord];
-			struct HFSPlusCatalogFile *_Nonnull const fileRecPtr = fileRecData.mutableBytes;
 
 			[file getDataForkHFSPlusExtentRecord:extents];
 			writeFH = [hfsPlusVol fileHandleForWritingToExtents:extents];
@@ -532,7 +552,7 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 				}
 				while (written > 0 && remaining > 0);
 				return remaining == 0;
-			} error:&copyError];
+			} error:&copyError] && [writeFH closeFileAndReturnError:&copyError];
 			if (! copiedDataFork) {
 				NSError *_Nonnull const copyFailedError = [NSError errorWithDomain:copyError.domain code:copyError.code userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:@"Failed copying the data fork of %@", file.realWorldURL.path], NSUnderlyingErrorKey: copyError }];
 				if (outError != NULL) {
@@ -560,7 +580,7 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 				}
 				while (written > 0 && remaining > 0);
 				return remaining == 0;
-			} error:&copyError];
+			} error:&copyError] && [writeFH closeFileAndReturnError:&copyError];
 			if (! copiedRsrcFork) {
 				NSError *_Nonnull const copyFailedError = [NSError errorWithDomain:copyError.domain code:copyError.code userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:@"Failed copying the resource fork of %@", file.realWorldURL.path], NSUnderlyingErrorKey: copyError }];
 				if (outError != NULL) {
@@ -584,13 +604,15 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 
 	//We need to repopulate the tree since we've just been changing files' catalog records.
 	[catBuilder catalogItemsAreDirty];
-	[catBuilder populateTree:catTree];
+	if (! [catBuilder populateTree:catTree error:outError]) {
+		return false;
+	}
 
 	__block bool wroteCatalog = false;
 	__block NSError *_Nullable catWriteError = nil;
 	[catTree serializeToData:^(NSData *const  _Nonnull data) {
 		ImpVirtualFileHandle *_Nonnull const catFH = [dstVol fileHandleForWritingToExtents:catExtentsPtr];
-		wroteCatalog = [catFH writeData:data error:&catWriteError];
+		wroteCatalog = [catFH writeData:data error:&catWriteError] == (NSInteger)data.length && [catFH closeFileAndReturnError:&catWriteError];
 	}];
 	if (! wroteCatalog) {
 		if (outError != NULL) {
@@ -605,7 +627,7 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 	__block NSError *_Nullable extWriteError = nil;
 	[extentsOverflowTree serializeToData:^(NSData *const  _Nonnull data) {
 		ImpVirtualFileHandle *_Nonnull const extFH = [dstVol fileHandleForWritingToExtents:extExtentsPtr];
-		wroteExtentsOverflow = [extFH writeData:data error:&extWriteError];
+		wroteExtentsOverflow = [extFH writeData:data error:&extWriteError] == (NSInteger)data.length && [extFH closeFileAndReturnError:&extWriteError];
 	}];
 	if (! wroteExtentsOverflow) {
 		if (outError != NULL) {
@@ -638,7 +660,9 @@ ImpArchiveVolumeFormat _Nullable const ImpArchiveVolumeFormatFromString(NSString
 
 #pragma mark Flushing to disk
 
+	ImpTraceTimestamp const flushTraceStart = ImpTraceBegin();
 	[hfsPlusVol flushVolumeStructures:outError];
+	ImpTraceEnd(flushTraceStart, "io", "flushVolumeStructures:");
 	numBlocksCopied += L(vh->allocationFile.totalBlocks);
 	[self deliverProgressUpdate:numBlocksCopied / (double)numBlocksInVolume operationDescription:@"Wrote the allocations file"];
 	numBlocksCopied += numBlocksInPreamble + numBlocksInPostamble;
@@ -25,6 +25,12 @@ typedef void (^ImpExtractionProgressUpdateBlock)(double progress, NSString *_Non
 @property(copy) NSString *_Nullable quarryNameOrPath;
 @property(copy) NSString *_Nullable destinationPath;
 
+///How many files to rehydrate at once when extracting a folder. Defaults to the number of active processors.
+@property NSUInteger numberOfWorkers;
+
+///If true, look items up in a catalog index kept next to the source image, building (and saving) the index first if there isn't a current one. Repeat extractions from the same image then don't need to search the catalog. Defaults to false.
+@property bool usesCatalogIndex;
+
 - (bool)performExtractionOrReturnError:(NSError *_Nullable *_Nonnull) outError;
 
 @end
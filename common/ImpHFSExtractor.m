@@ -14,10 +14,18 @@
 #import "ImpBTreeFile.h"
 #import "ImpBTreeNode.h"
 #import "ImpDehydratedItem.h"
+#import "ImpCatalogIndex.h"
 #import "ImpSizeUtilities.h"
 
 @implementation ImpHFSExtractor
 
+- (instancetype _Nonnull) init {
+	if ((self = [super init])) {
+		_numberOfWorkers = [NSProcessInfo processInfo].activeProcessorCount;
+	}
+	return self;
+}
+
 - (void) deliverProgressUpdate:(double)progress
 	operationDescription:(NSString *_Nonnull)operationDescription
 {
@@ -122,6 +130,8 @@
 		}
 
 		ImpSourceVolume *_Nonnull const srcVol = [[volumeClass alloc] initWithFileDescriptor:readFD startOffsetInBytes:startOffsetInBytes lengthInBytes:lengthInBytes textEncoding:self.hfsTextEncoding];
+		//Extraction never writes to the source, so it can read straight out of a mapping of it.
+		srcVol.usesMemoryMapping = true;
 		if (! [srcVol loadAndReturnError:&volumeLoadError])
 			return;
 
@@ -140,79 +150,102 @@
 		__block ImpDehydratedItem *_Nullable matchedByPath = nil;
 		NSMutableSet <ImpDehydratedItem *> *_Nonnull const matchedByName = [NSMutableSet setWithCapacity:1];
 
-		ImpBTreeFile *_Nonnull const catalog = srcVol.catalogBTree;
-		[catalog walkLeafNodes:^bool(ImpBTreeNode *_Nonnull const node) {
-			@autoreleasepool {
-				[node forEachHFSCatalogRecord_file:^(struct HFSCatalogKey const *_Nonnull const catalogKeyPtr, const struct HFSCatalogFile *const _Nonnull fileRec) {
-					ImpDehydratedItem *_Nonnull const dehydratedFile = [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVol
-						catalogNodeID:L(fileRec->fileID)
-						key:catalogKeyPtr
-						fileRecord:fileRec];
-	//				ImpPrintf(@"We're looking for “%@” and found a file named “%@”", self.quarryName, dehydratedFile.name);
-					bool const nameIsEqual = [dehydratedFile.name isEqualToString:self.quarryName];
-					bool const shouldRehydrateBecauseName = (grabAnyFileWithThisName && nameIsEqual);
-					bool const shouldRehydrateBecausePath = [self isQuarryPath:parsedPath isEqualToCatalogPath:dehydratedFile.path];
-					if (shouldRehydrateBecauseName) {
-						[matchedByName addObject:dehydratedFile];
-					}
-					if (shouldRehydrateBecausePath) {
-						matchedByPath = dehydratedFile;
-					}
-				} folder:^(struct HFSCatalogKey const *_Nonnull const catalogKeyPtr, const struct HFSCatalogFolder *const _Nonnull folderRec) {
-					ImpDehydratedItem *_Nonnull const dehydratedFolder = [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVol
-						catalogNodeID:L(folderRec->folderID)
-						key:catalogKeyPtr
-						folderRecord:folderRec];
-	//				ImpPrintf(@"We're looking for “%@” and found a file named “%@”", self.quarryName, dehydratedFile.name);
-					bool const nameIsEqual = [dehydratedFolder.name isEqualToString:self.quarryName];
-					bool const shouldRehydrateBecauseName = (grabAnyFileWithThisName && nameIsEqual);
-					bool const shouldRehydrateBecausePath = [self isQuarryPath:parsedPath isEqualToCatalogPath:dehydratedFolder.path];
-					if (shouldRehydrateBecauseName) {
-						[matchedByName addObject:dehydratedFolder];
-					}
-					if (shouldRehydrateBecausePath) {
-						matchedByPath = dehydratedFolder;
-					}
-				} thread:^(struct HFSCatalogKey const *_Nonnull const catalogKeyPtr, const struct HFSCatalogThread *const _Nonnull threadRec) {
-					//Ignore thread records.
-				}];
-				[node forEachHFSPlusCatalogRecord_file:^(struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSPlusCatalogFile const *_Nonnull const fileRec) {
-					ImpDehydratedItem *_Nonnull const dehydratedFile = [[ImpDehydratedItem alloc] initWithHFSPlusSourceVolume:hfsPlusVol
-						catalogNodeID:L(fileRec->fileID)
-						key:catalogKeyPtr
-						fileRecord:fileRec];
-	//				ImpPrintf(@"We're looking for “%@” and found a file named “%@”", self.quarryName, dehydratedFile.name);
-					bool const nameIsEqual = [dehydratedFile.name isEqualToString:self.quarryName];
-					bool const shouldRehydrateBecauseName = (grabAnyFileWithThisName && nameIsEqual);
-					bool const shouldRehydrateBecausePath = [self isQuarryPath:parsedPath isEqualToCatalogPath:dehydratedFile.path];
-					if (shouldRehydrateBecauseName) {
-						[matchedByName addObject:dehydratedFile];
-					}
-					if (shouldRehydrateBecausePath) {
-						matchedByPath = dehydratedFile;
-					}
-				} folder:^(struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSPlusCatalogFolder const *_Nonnull const folderRec) {
-					ImpDehydratedItem *_Nonnull const dehydratedFolder = [[ImpDehydratedItem alloc] initWithHFSPlusSourceVolume:hfsPlusVol
-						catalogNodeID:L(folderRec->folderID)
-						key:catalogKeyPtr
-						folderRecord:folderRec];
-	//				ImpPrintf(@"We're looking for “%@” and found a file named “%@”", self.quarryName, dehydratedFile.name);
-					bool const nameIsEqual = [dehydratedFolder.name isEqualToString:self.quarryName];
-					bool const shouldRehydrateBecauseName = (grabAnyFileWithThisName && nameIsEqual);
-					bool const shouldRehydrateBecausePath = [self isQuarryPath:parsedPath isEqualToCatalogPath:dehydratedFolder.path];
-					if (shouldRehydrateBecauseName) {
-						[matchedByName addObject:dehydratedFolder];
-					}
-					if (shouldRehydrateBecausePath) {
-						matchedByPath = dehydratedFolder;
+		ImpCatalogIndex *_Nullable const catalogIndex = self.usesCatalogIndex ? [ImpCatalogIndex indexForVolume:srcVol inImageAtURL:self.sourceDevice] : nil;
+		srcVol.catalogIndex = catalogIndex;
+		if (catalogIndex != nil) {
+			//Follow the path down from the root one folder at a time, rather than comparing every item's path against it.
+			if (parsedPath.count > 0 && (parsedPath.firstObject.length == 0 || [parsedPath.firstObject isEqualToString:srcVol.volumeName])) {
+				HFSCatalogNodeID cnid = kHFSRootFolderID;
+				for (NSUInteger i = 1; i < parsedPath.count && cnid != 0; ++i) {
+					cnid = [catalogIndex catalogNodeIDOfItemNamed:parsedPath[i] inFolderWithID:cnid];
+				}
+				if (cnid != 0) {
+					matchedByPath = [catalogIndex itemWithCatalogNodeID:cnid];
+				}
+			}
+			if (grabAnyFileWithThisName) {
+				[catalogIndex forEachItemNamed:self.quarryName block:^(HFSCatalogNodeID const cnid) {
+					ImpDehydratedItem *_Nullable const item = [catalogIndex itemWithCatalogNodeID:cnid];
+					if (item != nil) {
+						[matchedByName addObject:item];
 					}
-				} thread:^(struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSPlusCatalogThread const *_Nonnull const threadRec) {
-					//Ignore thread records.
 				}];
 			}
+		} else {
+			ImpBTreeFile *_Nonnull const catalog = srcVol.catalogBTree;
+			[catalog walkLeafNodes:^bool(ImpBTreeNode *_Nonnull const node) {
+				@autoreleasepool {
+					[node forEachHFSCatalogRecord_file:^(struct HFSCatalogKey const *_Nonnull const catalogKeyPtr, const struct HFSCatalogFile *const _Nonnull fileRec) {
+						ImpDehydratedItem *_Nonnull const dehydratedFile = [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVol
+							catalogNodeID:L(fileRec->fileID)
+							key:catalogKeyPtr
+							fileRecord:fileRec];
+		//				ImpPrintf(@"We're looking for “%@” and found a file named “%@”", self.quarryName, dehydratedFile.name);
+						bool const nameIsEqual = [dehydratedFile.name isEqualToString:self.quarryName];
+						bool const shouldRehydrateBecauseName = (grabAnyFileWithThisName && nameIsEqual);
+						bool const shouldRehydrateBecausePath = [self isQuarryPath:parsedPath isEqualToCatalogPath:dehydratedFile.path];
+						if (shouldRehydrateBecauseName) {
+							[matchedByName addObject:dehydratedFile];
+						}
+						if (shouldRehydrateBecausePath) {
+							matchedByPath = dehydratedFile;
+						}
+					} folder:^(struct HFSCatalogKey const *_Nonnull const catalogKeyPtr, const struct HFSCatalogFolder *const _Nonnull folderRec) {
+						ImpDehydratedItem *_Nonnull const dehydratedFolder = [[ImpDehydratedItem alloc] initWithHFSSourceVolume:hfsVol
+							catalogNodeID:L(folderRec->folderID)
+							key:catalogKeyPtr
+							folderRecord:folderRec];
+		//				ImpPrintf(@"We're looking for “%@” and found a file named “%@”", self.quarryName, dehydratedFile.name);
+						bool const nameIsEqual = [dehydratedFolder.name isEqualToString:self.quarryName];
+						bool const shouldRehydrateBecauseName = (grabAnyFileWithThisName && nameIsEqual);
+						bool const shouldRehydrateBecausePath = [self isQuarryPath:parsedPath isEqualToCatalogPath:dehydratedFolder.path];
+						if (shouldRehydrateBecauseName) {
+							[matchedByName addObject:dehydratedFolder];
+						}
+						if (shouldRehydrateBecausePath) {
+							matchedByPath = dehydratedFolder;
+						}
+					} thread:^(struct HFSCatalogKey const *_Nonnull const catalogKeyPtr, const struct HFSCatalogThread *const _Nonnull threadRec) {
+						//Ignore thread records.
+					}];
+					[node forEachHFSPlusCatalogRecord_file:^(struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSPlusCatalogFile const *_Nonnull const fileRec) {
+						ImpDehydratedItem *_Nonnull const dehydratedFile = [[ImpDehydratedItem alloc] initWithHFSPlusSourceVolume:hfsPlusVol
+							catalogNodeID:L(fileRec->fileID)
+							key:catalogKeyPtr
+							fileRecord:fileRec];
+		//				ImpPrintf(@"We're looking for “%@” and found a file named “%@”", self.quarryName, dehydratedFile.name);
+						bool const nameIsEqual = [dehydratedFile.name isEqualToString:self.quarryName];
+						bool const shouldRehydrateBecauseName = (grabAnyFileWithThisName && nameIsEqual);
+						bool const shouldRehydrateBecausePath = [self isQuarryPath:parsedPath isEqualToCatalogPath:dehydratedFile.path];
+						if (shouldRehydrateBecauseName) {
+							[matchedByName addObject:dehydratedFile];
+						}
+						if (shouldRehydrateBecausePath) {
+							matchedByPath = dehydratedFile;
+						}
+					} folder:^(struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSPlusCatalogFolder const *_Nonnull const folderRec) {
+						ImpDehydratedItem *_Nonnull const dehydratedFolder = [[ImpDehydratedItem alloc] initWithHFSPlusSourceVolume:hfsPlusVol
+							catalogNodeID:L(folderRec->folderID)
+							key:catalogKeyPtr
+							folderRecord:folderRec];
+		//				ImpPrintf(@"We're looking for “%@” and found a file named “%@”", self.quarryName, dehydratedFile.name);
+						bool const nameIsEqual = [dehydratedFolder.name isEqualToString:self.quarryName];
+						bool const shouldRehydrateBecauseName = (grabAnyFileWithThisName && nameIsEqual);
+						bool const shouldRehydrateBecausePath = [self isQuarryPath:parsedPath isEqualToCatalogPath:dehydratedFolder.path];
+						if (shouldRehydrateBecauseName) {
+							[matchedByName addObject:dehydratedFolder];
+						}
+						if (shouldRehydrateBecausePath) {
+							matchedByPath = dehydratedFolder;
+						}
+					} thread:^(struct HFSPlusCatalogKey const *_Nonnull const catalogKeyPtr, struct HFSPlusCatalogThread const *_Nonnull const threadRec) {
+						//Ignore thread records.
+					}];
+				}
 
-			return true;
-		}];
+				return true;
+			}];
+		}
 
 		NSMutableArray <ImpDehydratedItem *> *_Nonnull const matches = [NSMutableArray arrayWithCapacity:(matchedByPath != nil) + matchedByName.count];
 		if (matchedByPath != nil) [matches addObject:matchedByPath];
@@ -229,7 +262,7 @@
 			ImpDehydratedItem *_Nonnull const item = matches.firstObject;
 	//		ImpPrintf(@"Found an item named %@ with parent item #%u", item.name, item.parentFolderID);
 			NSString *_Nonnull const destPath = self.destinationPath ?: [item.name stringByReplacingOccurrencesOfString:@"/" withString:@":"];
-			rehydrated = [item rehydrateAtRealWorldURL:[NSURL fileURLWithPath:destPath isDirectory:false] error:&rehydrationError];
+			rehydrated = [item rehydrateAtRealWorldURL:[NSURL fileURLWithPath:destPath isDirectory:false] numberOfWorkers:self.numberOfWorkers error:&rehydrationError];
 			if (! rehydrated) {
 				ImpPrintf(@"Failed to rehydrate file named %@: %@", item.name, rehydrationError);
 			} else {
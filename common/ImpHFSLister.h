@@ -15,6 +15,9 @@
 ///If true, reports each item as an absolute HFS path (volume:folder:folder:item). Files are listed without trailing colons; folders and the root directory are listed with trailing colons. If false, reports each item as an icon (emoji) and name, indented by its depth in the hierarchy.
 @property bool printAbsolutePaths;
 
+///If true, items are reported as they're read from the catalog, in a single pass, instead of after building the volume's whole directory hierarchy. Output starts immediately and memory use stays flat however many items the volume has, but items come in catalog order (each folder's contents together) rather than hierarchy order, so the human-readable listing is always given as absolute paths. Applies to CSV inventories too.
+@property bool streamsFromCatalog;
+
 ///Print a CSV inventory of applications only, rather than a full human-readable directory listing. May be combined with other inventory<Type>s properties, in which case files matching any of the union of those types will be included in the CSV output.
 @property bool inventoryApplications;
 
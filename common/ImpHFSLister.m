@@ -32,9 +32,18 @@
 	ImpVolumeProbe *_Nonnull const probe = [[ImpVolumeProbe alloc] initWithFileDescriptor:readFD];
 	[probe findVolumes:^(const u_int64_t startOffsetInBytes, const u_int64_t lengthInBytes, Class  _Nullable const __unsafe_unretained volumeClass) {
 		ImpSourceVolume *_Nonnull srcVol = [[volumeClass alloc] initWithFileDescriptor:readFD startOffsetInBytes:startOffsetInBytes lengthInBytes:lengthInBytes textEncoding:self.hfsTextEncoding];
+		//We only ever read from the source, so serve reads out of a mapping of it rather than copying into buffers. (If it's a device, this quietly does nothing.)
+		srcVol.usesMemoryMapping = true;
 		bool const loaded = [srcVol loadAndReturnError:&volumeLoadError];
 
-		if (loaded) {
+		if (loaded && self.streamsFromCatalog) {
+			if (userWantsCSVInventory) {
+				[self inventoryInterestingItemsInCatalogOfVolume:srcVol];
+			} else {
+				[ImpDehydratedItem printCatalogOfHFSVolume:srcVol];
+			}
+			listed = true;
+		} else if (loaded) {
 			ImpDehydratedItem *_Nonnull const rootDirectory = [ImpDehydratedItem rootDirectoryOfHFSVolume:srcVol];
 			if (userWantsCSVInventory) {
 				[self inventoryInterestingItemsWithinItem:rootDirectory];
@@ -74,7 +83,8 @@
 	);
 }
 
-- (void) inventoryInterestingItemsWithinItem:(ImpDehydratedItem *_Nonnull const)rootDirectory {
+///Write the CSV header, then call the walk block, which should call visitItem with every item to consider for the inventory.
+- (void) inventoryInterestingItemsOnVolumeNamed:(NSString *_Nonnull const)volumeName walk:(void (^_Nonnull const)(void (^_Nonnull const visitItem)(ImpDehydratedItem *_Nullable const item)))walk {
 	NSArray <NSString *> *_Nonnull const columns = @[
 		@"volume_name",
 		@"application_name",
@@ -90,12 +100,12 @@
 	NSISO8601DateFormatter *_Nonnull const iso8601Fmtr = [NSISO8601DateFormatter new];
 	iso8601Fmtr.formatOptions = NSISO8601DateFormatWithInternetDateTime;
 	__weak __typeof(self) weakSelf = self;
-	[rootDirectory walkBreadthFirst:^(const NSUInteger depth, ImpDehydratedItem *_Nonnull const item) {
+	walk(^(ImpDehydratedItem *_Nullable const item) {
 		__strong __typeof(weakSelf) strongSelf = weakSelf;
-		if ([strongSelf shouldIncludeItemInInventory:item]) {
+		if (item != nil && [strongSelf shouldIncludeItemInInventory:item]) {
 			@autoreleasepool {
 				[csvProducer writeRow:@[
-					rootDirectory.name,
+					volumeName,
 					item.name,
 					item.versionStringFromVersionNumber ?: @"-",
 					[iso8601Fmtr stringFromDate:item.creationDate],
@@ -106,6 +116,23 @@
 				]];
 			}
 		}
+	});
+}
+
+- (void) inventoryInterestingItemsWithinItem:(ImpDehydratedItem *_Nonnull const)rootDirectory {
+	[self inventoryInterestingItemsOnVolumeNamed:rootDirectory.name walk:^(void (^_Nonnull const visitItem)(ImpDehydratedItem *_Nullable const item)) {
+		[rootDirectory walkBreadthFirst:^(const NSUInteger depth, ImpDehydratedItem *_Nonnull const item) {
+			visitItem(item);
+		}];
+	}];
+}
+
+- (void) inventoryInterestingItemsInCatalogOfVolume:(ImpSourceVolume *_Nonnull const)srcVol {
+	[self inventoryInterestingItemsOnVolumeNamed:srcVol.volumeName walk:^(void (^_Nonnull const visitItem)(ImpDehydratedItem *_Nullable const item)) {
+		[ImpDehydratedItem forEachItemInHFSVolume:srcVol block:^bool(ImpDehydratedItem *_Nonnull const item) {
+			visitItem(item);
+			return true;
+		}];
 	}];
 }
 
@@ -9,6 +9,16 @@
 
 #import <hfs/hfs_format.h>
 
+///How the allocator chooses where to put a new extent.
+typedef NS_ENUM(u_int8_t, ImpAllocationPolicy) {
+	///Use the first opening big enough for the request, searching from the end of the last allocation and wrapping around to the start of the volume. This lays forks out in the order they're allocated. This is the default.
+	ImpAllocationPolicyFirstFit,
+	///Use the smallest opening big enough for the request, so that holes left by deallocation get filled and big openings are saved for big requests.
+	ImpAllocationPolicyBestFit,
+	///Like best fit, but never settle for less than the whole request: if no single opening is big enough, fail rather than allocating a partial extent.
+	ImpAllocationPolicyContiguous,
+};
+
 @interface ImpHFSPlusDestinationVolume : ImpDestinationVolume
 
 @property(nonatomic, copy) NSData *_Nonnull bootBlocks;
@@ -41,6 +51,9 @@
 ///(Note that this is used when *creating* HFS+ volumes, whereas the superclass method with a similar name and purpose is for volumes being *read in*.)
 - (u_int32_t) firstUnusedBlockInWorkingBitmap;
 
+///The policy used by allocateBlocks:forFork:getExtent: and allocateBytes:forFork:populateExtentRecord:. Defaults to ImpAllocationPolicyFirstFit.
+@property(nonatomic) ImpAllocationPolicy allocationPolicy;
+
 /*!Attempt to allocate a contiguous range of available blocks. Writes the range allocated to the given extent.
  * Returns true if a contiguous extent containing this number of blocks was allocated. Returns false (without making any changes to existing allocations) if the request could not be fulfilled because not enough contiguous blocks were available.
  * You can pass an extent that is not empty, and this method will attempt to extend it contiguously forward. If that succeeds, blockCount will change but not startBlock.
@@ -53,6 +66,12 @@
 	forFork:(ImpForkType)forkType
 	getExtent:(struct HFSPlusExtentDescriptor *_Nonnull const)outExt;
 
+///Same as allocateBlocks:forFork:getExtent:, but with a specific allocation policy rather than the volume's allocationPolicy. Under ImpAllocationPolicyContiguous, this returns false without allocating anything if no single opening can hold all of the blocks.
+- (bool) allocateBlocks:(u_int32_t)numBlocks
+	forFork:(ImpForkType)forkType
+	policy:(ImpAllocationPolicy const)policy
+	getExtent:(struct HFSPlusExtentDescriptor *_Nonnull const)outExt;
+
 /*!Convenience method wrapping allocateBlocks:forFork:getExtent:. Attempts to fill one extent record with up to eight extents big enough to hold the requested length.
  *Returns 0 if the request was entirely fulfilled and the extent record now contains extents covering enough blocks to fully hold a file of this length. Otherwise, returns the number of bytes that don't yet have a home. Create a new extent record (for the extents overflow file) and call this method again with the remaining length.
  *Only the last non-empty extent in the record may be changed; others are assumed to already be optimal and will be left alone. The last non-empty extent may be extended or reallocated as described under allocateBlocks:forFork:getExtent:. If that isn't enough, this method will allocate further extents until either the extent record is full or the request is satisfied.
@@ -62,4 +81,13 @@
 	forFork:(ImpForkType)forkType
 	populateExtentRecord:(struct HFSPlusExtentDescriptor *_Nonnull const)outExts;
 
+///Same as allocateBytes:forFork:populateExtentRecord:, but with a specific allocation policy rather than the volume's allocationPolicy. Under ImpAllocationPolicyContiguous, each new extent must hold everything still needed, so this either adds one extent that covers the rest of the request or adds nothing and returns the whole remaining length.
+- (u_int64_t) allocateBytes:(u_int64_t)numBytes
+	forFork:(ImpForkType)forkType
+	policy:(ImpAllocationPolicy const)policy
+	populateExtentRecord:(struct HFSPlusExtentDescriptor *_Nonnull const)outExts;
+
+///Return every block in an extent record to free space and empty the record. Use this when a fork is being truncated or its allocation abandoned; the freed blocks will be reused by later allocations.
+- (void) deallocateExtentRecord:(struct HFSPlusExtentDescriptor *_Nonnull const)extRec;
+
 @end
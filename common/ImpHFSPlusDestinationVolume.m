@@ -8,7 +8,10 @@
 #import "ImpHFSPlusDestinationVolume.h"
 
 #import "ImpSizeUtilities.h"
+#import "ImpAllocationBitmap.h"
+#import "ImpFreeExtentIndex.h"
 #import "NSData+ImpSubdata.h"
+#import "ImpPerformanceCounters.h"
 
 @interface ImpHFSPlusDestinationVolume ()
 
@@ -30,7 +33,9 @@
 {
 	NSMutableData *_preamble; //Boot blocks + volume header = 1.5 K
 	struct HFSPlusVolumeHeader *_vh;
-	CFMutableBitVectorRef _allocationsBitmap;
+	ImpAllocationBitmap *_allocationsBitmap;
+	///The same information as the bitmap, organized for finding free space quickly. Every change to one must be made to the other.
+	ImpFreeExtentIndex *_freeExtents;
 
 	///Block numbers used for allocating new extents. See ImpForkType in the .h.
 	u_int32_t _highestUsedDataABlock, _lowestUsedRsrcABlock;
@@ -130,13 +135,13 @@
 
 - (u_int32_t) numberOfBlocksFreeAccordingToWorkingBitmap {
 	NSAssert(_allocationsBitmap != nil, @"Can't calculate number of free blocks on a volume that hasn't been initialized");
-	CFRange searchRange = { 0, CFBitVectorGetCount(_allocationsBitmap) };
-	return (u_int32_t)CFBitVectorGetCountOfBit(_allocationsBitmap, searchRange, false);
+	NSRange const searchRange = { 0, _allocationsBitmap.numberOfBits };
+	return (u_int32_t)[_allocationsBitmap countOfClearBitsInRange:searchRange];
 }
 - (u_int32_t) firstUnusedBlockInWorkingBitmap {
 	NSAssert(_allocationsBitmap != nil, @"Can't calculate number of free blocks on a volume that hasn't been initialized");
-	CFRange searchRange = { 0, CFBitVectorGetCount(_allocationsBitmap) };
-	return (u_int32_t)CFBitVectorGetFirstIndexOfBit(_allocationsBitmap, searchRange, false);
+	NSRange const searchRange = { 0, _allocationsBitmap.numberOfBits };
+	return (u_int32_t)[_allocationsBitmap indexOfFirstClearBitInRange:searchRange];
 }
 
 - (u_int32_t) numBlocksForPreambleWithSize:(u_int32_t const)aBlockSize {
@@ -172,17 +177,14 @@
 
 ///Create a new allocation bitmap that is numABlocks long. Marks the first and last few blocks as already allocated, and returns the count of those blocks.
 - (u_int32_t) _createAllocationBitmapFileWithBlockSize:(u_int32_t)aBlockSize count:(u_int32_t)numABlocks {
-	_allocationsBitmap = CFBitVectorCreateMutable(kCFAllocatorDefault, numABlocks);
-	CFBitVectorSetCount(_allocationsBitmap, numABlocks);
+	_allocationsBitmap = [[ImpAllocationBitmap alloc] initWithNumberOfBits:numABlocks];
 
 	u_int32_t numBlocksUsed = 0;
 
 	u_int32_t const firstPreambleBlock = 0; //At least the first boot block (if aBlockSize == kISOStandardBlockSize).
 	u_int32_t const numPreambleBlocks = [self numBlocksForPreambleWithSize:aBlockSize];
-	for (u_int32_t i = 0; i < numPreambleBlocks; ++i) {
-		CFBitVectorSetBitAtIndex(_allocationsBitmap, i, true);
-		++numBlocksUsed;
-	}
+	[_allocationsBitmap setBitsInRange:(NSRange){ firstPreambleBlock, numPreambleBlocks }];
+	numBlocksUsed += numPreambleBlocks;
 
 	S(_preambleExtent.startBlock, firstPreambleBlock);
 	S(_preambleExtent.blockCount, numPreambleBlocks);
@@ -194,12 +196,12 @@
 	_postambleExtent = [self extentFromByteOffset:_postambleStartInBytes size:postambleLengthInBytes];
 	u_int32_t const firstPostambleBlock = L(_postambleExtent.startBlock);
 	u_int32_t const numPostambleBlocks = L(_postambleExtent.blockCount);
-	for (u_int32_t thisBlock = firstPostambleBlock, count = 0; count < numPostambleBlocks; ++count, ++thisBlock) {
-		if (thisBlock < CFBitVectorGetCount(_allocationsBitmap)) {
-			CFBitVectorSetBitAtIndex(_allocationsBitmap, thisBlock, true);
-			++numBlocksUsed;
-		}
+	//The bitmap ignores any part of the extent past the last a-block, so count only the blocks that are actually in it.
+	[_allocationsBitmap setBitsInRange:(NSRange){ firstPostambleBlock, numPostambleBlocks }];
+	if (firstPostambleBlock < numABlocks) {
+		numBlocksUsed += MIN(numPostambleBlocks, numABlocks - firstPostambleBlock);
 	}
+	_freeExtents = [[ImpFreeExtentIndex alloc] initWithFreeBlocksInBitmap:_allocationsBitmap];
 	//And last but not least, allocate space for the allocations file that will hold our shiny new bitmap.
 	u_int32_t const numAllocationsBytes = ImpCeilingDivide(numABlocks, 8);
 	[self allocateBytes:numAllocationsBytes forFork:ImpForkTypeSpecialFileContents populateExtentRecord:_vh->allocationFile.extents];
@@ -233,10 +235,9 @@
 	[self initializeAllocationBitmapWithBlockSize:aBlockSize count:numPreambleBlocks + numABlocks + numPostambleBlocks];
 }
 
-///Search a range of blocks from the earliest block to the latest block for a contiguous range of available blocks that will entirely (or partially, if acceptPartial) satisfy the request.
-- (bool) findBlocksForward:(u_int32_t const)requestedBlocks
-	inRange:(CFRange const)wholeSearchRange
-	acceptPartial:(bool const)acceptPartial
+///Find room for up to requestedBlocks blocks according to the given policy. Doesn't allocate them. Returns false if nothing suitable is free.
+- (bool) findBlocks:(u_int32_t const)requestedBlocks
+	policy:(ImpAllocationPolicy const)policy
 	getExtent:(struct HFSPlusExtentDescriptor *_Nonnull const)outExt
 {
 	if (requestedBlocks == 0) {
@@ -246,128 +247,54 @@
 		return true;
 	}
 
-	CFIndex const firstOutOfBoundsBlock = wholeSearchRange.location + wholeSearchRange.length;
-
-	CFRange rangeToSearch = wholeSearchRange;
-	CFRange rangeToAllocate = { kCFNotFound, 0 };
-	while (rangeToSearch.location < firstOutOfBoundsBlock && rangeToSearch.length > 0 && rangeToAllocate.length < requestedBlocks) {
-		CFIndex const firstAvailableBlockNumber = CFBitVectorGetFirstIndexOfBit(_allocationsBitmap, rangeToSearch, false);
-		if (firstAvailableBlockNumber == kCFNotFound) {
+	NSRange foundRange = { NSNotFound, 0 };
+	switch (policy) {
+		case ImpAllocationPolicyFirstFit: {
+			//Search onward from where the last allocation left off, then wrap around to pick up any holes left behind.
+			u_int32_t const nextAllocation = L(_vh->nextAllocation);
+			u_int32_t const numAllBlocks = L(_vh->totalBlocks);
+			foundRange = [_freeExtents firstFreeRangeInRange:(NSRange){ nextAllocation, numAllBlocks - nextAllocation } minimumLength:requestedBlocks];
+			if (foundRange.location == NSNotFound) {
+				foundRange = [_freeExtents firstFreeRangeInRange:(NSRange){ 0, nextAllocation } minimumLength:requestedBlocks];
+			}
 			break;
 		}
-		CFRange const remainingRange = { firstAvailableBlockNumber, rangeToSearch.length - (firstAvailableBlockNumber - rangeToSearch.location) };
-		CFIndex const lastAvailableBlockNumber = CFBitVectorGetLastIndexOfBit(_allocationsBitmap, remainingRange, false);
-		rangeToAllocate = (CFRange){
-			.location = firstAvailableBlockNumber,
-			.length = (lastAvailableBlockNumber + 1) - firstAvailableBlockNumber,
-		};
-		if (rangeToAllocate.length > requestedBlocks) {
-			rangeToAllocate.length = requestedBlocks;
-		}
-		if (rangeToAllocate.length < requestedBlocks && ! acceptPartial) {
+		case ImpAllocationPolicyBestFit:
+		case ImpAllocationPolicyContiguous:
+			foundRange = [_freeExtents smallestFreeRangeWithMinimumLength:requestedBlocks];
 			break;
-		}
-
-		//+2 because the block after lastAvailableBlockNumber is already known to be unavailable, so skip over it.
-		CFRange nextRangeToSearch = {
-			.location = lastAvailableBlockNumber + 2,
-		};
-		CFIndex const startToStartDistance = nextRangeToSearch.location - rangeToSearch.location;
-		if (startToStartDistance > rangeToSearch.length) {
-			nextRangeToSearch.length = 0;
-		} else {
-			nextRangeToSearch.length = rangeToSearch.length - startToStartDistance;
-		}
-		rangeToSearch = nextRangeToSearch;
 	}
 
-	bool const success = rangeToAllocate.length >= requestedBlocks || (acceptPartial && rangeToAllocate.location != kCFNotFound);
-	if (success) {
-		S(outExt->startBlock, (u_int32_t)rangeToAllocate.location);
-		S(outExt->blockCount, (u_int32_t)rangeToAllocate.length);
+	//If there isn't an opening big enough, take the biggest one there is. (If the volume is fragmented, we may be able to cobble together multiple openings. If not, taking the last remaining available blocks but still needing more only delays inevitable failure.)
+	if (foundRange.location == NSNotFound && policy != ImpAllocationPolicyContiguous) {
+		foundRange = _freeExtents.largestFreeRange;
 	}
-
-	return success;
-}
-
-///Search a range of blocks from the earliest block to the latest block for the smallest contiguous range of available blocks that will entirely (or partially, if acceptPartial) satisfy the request.
-///This is an alternate, non-working implementation of the block allocator that supports filling in holes where blocks have previously been deallocated. It seeks the tightest hole that will fit the desired allocation. It would be cool if it worked, and the code is preserved here in case someone wants to give it a whack, but it's not really necessary for the case of converting a volume from another file system, which will consist entirely of allocations with no deallocations, so no hole-filling is needed.
-- (bool) overlyFancy_findBlocksForward:(u_int32_t const)requestedBlocks
-	inRange:(CFRange const)wholeSearchRange
-	acceptPartial:(bool const)acceptPartial
-	getExtent:(struct HFSPlusExtentDescriptor *_Nonnull const)outExt
-{
-	CFIndex const nextBlockAfterSearchRange = wholeSearchRange.location + wholeSearchRange.length;
-
-	CFRange bestRangeSoFar = { kCFNotFound, 0 };
-	CFRange searchRange = wholeSearchRange;
-	while (searchRange.location != kCFNotFound && searchRange.length > 0) {
-		CFIndex firstAvailableBlockNumber = CFBitVectorGetFirstIndexOfBit(_allocationsBitmap, searchRange, false);
-		if (firstAvailableBlockNumber == kCFNotFound) {
-			//There are no (more) available blocks. At all.
-			//If we were searching from nextAllocation, our caller should try again starting from the FUAB.
-			searchRange.location = kCFNotFound;
-			break;
-		} else {
-			searchRange = (CFRange){ firstAvailableBlockNumber, requestedBlocks };
-
-			//Note: Using CFBitVectorGetFirstIndexOfBit to find the next unavailable block won't work if the volume is completely empty (we're allocating the allocations file). We must search for the last available bit, not the next unavailable bit.
-			CFIndex const lastAvailableBlockNumber = CFBitVectorGetLastIndexOfBit(_allocationsBitmap, searchRange, false);
-			CFIndex const nextUnavailableBlockNumber = lastAvailableBlockNumber + 1; //Bold assuming that this is actually a valid index…
-
-			CFRange foundRange = { firstAvailableBlockNumber, nextUnavailableBlockNumber - firstAvailableBlockNumber };
-			if (foundRange.length >= requestedBlocks) {
-				if (acceptPartial && bestRangeSoFar.length < requestedBlocks && foundRange.length > bestRangeSoFar.length) {
-					bestRangeSoFar = foundRange;
-				} else {
-					if (foundRange.length == requestedBlocks) {
-						//The perfect fit! Return this range immediately.
-						bestRangeSoFar = foundRange;
-						break;
-					} else if (bestRangeSoFar.length < requestedBlocks) {
-						//We hadn't previously found an extent large enough (we may or may not have accepted any partial extents), but we just did. This is our new best range, but keep looking.
-						bestRangeSoFar = foundRange;
-					} else if (foundRange.length < bestRangeSoFar.length) {
-						//This is a better, tighter fit than our previous best range. This is our new best range, but keep looking.
-						bestRangeSoFar = foundRange;
-					}
-				}
-			} //If this is enough blocks
-
-			//Advance the loop by searching only the blocks we haven't searched yet.
-			searchRange = (CFRange) {
-				nextUnavailableBlockNumber,
-				nextBlockAfterSearchRange > nextUnavailableBlockNumber
-				? nextBlockAfterSearchRange - nextUnavailableBlockNumber
-				: 0
-			};
-		} //If we had any available blocks at all
-	} //While the search range is not empty
-
-	if (bestRangeSoFar.length > 0) {
-		CFBitVectorSetBits(_allocationsBitmap, bestRangeSoFar, true);
-		S(outExt->startBlock, (u_int32_t)bestRangeSoFar.location);
-		S(outExt->blockCount, (u_int32_t)bestRangeSoFar.length);
-		return true;
+	if (foundRange.location == NSNotFound) {
+		return false;
 	}
-	return false;
+
+	S(outExt->startBlock, (u_int32_t)foundRange.location);
+	S(outExt->blockCount, (u_int32_t)MIN(foundRange.length, (NSUInteger)requestedBlocks));
+	return true;
 }
 
 - (void) allocateBlocksOfExtent:(const struct HFSPlusExtentDescriptor *_Nonnull const)oneExtent {
-	CFRange const range = {
+	NSRange const range = {
 		L(oneExtent->startBlock),
 		L(oneExtent->blockCount),
 	};
-	CFBitVectorSetBits(_allocationsBitmap, range, true);
-	S(_vh->nextAllocation, (u_int32_t)(range.location + range.length));
+	[_allocationsBitmap setBitsInRange:range];
+	[_freeExtents removeRange:range];
+	S(_vh->nextAllocation, (u_int32_t)NSMaxRange(range));
 }
 
 - (void) deallocateBlocksOfExtent:(const struct HFSPlusExtentDescriptor *_Nonnull const)oneExtent {
-	CFRange const range = {
+	NSRange const range = {
 		L(oneExtent->startBlock),
 		L(oneExtent->blockCount),
 	};
-	CFBitVectorSetBits(_allocationsBitmap, range, false);
+	[_allocationsBitmap clearBitsInRange:range];
+	[_freeExtents addFreeRange:range];
 }
 
 ///Grow an already-allocated extent (in one or both directions) to satisfy a requested number of blocks. Returns true if this succeeded or false if there wasn't enough space surrounding the extent to grow it to the requested size. If the extent was grown, the old extent will have been deallocated and the new extent allocated, and *outExt will have been updated with the revised extent, which is not guaranteed to overlap the original extent at all (this algorithm will not search the whole disk but will use empty space that adjoins the original extent, even if the movement would ultimately be farther than the length of the new extent). If this method returns false, no changes were made.
@@ -384,16 +311,16 @@
 	bool needsRestoreIfFailed = false;
 
 	//Before we actually try to change the size of the extent, see if we can find empty space *before* it. Whether this ends up being a partial slide or a total move, we should seek to reduce rather than create fragmentation.
-	CFRange searchRange = {
+	NSRange searchRange = {
 		.location = [self numBlocksForPreambleWithSize:self.numberOfBytesPerBlock],
 	};
 	searchRange.length = L(outExt->startBlock) - searchRange.location;
 
-	CFIndex lastAvailableBlockBeforeExistingExtent = CFBitVectorGetLastIndexOfBit(_allocationsBitmap, searchRange, false);
-	if (lastAvailableBlockBeforeExistingExtent == L(outExt->startBlock) - 1) {
+	NSUInteger const lastAvailableBlockBeforeExistingExtent = [_allocationsBitmap indexOfLastClearBitInRange:searchRange];
+	if (lastAvailableBlockBeforeExistingExtent != NSNotFound && lastAvailableBlockBeforeExistingExtent == L(outExt->startBlock) - 1) {
 		//OK, there is at least one available block before the existing extent. Now find the beginning of that extent.
-		CFIndex const lastUnavailableBlockBeforeExistingExtent = CFBitVectorGetLastIndexOfBit(_allocationsBitmap, searchRange, true);
-		CFIndex const firstAvailableBlockBeforeExistingExtent = lastUnavailableBlockBeforeExistingExtent + 1;
+		NSUInteger const lastUnavailableBlockBeforeExistingExtent = [_allocationsBitmap indexOfLastSetBitInRange:searchRange];
+		NSUInteger const firstAvailableBlockBeforeExistingExtent = lastUnavailableBlockBeforeExistingExtent != NSNotFound ? lastUnavailableBlockBeforeExistingExtent + 1 : searchRange.location;
 
 		//IMPORTANT: The old extent and the new extent may overlap. In that case, the already-allocated blocks will disrupt the search—we'll think those blocks aren't available even though they're already part of the allocation we're changing. So, temporarily deallocate the existing extent and reallocate it if needed.
 		[self deallocateBlocksOfExtent:outExt];
@@ -411,8 +338,10 @@
 	//If the number of blocks in the search range that are already allocated equals the block count of our existing extent, then all the *other* blocks in the search range are available. Claim them.
 	//(There won't be a case of *fewer* blocks in the search range already allocated because in the case where we slide backward, we deallocate the original extent above, so the entire search range should be clear at this point.)
 	//If there are no blocks in the search range that are already allocated… great, they're all free. Claim them.
-	CFIndex const alreadyAllocated = CFBitVectorGetCountOfBit(_allocationsBitmap, searchRange, true);
-	if (alreadyAllocated == L(outExt->blockCount)) {
+	//The bitmap ignores any part of the search range past the end of the volume, so check that separately; otherwise those nonexistent blocks would look available.
+	bool const searchRangeIsInBounds = NSMaxRange(searchRange) <= _allocationsBitmap.numberOfBits;
+	NSUInteger const alreadyAllocated = [_allocationsBitmap countOfSetBitsInRange:searchRange];
+	if (searchRangeIsInBounds && alreadyAllocated == L(outExt->blockCount)) {
 		S(outExt->startBlock, (u_int32_t)searchRange.location);
 		S(outExt->blockCount, requestedBlocks);
 
@@ -422,11 +351,12 @@
 
 	//No such luck. Restore anything we might've deallocated, then return failure.
 	if (needsRestoreIfFailed && ! allocated) {
-		CFRange const restoreRange = {
+		NSRange const restoreRange = {
 			L(backupExt.startBlock),
 			L(backupExt.blockCount)
 		};
-		CFBitVectorSetBits(_allocationsBitmap, restoreRange, true);
+		[_allocationsBitmap setBitsInRange:restoreRange];
+		[_freeExtents removeRange:restoreRange];
 	}
 
 	return allocated;
@@ -436,9 +366,15 @@
 	forFork:(ImpForkType)forkType
 	getExtent:(struct HFSPlusExtentDescriptor *_Nonnull const)outExt
 {
-	u_int32_t nextAllocation = L(_vh->nextAllocation);
-	u_int32_t const numAllBlocks = L(_vh->totalBlocks);
+	return [self allocateBlocks:requestedBlocks forFork:forkType policy:self.allocationPolicy getExtent:outExt];
+}
 
+- (bool) allocateBlocks:(u_int32_t)requestedBlocks
+	forFork:(ImpForkType)forkType
+	policy:(ImpAllocationPolicy const)policy
+	getExtent:(struct HFSPlusExtentDescriptor *_Nonnull const)outExt
+{
+	ImpPerformanceCountAllocatorCall();
 	bool fulfilled = false;
 	bool const verboseAllocation = false;
 
@@ -449,36 +385,15 @@
 	}
 
 	if (! fulfilled) {
-		CFRange const firstSearchRange = { nextAllocation, numAllBlocks - nextAllocation };
-		CFRange const secondSearchRange = { 0, nextAllocation };
-		//First search for a big enough opening to satisfy the request. If there isn't one, take any opening we can find. (If the volume is fragmented, we may be able to cobble together multiple openings. If not, taking the last remaining available blocks but still needing more only delays inevitable failure.)
-		fulfilled = [self findBlocksForward:requestedBlocks inRange:firstSearchRange acceptPartial:false getExtent:outExt];
-		if (fulfilled) {
-			if (verboseAllocation) ImpPrintf(@"Successfully allocated { %u, %u } from a sufficient opening in the latter half", L(outExt->startBlock), L(outExt->blockCount));
-		} else {
-			fulfilled = [self findBlocksForward:requestedBlocks inRange:secondSearchRange acceptPartial:false getExtent:outExt];
-			if (fulfilled) {
-				if (verboseAllocation) ImpPrintf(@"Successfully allocated { %u, %u } from a sufficient opening in the former half", L(outExt->startBlock), L(outExt->blockCount));
-			} else {
-				fulfilled = [self findBlocksForward:requestedBlocks inRange:firstSearchRange acceptPartial:true getExtent:outExt];
-				if (fulfilled) {
-					if (verboseAllocation) ImpPrintf(@"Successfully allocated { %u, %u } from a partial opening in the latter half", L(outExt->startBlock), L(outExt->blockCount));
-				} else {
-					fulfilled = [self findBlocksForward:requestedBlocks inRange:secondSearchRange acceptPartial:true getExtent:outExt];
-					if (fulfilled) {
-						if (verboseAllocation) ImpPrintf(@"Successfully allocated { %u, %u } from a partial opening in the former half", L(outExt->startBlock), L(outExt->blockCount));
-					} else {
-						ImpPrintf(@"Failed to allocate %u blocks", requestedBlocks);
-					}
-				}
-			}
-		}
-
+		fulfilled = [self findBlocks:requestedBlocks policy:policy getExtent:outExt];
 		if (fulfilled) {
+			if (verboseAllocation) ImpPrintf(@"Successfully allocated { %u, %u } of %u requested blocks", L(outExt->startBlock), L(outExt->blockCount), requestedBlocks);
 			if (existingSizeOfExtent > 0) {
 				[self deallocateBlocksOfExtent:&backupExtent];
 			}
 			[self allocateBlocksOfExtent:outExt];
+		} else {
+			ImpPrintf(@"Failed to allocate %u blocks", requestedBlocks);
 		}
 	}
 
@@ -488,6 +403,14 @@
 - (u_int64_t) allocateBytes:(u_int64_t)numBytes
 	forFork:(ImpForkType)forkType
 	populateExtentRecord:(struct HFSPlusExtentDescriptor *_Nonnull const)outExts
+{
+	return [self allocateBytes:numBytes forFork:forkType policy:self.allocationPolicy populateExtentRecord:outExts];
+}
+
+- (u_int64_t) allocateBytes:(u_int64_t)numBytes
+	forFork:(ImpForkType)forkType
+	policy:(ImpAllocationPolicy const)policy
+	populateExtentRecord:(struct HFSPlusExtentDescriptor *_Nonnull const)outExts
 {
 	u_int32_t const aBlockSize = self.numberOfBytesPerBlock;
 	u_int64_t remaining = numBytes;
@@ -511,7 +434,7 @@
 		if (numBlocksThisExtent > UINT32_MAX) numBlocksThisExtent = UINT32_MAX;
 
 		//Try to allocate that many.
-		bool allocated = [self allocateBlocks:(u_int32_t)numBlocksThisExtent forFork:forkType getExtent:outExts + extentIdx];
+		bool allocated = [self allocateBlocks:(u_int32_t)numBlocksThisExtent forFork:forkType policy:policy getExtent:outExts + extentIdx];
 
 		//Whatever we allocated, deduct it from our number of bytes remaining and advance to the next slot in the extent record.
 		if (allocated) {
@@ -538,6 +461,15 @@
 	return remaining;
 }
 
+- (void) deallocateExtentRecord:(struct HFSPlusExtentDescriptor *_Nonnull const)extRec {
+	for (NSUInteger i = 0; i < kHFSPlusExtentDensity; ++i) {
+		if (L(extRec[i].blockCount) > 0) {
+			[self deallocateBlocksOfExtent:extRec + i];
+		}
+	}
+	memset(extRec, 0, sizeof(HFSPlusExtentRecord));
+}
+
 #pragma mark Volume writing
 
 - (bool) writeTemporaryPreamble:(out NSError *_Nullable *_Nullable const)outError {
@@ -559,7 +491,7 @@
 	NSAssert(preambleData1.length == kISOStandardBlockSize, @"Temporary preamble chunk #1 was wrong length; needed to be 0x%x bytes, but got 0x%lx bytes", kISOStandardBlockSize, preambleData1.length);
 
 	u_int64_t const volumeStartInBytes = self.startOffsetInBytes;
-	ssize_t amtWritten = pwrite(self.fileDescriptor, preambleData0.bytes, preambleData0.length, volumeStartInBytes + 0);
+	ssize_t amtWritten = [self writeBytesWithoutSkippingZeroes:preambleData0.bytes length:preambleData0.length atOffsetInFile:volumeStartInBytes + 0];
 	if (amtWritten < 0 || (NSUInteger)amtWritten < preambleData0.length) {
 		NSError *_Nonnull const cantWriteTempPreambleChunk0Error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Could not write temporary preamble chunk #0 to converted volume", @"") }];
 		if (outError != NULL) {
@@ -569,7 +501,7 @@
 	}
 
 	NSData *_Nonnull const volumeHeader = self.volumeHeader;
-	amtWritten = pwrite(self.fileDescriptor, volumeHeader.bytes, volumeHeader.length, volumeStartInBytes + preambleData0.length);
+	amtWritten = [self writeBytesWithoutSkippingZeroes:volumeHeader.bytes length:volumeHeader.length atOffsetInFile:volumeStartInBytes + preambleData0.length];
 	if (amtWritten < 0 || (NSUInteger)amtWritten < volumeHeader.length) {
 		NSError *_Nonnull const cantWriteVolumeHeaderError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Could not write converted volume header in temporary location", @"") }];
 		if (outError != NULL) {
@@ -578,7 +510,7 @@
 		return false;
 	}
 
-	amtWritten = pwrite(self.fileDescriptor, preambleData1.bytes, preambleData1.length, volumeStartInBytes + preambleData0.length + preambleData1.length);
+	amtWritten = [self writeBytesWithoutSkippingZeroes:preambleData1.bytes length:preambleData1.length atOffsetInFile:volumeStartInBytes + preambleData0.length + preambleData1.length];
 	if (amtWritten < 0 || (NSUInteger)amtWritten < preambleData1.length) {
 		NSError *_Nonnull const cantWriteTempPreambleChunk2Error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Could not write temporary preamble chunk #2 to converted volume", @"") }];
 		if (outError != NULL) {
@@ -592,9 +524,8 @@
 
 - (bool) flushVolumeStructures:(NSError *_Nullable *_Nullable const)outError {
 //	ImpPrintf(@"Writing final allocations file");
-	NSUInteger const numABlocks = self.numberOfBlocksTotal;
-	NSMutableData *_Nonnull const bitmapData = [NSMutableData dataWithLength:ImpCeilingDivide(numABlocks, 8)];
-	CFBitVectorGetBits(_allocationsBitmap, (CFRange){ 0, numABlocks }, bitmapData.mutableBytes);
+	//The working bitmap is already in on-disk layout, so it can be written straight from its own storage.
+	NSData *_Nonnull const bitmapData = _allocationsBitmap.bitmapData;
 	if (! [self writeData:bitmapData startingFrom:0 toExtents:_vh->allocationFile.extents error:outError]) {
 		return false;
 	}
@@ -602,7 +533,7 @@
 //	ImpPrintf(@"Writing real boot blocks");
 	u_int64_t const volumeStartInBytes = self.startOffsetInBytes;
 	NSData *_Nonnull const bootBlocks = self.bootBlocks;
-	ssize_t amtWritten = pwrite(self.fileDescriptor, bootBlocks.bytes, bootBlocks.length, volumeStartInBytes + 0);
+	ssize_t amtWritten = [self writeBytesWithoutSkippingZeroes:bootBlocks.bytes length:bootBlocks.length atOffsetInFile:volumeStartInBytes + 0];
 	if (amtWritten < 0 || (NSUInteger)amtWritten < bootBlocks.length) {
 		NSError *_Nonnull const cantWriteBootBlocksError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Could not copy boot blocks from original volume to converted volume", @"") }];
 		if (outError != NULL) {
@@ -617,7 +548,7 @@
 //	ImpPrintf(@"Final catalog file will be %llu bytes in %u blocks", L(vh->catalogFile.logicalSize), L(vh->catalogFile.totalBlocks));
 //	ImpPrintf(@"Final extents overflow file will be %llu bytes in %u blocks", L(vh->extentsFile.logicalSize), L(vh->extentsFile.totalBlocks));
 
-	amtWritten = pwrite(self.fileDescriptor, volumeHeader.bytes, volumeHeader.length, volumeStartInBytes + bootBlocks.length);
+	amtWritten = [self writeBytesWithoutSkippingZeroes:volumeHeader.bytes length:volumeHeader.length atOffsetInFile:volumeStartInBytes + bootBlocks.length];
 	if (amtWritten < 0 || (NSUInteger)amtWritten < volumeHeader.length) {
 		NSError *_Nonnull const cantWriteVolumeHeaderError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Could not write converted volume header", @"") }];
 		if (outError != NULL) {
@@ -629,7 +560,7 @@
 //	ImpPrintf(@"Writing postamble");
 	//The postamble is the last 1 K of the volume, containing the alternate volume header and the footer.
 	//The postamble needs to be in the very last 1 K of the disk, regardless of where the a-block boundary is. TN1150 is explicit that this region can lie outside of an a-block and any a-blocks it does lie inside of must be marked as used.
-	amtWritten = pwrite(self.fileDescriptor, volumeHeader.bytes, volumeHeader.length, volumeStartInBytes + _postambleStartInBytes);
+	amtWritten = [self writeBytesWithoutSkippingZeroes:volumeHeader.bytes length:volumeHeader.length atOffsetInFile:volumeStartInBytes + _postambleStartInBytes];
 	if (amtWritten < 0 || (NSUInteger)amtWritten < volumeHeader.length) {
 		NSError *_Nonnull const cantWriteAltVolumeHeaderError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Could not write alternate volume header", @"") }];
 		if (outError != NULL) {
@@ -640,7 +571,7 @@
 	off_t const lastHalfKStart = _postambleStartInBytes + kISOStandardBlockSize;
 	NSMutableData *_Nonnull const emptyHalfK = [NSMutableData dataWithLength:kISOStandardBlockSize];
 	NSData *_Nonnull const lastBlock = self.lastBlock ?: emptyHalfK;
-	amtWritten = pwrite(self.fileDescriptor, lastBlock.bytes, lastBlock.length, volumeStartInBytes + lastHalfKStart);
+	amtWritten = [self writeBytesWithoutSkippingZeroes:lastBlock.bytes length:lastBlock.length atOffsetInFile:volumeStartInBytes + lastHalfKStart];
 	if (amtWritten < 0 || (NSUInteger)amtWritten < lastBlock.length) {
 		NSError *_Nonnull const cantWriteAltVolumeHeaderError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Could not write alternate volume header", @"") }];
 		if (outError != NULL) {
@@ -9,6 +9,7 @@
 
 #import "ImpSizeUtilities.h"
 #import "NSData+ImpSubdata.h"
+#import "ImpPerformanceCounters.h"
 
 #import "ImpTextEncodingConverter.h"
 #import "ImpBTreeTypes.h"
@@ -18,7 +19,6 @@
 {
 	NSMutableData *_preamble; //Boot blocks + volume header = 1.5 K
 	struct HFSPlusVolumeHeader *_vh;
-	CFMutableBitVectorRef _allocationsBitmap;
 	bool _hasVolumeHeader;
 }
 
@@ -108,22 +108,11 @@
 	return @":::Volume root not found:::";
 }
 
-#pragma mark Block allocation
-
-- (bool) isBlockAllocated:(u_int32_t const)blockNumber {
-	if (_allocationsBitmap != nil) {
-		return CFBitVectorGetBitAtIndex(_allocationsBitmap, blockNumber);
-	} else {
-		//We're reading the allocations bitmap. Just claim any block we're reading for it is allocated.
-		return true;
-	}
-}
-
 #pragma mark Reading blocks
 
 - (bool) readBootBlocksFromFileDescriptor:(int const)readFD error:(NSError *_Nullable *_Nonnull const)outError {
 	_preamble = [NSMutableData dataWithLength:kISOStandardBlockSize * 3];
-	ssize_t const amtRead = pread(readFD, _preamble.mutableBytes, _preamble.length, self.startOffsetInBytes + kISOStandardBlockSize * 0);
+	ssize_t const amtRead = ImpPread(readFD, _preamble.mutableBytes, _preamble.length, self.startOffsetInBytes + kISOStandardBlockSize * 0);
 	if (amtRead < 0) {
 		NSError *_Nonnull const readError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: @"Error reading volume preamble" }];
 		if (outError != NULL) *outError = readError;
@@ -321,6 +310,25 @@
 	return totalAmountRead;
 }
 
+#pragma mark Paths
+
+- (bool) getName:(NSString *_Nullable *_Nonnull const)outName
+	parentID:(HFSCatalogNodeID *_Nonnull const)outParentID
+	ofFolderWithID:(HFSCatalogNodeID const)folderID
+{
+	struct HFSUniStr255 emptyName = { .length = 0 };
+	NSData *_Nullable keyData = nil;
+	NSData *_Nullable threadRecordData = nil;
+	if (! [self.catalogBTree searchCatalogTreeForItemWithParentID:folderID unicodeName:&emptyName getRecordKeyData:&keyData threadRecordData:&threadRecordData]) {
+		return false;
+	}
+
+	struct HFSPlusCatalogThread const *_Nonnull const threadPtr = threadRecordData.bytes;
+	*outName = [self.textEncodingConverter stringFromHFSUniStr255:&(threadPtr->nodeName)];
+	*outParentID = L(threadPtr->parentID);
+	return true;
+}
+
 #pragma mark Reading fork contents
 
 - (NSData *_Nullable) readDataFromFileDescriptor:(int const)readFD
@@ -330,6 +338,15 @@
 	error:(NSError *_Nullable *_Nonnull const)outError
 {
 	NSUInteger const blockSize = self.numberOfBytesPerBlock;
+	if (self.usesMemoryMapping && numExtents > 0 && extents[0].blockCount != 0 && (numExtents == 1 || extents[1].blockCount == 0)) {
+		//The whole file is one extent, so it can be served straight out of the mapping.
+		NSData *_Nullable const mappedData = [self mappedDataForBlocksStartingAt:L(extents[0].startBlock) count:L(extents[0].blockCount) error:outError];
+		if (mappedData != nil && mappedData.length > numBytes) {
+			return [self mappedDataAtOffset:[self offsetInBytesOfBlock:L(extents[0].startBlock)] length:numBytes];
+		}
+		return mappedData;
+	}
+
 	bool successfullyReadAllNonEmptyExtents = true;
 
 	NSNumberFormatter *_Nonnull const fmtr = [NSNumberFormatter new];
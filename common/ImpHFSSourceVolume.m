@@ -8,13 +8,31 @@
 #import "ImpHFSSourceVolume.h"
 
 #import "ImpSizeUtilities.h"
+#import "ImpAllocationBitmap.h"
+#import "ImpPerformanceCounters.h"
+#import "ImpTextEncodingConverter.h"
 
 #import "ImpBTreeFile.h"
+#import "ImpBTreeNode.h"
+
+#import <os/lock.h>
+
+///One extent record from the extents overflow file, along with the startBlock from its key (in native byte order). The extents themselves are kept in on-disk (big-endian) byte order, same as anywhere else we pass around an HFSExtentRecord.
+struct ImpHFSOverflowExtentRecord {
+	u_int16_t startBlock;
+	HFSExtentRecord extents;
+};
 
 @implementation ImpHFSSourceVolume
 {
 	NSData *_mdbData;
 	struct HFSMasterDirectoryBlock const *_mdb;
+
+	os_unfair_lock _extentMapLock;
+	///Keys are CNID << 8 | fork type. Values are arrays of struct ImpHFSOverflowExtentRecord, in key order.
+	NSDictionary <NSNumber *, NSData *> *_overflowExtentRecordsByFork;
+	///The tree _overflowExtentRecordsByFork was built from, so we know to rebuild it if the extents overflow tree gets replaced.
+	ImpBTreeFile *_extentMapTree;
 }
 
 #pragma mark Property accessors
@@ -68,7 +86,7 @@
 - (bool) readVolumeHeaderFromFileDescriptor:(int const)readFD error:(NSError *_Nullable *_Nonnull const)outError {
 	//The volume header occupies the first sizeof(HFSMasterDirectoryBlock) bytes of one 512-byte block.
 	NSMutableData *_Nonnull const mdbData = [NSMutableData dataWithLength:ImpNextMultipleOfSize(sizeof(HFSMasterDirectoryBlock), kISOStandardBlockSize)];
-	ssize_t const amtRead = pread(readFD, mdbData.mutableBytes, mdbData.length, _startOffsetInBytes + kISOStandardBlockSize * 2);
+	ssize_t const amtRead = ImpPread(readFD, mdbData.mutableBytes, mdbData.length, _startOffsetInBytes + kISOStandardBlockSize * 2);
 	if (amtRead < 0) {
 		NSError *_Nonnull const readError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: @"Error reading source volume HFS header" }];
 		if (outError != NULL) *outError = readError;
@@ -116,7 +134,7 @@
 #if ImpHFS_DEBUG_LOGGING
 	ImpPrintf(@"Reading %zu (0x%zx) bytes (%zu blocks) of VBM starting from offset 0x%llx bytes", volumeBitmap.length, volumeBitmap.length, volumeBitmap.length / kISOStandardBlockSize, lseek(readFD, 0, SEEK_CUR));
 #endif
-	ssize_t const amtRead = pread(readFD, volumeBitmap.mutableBytes, volumeBitmap.length, _startOffsetInBytes + kISOStandardBlockSize * 3);
+	ssize_t const amtRead = ImpPread(readFD, volumeBitmap.mutableBytes, volumeBitmap.length, _startOffsetInBytes + kISOStandardBlockSize * 3);
 	if (amtRead < 0) {
 		NSError *_Nonnull const readError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: @"Error reading source volume allocation bitmap" }];
 		if (outError != NULL) *outError = readError;
@@ -140,18 +158,25 @@
 	//TODO: We may also need to load further extents from the extents overflow file, if the catalog is particularly fragmented. Only using the extent record in the volume header may lead to only having part of the catalog.
 	struct HFSExtentDescriptor const *_Nonnull const catExtDescs = _mdb->drCTExtRec;
 	u_int64_t const catFileLen = L(_mdb->drCTFlSize);
-	NSMutableData *_Nonnull const catalogFileData = [NSMutableData dataWithCapacity:ImpNumberOfBlocksInHFSExtentRecord(catExtDescs) * L(_mdb->drAlBlkSiz)];
-	__block u_int32_t numExtents = 0;
-	[self forEachExtentInFileWithID:kHFSCatalogFileID
-							   fork:ImpForkTypeData
-				  forkLogicalLength:catFileLen
-		  startingWithExtentsRecord:catExtDescs
-			  readDataOrReturnError:outError
-							  block:^bool(NSData *const  _Nonnull fileData, const u_int64_t logicalLength) {
-		[catalogFileData appendData:fileData];
-		++numExtents;
-		return true;
-	}];
+	NSData *_Nullable catalogFileData = nil;
+	if (self.usesMemoryMapping && ImpNumberOfBlocksInHFSExtentRecord(catExtDescs) * (u_int64_t)L(_mdb->drAlBlkSiz) >= catFileLen) {
+		//The whole catalog is in the MDB's extent record, so there's nothing to look up in the extents overflow file, and if it's all one extent it can be used straight out of the mapping.
+		catalogFileData = [self readDataFromFileDescriptor:readFD logicalLength:catFileLen extents:catExtDescs numExtents:kHFSExtentDensity error:outError];
+	} else {
+		NSMutableData *_Nonnull const catalogFileMutableData = [NSMutableData dataWithCapacity:ImpNumberOfBlocksInHFSExtentRecord(catExtDescs) * L(_mdb->drAlBlkSiz)];
+		__block u_int32_t numExtents = 0;
+		[self forEachExtentInFileWithID:kHFSCatalogFileID
+								   fork:ImpForkTypeData
+					  forkLogicalLength:catFileLen
+			  startingWithExtentsRecord:catExtDescs
+				  readDataOrReturnError:outError
+								  block:^bool(NSData *const  _Nonnull fileData, const u_int64_t logicalLength) {
+			[catalogFileMutableData appendData:fileData];
+			++numExtents;
+			return true;
+		}];
+		catalogFileData = catalogFileMutableData;
+	}
 	if (tapURL != nil) [catalogFileData writeToURL:tapURL options:0 error:NULL];
 
 	bool const successfullyReadCatalog = catalogFileData != nil && catalogFileData.length > 0;
@@ -194,15 +219,94 @@
 	return (self.extentsOverflowBTree != nil);
 }
 
+#pragma mark Extent map
+
+///Walk the extents overflow file's leaf row once, collecting every record into a per-fork list. Must be called with _extentMapLock held.
+- (NSDictionary <NSNumber *, NSData *> *_Nonnull) buildOverflowExtentMapFromTree:(ImpBTreeFile *_Nonnull const)extentsFile {
+	NSMutableDictionary <NSNumber *, NSMutableData *> *_Nonnull const recordsByFork = [NSMutableDictionary dictionary];
+
+	__block NSMutableData *_Nullable currentForkRecords = nil;
+	__block u_int64_t currentForkKey = UINT64_MAX;
+	[extentsFile walkLeafNodes:^bool(ImpBTreeNode *_Nonnull const node) {
+		u_int16_t const numRecords = node.numberOfRecords;
+		for (u_int16_t i = 0; i < numRecords; ++i) {
+			u_int16_t keyLength = 0, payloadLength = 0;
+			struct HFSExtentKey const *_Nonnull const keyPtr = [node pointerToKeyOfRecordAtIndex:i length:&keyLength];
+			void const *_Nonnull const payloadPtr = [node pointerToPayloadOfRecordAtIndex:i length:&payloadLength];
+			if (keyLength < sizeof(struct HFSExtentKey) || payloadLength < sizeof(HFSExtentRecord)) {
+				//Not an extent record. (Shouldn't happen in a leaf node of a well-formed extents overflow file.)
+				continue;
+			}
+
+			u_int64_t const forkKey = ((u_int64_t)L(keyPtr->fileID) << 8) | L(keyPtr->forkType);
+			//Records are sorted by file ID, then fork type, then start block, so all of one fork's records are adjacent. Only go to the dictionary when we cross into a new fork.
+			if (forkKey != currentForkKey) {
+				currentForkKey = forkKey;
+				NSNumber *_Nonnull const forkKeyNumber = @(forkKey);
+				currentForkRecords = recordsByFork[forkKeyNumber];
+				if (currentForkRecords == nil) {
+					currentForkRecords = [NSMutableData dataWithCapacity:sizeof(struct ImpHFSOverflowExtentRecord)];
+					recordsByFork[forkKeyNumber] = currentForkRecords;
+				}
+			}
+
+			struct ImpHFSOverflowExtentRecord record = { .startBlock = L(keyPtr->startBlock) };
+			memcpy(record.extents, payloadPtr, sizeof(record.extents));
+			[currentForkRecords appendBytes:&record length:sizeof(record)];
+		}
+		return true;
+	}];
+
+	return recordsByFork;
+}
+
+///Returns an array of struct ImpHFSOverflowExtentRecord holding every extents overflow record for this fork, sorted by start block, or nil if the fork has no overflow records. The first time this is called (for any fork), it builds a map of every fork's overflow records in one pass over the extents overflow file; thereafter, lookups don't touch the B*-tree at all.
+- (NSData *_Nullable) overflowExtentRecordsForFileWithID:(HFSCatalogNodeID const)cnid fork:(ImpForkType const)forkType {
+	ImpBTreeFile *_Nullable const extentsFile = self.extentsOverflowBTree;
+	if (extentsFile == nil) {
+		//Most likely we're still loading the volume and haven't read the extents overflow file yet. Don't cache anything, since there'll be a tree to map later.
+		return nil;
+	}
+
+	NSData *_Nullable records = nil;
+	os_unfair_lock_lock(&_extentMapLock);
+	if (_overflowExtentRecordsByFork == nil || _extentMapTree != extentsFile) {
+		_overflowExtentRecordsByFork = [self buildOverflowExtentMapFromTree:extentsFile];
+		_extentMapTree = extentsFile;
+	}
+	records = _overflowExtentRecordsByFork[@(((u_int64_t)cnid << 8) | forkType)];
+	os_unfair_lock_unlock(&_extentMapLock);
+
+	return records;
+}
+
+#pragma mark Paths
+
+- (bool) getName:(NSString *_Nullable *_Nonnull const)outName
+	parentID:(HFSCatalogNodeID *_Nonnull const)outParentID
+	ofFolderWithID:(HFSCatalogNodeID const)folderID
+{
+	NSData *_Nullable keyData = nil;
+	NSData *_Nullable threadRecordData = nil;
+	if (! [self.catalogBTree searchCatalogTreeForItemWithParentID:folderID name:"\p" getRecordKeyData:&keyData threadRecordData:&threadRecordData]) {
+		return false;
+	}
+
+	struct HFSCatalogThread const *_Nonnull const threadPtr = threadRecordData.bytes;
+	*outName = [self.textEncodingConverter stringForPascalString:threadPtr->nodeName];
+	*outParentID = L(threadPtr->parentID);
+	return true;
+}
+
 #pragma mark Orphaned block checking
 
 - (void) findExtentsThatAreAllocatedButAreNotReferencedInTheBTrees:(void (^_Nonnull const)(NSRange))block {
-	CFMutableBitVectorRef _Nonnull const orphanedBlocks = CFBitVectorCreateMutableCopy(kCFAllocatorDefault, CFBitVectorGetCount(_bitVector), _bitVector);
+	ImpAllocationBitmap *_Nonnull const orphanedBlocks = [_allocationBitmap copy];
 
 	NSUInteger const blockSize = self.numberOfBytesPerBlock;
 	u_int64_t (^_Nonnull const markOffBits)(struct HFSExtentDescriptor const *_Nonnull const oneExtent, u_int64_t logicalBytesRemaining) = ^u_int64_t(struct HFSExtentDescriptor const *_Nonnull const oneExtent, u_int64_t logicalBytesRemaining) {
-		CFRange const range = { L(oneExtent->startBlock), L(oneExtent->blockCount) };
-		CFBitVectorSetBits(orphanedBlocks, range, 0);
+		NSRange const range = { L(oneExtent->startBlock), L(oneExtent->blockCount) };
+		[orphanedBlocks clearBitsInRange:range];
 		return range.length * blockSize;
 	};
 
@@ -237,9 +341,7 @@
 		startingWithExtentsRecord:_mdb->drXTExtRec
 		block:markOffBits];
 
-	[self findExtents:block inBitVector:orphanedBlocks];
-
-	CFRelease(orphanedBlocks);
+	[self findExtents:block inBitmap:orphanedBlocks];
 }
 
 #pragma mark Reading fork contents
@@ -268,6 +370,15 @@
 	error:(NSError *_Nullable *_Nonnull const)outError
 {
 	NSUInteger const blockSize = self.numberOfBytesPerBlock;
+	if (self.usesMemoryMapping && numExtents > 0 && extents[0].blockCount != 0 && (numExtents == 1 || extents[1].blockCount == 0)) {
+		//The whole file is one extent, so it can be served straight out of the mapping.
+		NSData *_Nullable const mappedData = [self mappedDataForBlocksStartingAt:L(extents[0].startBlock) count:L(extents[0].blockCount) error:outError];
+		if (mappedData != nil && mappedData.length > numBytes) {
+			return [self mappedDataAtOffset:[self offsetInBytesOfBlock:L(extents[0].startBlock)] length:numBytes];
+		}
+		return mappedData;
+	}
+
 	bool successfullyReadAllNonEmptyExtents = true;
 
 	NSNumberFormatter *_Nonnull const fmtr = [NSNumberFormatter new];
@@ -377,26 +488,21 @@
 	//First, process the initial extents record from the catalog.
 	processOneExtentRecord(initialExtRec, kHFSExtentDensity);
 
-	//Second, if we're not done yet, consult the extents overflow B*-tree for this item.
+	//Second, if we're not done yet, consult the extents overflow B*-tree for this item. Rather than searching the tree once per record, we look the fork up in the extent map, which has every overflow record for this fork in order.
 	if (keepIterating && logicalBytesRemaining > 0) {
 //		ImpPrintf(@"Still need to find %llu bytes. Looking in the extents overflow file…", logicalBytesRemaining);
-		ImpBTreeFile *_Nonnull const extentsFile = self.extentsOverflowBTree;
-
-		__block u_int32_t precedingBlockCount = ImpNumberOfBlocksInHFSExtentRecord(initialExtRec);
-		bool keepSearching = true;
-		while (keepSearching) {
-			NSUInteger const numRecordsEncountered = [extentsFile searchExtentsOverflowTreeForCatalogNodeID:cnid
-			fork:forkType
-				precededByNumberOfBlocks:precedingBlockCount
-			forEachRecord:^bool(NSData *_Nonnull const recordData)
-		{
-			struct HFSExtentDescriptor const *_Nonnull const hfsExtRec = recordData.bytes;
-			NSUInteger const numExtentDescriptors = recordData.length / sizeof(struct HFSExtentDescriptor);
-			processOneExtentRecord(hfsExtRec, numExtentDescriptors);
-				precedingBlockCount += ImpNumberOfBlocksInHFSExtentRecord(hfsExtRec);
-			return keepIterating;
-		}];
-			keepSearching = numRecordsEncountered > 0;
+		NSData *_Nullable const overflowRecordsData = [self overflowExtentRecordsForFileWithID:cnid fork:forkType];
+		struct ImpHFSOverflowExtentRecord const *_Nullable const overflowRecords = overflowRecordsData.bytes;
+		NSUInteger const numOverflowRecords = overflowRecordsData.length / sizeof(struct ImpHFSOverflowExtentRecord);
+
+		u_int32_t precedingBlockCount = ImpNumberOfBlocksInHFSExtentRecord(initialExtRec);
+		for (NSUInteger i = 0; i < numOverflowRecords && keepIterating; ++i) {
+			//Each record has to pick up exactly where the previous one left off. If there's a gap, the old one-search-per-record approach would have come up empty at this point, so stop here too.
+			if (overflowRecords[i].startBlock != (u_int16_t)precedingBlockCount) {
+				break;
+			}
+			processOneExtentRecord(overflowRecords[i].extents, kHFSExtentDensity);
+			precedingBlockCount += ImpNumberOfBlocksInHFSExtentRecord(overflowRecords[i].extents);
 		}
 	}
 
@@ -418,7 +524,9 @@
 
 	int const readFD = self.fileDescriptor;
 	u_int64_t const blockSize = self.numberOfBytesPerBlock;
-	NSMutableData *_Nonnull const data = [NSMutableData dataWithLength:blockSize * L(hfsExtRec[0].blockCount)];
+	//When the source is mapped, each extent is delivered as a view into the mapping, and this buffer goes unused.
+	bool const mappedSource = self.usesMemoryMapping;
+	NSMutableData *_Nonnull const data = [NSMutableData dataWithLength:mappedSource ? 0 : blockSize * L(hfsExtRec[0].blockCount)];
 	__weak typeof(self) weakSelf = self;
 
 	totalAmountRead += [self forEachExtentInFileWithID:cnid
@@ -431,16 +539,25 @@
 		u_int64_t const physicalLength = blockSize * L(oneExtent->blockCount);
 
 		u_int64_t amtRead = 0;
-		[data setLength:physicalLength];
-		bool const success = [weakSelf readIntoData:data
-			atOffset:0
-			fromFileDescriptor:readFD
-			extent:oneExtent
-			actualAmountRead:&amtRead
-			error:&readError];
+		NSData *_Nullable extentData = nil;
+		bool success;
+		if (mappedSource) {
+			extentData = [weakSelf mappedDataForBlocksStartingAt:L(oneExtent->startBlock) count:L(oneExtent->blockCount) error:&readError];
+			success = extentData != nil;
+			amtRead = extentData.length;
+		} else {
+			[data setLength:physicalLength];
+			success = [weakSelf readIntoData:data
+				atOffset:0
+				fromFileDescriptor:readFD
+				extent:oneExtent
+				actualAmountRead:&amtRead
+				error:&readError];
+			extentData = data;
+		}
 
 		if (success) {
-			bool const successfullyDelivered = block(data, MAX(amtRead, logicalBytesRemaining));
+			bool const successfullyDelivered = block(extentData, MAX(amtRead, logicalBytesRemaining));
 //			ImpPrintf(@"Consumer block returned %@; returning %llu bytes", successfullyDelivered ? @"true" : @"false", successfullyDelivered ? amtRead : 0);
 			return successfullyDelivered ? amtRead : 0;
 		} else {
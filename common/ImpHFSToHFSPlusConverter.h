@@ -12,6 +12,8 @@ typedef void (^ImpConversionProgressUpdateBlock)(double progress, NSString *_Non
 
 @class ImpSourceVolume, ImpDestinationVolume;
 @class ImpBTreeFile, ImpMutableBTreeFile;
+@class ImpConversionReport;
+struct ImpProgressSnapshot;
 
 extern NSString *_Nonnull const ImpRescuedDataFileName;
 
@@ -27,6 +29,23 @@ extern NSString *_Nonnull const ImpRescuedDataFileName;
 ///WARNING: SETTING THIS TO FALSE IS LITERALLY ASKING TO LOSE DATA.
 @property bool copyForkData;
 
+///Only matters when copyForkData is false. If true (the default), forks are filled in with placeholder text (see placeholderForkData). If false, fork contents are not written at all, making for a metadata-only conversion; in a sparse destination, every fork is a hole.
+@property bool writesPlaceholderForkData;
+
+///If true (the default), blocks that are entirely zero are left as holes in the destination file rather than written. See -[ImpDestinationVolume writesSparseOutput].
+@property bool writesSparseOutput;
+///If true, ask the file system to reserve space for the whole destination volume before writing any of it, to keep it from being fragmented. This uses up space that sparse output would have saved, so it's off by default.
+@property bool preallocatesDestination;
+
+///If true, fork contents are read from the source in one front-to-back sweep after the whole catalog has been walked, rather than file by file as the walk finds them. This saves a lot of seeking on sources where seeking is slow (optical media, old spinning disks), but nothing gets copied until the walk is done. Off by default. See -[ImpForkCopyEngine readsInPhysicalOrder].
+@property bool readsSourceInPhysicalOrder;
+
+///If nonzero, build the new catalog within about this many bytes of working memory, spilling sorted batches of records to temporary files. See -[ImpCatalogBuilder memoryBudgetInBytes]. Default is 0 (build the catalog entirely in memory).
+@property NSUInteger catalogMemoryBudgetInBytes;
+
+///If true, a description of each file is delivered to conversionProgressUpdateBlock as the file is copied. Building those descriptions can cost more than copying a small file, so this is off by default, and progress updates are only delivered as the conversion moves from one phase to the next. Either way, the counters below are kept up to date; use getProgressSnapshot: (for example, with an ImpProgressEmitter) to watch them.
+@property bool verboseProgress;
+
 ///Data to fill in non-copied fork data blocks with. Not used in normal operation; only used when copyForkData is false.
 @property(readonly) NSData *_Nonnull const placeholderForkData;
 
@@ -42,6 +61,20 @@ extern NSString *_Nonnull const ImpRescuedDataFileName;
 ///Decrease self.numberOfSourceBlocksToCopy by this number.
 - (void) reportSourceBlocksWillNotBeCopied:(NSUInteger const)thisManyFewer;
 
+///The number of files whose forks have both finished copying. Safe to read from any thread.
+@property(readonly) u_int64_t numberOfFilesCopied;
+///The number of folders (not counting the root folder) that have been converted. Safe to read from any thread.
+@property(readonly) u_int64_t numberOfFoldersCopied;
+///The number of bytes of fork contents that have been written to the destination volume. Safe to read from any thread.
+@property(readonly) u_int64_t numberOfBytesCopied;
+
+- (void) reportFilesCopied:(NSUInteger const)thisManyMore;
+- (void) reportFoldersCopied:(NSUInteger const)thisManyMore;
+- (void) reportBytesCopied:(u_int64_t const)thisManyMore;
+
+///Fill out a snapshot of the conversion's progress. This only reads counters, so it's cheap and can be called from any thread while the conversion is running.
+- (void) getProgressSnapshot:(struct ImpProgressSnapshot *_Nonnull const)outSnapshot;
+
 ///Increase self.numberOfSourceBlocksCopied by the total number of blocks indicated by an extent record.
 - (void) reportSourceExtentRecordCopied:(struct HFSExtentDescriptor const *_Nonnull const)extRecPtr;
 ///Decrease self.numberOfSourceBlocksToCopy by the total number of blocks indicated by an extent record.
@@ -57,6 +90,9 @@ extern NSString *_Nonnull const ImpRescuedDataFileName;
 
 - (bool)performConversionOrReturnError:(NSError *_Nullable *_Nonnull) outError;
 
+///Time spent and work done in each step of the most recent conversion, including any step that failed. Empty before the first conversion.
+@property(readonly) ImpConversionReport *_Nonnull performanceReport;
+
 #pragma mark Methods for subclasses' use
 
 ///Calls self.conversionProgressUpdateBlock with these values.
@@ -78,7 +114,8 @@ extern NSString *_Nonnull const ImpRescuedDataFileName;
 - (NSMutableData *_Nonnull) convertHFSCatalogKeyToHFSPlus:(NSData *_Nonnull const)sourceKeyData;
 
 - (void) convertHFSVolumeHeader:(struct HFSMasterDirectoryBlock const *_Nonnull const)mdbPtr toHFSPlusVolumeHeader:(struct HFSPlusVolumeHeader *_Nonnull const)vhPtr;
-- (ImpMutableBTreeFile *_Nonnull) convertHFSCatalogFile:(ImpBTreeFile *_Nonnull const)sourceTree;
+///Returns nil if the converted catalog couldn't be built (e.g., because it's being built under a memory budget and its temporary files couldn't be written).
+- (ImpMutableBTreeFile *_Nullable) convertHFSCatalogFile:(ImpBTreeFile *_Nonnull const)sourceTree error:(NSError *_Nullable *_Nullable const)outError;
 - (void) copyFromHFSExtentsOverflowFile:(ImpBTreeFile *_Nonnull const)sourceTree toHFSPlusExtentsOverflowFile:(ImpMutableBTreeFile *_Nonnull const)destTree;
 
 ///Open files for reading and writing and do any other preflight checks before conversion begins. The abstract class implements this method. After this method returns, self.hfsVolume and self.hfsPlusVolume are non-nil.
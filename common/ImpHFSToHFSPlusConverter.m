@@ -10,10 +10,14 @@
 #import <hfs/hfs_format.h>
 #import <CoreServices/CoreServices.h>
 #import <sys/stat.h>
+#import <os/lock.h>
+#import <stdatomic.h>
 
 #import "ImpByteOrder.h"
 #import "ImpSizeUtilities.h"
 #import "ImpErrorUtilities.h"
+#import "ImpFileTransfer.h"
+#import "ImpPerformanceCounters.h"
 #import "NSData+ImpMultiplication.h"
 #import "ImpSourceVolume.h"
 #import "ImpHFSSourceVolume.h"
@@ -27,6 +31,9 @@
 #import "ImpExtentSeries.h"
 #import "ImpTextEncodingConverter.h"
 #import "ImpCatalogBuilder.h"
+#import "ImpConversionReport.h"
+#import "ImpProgressEmitter.h"
+#import "ImpTrace.h"
 
 NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered from orphaned blocks";
 
@@ -34,9 +41,9 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 {
 	NSData *_placeholderForkData;
 	TextEncoding _hfsTextEncoding, _hfsPlusTextEncoding;
-	TextToUnicodeInfo _ttui;
 	int _readFD, _writeFD;
 	bool _hasReportedPostVolumeLength;
+	_Atomic u_int64_t _numberOfFilesCopied, _numberOfFoldersCopied, _numberOfBytesCopied;
 }
 
 + (NSData *_Nonnull const) placeholderForkData {
@@ -59,13 +66,34 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 	return placeholderForkData;
 }
 
+///Returns the one-block placeholder repeated to fill a block of this size. These are cached for the life of the process, so every conversion using the same block size (which, for batches of floppy images, is nearly all of them) shares one copy.
++ (NSData *_Nonnull const) placeholderForkDataForBlockSize:(NSUInteger const)blockSize {
+	static NSMutableDictionary <NSNumber *, NSData *> *_Nullable placeholdersByBlockSize = nil;
+	static os_unfair_lock placeholdersLock = OS_UNFAIR_LOCK_INIT;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
+		placeholdersByBlockSize = [NSMutableDictionary dictionaryWithCapacity:1];
+	});
+
+	NSNumber *_Nonnull const key = @(blockSize);
+	os_unfair_lock_lock(&placeholdersLock);
+	NSData *_Nullable placeholder = placeholdersByBlockSize[key];
+	if (placeholder == nil) {
+		NSData *_Nonnull const oneBlockPlaceholder = [self placeholderForkData];
+		NSUInteger const multiplier = blockSize / oneBlockPlaceholder.length;
+		placeholder = [oneBlockPlaceholder times_Imp:multiplier];
+		placeholdersByBlockSize[key] = placeholder;
+	}
+	os_unfair_lock_unlock(&placeholdersLock);
+
+	return placeholder;
+}
+
 - (NSData *_Nonnull const) placeholderForkData {
 	if (_placeholderForkData == nil) {
-		NSData *_Nonnull const oneBlockPlaceholder = [[self class] placeholderForkData];
 		NSUInteger const srcBlockSize = self.sourceVolume.numberOfBytesPerBlock;
 		NSAssert(srcBlockSize > 0, @"Can't build placeholder fork data until source volume's block size is known");
-		NSUInteger const multiplier = srcBlockSize / oneBlockPlaceholder.length;
-		_placeholderForkData = [oneBlockPlaceholder times_Imp:multiplier];
+		_placeholderForkData = [[self class] placeholderForkDataForBlockSize:srcBlockSize];
 		NSLog(@"Placeholder size: %lu bytes", _placeholderForkData.length);
 	}
 	return _placeholderForkData;
@@ -77,58 +105,17 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 		//TODO: Even for MacRoman, it may make sense to expose a choice between kMacRomanCurrencySignVariant and kMacRomanEuroSignVariant. (Also maybe auto-detect based on volume creation date? Euro sign variant came in with Mac OS 8.5.)
 		_hfsTextEncoding = CreateTextEncoding(kTextEncodingMacRoman, kMacRomanDefaultVariant, kTextEncodingDefaultFormat);
 		_hfsPlusTextEncoding = CreateTextEncoding(kTextEncodingUnicodeV2_0, kUnicodeHFSPlusDecompVariant, kUnicodeUTF16BEFormat);
-
-		struct UnicodeMapping mapping = {
-			.unicodeEncoding = _hfsPlusTextEncoding,
-			.otherEncoding = _hfsTextEncoding,
-			.mappingVersion = kUnicodeUseHFSPlusMapping,
-		};
-		OSStatus const err = CreateTextToUnicodeInfo(&mapping, &_ttui);
-		if (err != noErr) {
-			ImpPrintf(@"Volume converter failed to initialize Unicode conversion: error %d/%s", err, ImpExplainOSStatus(err));
-		}
+		_writesPlaceholderForkData = true;
+		_writesSparseOutput = true;
+		_performanceReport = [ImpConversionReport new];
 	}
 	return self;
 }
 
 - (NSData *_Nonnull const)hfsUniStr255ForPascalString:(ConstStr31Param _Nonnull)pascalString {
-	//The length in MacRoman characters may include accented characters that HFS+ decomposition will decompose to a base character and a combining character, so we actually need to double the length *in characters*.
-	ByteCount outputPayloadSizeInBytes = (2 * *pascalString) * sizeof(UniChar);
-	//TECConvertText documentation: “Always allocate a buffer at least 32 bytes long.”
-	if (outputPayloadSizeInBytes < 32) {
-		outputPayloadSizeInBytes = 32;
-	}
-	ByteCount const outputBufferSizeInBytes = outputPayloadSizeInBytes + 1 * sizeof(UniChar);
-	NSMutableData *_Nonnull const unicodeData = [NSMutableData dataWithLength:outputBufferSizeInBytes];
-
-	if (*pascalString == 0) {
-		//TEC doesn't like converting empty strings, so just return our empty HFSUniStr255 without calling TEC.
-		return unicodeData;
-	}
-
-	UniChar *_Nonnull const outputBuf = unicodeData.mutableBytes;
-
-	ByteCount actualOutputLengthInBytes = 0;
-	OSStatus const err = ConvertFromPStringToUnicode(_ttui, pascalString, outputPayloadSizeInBytes, &actualOutputLengthInBytes, outputBuf + 1);
-
-	if (err != noErr) {
-		NSMutableData *_Nonnull const cStringData = [NSMutableData dataWithLength:pascalString[0]];
-		char *_Nonnull const cStringBytes = cStringData.mutableBytes;
-		memcpy(cStringBytes, pascalString + 1, *pascalString);
-		ImpPrintf(@"Failed to convert filename '%s' (length %u) to Unicode: error %d/%s", (char const *)cStringBytes, (unsigned)*pascalString, err, ImpExplainOSStatus(err));
-		if (err == kTECOutputBufferFullStatus) {
-			ImpPrintf(@"Output buffer fill: %lu vs. buffer size %lu", (unsigned long)actualOutputLengthInBytes, outputPayloadSizeInBytes);
-		}
-		return nil;
-	} else {
-#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
-		//Swap all the bytes in the output data.
-		swab(outputBuf + 1, outputBuf + 1, actualOutputLengthInBytes);
-#endif
-	}
-	S(outputBuf[0], (u_int16_t)(actualOutputLengthInBytes / sizeof(UniChar)));
-
-	return unicodeData;
+	//Use the process-wide converter for this encoding rather than creating our own TEC objects for every conversion.
+	ImpTextEncodingConverter *_Nonnull const tec = [ImpTextEncodingConverter converterWithHFSTextEncoding:self.hfsTextEncoding];
+	return [tec hfsUniStr255ForPascalString:pascalString];
 }
 - (NSString *_Nonnull const) stringForPascalString:(ConstStr31Param _Nonnull)pascalString {
 	NSData *_Nonnull const unicodeData = [self hfsUniStr255ForPascalString:pascalString];
@@ -153,6 +140,38 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 - (void) reportSourceBlocksWillNotBeCopied:(NSUInteger const)thisManyFewer {
 	self.numberOfSourceBlocksToCopy = self.numberOfSourceBlocksToCopy - thisManyFewer;
 }
+
+- (u_int64_t) numberOfFilesCopied {
+	return atomic_load_explicit(&_numberOfFilesCopied, memory_order_relaxed);
+}
+- (u_int64_t) numberOfFoldersCopied {
+	return atomic_load_explicit(&_numberOfFoldersCopied, memory_order_relaxed);
+}
+- (u_int64_t) numberOfBytesCopied {
+	return atomic_load_explicit(&_numberOfBytesCopied, memory_order_relaxed);
+}
+- (void) reportFilesCopied:(NSUInteger const)thisManyMore {
+	atomic_fetch_add_explicit(&_numberOfFilesCopied, thisManyMore, memory_order_relaxed);
+}
+- (void) reportFoldersCopied:(NSUInteger const)thisManyMore {
+	atomic_fetch_add_explicit(&_numberOfFoldersCopied, thisManyMore, memory_order_relaxed);
+}
+- (void) reportBytesCopied:(u_int64_t const)thisManyMore {
+	atomic_fetch_add_explicit(&_numberOfBytesCopied, thisManyMore, memory_order_relaxed);
+}
+
+- (void) getProgressSnapshot:(struct ImpProgressSnapshot *_Nonnull const)outSnapshot {
+	//The source volume's file and folder counts come from its volume header, which doesn't change once the volume has been loaded.
+	ImpSourceVolume *_Nullable const srcVol = self.sourceVolume;
+	outSnapshot->filesDone = self.numberOfFilesCopied;
+	outSnapshot->filesTotal = srcVol.numberOfFiles;
+	outSnapshot->foldersDone = self.numberOfFoldersCopied;
+	outSnapshot->foldersTotal = srcVol.numberOfFolders;
+	outSnapshot->blocksDone = self.numberOfSourceBlocksCopied;
+	outSnapshot->blocksTotal = self.numberOfSourceBlocksToCopy;
+	outSnapshot->bytesDone = self.numberOfBytesCopied;
+}
+
 - (void) reportSourceExtentRecordCopied:(struct HFSExtentDescriptor const *_Nonnull const)extRecPtr {
 	[self reportSourceBlocksCopied:ImpNumberOfBlocksInHFSExtentRecord(extRecPtr)];
 }
@@ -287,14 +306,40 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 }
 
 - (bool) performConversionOrReturnError:(NSError *_Nullable *_Nonnull) outError {
+	ImpConversionReport *_Nonnull const report = [ImpConversionReport new];
+	_performanceReport = report;
+	atomic_store(&_numberOfFilesCopied, 0);
+	atomic_store(&_numberOfFoldersCopied, 0);
+	atomic_store(&_numberOfBytesCopied, 0);
+
+	ImpTraceTimestamp traceStart = ImpTraceBegin();
+	[report beginStepNamed:@"step0_preflight"];
 	bool const preflightSuccess = [self step0_preflight_error:outError];
+	[report endStepWithSuccess:preflightSuccess];
+	ImpTraceEnd(traceStart, "conversion", "step0_preflight");
 	if (! preflightSuccess) return preflightSuccess;
+
+	traceStart = ImpTraceBegin();
+	[report beginStepNamed:@"step1_convertPreamble"];
 	bool const preambleSuccess = [self step1_convertPreamble_error:outError];
+	[report endStepWithSuccess:preambleSuccess];
+	ImpTraceEnd(traceStart, "conversion", "step1_convertPreamble");
 	if (! preambleSuccess) return preambleSuccess;
+
+	traceStart = ImpTraceBegin();
+	[report beginStepNamed:@"step2_convertVolume"];
 	bool const convertSuccess = [self step2_convertVolume_error:outError];
+	[report endStepWithSuccess:convertSuccess];
+	ImpTraceEnd(traceStart, "conversion", "step2_convertVolume");
 	if (! convertSuccess) return convertSuccess;
+
+	traceStart = ImpTraceBegin();
+	[report beginStepNamed:@"step3_flushVolume"];
 	bool const flushSuccess = [self step3_flushVolume_error:outError];
-	if (! convertSuccess) return convertSuccess;
+	[report endStepWithSuccess:flushSuccess];
+	ImpTraceEnd(traceStart, "conversion", "step3_flushVolume");
+	if (! flushSuccess) return flushSuccess;
+
 	return preflightSuccess && preambleSuccess && convertSuccess && flushSuccess;
 }
 
@@ -435,12 +480,14 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 	return [ImpBTreeFile nodeSizeForVersion:ImpBTreeVersionHFSPlusCatalog];
 }
 
-- (ImpMutableBTreeFile *_Nonnull) convertHFSCatalogFile:(ImpBTreeFile *_Nonnull const)sourceTree {
+- (ImpMutableBTreeFile *_Nullable) convertHFSCatalogFile:(ImpBTreeFile *_Nonnull const)sourceTree error:(NSError *_Nullable *_Nullable const)outError {
+	ImpTraceTimestamp const traceStart = ImpTraceBegin();
 	NSUInteger const numItems = self.sourceVolume.numberOfFiles + self.sourceVolume.numberOfFolders;
 	ImpCatalogBuilder *_Nonnull const catBuilder = [[ImpCatalogBuilder alloc] initWithBTreeVersion:ImpBTreeVersionHFSPlusCatalog
 		bytesPerNode:self.destinationCatalogNodeSize
 		expectedNumberOfItems:numItems];
 	catBuilder.treeDepthHint = sourceTree.headerNode.treeDepth;
+	catBuilder.memoryBudgetInBytes = self.catalogMemoryBudgetInBytes;
 //	ImpTextEncodingConverter *_Nonnull const tec = self.sourceVolume.textEncodingConverter;
 
 	//Gather our list of all items, converting file, folder, and thread records as we go and keeping each item's file/folder record and thread record (if it has one) together.
@@ -488,7 +535,10 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 		nodeCount:catBuilder.totalNodeCount
 		convertTree:sourceTree];
 
-	[catBuilder populateTree:destTree];
+	if (! [catBuilder populateTree:destTree error:outError]) {
+		ImpTraceEnd(traceStart, "catalog", "Convert catalog");
+		return nil;
+	}
 
 	NSAssert([_destinationVolume isKindOfClass:[ImpHFSPlusDestinationVolume class]], @"ERROR: Destination volume is not an HFS+ volume! Can't convert to anything but an HFS+ volume yet.");
 	ImpHFSPlusDestinationVolume *_Nonnull const hfsPlusVol = (ImpHFSPlusDestinationVolume *)_destinationVolume;
@@ -508,6 +558,7 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 //	ImpPrintf(@"HFS tree had %lu live nodes out of %lu; HFS+ tree has %lu live nodes out of %lu", numSrcLiveNodes, numSrcPotentialNodes, numDstLiveNodes, numDstPotentialNodes);
 	NSAssert(numDstLiveNodes <= numDstPotentialNodes, @"Conversion failure: Produced more catalog nodes than the catalog file was preallocated for (please file a bug, include this message, and if possible and legal attach the disk image you were trying to convert)");
 
+	ImpTraceEndWithArguments(traceStart, "catalog", "Convert catalog", "items", numItems, "nodes", numDstLiveNodes);
 	return destTree;
 }
 
@@ -610,6 +661,11 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 	}
 
 	if (haveFoundHFSVolume) {
+		if (! [self.destinationVolume prepareBackingFileWithPreallocation:self.preallocatesDestination error:outError]) {
+			return false;
+		}
+		self.destinationVolume.writesSparseOutput = self.writesSparseOutput;
+
 		//Strictly speaking, the data before and after the volume doesn't need to be a multiple of the block size.
 		//But the denominator of our progress calculation is in source allocation blocks, so using ISO standard blocks for surrounding data could exaggerate its proportion of what remains to be copied.
 		u_int64_t const volumeStartOffset = self.sourceVolume.startOffsetInBytes;
@@ -662,46 +718,37 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 
 ///Copy the partition map (if any) and any other partitions before the volume.
 - (bool) copyBytesBeforeVolume_error:(NSError *_Nullable *_Nullable const)outError {
-	lseek(_readFD, 0, SEEK_SET);
-	lseek(_writeFD, 0, SEEK_SET);
-
 	ImpSourceVolume *_Nonnull const srcVol = self.sourceVolume;
 	u_int64_t const blockSize = srcVol.numberOfBytesPerBlock;
-	NSMutableData *_Nonnull const bufferData = [NSMutableData dataWithLength:blockSize];
-	void *_Nonnull const buf = bufferData.mutableBytes;
 
 	u_int64_t const numBytesBeforeVolume = srcVol.startOffsetInBytes;
 	u_int64_t const numBlocksBeforeVolume = ImpCeilingDivide(numBytesBeforeVolume, blockSize);
-	for (u_int64_t i = 0; i < numBlocksBeforeVolume; ++i) {
-		ssize_t amtRead = read(_readFD, buf, blockSize);
-		if (amtRead < 0) {
-			NSError *_Nonnull const readError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Failure to read data prior to volume", @"Converter error") }];
-			if (outError != NULL) {
-				*outError = readError;
-			}
-			return false;
-		}
+	if (numBlocksBeforeVolume == 0) {
+		return true;
+	}
 
-		ssize_t amtWritten = write(_writeFD, buf, blockSize);
-		if (amtWritten < 0) {
-			NSError *_Nonnull const writeError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Failure to write data prior to volume", @"Converter error") }];
-			if (outError != NULL) {
-				*outError = writeError;
-			}
-			return false;
+	//This is copied verbatim. The source must have all of it, since the volume comes after it; if it runs out early, ImpTransferBytes fails.
+	NSError *_Nullable transferError = nil;
+	u_int64_t amtTransferred = 0;
+	bool const transferred = ImpTransferBytes(_readFD, 0, _writeFD, 0, numBlocksBeforeVolume * blockSize, &amtTransferred, &transferError);
+	if (! transferred) {
+		NSError *_Nonnull const copyError = [NSError errorWithDomain:transferError.domain code:transferError.code userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Failure to copy data prior to volume", @"Converter error"), NSUnderlyingErrorKey: transferError }];
+		if (outError != NULL) {
+			*outError = copyError;
 		}
-
-		[self reportSourceBlocksCopied:1];
+		return false;
 	}
 
+	[self reportSourceBlocksCopied:numBlocksBeforeVolume];
+
 	return true;
 }
 ///Copy any other partitions after the volume.
 - (bool) copyBytesAfterVolume_error:(NSError *_Nullable *_Nullable const)outError {
 	ImpSourceVolume *_Nonnull const srcVol = self.sourceVolume;
 	u_int64_t const numBytesBeforeEndOfVolume = srcVol.startOffsetInBytes + srcVol.lengthInBytes;
-	off_t const readPos = lseek(_readFD, numBytesBeforeEndOfVolume, SEEK_SET);
-	off_t const writePos = lseek(_writeFD, numBytesBeforeEndOfVolume, SEEK_SET);
+	off_t const readPos = numBytesBeforeEndOfVolume;
+	off_t const writePos = numBytesBeforeEndOfVolume;
 
 	NSByteCountFormatter *_Nonnull const bcf = [NSByteCountFormatter new];
 	NSNumberFormatter *_Nonnull const nf = [NSNumberFormatter new];
@@ -710,34 +757,50 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 	ImpPrintf(@"Copying bytes following volume (including any subsequent partitions). Copy will start at %@ (%@ bytes) from the source and %@ (%@ bytes) in the destination.", [bcf stringFromByteCount:readPos], [nf stringFromNumber:@(readPos)], [bcf stringFromByteCount:writePos], [nf stringFromNumber:@(writePos)]);
 
 	u_int64_t const blockSize = srcVol.numberOfBytesPerBlock;
+	//We don't necessarily know how long the source is (it may be a device), so copy in chunks until we run out, reporting progress as we go. The chunks are big enough that the per-chunk overhead doesn't matter.
+	u_int64_t const chunkSize = ImpNextMultipleOfSize(8 * 1024 * 1024, blockSize);
 
-	NSMutableData *_Nonnull const bufferData = [NSMutableData dataWithLength:blockSize];
-	void *_Nonnull const buf = bufferData.mutableBytes;
-
-	ssize_t amtRead = 0;
 	off_t totalAmtWritten = 0;
-	while ((amtRead = read(_readFD, buf, blockSize)) > 0) {
-		ssize_t amtWritten = write(_writeFD, buf, blockSize);
-		if (amtWritten < 0) {
-			NSError *_Nonnull const writeError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Failure to write data following volume", @"Converter error") }];
+	while (true) {
+		NSError *_Nullable transferError = nil;
+		u_int64_t amtTransferred = 0;
+		bool const transferred = ImpTransferBytes(_readFD, readPos + totalAmtWritten, _writeFD, writePos + totalAmtWritten, chunkSize, &amtTransferred, &transferError);
+		//Running out of source partway through a chunk is how we find the end of the source, so it isn't an error here.
+		bool const reachedEndOfSource = ! transferred && [transferError.domain isEqualToString:NSCocoaErrorDomain] && transferError.code == NSFileReadCorruptFileError;
+		if (! (transferred || reachedEndOfSource)) {
+			NSError *_Nonnull const copyError = [NSError errorWithDomain:NSPOSIXErrorDomain code:transferError.code userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Failure to copy data following volume", @"Converter error"), NSUnderlyingErrorKey: transferError }];
 			if (outError != NULL) {
-				*outError = writeError;
+				*outError = copyError;
 			}
 			return false;
 		}
-		totalAmtWritten += amtWritten;
+		totalAmtWritten += amtTransferred;
 
 		//If we haven't previously reported the number of these blocks to be copied, don't worry about reporting them copied.
 		if (_hasReportedPostVolumeLength) {
-			[self reportSourceBlocksCopied:1];
+			[self reportSourceBlocksCopied:ImpCeilingDivide(amtTransferred, blockSize)];
+		}
+
+		if (amtTransferred < chunkSize) {
+			//Reached the end of the source.
+			break;
 		}
 	}
-	if (amtRead < 0) {
-		NSError *_Nonnull const readError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Failure to read data following volume", @"Converter error") }];
-		if (outError != NULL) {
-			*outError = readError;
+
+	//Historically this copy has always been done in whole blocks, so if the source ended partway through a block, pad out the rest of it.
+	u_int64_t const numBytesInPartialBlock = totalAmtWritten % blockSize;
+	if (numBytesInPartialBlock > 0) {
+		u_int64_t const numPaddingBytes = blockSize - numBytesInPartialBlock;
+		NSMutableData *_Nonnull const padding = [NSMutableData dataWithLength:numPaddingBytes];
+		ssize_t const amtWritten = ImpPwrite(_writeFD, padding.bytes, numPaddingBytes, writePos + totalAmtWritten);
+		if (amtWritten < 0) {
+			NSError *_Nonnull const writeError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: NSLocalizedString(@"Failure to write data following volume", @"Converter error") }];
+			if (outError != NULL) {
+				*outError = writeError;
+			}
+			return false;
 		}
-		return false;
+		totalAmtWritten += amtWritten;
 	}
 
 	ImpPrintf(@"Copied %@ (%@ bytes) after volume", [bcf stringFromByteCount:totalAmtWritten], [nf stringFromNumber:@(totalAmtWritten)]);
@@ -752,7 +815,9 @@ NSString *_Nonnull const ImpRescuedDataFileName = @"!!! Data impluse recovered f
 		return false;
 	}
 
+	ImpTraceTimestamp const traceStart = ImpTraceBegin();
 	bool const flushed = [self.destinationVolume flushVolumeStructures:outError];
+	ImpTraceEnd(traceStart, "io", "flushVolumeStructures:");
 	if (flushed) {
 		[self deliverProgressUpdateWithOperationDescription:NSLocalizedString(@"Successfully wrote volume", @"Conversion progress message")];
 	}
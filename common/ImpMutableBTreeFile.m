@@ -311,10 +311,15 @@
 	quarryCatalogKey.keyLength -= sizeof(quarryCatalogKey.keyLength);
 //	ImpPrintf(@"Input node name is %u characters; node name in search key is %u characters", L(nodeName->length), L(quarryCatalogKey.nodeName.length));
 
+	HFSCatalogNodeID const quarryParentID = L(quarryCatalogKey.parentID);
+	struct ImpHFSPlusFoldedName quarryName;
+	quarryName.length = (u_int16_t)ImpHFSPlusFoldName(&quarryCatalogKey.nodeName, quarryName.unicode);
+	struct ImpHFSPlusFoldedName const *_Nonnull const quarryNamePtr = &quarryName;
+
 //	ImpTextEncodingConverter *_Nonnull const tec = [[ImpTextEncodingConverter alloc] initWithHFSTextEncoding:kTextEncodingMacRoman];
 	ImpBTreeRecordKeyComparator _Nonnull const compareKeys = ^ImpBTreeComparisonResult(const void *const  _Nonnull foundKeyPtr) {
 		struct HFSPlusCatalogKey const *_Nonnull const foundCatKeyPtr = foundKeyPtr;
-		ImpBTreeComparisonResult const result = ImpBTreeCompareHFSPlusCatalogKeys(&quarryCatalogKey, foundCatKeyPtr);
+		ImpBTreeComparisonResult const result = ImpBTreeCompareHFSPlusCatalogKeyWithFoldedName(quarryParentID, quarryNamePtr, foundCatKeyPtr);
 //		NSString *_Nonnull const quarryName = [tec stringFromHFSUniStr255:&(quarryCatalogKey.nodeName)];
 //		NSString *_Nonnull const foundName = [tec stringFromHFSUniStr255:&(foundCatKeyPtr->nodeName)];
 //		ImpPrintf(@"Parent ID #%u, name “%@” vs parent ID #%u, name “%@” => %+d", L(quarryCatalogKey.parentID), quarryName, L(foundCatKeyPtr->parentID), foundName, result);
@@ -340,10 +345,14 @@
 	u_int16_t const keyLength = sizeof(quarryCatalogKey.parentID) + sizeof(quarryCatalogKey.nodeName.length) + sizeof(UniChar) * L(quarryCatalogKey.nodeName.length);
 	S(quarryCatalogKey.keyLength, (u_int16_t)keyLength);
 
+	struct ImpHFSPlusFoldedName quarryName;
+	quarryName.length = (u_int16_t)ImpHFSPlusFoldName(&quarryCatalogKey.nodeName, quarryName.unicode);
+	struct ImpHFSPlusFoldedName const *_Nonnull const quarryNamePtr = &quarryName;
+
 	//TODO: Factor this out into -hfsCatalogKeyComparator and -hfsPlusCatalogKeyComparator (the latter should use Unicode name comparisons)
 	ImpBTreeRecordKeyComparator _Nonnull const compareKeys = ^ImpBTreeComparisonResult(const void *const  _Nonnull foundKeyPtr) {
 		struct HFSPlusCatalogKey const *_Nonnull const foundCatKeyPtr = foundKeyPtr;
-		return ImpBTreeCompareHFSPlusCatalogKeys(&quarryCatalogKey, foundCatKeyPtr);
+		return ImpBTreeCompareHFSPlusCatalogKeyWithFoldedName(parentID, quarryNamePtr, foundCatKeyPtr);
 	};
 
 	ImpBTreeNode *_Nullable foundNode = nil;
@@ -0,0 +1,55 @@
+//
+//  ImpPerformanceCounters.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-19.
+//
+
+#ifndef ImpPerformanceCounters_h
+#define ImpPerformanceCounters_h
+
+#import <Foundation/Foundation.h>
+
+#import <sys/uio.h>
+
+/*!Process-wide counters of the work done reading and writing volumes. These are always on; each one is a single relaxed atomic increment, which is noise next to the syscall or search it counts.
+ * The counters are not per-volume or per-conversion. If several conversions run at once in the same process, they all count into the same totals, which is why convert-batch only writes reports when it's running one conversion at a time.
+ */
+struct ImpPerformanceCounterSnapshot {
+	///Calls to pread, and the bytes they returned.
+	u_int64_t readCalls, bytesRead;
+	///Calls to pwrite and pwritev, and the bytes they accepted.
+	u_int64_t writeCalls, bytesWritten;
+	///B-tree nodes examined while searching or walking a tree.
+	u_int64_t bTreeNodeVisits;
+	///Requests to a destination volume's block allocator.
+	u_int64_t allocatorCalls;
+	///Bytes currently held in large working buffers (fork copy buffers, write-behind buffers, catalog arena slabs), and the most that have been held at once since the last ImpPerformanceCountersResetPeakBufferBytes.
+	u_int64_t bufferBytesInUse, peakBufferBytes;
+};
+
+///Copy every counter's current value into the snapshot. The counters are read one at a time, so if other threads are working, the snapshot may be very slightly inconsistent.
+void ImpPerformanceCountersGetSnapshot(struct ImpPerformanceCounterSnapshot *_Nonnull const outSnapshot);
+///Set the peak buffer usage back to the current usage, so the next snapshot's peak reflects only what happens after this.
+void ImpPerformanceCountersResetPeakBufferBytes(void);
+
+#pragma mark Counted I/O
+
+///Same as pread(2), but counted.
+ssize_t ImpPread(int const fd, void *_Nonnull const buf, size_t const length, off_t const offset);
+///Same as pwrite(2), but counted.
+ssize_t ImpPwrite(int const fd, void const *_Nonnull const buf, size_t const length, off_t const offset);
+///Same as pwritev(2), but counted (as one call). Only available where pwritev is.
+ssize_t ImpPwritev(int const fd, struct iovec const *_Nonnull const vectors, int const numVectors, off_t const offset) API_AVAILABLE(macos(11.0));
+
+#pragma mark Other events
+
+void ImpPerformanceCountBTreeNodeVisit(void);
+void ImpPerformanceCountAllocatorCall(void);
+
+///Call when a large working buffer is created, with its capacity.
+void ImpPerformanceBufferAllocated(u_int64_t const numBytes);
+///Call when a buffer previously reported to ImpPerformanceBufferAllocated is released, with the same size.
+void ImpPerformanceBufferFreed(u_int64_t const numBytes);
+
+#endif /* ImpPerformanceCounters_h */
@@ -0,0 +1,87 @@
+//
+//  ImpPerformanceCounters.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-19.
+//
+
+#import "ImpPerformanceCounters.h"
+
+#import <stdatomic.h>
+#import <unistd.h>
+
+static _Atomic u_int64_t ImpReadCalls, ImpBytesRead;
+static _Atomic u_int64_t ImpWriteCalls, ImpBytesWritten;
+static _Atomic u_int64_t ImpBTreeNodeVisits;
+static _Atomic u_int64_t ImpAllocatorCalls;
+static _Atomic u_int64_t ImpBufferBytesInUse, ImpPeakBufferBytes;
+
+//Nothing is ordered by these counters, so relaxed ordering is all any of them need.
+#define ImpCounterAdd(counter, amount) atomic_fetch_add_explicit(&(counter), (amount), memory_order_relaxed)
+#define ImpCounterLoad(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+void ImpPerformanceCountersGetSnapshot(struct ImpPerformanceCounterSnapshot *_Nonnull const outSnapshot) {
+	outSnapshot->readCalls = ImpCounterLoad(ImpReadCalls);
+	outSnapshot->bytesRead = ImpCounterLoad(ImpBytesRead);
+	outSnapshot->writeCalls = ImpCounterLoad(ImpWriteCalls);
+	outSnapshot->bytesWritten = ImpCounterLoad(ImpBytesWritten);
+	outSnapshot->bTreeNodeVisits = ImpCounterLoad(ImpBTreeNodeVisits);
+	outSnapshot->allocatorCalls = ImpCounterLoad(ImpAllocatorCalls);
+	outSnapshot->bufferBytesInUse = ImpCounterLoad(ImpBufferBytesInUse);
+	outSnapshot->peakBufferBytes = ImpCounterLoad(ImpPeakBufferBytes);
+}
+
+void ImpPerformanceCountersResetPeakBufferBytes(void) {
+	atomic_store_explicit(&ImpPeakBufferBytes, ImpCounterLoad(ImpBufferBytesInUse), memory_order_relaxed);
+}
+
+#pragma mark Counted I/O
+
+ssize_t ImpPread(int const fd, void *_Nonnull const buf, size_t const length, off_t const offset) {
+	ssize_t const amtRead = pread(fd, buf, length, offset);
+	ImpCounterAdd(ImpReadCalls, 1);
+	if (amtRead > 0) {
+		ImpCounterAdd(ImpBytesRead, (u_int64_t)amtRead);
+	}
+	return amtRead;
+}
+
+ssize_t ImpPwrite(int const fd, void const *_Nonnull const buf, size_t const length, off_t const offset) {
+	ssize_t const amtWritten = pwrite(fd, buf, length, offset);
+	ImpCounterAdd(ImpWriteCalls, 1);
+	if (amtWritten > 0) {
+		ImpCounterAdd(ImpBytesWritten, (u_int64_t)amtWritten);
+	}
+	return amtWritten;
+}
+
+ssize_t ImpPwritev(int const fd, struct iovec const *_Nonnull const vectors, int const numVectors, off_t const offset) {
+	ssize_t const amtWritten = pwritev(fd, vectors, numVectors, offset);
+	ImpCounterAdd(ImpWriteCalls, 1);
+	if (amtWritten > 0) {
+		ImpCounterAdd(ImpBytesWritten, (u_int64_t)amtWritten);
+	}
+	return amtWritten;
+}
+
+#pragma mark Other events
+
+void ImpPerformanceCountBTreeNodeVisit(void) {
+	ImpCounterAdd(ImpBTreeNodeVisits, 1);
+}
+
+void ImpPerformanceCountAllocatorCall(void) {
+	ImpCounterAdd(ImpAllocatorCalls, 1);
+}
+
+void ImpPerformanceBufferAllocated(u_int64_t const numBytes) {
+	u_int64_t const nowInUse = ImpCounterAdd(ImpBufferBytesInUse, numBytes) + numBytes;
+	u_int64_t peak = ImpCounterLoad(ImpPeakBufferBytes);
+	while (nowInUse > peak && ! atomic_compare_exchange_weak_explicit(&ImpPeakBufferBytes, &peak, nowInUse, memory_order_relaxed, memory_order_relaxed)) {
+		//peak has been updated to whatever another thread put there; try again if we're still higher.
+	}
+}
+
+void ImpPerformanceBufferFreed(u_int64_t const numBytes) {
+	atomic_fetch_sub_explicit(&ImpBufferBytesInUse, numBytes, memory_order_relaxed);
+}
@@ -0,0 +1,48 @@
+//
+//  ImpProgressEmitter.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-21.
+//
+
+#import <Foundation/Foundation.h>
+
+///A moment's reading of an operation's progress counters. Any total that isn't known yet is 0.
+struct ImpProgressSnapshot {
+	u_int64_t filesDone, filesTotal;
+	u_int64_t foldersDone, foldersTotal;
+	u_int64_t blocksDone, blocksTotal;
+	u_int64_t bytesDone;
+};
+
+///Fill in the snapshot with the operation's current counts. Called on the emitter's queue, so it must only read things that are safe to read from another thread (atomic counters, mainly).
+typedef void (^ImpProgressSampler)(struct ImpProgressSnapshot *_Nonnull const outSnapshot);
+///elapsed is the number of seconds since the emitter was started.
+typedef void (^ImpProgressSampleHandler)(struct ImpProgressSnapshot const *_Nonnull const snapshot, NSTimeInterval const elapsed);
+
+/*!A progress emitter takes a snapshot of an operation's progress at a fixed interval, on a queue of its own, and reports each one to a block and/or as a line of JSON written to a file descriptor.
+ *The operation being watched doesn't call the emitter at all; it just bumps its counters. That way, the cost of reporting progress depends on how long the operation takes, not on how many items it goes through.
+ */
+@interface ImpProgressEmitter : NSObject
+
+- (instancetype _Nonnull) initWithSampler:(ImpProgressSampler _Nonnull)sampler NS_DESIGNATED_INITIALIZER;
+- (instancetype _Nonnull) init NS_UNAVAILABLE;
+
+///How many seconds between samples. Default is 1 second. Must be set before start.
+@property NSTimeInterval interval;
+
+///If non-negative, each sample is written to this file descriptor as one line of JSON (newline-delimited JSON, a.k.a. NDJSON). Default is -1 (no JSON). The emitter doesn't close the file descriptor.
+///Each line is written all at once, so emitters sharing a pipe won't interleave their lines (as long as the lines are shorter than PIPE_BUF, which they will be unless the label is very long).
+@property int outputFileDescriptor;
+///If non-nil, included in every JSON line as "label", to tell apart several operations reporting to the same file descriptor.
+@property(copy) NSString *_Nullable label;
+
+///Called with each sample, on the emitter's queue.
+@property(copy) ImpProgressSampleHandler _Nullable sampleHandler;
+
+///Start taking samples. The first is taken one interval from now.
+- (void) start;
+///Stop taking samples, then take one last one (with "final" set to true in the JSON) so the last report reflects how things ended. Returns after that sample has been reported.
+- (void) stop;
+
+@end
@@ -0,0 +1,128 @@
+//
+//  ImpProgressEmitter.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-21.
+//
+
+#import "ImpProgressEmitter.h"
+
+#import <time.h>
+#import <unistd.h>
+
+static double ImpMonotonicSeconds(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+@implementation ImpProgressEmitter
+{
+	ImpProgressSampler _Nonnull _sampler;
+	dispatch_queue_t _Nonnull _queue;
+	dispatch_source_t _Nullable _timer;
+	double _startTime;
+	///The label as a JSON key-value pair with a trailing comma, ready to be dropped into each line. Empty if there's no label.
+	NSString *_Nonnull _labelField;
+}
+
+- (instancetype _Nonnull) initWithSampler:(ImpProgressSampler _Nonnull)sampler {
+	if ((self = [super init])) {
+		_sampler = [sampler copy];
+		_queue = dispatch_queue_create("org.boredzo.impluse.progress", DISPATCH_QUEUE_SERIAL);
+		_interval = 1.0;
+		_outputFileDescriptor = -1;
+		_labelField = @"";
+	}
+	return self;
+}
+
+- (void) dealloc {
+	if (_timer != nil) {
+		dispatch_source_cancel(_timer);
+	}
+}
+
+- (void) start {
+	NSAssert(_timer == nil, @"Progress emitter started twice");
+
+	if (self.label != nil) {
+		NSData *_Nullable const labelJSON = [NSJSONSerialization dataWithJSONObject:self.label options:NSJSONWritingFragmentsAllowed error:NULL];
+		if (labelJSON != nil) {
+			_labelField = [NSString stringWithFormat:@"\"label\":%@,", [[NSString alloc] initWithData:labelJSON encoding:NSUTF8StringEncoding]];
+		}
+	}
+
+	_startTime = ImpMonotonicSeconds();
+	u_int64_t const intervalNanoseconds = (u_int64_t)(self.interval * NSEC_PER_SEC);
+	_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _queue);
+	//Nobody needs these exactly on the second, so give the system some slack to coalesce the timer with other wakeups.
+	dispatch_source_set_timer(_timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)intervalNanoseconds), intervalNanoseconds, intervalNanoseconds / 10);
+	__weak ImpProgressEmitter *_Nullable const weakSelf = self;
+	dispatch_source_set_event_handler(_timer, ^{
+		[weakSelf emitSampleIsFinal:false];
+	});
+	dispatch_resume(_timer);
+}
+
+- (void) stop {
+	if (_timer == nil) {
+		return;
+	}
+	//Once cancelled, the timer won't fire again, and any sample it's in the middle of reporting will finish before the final one (since they're on the same serial queue).
+	dispatch_source_cancel(_timer);
+	_timer = nil;
+	dispatch_sync(_queue, ^{
+		[self emitSampleIsFinal:true];
+	});
+}
+
+#pragma mark Reporting
+
+static void ImpWriteFully(int const fd, char const *_Nonnull buf, size_t length) {
+	while (length > 0) {
+		ssize_t const amtWritten = write(fd, buf, length);
+		if (amtWritten < 0) {
+			if (errno == EINTR) continue;
+			//Progress is a courtesy. If whoever's reading it has gone away, that's no reason to stop the operation.
+			break;
+		}
+		buf += amtWritten;
+		length -= (size_t)amtWritten;
+	}
+}
+
+///Must be called on _queue.
+- (void) emitSampleIsFinal:(bool const)isFinal {
+	struct ImpProgressSnapshot snapshot = { 0 };
+	_sampler(&snapshot);
+	NSTimeInterval const elapsed = ImpMonotonicSeconds() - _startTime;
+
+	ImpProgressSampleHandler _Nullable const sampleHandler = self.sampleHandler;
+	if (sampleHandler != nil) {
+		sampleHandler(&snapshot, elapsed);
+	}
+
+	int const fd = self.outputFileDescriptor;
+	if (fd >= 0) {
+		double const fraction = snapshot.blocksTotal > 0 ? MIN(1.0, snapshot.blocksDone / (double)snapshot.blocksTotal) : 0.0;
+		double const bytesPerSecond = elapsed > 0.0 ? snapshot.bytesDone / elapsed : 0.0;
+		char *_Nullable line = NULL;
+		int const lineLength = asprintf(&line, "{%s\"elapsed_seconds\":%.3f,\"files_done\":%llu,\"files_total\":%llu,\"folders_done\":%llu,\"folders_total\":%llu,\"blocks_done\":%llu,\"blocks_total\":%llu,\"bytes_done\":%llu,\"bytes_per_second\":%.0f,\"fraction\":%.4f,\"final\":%s}\n",
+			_labelField.UTF8String,
+			elapsed,
+			snapshot.filesDone, snapshot.filesTotal,
+			snapshot.foldersDone, snapshot.foldersTotal,
+			snapshot.blocksDone, snapshot.blocksTotal,
+			snapshot.bytesDone,
+			bytesPerSecond,
+			fraction,
+			isFinal ? "true" : "false");
+		if (lineLength > 0 && line != NULL) {
+			ImpWriteFully(fd, line, (size_t)lineLength);
+		}
+		free(line);
+	}
+}
+
+@end
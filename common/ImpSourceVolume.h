@@ -9,14 +9,16 @@
 
 @class ImpBTreeFile;
 @class ImpTextEncodingConverter;
+@class ImpAllocationBitmap;
+@class ImpCatalogIndex;
 
 #import "ImpForkUtilities.h"
 
 @interface ImpSourceVolume : NSObject
 {
 	NSMutableData *_bootBlocksData;
-	CFBitVectorRef _bitVector;
-	CFMutableBitVectorRef _blocksThatAreAllocatedButWereNotAccessed;
+	ImpAllocationBitmap *_allocationBitmap;
+	ImpAllocationBitmap *_blocksThatAreAllocatedButWereNotAccessed;
 
 	u_int64_t _startOffsetInBytes, _lengthInBytes;
 	int _fileDescriptor;
@@ -41,6 +43,11 @@
 ///The total length of the volume, from preamble to postamble. May be an estimate based on the volume header, if the volume was created from a device.
 @property(nonatomic, readonly) u_int64_t lengthInBytes;
 
+/*!If set to true, the whole source file is mapped into memory read-only, and reads (including of the catalog and extents overflow files) are served from the mapping, as no-copy views into it wherever possible, instead of being read into freshly-allocated buffers. Data returned from such reads keeps the mapping alive for as long as it exists.
+ * Mapping is only possible for regular files; if the source can't be mapped (e.g., it's a device), this property stays false and reads go through pread as usual. Since an I/O error while touching a mapped page is a crash rather than an error, this is best used for images on local storage that won't change while they're open. Set this before loading the volume.
+ */
+@property(nonatomic) bool usesMemoryMapping;
+
 ///Read the boot blocks, volume header, and allocation bitmap in that order, followed by the extents overflow file and catalog file.
 - (bool)loadAndReturnError:(NSError *_Nullable *_Nonnull const)outError;
 
@@ -72,8 +79,8 @@
 ///Returns whether a block is marked as in use according to the volume bitmap. Does not guarantee that the block is actually referred to by an extent in the catalog or extents overflow trees.
 - (bool) isBlockAllocated:(u_int32_t const)blockNumber;
 
-///Abstract method for subclasses.
-- (void) findExtents:(void (^_Nonnull const)(NSRange))block inBitVector:(CFBitVectorRef _Nonnull const)bitVector;
+///Call the block with an NSRange containing each contiguous extent of blocks that are set in the bitmap, within the bounds of the volume. For subclasses' implementations of findExtentsThatAreAllocatedButAreNotReferencedInTheBTrees:.
+- (void) findExtents:(void (^_Nonnull const)(NSRange))block inBitmap:(ImpAllocationBitmap *_Nonnull const)bitmap;
 
 ///Identify which blocks are marked as allocated in the volume bitmap but have not been read from, and print those to the log.
 - (void) reportBlocksThatAreAllocatedButHaveNotBeenAccessed;
@@ -86,6 +93,8 @@
 
 @property(strong) ImpBTreeFile *_Nonnull catalogBTree;
 @property(strong) ImpBTreeFile *_Nonnull extentsOverflowBTree;
+///If set, used to find forks' extents without walking the extents overflow file. Nothing sets this automatically; see ImpCatalogIndex.
+@property(strong) ImpCatalogIndex *_Nullable catalogIndex;
 
 - (NSString *_Nonnull) volumeName;
 - (u_int32_t) firstPhysicalBlockOfFirstAllocationBlock;
@@ -105,8 +114,36 @@
 - (NSUInteger) catalogSizeInBytes;
 - (NSUInteger) extentsOverflowSizeInBytes;
 
+#pragma mark Paths
+
+///Returns the names of a folder and every folder above it, starting with the volume name, that, if joined by colons, will form the folder's HFS path. Returns an empty array for kHFSRootParentID (the root folder's parent).
+///Each folder's path is looked up in the catalog only once and then remembered for the life of the volume, so items in the same folder, or anywhere under a folder that's been looked up before, cost no further searches. Safe to call from multiple threads.
+- (NSArray <NSString *> *_Nonnull) pathComponentsOfFolderWithID:(HFSCatalogNodeID const)folderID;
+///Remember a folder's path, as returned by pathComponentsOfFolderWithID:, for callers that already know it from walking the catalog themselves.
+- (void) rememberPathComponents:(NSArray <NSString *> *_Nonnull const)pathComponents ofFolderWithID:(HFSCatalogNodeID const)folderID;
+
+///For subclasses. Look up a folder's thread record and return by reference its name and the CNID of its parent. Returns false if the folder has no thread record.
+- (bool) getName:(NSString *_Nullable *_Nonnull const)outName
+	parentID:(HFSCatalogNodeID *_Nonnull const)outParentID
+	ofFolderWithID:(HFSCatalogNodeID const)folderID;
+
 #pragma mark Reading fork contents
 
+///The offset in bytes, within the file descriptor, at which a given allocation block starts. Takes into account both the volume's start offset and the offset of the first allocation block.
+- (off_t) offsetInBytesOfBlock:(u_int32_t const)blockNumber;
+
+///For callers that account for blocks without reading them into memory (such as a metadata-only conversion). Does the same bookkeeping that readIntoData:… does before reading: returns false if any of the blocks are unallocated, and otherwise marks them as accessed.
+- (bool) prepareToTransferBlocksStartingAt:(u_int32_t const)startBlock
+	count:(u_int32_t const)blockCount
+	error:(NSError *_Nullable *_Nonnull const)outError;
+
+///For subclasses, when usesMemoryMapping is true. Returns a no-copy view of up to length bytes of the mapping starting at offset (in bytes within the file descriptor, as for offsetInBytesOfBlock:). As with pread, the returned data will be shorter than requested (possibly empty) if the file ends sooner.
+- (NSData *_Nonnull) mappedDataAtOffset:(off_t const)offset length:(u_int64_t const)length;
+///For subclasses, when usesMemoryMapping is true. Does the same checks and bookkeeping as readIntoData:…, then returns a no-copy view of the blocks' contents in the mapping. Returns nil on failure.
+- (NSData *_Nullable) mappedDataForBlocksStartingAt:(u_int32_t const)startBlock
+	count:(u_int32_t const)blockCount
+	error:(NSError *_Nullable *_Nonnull const)outError;
+
 ///Low-level method intended for subclasses implementing their own versions of the higher-level readDataFromFileDescriptor:logicalLength:… method. This effectively takes one extent, using HFS+'s larger type for block numbers.
 ///Returns intoData on success; nil on failure. The copy's destination starts offset bytes into the data.
 - (bool) readIntoData:(NSMutableData *_Nonnull const)intoData
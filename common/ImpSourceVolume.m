@@ -15,9 +15,16 @@
 #import "ImpTextEncodingConverter.h"
 #import "ImpExtentSeries.h"
 #import "ImpBTreeFile.h"
+#import "ImpAllocationBitmap.h"
+#import "ImpPerformanceCounters.h"
+#import "ImpTrace.h"
 
 #import "ImpHFSSourceVolume.h"
 
+#import <os/lock.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+
 @interface ImpSourceVolume ()
 
 @property(readwrite, nonnull, strong) ImpTextEncodingConverter *textEncodingConverter;
@@ -28,6 +35,13 @@
 {
 	NSData *_lastBlockData;
 	NSMutableData *_volumeBitmapData;
+	///Guards _blocksThatAreAllocatedButWereNotAccessed, since reads may come in from multiple threads (e.g., ImpForkCopyEngine's reader workers).
+	os_unfair_lock _accessTrackingLock;
+	///Non-nil when usesMemoryMapping is on. Its bytes are the whole file, mapped read-only; its deallocator unmaps them.
+	NSData *_mappedFileData;
+	///Guards _pathComponentsByFolderID, and the catalog searches that fill it in (the catalog's node cache isn't thread-safe).
+	os_unfair_lock _pathCacheLock;
+	NSMutableDictionary <NSNumber *, NSArray <NSString *> *> *_pathComponentsByFolderID;
 }
 
 - (void) impluseBugDetected_messageSentToAbstractClass {
@@ -43,20 +57,69 @@
 		_fileDescriptor = readFD;
 		_startOffsetInBytes = startOffset;
 		_lengthInBytes = lengthInBytes;
-		_textEncodingConverter = [[ImpTextEncodingConverter alloc] initWithHFSTextEncoding:hfsTextEncoding];
+		_accessTrackingLock = OS_UNFAIR_LOCK_INIT;
+		_pathCacheLock = OS_UNFAIR_LOCK_INIT;
+		_pathComponentsByFolderID = [NSMutableDictionary new];
+		_textEncodingConverter = [ImpTextEncodingConverter converterWithHFSTextEncoding:hfsTextEncoding];
 	}
 	return self;
 }
 
-- (void) dealloc {
-	if (_bitVector != NULL) {
-		CFRelease(_bitVector);
+#pragma mark Memory mapping
+
+- (bool) usesMemoryMapping {
+	return _mappedFileData != nil;
+}
+- (void) setUsesMemoryMapping:(bool)shouldMap {
+	if (! shouldMap) {
+		//Any views still out there keep the mapping alive until they're done with it.
+		_mappedFileData = nil;
+	} else if (_mappedFileData == nil) {
+		_mappedFileData = [self mapFileDescriptor:self.fileDescriptor];
 	}
 }
 
+///Map the whole file read-only. Returns nil if it can't be mapped, such as if it's a device rather than a regular file.
+- (NSData *_Nullable) mapFileDescriptor:(int const)readFD {
+	struct stat sb;
+	if (fstat(readFD, &sb) != 0 || ! S_ISREG(sb.st_mode) || sb.st_size <= 0 || (u_int64_t)sb.st_size > SIZE_MAX) {
+		return nil;
+	}
+
+	size_t const mappingLength = (size_t)sb.st_size;
+	void *_Nonnull const mappedBytes = mmap(NULL, mappingLength, PROT_READ, MAP_SHARED, readFD, 0);
+	if (mappedBytes == MAP_FAILED) {
+		ImpPrintf(@"Could not map source volume into memory (%s); falling back to reading it", strerror(errno));
+		return nil;
+	}
+
+	return [[NSData alloc] initWithBytesNoCopy:mappedBytes length:mappingLength deallocator:^(void *_Nonnull bytes, NSUInteger length) {
+		munmap(bytes, length);
+	}];
+}
+
+- (NSData *_Nonnull) mappedDataAtOffset:(off_t const)offset length:(u_int64_t const)length {
+	NSData *_Nonnull const mapping = _mappedFileData;
+	NSAssert(mapping != nil, @"Can't get mapped data from a volume that isn't memory-mapped");
+
+	NSUInteger const mappingLength = mapping.length;
+	if (offset < 0 || (u_int64_t)offset >= mappingLength) {
+		return [NSData data];
+	}
+	NSUInteger const available = mappingLength - (NSUInteger)offset;
+	NSUInteger const viewLength = length < available ? (NSUInteger)length : available;
+
+	//Unlike dangerouslyFastSubdataWithRange_Imp:, the view holds on to the mapping (by way of the deallocator block capturing it), so it's safe for it to outlive us.
+	return [[NSData alloc] initWithBytesNoCopy:(void *)(mapping.bytes + offset) length:viewLength deallocator:^(void *_Nonnull bytes, NSUInteger viewBytesLength) {
+		(void)mapping;
+	}];
+}
+
+#pragma mark -
+
 - (bool) readBootBlocksFromFileDescriptor:(int const)readFD error:(NSError *_Nullable *_Nonnull const)outError {
 	_bootBlocksData = [NSMutableData dataWithLength:kISOStandardBlockSize * 2];
-	ssize_t const amtRead = pread(readFD, _bootBlocksData.mutableBytes, _bootBlocksData.length, _startOffsetInBytes + kISOStandardBlockSize * 0);
+	ssize_t const amtRead = ImpPread(readFD, _bootBlocksData.mutableBytes, _bootBlocksData.length, _startOffsetInBytes + kISOStandardBlockSize * 0);
 	if (amtRead < 0) {
 		NSError *_Nonnull const readError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: @"Error reading source volume boot blocks" }];
 		if (outError != NULL) *outError = readError;
@@ -77,9 +140,9 @@
 
 - (void) setAllocationBitmapData:(NSMutableData *_Nonnull const)bitmapData numberOfBits:(u_int32_t const)numBits {
 	_volumeBitmapData = bitmapData;
-	_bitVector = CFBitVectorCreate(kCFAllocatorDefault, _volumeBitmapData.bytes, numBits);
+	_allocationBitmap = [[ImpAllocationBitmap alloc] initWithBitmapData:_volumeBitmapData numberOfBits:numBits];
 
-	_blocksThatAreAllocatedButWereNotAccessed = CFBitVectorCreateMutableCopy(kCFAllocatorDefault, numBits, _bitVector);
+	_blocksThatAreAllocatedButWereNotAccessed = [_allocationBitmap copy];
 }
 
 - (bool)readAllocationBitmapFromFileDescriptor:(int const)readFD tapURL:(NSURL *_Nullable const)tapURL error:(NSError *_Nullable *_Nonnull const)outError {
@@ -97,7 +160,7 @@
 
 - (bool) readLastBlockFromFileDescriptor:(int const)readFD error:(NSError *_Nullable *_Nonnull const)outError {
 	NSMutableData *_Nonnull const lastBlockData = [NSMutableData dataWithLength:kISOStandardBlockSize];
-	ssize_t const amtRead = pread(readFD, lastBlockData.mutableBytes, lastBlockData.length, _startOffsetInBytes + _lengthInBytes - kISOStandardBlockSize);
+	ssize_t const amtRead = ImpPread(readFD, lastBlockData.mutableBytes, lastBlockData.length, _startOffsetInBytes + _lengthInBytes - kISOStandardBlockSize);
 	if (amtRead < 0) {
 		NSError *_Nonnull const readError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: @"Error reading source volume last block" }];
 		if (outError != NULL) *outError = readError;
@@ -133,11 +196,16 @@
 
 - (NSData *_Nullable) dataForBlocksStartingAt:(u_int32_t const)startBlock count:(u_int32_t const)blockCount {
 	NSUInteger const blockSize = self.numberOfBytesPerBlock;
+	if (_mappedFileData != nil) {
+		NSData *_Nonnull const mappedData = [self mappedDataAtOffset:[self offsetInBytesOfBlock:startBlock] length:blockSize * blockCount];
+		return mappedData.length > 0 ? mappedData : nil;
+	}
+
 	NSMutableData *_Nonnull const intoData = [NSMutableData dataWithLength:blockSize * blockCount];
 	off_t const readStart = self.startOffsetInBytes + self.offsetOfFirstAllocationBlock + startBlock * blockSize;
 	enum { offset = 0 };
 	size_t const numBytesToRead = intoData.length - offset;
-	ssize_t const amtRead = pread(self.fileDescriptor, intoData.mutableBytes + offset, numBytesToRead, readStart);
+	ssize_t const amtRead = ImpPread(self.fileDescriptor, intoData.mutableBytes + offset, numBytesToRead, readStart);
 	return amtRead > 0 ? intoData : nil;
 }
 - (NSData *_Nullable) dataForBlock:(u_int32_t)aBlock {
@@ -160,62 +228,42 @@
 	return blockNumber < self.numberOfBlocksTotal;
 }
 - (bool) isBlockAllocated:(u_int32_t const)blockNumber {
-	return CFBitVectorGetBitAtIndex(_bitVector, blockNumber);
+	if (_allocationBitmap == nil) {
+		//We're reading the allocations bitmap (HFS+ reads it through the allocations file, like any other fork). Just claim any block we're reading for it is allocated.
+		return true;
+	}
+	return blockNumber < _allocationBitmap.numberOfBits && [_allocationBitmap bitAtIndex:blockNumber];
 }
 
 - (u_int32_t) numberOfBlocksFreeAccordingToBitmap {
-	return (u_int32_t)CFBitVectorGetCountOfBit(_bitVector, (CFRange){ 0, self.numberOfBlocksTotal }, false);
+	return (u_int32_t)[_allocationBitmap countOfClearBitsInRange:(NSRange){ 0, self.numberOfBlocksTotal }];
 }
 
 - (void) reportBlocksThatAreAllocatedButHaveNotBeenAccessed {
-	CFRange const entireRange = { 0, self.numberOfBlocksTotal };
-	CFRange searchRange = entireRange;
-	CFRange foundRange;
-	while ((foundRange.location = CFBitVectorGetFirstIndexOfBit(_blocksThatAreAllocatedButWereNotAccessed, searchRange, true)) != kCFNotFound) {
-		searchRange.length -= foundRange.location - searchRange.location;
-		searchRange.location = foundRange.location;
-
-		CFIndex const lastMissedBit = CFBitVectorGetLastIndexOfBit(_blocksThatAreAllocatedButWereNotAccessed, searchRange, true);
-		foundRange.length = (lastMissedBit - foundRange.location) + 1;
-		ImpPrintf(@"Blocks that have not been accessed: %lu through %lu (%lu blocks)", foundRange.location, lastMissedBit, foundRange.length);
-
-		searchRange.length -= foundRange.length;
-		searchRange.location += foundRange.length;
-	}
-	NSUInteger const numUnreadBlocks = CFBitVectorGetCountOfBit(_blocksThatAreAllocatedButWereNotAccessed, entireRange, true);
+	NSRange const entireRange = { 0, self.numberOfBlocksTotal };
+	[self findExtents:^(NSRange const foundRange) {
+		ImpPrintf(@"Blocks that have not been accessed: %lu through %lu (%lu blocks)", foundRange.location, NSMaxRange(foundRange) - 1, foundRange.length);
+	} inBitmap:_blocksThatAreAllocatedButWereNotAccessed];
+	NSUInteger const numUnreadBlocks = [_blocksThatAreAllocatedButWereNotAccessed countOfSetBitsInRange:entireRange];
 	if (numUnreadBlocks > 0) {
-		ImpPrintf(@"Of the %lu blocks that are marked as allocated, %lu have not been read from", CFBitVectorGetCountOfBit(_bitVector, entireRange, true), numUnreadBlocks);
+		ImpPrintf(@"Of the %lu blocks that are marked as allocated, %lu have not been read from", [_allocationBitmap countOfSetBitsInRange:entireRange], numUnreadBlocks);
 	}
 }
 - (u_int32_t) numberOfBlocksThatAreAllocatedButHaveNotBeenAccessed {
-	CFRange const entireRange = { 0, self.numberOfBlocksTotal };
-	NSUInteger const numUnreadBlocks = CFBitVectorGetCountOfBit(_blocksThatAreAllocatedButWereNotAccessed, entireRange, true);
+	NSRange const entireRange = { 0, self.numberOfBlocksTotal };
+	NSUInteger const numUnreadBlocks = [_blocksThatAreAllocatedButWereNotAccessed countOfSetBitsInRange:entireRange];
 	if (numUnreadBlocks > 0) {
-		ImpPrintf(@"Of the %lu blocks that are marked as allocated, %lu have not been read from", CFBitVectorGetCountOfBit(_bitVector, entireRange, true), numUnreadBlocks);
+		ImpPrintf(@"Of the %lu blocks that are marked as allocated, %lu have not been read from", [_allocationBitmap countOfSetBitsInRange:entireRange], numUnreadBlocks);
 	}
 
 	return numUnreadBlocks > UINT32_MAX ? UINT32_MAX : (u_int32_t)numUnreadBlocks;
 }
-- (void) findExtents:(void (^_Nonnull const)(NSRange))block inBitVector:(CFBitVectorRef _Nonnull const)bitVector {
-	CFRange const entireRange = { 0, self.numberOfBlocksTotal };
-	CFRange searchRange = entireRange;
-	CFRange foundRange;
-	while ((foundRange.location = CFBitVectorGetFirstIndexOfBit(bitVector, searchRange, true)) != kCFNotFound) {
-		searchRange.length -= foundRange.location - searchRange.location;
-		searchRange.location = foundRange.location;
-
-		CFIndex const lastMissedBit = CFBitVectorGetLastIndexOfBit(bitVector, searchRange, true);
-		foundRange.length = (lastMissedBit - foundRange.location) + 1;
-
-		NSRange const extent = { foundRange.location, foundRange.length };
-		block(extent);
-
-		searchRange.length -= foundRange.length;
-		searchRange.location += foundRange.length;
-	}
+- (void) findExtents:(void (^_Nonnull const)(NSRange))block inBitmap:(ImpAllocationBitmap *_Nonnull const)bitmap {
+	NSRange const entireRange = { 0, self.numberOfBlocksTotal };
+	[bitmap enumerateRunsOfSetBitsInRange:entireRange usingBlock:block];
 }
 - (void) findExtentsThatAreAllocatedButHaveNotBeenAccessed:(void (^_Nonnull const)(NSRange))block {
-	[self findExtents:block inBitVector:_blocksThatAreAllocatedButWereNotAccessed];
+	[self findExtents:block inBitmap:_blocksThatAreAllocatedButWereNotAccessed];
 }
 - (void) findExtentsThatAreAllocatedButAreNotReferencedInTheBTrees:(void (^_Nonnull const)(NSRange))block {
 	[self impluseBugDetected_messageSentToAbstractClass];
@@ -226,8 +274,8 @@
 		numOrphanedBlocks += extentRange.length;
 	}];
 	if (numOrphanedBlocks > 0) {
-		CFRange const entireRange = { 0, self.numberOfBlocksTotal };
-		ImpPrintf(@"Of the %lu blocks that are marked as allocated, %lu are not claimed by any fork", CFBitVectorGetCountOfBit(_bitVector, entireRange, true), numOrphanedBlocks);
+		NSRange const entireRange = { 0, self.numberOfBlocksTotal };
+		ImpPrintf(@"Of the %lu blocks that are marked as allocated, %lu are not claimed by any fork", [_allocationBitmap countOfSetBitsInRange:entireRange], numOrphanedBlocks);
 	}
 
 	return numOrphanedBlocks;
@@ -290,45 +338,149 @@
 	return 0;
 }
 
+#pragma mark Paths
+
+- (bool) getName:(NSString *_Nullable *_Nonnull const)outName
+	parentID:(HFSCatalogNodeID *_Nonnull const)outParentID
+	ofFolderWithID:(HFSCatalogNodeID const)folderID
+{
+	[self impluseBugDetected_messageSentToAbstractClass];
+	return false;
+}
+
+- (NSArray <NSString *> *_Nonnull) pathComponentsOfFolderWithID:(HFSCatalogNodeID const)folderID {
+	if (folderID == kHFSRootParentID) {
+		return @[];
+	}
+
+	os_unfair_lock_lock(&_pathCacheLock);
+	NSArray <NSString *> *_Nullable path = _pathComponentsByFolderID[@(folderID)];
+	if (path == nil) {
+		//Climb until we reach a folder whose path we already know (or the root's parent), noting each folder along the way. Then come back down, filling in each of those folders' paths.
+		NSMutableArray <NSNumber *> *_Nonnull const unresolvedFolderIDs = [NSMutableArray arrayWithCapacity:8];
+		NSMutableArray <NSString *> *_Nonnull const unresolvedNames = [NSMutableArray arrayWithCapacity:8];
+		HFSCatalogNodeID nextFolderID = folderID;
+		while (nextFolderID != kHFSRootParentID && (path = _pathComponentsByFolderID[@(nextFolderID)]) == nil) {
+			NSString *_Nullable name = nil;
+			HFSCatalogNodeID parentID = kHFSRootParentID;
+			if (! [self getName:&name parentID:&parentID ofFolderWithID:nextFolderID]) {
+				//Without a thread record, there's no going any higher, so the path starts here (as it always has).
+				break;
+			}
+			[unresolvedFolderIDs addObject:@(nextFolderID)];
+			[unresolvedNames addObject:name];
+			nextFolderID = parentID;
+		}
+
+		if (path == nil) {
+			path = @[];
+		}
+		for (NSUInteger i = unresolvedFolderIDs.count; i > 0; --i) {
+			path = [path arrayByAddingObject:unresolvedNames[i - 1]];
+			_pathComponentsByFolderID[unresolvedFolderIDs[i - 1]] = path;
+		}
+	}
+	os_unfair_lock_unlock(&_pathCacheLock);
+
+	return path;
+}
+
+- (void) rememberPathComponents:(NSArray <NSString *> *_Nonnull const)pathComponents ofFolderWithID:(HFSCatalogNodeID const)folderID {
+	os_unfair_lock_lock(&_pathCacheLock);
+	_pathComponentsByFolderID[@(folderID)] = [pathComponents copy];
+	os_unfair_lock_unlock(&_pathCacheLock);
+}
+
 #pragma mark Reading fork contents
 
-- (bool) readIntoData:(NSMutableData *_Nonnull const)intoData
-	atOffset:(NSUInteger)offset
-	fromFileDescriptor:(int const)readFD
-	startBlock:(u_int32_t const)startBlock
-	blockCount:(u_int32_t const)blockCount
-	actualAmountRead:(u_int64_t *_Nonnull const)outAmtRead
+- (off_t) offsetInBytesOfBlock:(u_int32_t const)blockNumber {
+	return self.startOffsetInBytes + self.offsetOfFirstAllocationBlock + blockNumber * (off_t)self.numberOfBytesPerBlock;
+}
+
+///Returns true if every block in the range is allocated. Otherwise, returns false and fills out an error identifying the offending block.
+- (bool) checkBlocksAreAllocatedStartingAt:(u_int32_t const)startBlock
+	count:(u_int32_t const)blockCount
 	error:(NSError *_Nullable *_Nonnull const)outError
 {
-	int32_t firstUnallocatedBlockNumber = -1;
-	//TODO: Optimize using CFBitVectorGetCountOfBit (start range at startBlock, check returned count >= blockCount)
-	for (u_int16_t i = 0; i < blockCount; ++i) {
-//		ImpPrintf(@"- #%u: %@", startBlock + i, CFBitVectorGetBitAtIndex(_bitVector, startBlock + i) ? @"YES" : @"NO!");
-		if (! [self isBlockAllocated:startBlock + i]) {
-			firstUnallocatedBlockNumber = startBlock + i;
+	NSUInteger firstUnallocatedBlockNumber = NSNotFound;
+	if (_allocationBitmap != nil) {
+		NSRange const extentRange = { startBlock, blockCount };
+		firstUnallocatedBlockNumber = [_allocationBitmap indexOfFirstClearBitInRange:extentRange];
+		if (firstUnallocatedBlockNumber == NSNotFound && NSMaxRange(extentRange) > _allocationBitmap.numberOfBits) {
+			//The extent runs off the end of the bitmap, which the bitmap's range operations clip off. Those blocks can't be allocated.
+			firstUnallocatedBlockNumber = MAX(startBlock, _allocationBitmap.numberOfBits);
 		}
 	}
-//	ImpPrintf(@"Extent starting at %u is fully allocated before reading: %@", startBlock, (firstUnallocatedBlockNumber < 0) ? @"YES" : @"NO");
-	if (firstUnallocatedBlockNumber > -1) {
+	if (firstUnallocatedBlockNumber != NSNotFound) {
 		//It's possible that this should be a warning, or that its level of fatality should be adjustable (particularly in situations of data recovery).
-		NSError *_Nonnull const readingIntoTheVoidError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Attempt to read block #%u, which is unallocated; this may indicate a bug in this program, or that the volume itself was corrupt (please save a copy of it using bzip2)", @""), firstUnallocatedBlockNumber] }];
+		NSError *_Nonnull const readingIntoTheVoidError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileReadCorruptFileError userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Attempt to read block #%u, which is unallocated; this may indicate a bug in this program, or that the volume itself was corrupt (please save a copy of it using bzip2)", @""), (u_int32_t)firstUnallocatedBlockNumber] }];
 		if (outError != NULL) {
 			*outError = readingIntoTheVoidError;
 		}
 		return false;
 	}
+	return true;
+}
+
+- (void) markBlocksAccessedStartingAt:(u_int32_t const)startBlock count:(u_int32_t const)blockCount {
+	if (_blocksThatAreAllocatedButWereNotAccessed != nil) {
+		os_unfair_lock_lock(&_accessTrackingLock);
+		[_blocksThatAreAllocatedButWereNotAccessed clearBitsInRange:(NSRange){ startBlock, blockCount }];
+		os_unfair_lock_unlock(&_accessTrackingLock);
+	}
+}
 
-	off_t const readStart = self.startOffsetInBytes + self.offsetOfFirstAllocationBlock + startBlock * self.numberOfBytesPerBlock;
+- (bool) prepareToTransferBlocksStartingAt:(u_int32_t const)startBlock
+	count:(u_int32_t const)blockCount
+	error:(NSError *_Nullable *_Nonnull const)outError
+{
+	if (! [self checkBlocksAreAllocatedStartingAt:startBlock count:blockCount error:outError]) {
+		return false;
+	}
+	[self markBlocksAccessedStartingAt:startBlock count:blockCount];
+	return true;
+}
+
+- (NSData *_Nullable) mappedDataForBlocksStartingAt:(u_int32_t const)startBlock
+	count:(u_int32_t const)blockCount
+	error:(NSError *_Nullable *_Nonnull const)outError
+{
+	if (! [self prepareToTransferBlocksStartingAt:startBlock count:blockCount error:outError]) {
+		return nil;
+	}
+	return [self mappedDataAtOffset:[self offsetInBytesOfBlock:startBlock] length:self.numberOfBytesPerBlock * (u_int64_t)blockCount];
+}
+
+- (bool) readIntoData:(NSMutableData *_Nonnull const)intoData
+	atOffset:(NSUInteger)offset
+	fromFileDescriptor:(int const)readFD
+	startBlock:(u_int32_t const)startBlock
+	blockCount:(u_int32_t const)blockCount
+	actualAmountRead:(u_int64_t *_Nonnull const)outAmtRead
+	error:(NSError *_Nullable *_Nonnull const)outError
+{
+	if (! [self checkBlocksAreAllocatedStartingAt:startBlock count:blockCount error:outError]) {
+		return false;
+	}
+
+	off_t const readStart = [self offsetInBytesOfBlock:startBlock];
 	size_t const numBytesToRead = intoData.length - offset;
 	size_t const numBlocksToRead = ImpCeilingDivide(intoData.length, self.numberOfBytesPerBlock);
-	if (_blocksThatAreAllocatedButWereNotAccessed != NULL) {
-		CFBitVectorSetBits(_blocksThatAreAllocatedButWereNotAccessed, (CFRange) { startBlock, numBlocksToRead }, false);
-	}
+	[self markBlocksAccessedStartingAt:startBlock count:(u_int32_t)numBlocksToRead];
 //	ImpPrintf(@"Reading 0x%lx bytes (%lu bytes = %lu blocks) from source volume starting at 0x%llx bytes (extent: [ start #%u, %u blocks ])", intoData.length, intoData.length, ImpCeilingDivide(intoData.length, self.numberOfBytesPerBlock), readStart, startBlock, blockCount);
 	if (numBlocksToRead < blockCount) {
 		NSLog(@"Underrun alert! Data is not big enough to hold this extent. Only reading %zu blocks out of this extent's %u blocks", numBlocksToRead, blockCount);
 	}
-	ssize_t const amtRead = pread(readFD, intoData.mutableBytes + offset, numBytesToRead, readStart);
+	ImpTraceTimestamp const traceStart = ImpTraceBegin();
+	ssize_t amtRead;
+	if (_mappedFileData != nil) {
+		NSData *_Nonnull const mappedData = [self mappedDataAtOffset:readStart length:numBytesToRead];
+		memcpy(intoData.mutableBytes + offset, mappedData.bytes, mappedData.length);
+		amtRead = (ssize_t)mappedData.length;
+	} else {
+		amtRead = ImpPread(readFD, intoData.mutableBytes + offset, numBytesToRead, readStart);
+	}
+	ImpTraceEndWithArguments(traceStart, "io", "Read extent", "startBlock", startBlock, "blockCount", blockCount);
 	if (outAmtRead != NULL) {
 		*outAmtRead = amtRead;
 	}
@@ -44,7 +44,7 @@
 
 #pragma mark Factories
 
-///Returns an object that (hopefully) can convert filenames from the given encoding into Unicode.
+///Returns an object that (hopefully) can convert filenames from the given encoding into Unicode. There is only one converter per encoding per process; it's created the first time it's asked for and shared thereafter, including between threads (every converter serializes its own use of TEC).
 + (instancetype _Nullable) converterWithHFSTextEncoding:(TextEncoding const)hfsTextEncoding;
 ///Returns an object that (hopefully) can convert filenames from the given encoding into Unicode.
 - (instancetype _Nullable) initWithHFSTextEncoding:(TextEncoding const)hfsTextEncoding;
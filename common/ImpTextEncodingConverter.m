@@ -7,6 +7,8 @@
 
 #import "ImpTextEncodingConverter.h"
 
+#import <os/lock.h>
+
 #import "ImpPrintf.h"
 #import "ImpByteOrder.h"
 #import "ImpErrorUtilities.h"
@@ -21,6 +23,8 @@ enum {
 	TextEncoding _hfsTextEncoding, _hfsPlusTextEncoding;
 	TextToUnicodeInfo _ttui;
 	UnicodeToTextInfo _utti;
+	///TEC's conversion info objects aren't documented as safe to use from multiple threads at once, and shared converters may be used by several conversions running in parallel, so every call into TEC that uses _ttui or _utti holds this lock.
+	os_unfair_lock _tecLock;
 }
 
 #pragma mark Text encoding names
@@ -152,17 +156,21 @@ enum {
 
 + (instancetype _Nullable) converterWithHFSTextEncoding:(TextEncoding const)hfsTextEncoding {
 	static NSMutableDictionary <NSNumber *, ImpTextEncodingConverter *> *_Nullable converterCache = nil;
-	if (converterCache == nil) {
+	static os_unfair_lock converterCacheLock = OS_UNFAIR_LOCK_INIT;
+	static dispatch_once_t onceToken;
+	dispatch_once(&onceToken, ^{
 		//We're most likely to find MacRoman plus at most one other encoding. More than two encodings should be fairly rare. The NSMutableDictionary initializer will let us go over if we need to.
 		converterCache = [NSMutableDictionary dictionaryWithCapacity:2];
-	}
+	});
 
 	NSNumber *_Nonnull const key = @(hfsTextEncoding);
+	os_unfair_lock_lock(&converterCacheLock);
 	ImpTextEncodingConverter *_Nullable thisConverter = converterCache[key];
 	if (thisConverter == nil) {
 		thisConverter = [[self alloc] initWithHFSTextEncoding:hfsTextEncoding];
 		converterCache[key] = thisConverter;
 	}
+	os_unfair_lock_unlock(&converterCacheLock);
 
 	return thisConverter;
 
@@ -171,6 +179,7 @@ enum {
 - (instancetype _Nullable) initWithHFSTextEncoding:(TextEncoding const)hfsTextEncoding {
 	if ((self = [super init])) {
 		_hfsTextEncoding = hfsTextEncoding;
+		_tecLock = OS_UNFAIR_LOCK_INIT;
 		_hfsPlusTextEncoding = CreateTextEncoding(kTextEncodingUnicodeV2_0, kUnicodeHFSPlusDecompVariant, kUnicodeUTF16BEFormat);
 
 		struct UnicodeMapping mapping = {
@@ -204,6 +213,7 @@ enum {
 
 - (size_t) lengthOfEncodedString:(NSString *_Nonnull const)string {
 	ByteCount numBytes = 0;
+	os_unfair_lock_lock(&_tecLock);
 	OSStatus err = ConvertFromUnicodeToText(_utti,
 		string.length, /*inBuffer*/ NULL,
 		/*controlFlags*/ 0,
@@ -212,6 +222,7 @@ enum {
 		/*outCapacity*/ 0,
 		/*outInputBytesConsumed*/ NULL,
 		/*outLen*/ &numBytes, /*outBuffer*/ NULL);
+	os_unfair_lock_unlock(&_tecLock);
 	if (err != noErr) {
 		fprintf(stderr, "Couldn't estimate length of encoded string: %s\n", string.UTF8String);
 	}
@@ -254,6 +265,7 @@ enum {
 
 	ByteCount const outputPayloadSizeInBytes = outputBufferSizeInBytes - 1 * sizeof(UniChar);
 	ByteCount actualOutputLengthInBytes = 0;
+	os_unfair_lock_lock(&_tecLock);
 	OSStatus err = ConvertFromPStringToUnicode(_ttui, pascalString, outputPayloadSizeInBytes, &actualOutputLengthInBytes, outputBuf);
 
 	if (err == paramErr) {
@@ -261,6 +273,7 @@ enum {
 		NSLog(@"Unicode conversion failure!");
 		err = ConvertFromPStringToUnicode(_ttui, pascalString, outputPayloadSizeInBytes, &actualOutputLengthInBytes, outputBuf);
 	}
+	os_unfair_lock_unlock(&_tecLock);
 
 	if (err == noErr) {
 #if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
@@ -386,7 +399,9 @@ enum {
 		return could255;
 	}
 	ByteCount numBytesProduced = 0;
+	os_unfair_lock_lock(&_tecLock);
 	OSStatus err = ConvertFromUnicodeToText(_utti, unicodeName.length * sizeof(UniChar), unicodeName.unicode, /*controlFlags*/ 0, /*offsetCount*/ 0, /*offsetArray*/ NULL, /*outOffsetCount*/ 0, /*outOffsetArray*/ NULL, /*outputBufLen*/ maxLength, /*outNumBytesRead*/ NULL, &numBytesProduced, outPString + 1);
+	os_unfair_lock_unlock(&_tecLock);
 	if (err != noErr) {
 		NSError *_Nonnull const conversionError = [NSError errorWithDomain:NSOSStatusErrorDomain code:err userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:@"Couldn't convert string to encoding %@ in max length %lu because of an error %d/%s", [[self class] nameOfTextEncoding:_hfsTextEncoding], maxLength, err, GetMacOSStatusCommentString(err)] }];
 		if (outError != NULL) {
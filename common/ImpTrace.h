@@ -0,0 +1,35 @@
+//
+//  ImpTrace.h
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-20.
+//
+
+#ifndef ImpTrace_h
+#define ImpTrace_h
+
+#import <Foundation/Foundation.h>
+
+/*!A trace is a timeline of spans of work (reading an extent, writing a run of blocks, building the catalog, and so on), each recorded with the thread it ran on, which can be written out in Chrome's trace-event format and loaded into chrome://tracing or Perfetto.
+ *Tracing is off until ImpTraceStartRecording is called. While it's off, ImpTraceBegin returns 0 and ImpTraceEnd returns immediately, so spans cost next to nothing when nobody's looking.
+ *Span names, categories, and argument names must be string literals (or otherwise live for the rest of the process), because only the pointers are kept until the trace is written out.
+ */
+
+///A span's start time, in nanoseconds since an arbitrary point. 0 means tracing was off when the span began, and the span won't be recorded.
+typedef u_int64_t ImpTraceTimestamp;
+
+///Start recording spans. Spans already in progress (begun while tracing was off) won't be recorded.
+void ImpTraceStartRecording(void);
+bool ImpTraceIsRecording(void);
+
+///Note the start of a span. Pass the result to ImpTraceEnd when the span is over.
+ImpTraceTimestamp ImpTraceBegin(void);
+///Record a span from start until now, on the current thread.
+void ImpTraceEnd(ImpTraceTimestamp const start, char const *_Nonnull const category, char const *_Nonnull const name);
+///Record a span from start until now, on the current thread, with up to two numeric arguments (such as a block number and count). Pass NULL for an argument name to leave that argument out.
+void ImpTraceEndWithArguments(ImpTraceTimestamp const start, char const *_Nonnull const category, char const *_Nonnull const name, char const *_Nullable const arg0Name, u_int64_t const arg0, char const *_Nullable const arg1Name, u_int64_t const arg1);
+
+///Write every span recorded so far to a file as a Chrome trace-event JSON object. Recording continues afterward.
+bool ImpTraceWriteToURL(NSURL *_Nonnull const url, NSError *_Nullable *_Nullable const outError);
+
+#endif /* ImpTrace_h */
@@ -0,0 +1,209 @@
+//
+//  ImpTrace.m
+//  impluse-hfs
+//
+//  Created by Peter Hosey on 2024-06-20.
+//
+
+#import "ImpTrace.h"
+
+#import <os/lock.h>
+#import <pthread.h>
+#import <stdatomic.h>
+#import <time.h>
+#import <unistd.h>
+
+struct ImpTraceEvent {
+	char const *_Nonnull category;
+	char const *_Nonnull name;
+	char const *_Nullable arg0Name;
+	char const *_Nullable arg1Name;
+	u_int64_t arg0, arg1;
+	u_int64_t threadID;
+	ImpTraceTimestamp start, end;
+};
+
+enum {
+	///Events are stored in fixed-size chunks, so recording one never has to move the ones before it.
+	ImpTraceEventsPerChunk = 8192,
+};
+
+static atomic_bool ImpTraceRecording = false;
+static os_unfair_lock ImpTraceLock = OS_UNFAIR_LOCK_INIT;
+//Guarded by ImpTraceLock.
+static NSMutableArray <NSMutableData *> *_Nullable ImpTraceChunks;
+static NSUInteger ImpTraceNumEventsInLastChunk;
+static NSMutableDictionary <NSNumber *, NSString *> *_Nullable ImpTraceThreadNames;
+
+static __thread u_int64_t ImpTraceCurrentThreadID;
+
+static ImpTraceTimestamp ImpTraceNow(void) {
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	//Never return 0, since that means "not recording".
+	return (u_int64_t)now.tv_sec * NSEC_PER_SEC + (u_int64_t)now.tv_nsec + 1;
+}
+
+///Name a thread after what it's doing: its own name if it has one, otherwise the label of the dispatch queue it's running. (Dispatch worker threads can serve more than one queue, so this is only the first queue the thread was seen on.)
+static NSString *_Nonnull ImpTraceNameOfCurrentThread(void) {
+	if (pthread_main_np()) {
+		return @"main";
+	}
+	char name[64] = { 0 };
+	if (pthread_getname_np(pthread_self(), name, sizeof(name)) == 0 && name[0] != '\0') {
+		return @(name);
+	}
+	char const *_Nullable const queueLabel = dispatch_queue_get_label(DISPATCH_CURRENT_QUEUE_LABEL);
+	if (queueLabel != NULL && queueLabel[0] != '\0') {
+		return @(queueLabel);
+	}
+	return @"thread";
+}
+
+///Returns this thread's ID, registering its name the first time. Must be called with the lock held.
+static u_int64_t ImpTraceThreadIDForCurrentThread(void) {
+	if (ImpTraceCurrentThreadID == 0) {
+		u_int64_t threadID = 0;
+		pthread_threadid_np(NULL, &threadID);
+		ImpTraceCurrentThreadID = threadID;
+		ImpTraceThreadNames[@(threadID)] = ImpTraceNameOfCurrentThread();
+	}
+	return ImpTraceCurrentThreadID;
+}
+
+void ImpTraceStartRecording(void) {
+	os_unfair_lock_lock(&ImpTraceLock);
+	if (ImpTraceChunks == nil) {
+		ImpTraceChunks = [NSMutableArray new];
+		ImpTraceThreadNames = [NSMutableDictionary new];
+	}
+	os_unfair_lock_unlock(&ImpTraceLock);
+	atomic_store(&ImpTraceRecording, true);
+}
+
+bool ImpTraceIsRecording(void) {
+	return atomic_load_explicit(&ImpTraceRecording, memory_order_relaxed);
+}
+
+ImpTraceTimestamp ImpTraceBegin(void) {
+	return ImpTraceIsRecording() ? ImpTraceNow() : 0;
+}
+
+void ImpTraceEnd(ImpTraceTimestamp const start, char const *_Nonnull const category, char const *_Nonnull const name) {
+	ImpTraceEndWithArguments(start, category, name, NULL, 0, NULL, 0);
+}
+
+void ImpTraceEndWithArguments(ImpTraceTimestamp const start, char const *_Nonnull const category, char const *_Nonnull const name, char const *_Nullable const arg0Name, u_int64_t const arg0, char const *_Nullable const arg1Name, u_int64_t const arg1) {
+	if (start == 0) {
+		return;
+	}
+	ImpTraceTimestamp const end = ImpTraceNow();
+
+	os_unfair_lock_lock(&ImpTraceLock);
+	if (ImpTraceChunks.count == 0 || ImpTraceNumEventsInLastChunk == ImpTraceEventsPerChunk) {
+		[ImpTraceChunks addObject:[NSMutableData dataWithLength:sizeof(struct ImpTraceEvent) * ImpTraceEventsPerChunk]];
+		ImpTraceNumEventsInLastChunk = 0;
+	}
+	struct ImpTraceEvent *_Nonnull const events = ImpTraceChunks.lastObject.mutableBytes;
+	events[ImpTraceNumEventsInLastChunk++] = (struct ImpTraceEvent){
+		.category = category,
+		.name = name,
+		.arg0Name = arg0Name,
+		.arg1Name = arg1Name,
+		.arg0 = arg0,
+		.arg1 = arg1,
+		.threadID = ImpTraceThreadIDForCurrentThread(),
+		.start = start,
+		.end = end,
+	};
+	os_unfair_lock_unlock(&ImpTraceLock);
+}
+
+#pragma mark Output
+
+///Write a string as a JSON string literal, quotes and all.
+static void ImpTraceWriteJSONString(FILE *_Nonnull const file, char const *_Nonnull str) {
+	fputc('"', file);
+	for (; *str != '\0'; ++str) {
+		unsigned char const ch = (unsigned char)*str;
+		if (ch == '"' || ch == '\\') {
+			fputc('\\', file);
+			fputc(ch, file);
+		} else if (ch < 0x20) {
+			fprintf(file, "\\u%04x", ch);
+		} else {
+			fputc(ch, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool ImpTraceWriteToURL(NSURL *_Nonnull const url, NSError *_Nullable *_Nullable const outError) {
+	FILE *_Nullable const file = fopen(url.fileSystemRepresentation, "w");
+	if (file == NULL) {
+		if (outError != NULL) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Could not open %@ to write the trace to", @"Trace error"), url.path] }];
+		return false;
+	}
+
+	int const pid = getpid();
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n", file);
+	__block bool first = true;
+
+	os_unfair_lock_lock(&ImpTraceLock);
+	//Timestamps are written relative to the earliest span, so they start near zero.
+	ImpTraceTimestamp epoch = UINT64_MAX;
+	NSUInteger const numChunks = ImpTraceChunks.count;
+	for (NSUInteger chunkIdx = 0; chunkIdx < numChunks; ++chunkIdx) {
+		struct ImpTraceEvent const *_Nonnull const events = ImpTraceChunks[chunkIdx].bytes;
+		NSUInteger const numEvents = chunkIdx == numChunks - 1 ? ImpTraceNumEventsInLastChunk : ImpTraceEventsPerChunk;
+		for (NSUInteger i = 0; i < numEvents; ++i) {
+			epoch = MIN(epoch, events[i].start);
+		}
+	}
+
+	[ImpTraceThreadNames enumerateKeysAndObjectsUsingBlock:^(NSNumber *_Nonnull const threadID, NSString *_Nonnull const threadName, BOOL *_Nonnull const stop) {
+		fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":%d,\"tid\":%llu,\"args\":{\"name\":", first ? "" : ",\n", pid, threadID.unsignedLongLongValue);
+		ImpTraceWriteJSONString(file, threadName.UTF8String);
+		fputs("}}", file);
+		first = false;
+	}];
+
+	for (NSUInteger chunkIdx = 0; chunkIdx < numChunks; ++chunkIdx) {
+		struct ImpTraceEvent const *_Nonnull const events = ImpTraceChunks[chunkIdx].bytes;
+		NSUInteger const numEvents = chunkIdx == numChunks - 1 ? ImpTraceNumEventsInLastChunk : ImpTraceEventsPerChunk;
+		for (NSUInteger i = 0; i < numEvents; ++i) {
+			struct ImpTraceEvent const *_Nonnull const event = events + i;
+			fprintf(file, "%s{\"ph\":\"X\",\"cat\":", first ? "" : ",\n");
+			ImpTraceWriteJSONString(file, event->category);
+			fputs(",\"name\":", file);
+			ImpTraceWriteJSONString(file, event->name);
+			//Trace-event times are in microseconds.
+			fprintf(file, ",\"pid\":%d,\"tid\":%llu,\"ts\":%.3f,\"dur\":%.3f", pid, event->threadID, (event->start - epoch) / 1e3, (event->end - event->start) / 1e3);
+			if (event->arg0Name != NULL || event->arg1Name != NULL) {
+				fputs(",\"args\":{", file);
+				if (event->arg0Name != NULL) {
+					ImpTraceWriteJSONString(file, event->arg0Name);
+					fprintf(file, ":%llu", event->arg0);
+				}
+				if (event->arg1Name != NULL) {
+					if (event->arg0Name != NULL) fputc(',', file);
+					ImpTraceWriteJSONString(file, event->arg1Name);
+					fprintf(file, ":%llu", event->arg1);
+				}
+				fputc('}', file);
+			}
+			fputc('}', file);
+			first = false;
+		}
+	}
+	os_unfair_lock_unlock(&ImpTraceLock);
+
+	fputs("\n]}\n", file);
+	bool const wroteAll = ferror(file) == 0;
+	int const writeErrno = errno;
+	if (fclose(file) != 0 || ! wroteAll) {
+		if (outError != NULL) *outError = [NSError errorWithDomain:NSPOSIXErrorDomain code:wroteAll ? errno : writeErrno userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Could not write the trace to %@", @"Trace error"), url.path] }];
+		return false;
+	}
+	return true;
+}
@@ -11,7 +11,7 @@
 
 @class ImpDestinationVolume;
 
-///This is a simple file-handle-like object for writing to files within the HFS+ volume. Writes may be buffered, but ultimately will hit the real backing file via the volume's file descriptor.
+///This is a simple file-handle-like object for writing to files within the HFS+ volume. Writes are buffered, and ultimately hit the real backing file via the volume's file descriptor: data is gathered until there's about a megabyte of it, then written out in whole blocks, one vectored write per extent. Each block is written exactly once; the last, partial block is held until the file handle is closed.
 @interface ImpVirtualFileHandle : NSObject
 
 ///Create a new virtual file handle backed by a destination volume (and its backing file descriptor). extentRecPtr must be a pointer to a populated HFS+ extent record (at least kHFSPlusExtentDensity extent descriptors).
@@ -23,10 +23,13 @@
 ///If the file in question has even more extents in the extents overflow file, call this to extend the file handle's knowledge of where it can write data into.
 - (void) growIntoExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)extentRecPtr;
 
-///Write some data to the file. The new data will be appended immediately after any data previously written to the same file handle. Returns the number of bytes written, or -1 in case of error. If this returns zero (or otherwise less data than you tried to write), the file handle's backing extents are full and you need to grow the handle into more extents to be able to write more data.
+///Write some data to the file. The new data will be appended immediately after any data previously written to the same file handle. Returns the number of bytes written (which may not have actually hit the backing file yet), or -1 in case of error. If this returns zero (or otherwise less data than you tried to write), the file handle's backing extents are full and you need to grow the handle into more extents to be able to write more data.
 - (NSInteger) writeData:(NSData *_Nonnull const)data error:(NSError *_Nullable *_Nonnull const)outError;
 
-///Flush any pending writes and bar any further writes.
+///Flush any pending writes and bar any further writes. The last block is padded out with zeroes. Returns false if the final write failed. Closing an already-closed file handle does nothing and returns true.
+- (bool) closeFileAndReturnError:(NSError *_Nullable *_Nonnull const)outError;
+
+///Like closeFileAndReturnError:, but only logs an error. A file handle that's deallocated without having been closed will be closed this way.
 - (void) closeFile;
 
 @end
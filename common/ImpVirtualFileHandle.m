@@ -7,11 +7,58 @@
 
 #import "ImpVirtualFileHandle.h"
 
-#import "NSData+ImpSubdata.h"
+#import "ImpSizeUtilities.h"
+#import "ImpPerformanceCounters.h"
+#import "ImpTrace.h"
 
 #import "ImpDestinationVolume.h"
 #import "ImpHFSPlusDestinationVolume.h"
 
+#import <sys/uio.h>
+
+enum {
+	///How much data to gather before writing any of it out. This is rounded up to a whole number of blocks.
+	ImpVirtualFileHandleWriteBehindSize = 1024 * 1024,
+	///Every write is made from at most two places: the write-behind buffer, followed by the data the client just handed us.
+	ImpVirtualFileHandleMaxSourceVectors = 2,
+};
+
+///pwritev isn't available before macOS 11, so fall back to one pwrite per vector there. Either way, returns the total number of bytes written (which may be short), or -1 if nothing could be written.
+static ssize_t ImpWriteVectorsAtOffset(int const fd, struct iovec const *_Nonnull const vectors, int const numVectors, off_t const offset) {
+	if (@available(macOS 11.0, *)) {
+		return ImpPwritev(fd, vectors, numVectors, offset);
+	}
+
+	ssize_t total = 0;
+	for (int i = 0; i < numVectors; ++i) {
+		ssize_t const amtWritten = ImpPwrite(fd, vectors[i].iov_base, vectors[i].iov_len, offset + total);
+		if (amtWritten < 0) {
+			return total > 0 ? total : amtWritten;
+		}
+		total += amtWritten;
+		if ((size_t)amtWritten < vectors[i].iov_len) {
+			break;
+		}
+	}
+	return total;
+}
+
+///Fill out outVectors with the vectors that cover length bytes, starting offset bytes into the concatenation of the source vectors. Returns the number of vectors filled out, which is never more than numSourceVectors.
+static int ImpSliceVectors(struct iovec const *_Nonnull const sourceVectors, int const numSourceVectors, u_int64_t offset, u_int64_t length, struct iovec *_Nonnull const outVectors) {
+	int numVectors = 0;
+	for (int i = 0; i < numSourceVectors && length > 0; ++i) {
+		if (offset >= sourceVectors[i].iov_len) {
+			offset -= sourceVectors[i].iov_len;
+			continue;
+		}
+		u_int64_t const lengthOfSlice = MIN(sourceVectors[i].iov_len - offset, length);
+		outVectors[numVectors++] = (struct iovec){ (char *)sourceVectors[i].iov_base + offset, lengthOfSlice };
+		length -= lengthOfSlice;
+		offset = 0;
+	}
+	return numVectors;
+}
+
 @implementation ImpVirtualFileHandle
 {
 	ImpDestinationVolume *_Nonnull _backingVolume;
@@ -19,45 +66,46 @@
 	struct HFSPlusExtentDescriptor *_Nonnull _extentsPtr;
 	NSUInteger _numExtents;
 	NSUInteger _numExtentsIncludingEmpties; //Always a multiple of kHFSPlusExtentDensity
-	NSMutableData *_Nonnull dataNotYetWritten;
+	///Data that has been accepted but not yet written out. Always less than _writeBufferCapacity bytes. These bytes go in the fork immediately after _bytesFlushed.
+	NSMutableData *_Nonnull _writeBuffer;
+	NSUInteger _writeBufferCapacity;
 	u_int64_t _bytesWrittenSoFar; //Effectively the file mark
+	u_int64_t _bytesFlushed;
 	u_int32_t _blockSize;
-	u_int32_t _currentExtentIndex;
-	struct HFSPlusExtentDescriptor _remainderOfCurrentExtent;
+	///The extent that the next flush starts in, and where that extent starts in the fork. Writes are strictly sequential, so this only ever moves forward.
+	NSUInteger _flushExtentIndex;
+	u_int64_t _flushExtentStartInFork;
+	bool _closed;
 }
 
 - (instancetype _Nonnull) initWithVolume:(ImpDestinationVolume *_Nonnull const)dstVol extents:(struct HFSPlusExtentDescriptor const *_Nonnull const)extentRecPtr {
 	if ((self = [super init])) {
 		_backingVolume = dstVol;
+		_blockSize = dstVol.numberOfBytesPerBlock;
 
 		_extentsData = [NSMutableData dataWithLength:sizeof(struct HFSPlusExtentDescriptor) * kHFSPlusExtentDensity];
 		_extentsPtr = _extentsData.mutableBytes;
-		NSUInteger totalSize = 0;
-		for (NSUInteger i = 0; i < kHFSPlusExtentDensity; ++i) {
-			NSUInteger const blockCount = extentRecPtr[i].blockCount;
-			if (blockCount == 0) {
-				break;
-			}
-
-			totalSize += blockCount * _backingVolume.numberOfBytesPerBlock;
-			_extentsPtr[i] = extentRecPtr[i];
-
-			++_numExtents;
-		}
 		_numExtentsIncludingEmpties += kHFSPlusExtentDensity;
+		[self growIntoExtents:extentRecPtr];
 
-		_totalPhysicalSize = totalSize;
-		_blockSize = dstVol.numberOfBytesPerBlock;
-		dataNotYetWritten = [NSMutableData dataWithCapacity:_blockSize * 2];
+		_writeBufferCapacity = ImpNextMultipleOfSize(ImpVirtualFileHandleWriteBehindSize, _blockSize);
+		_writeBuffer = [NSMutableData dataWithCapacity:_writeBufferCapacity];
+		ImpPerformanceBufferAllocated(_writeBufferCapacity);
 	}
 	return self;
 }
 
+- (void) dealloc {
+	if (! _closed) {
+		[self closeFile];
+	}
+}
+
 - (void) growIntoExtents:(struct HFSPlusExtentDescriptor const *_Nonnull const)extentRecPtr {
 	enum { sizeOfOneExtentRecord = sizeof(struct HFSPlusExtentDescriptor) * kHFSPlusExtentDensity };
 
 	for (NSUInteger srcIdx = 0, destIdx = _numExtents; srcIdx < kHFSPlusExtentDensity; ++srcIdx, ++destIdx) {
-		NSUInteger const blockCount = extentRecPtr[srcIdx].blockCount;
+		u_int32_t const blockCount = L(extentRecPtr[srcIdx].blockCount);
 		if (blockCount == 0) {
 			break;
 		}
@@ -70,151 +118,140 @@
 
 		_extentsPtr[destIdx] = extentRecPtr[srcIdx];
 		++_numExtents;
+		_totalPhysicalSize += blockCount * (u_int64_t)_blockSize;
 	}
 }
 
-///Divvy up an extent according to the length of some data.
-///The first extent is the portion of the whole extent to which some of the data can be written in whole blocks.
-///The remainder bytes is the number of bytes at the end of data that aren't a whole block. (That is, the remainder of dividing the data's length by the block size, *plus* any blocks that might not have fit in the whole extent if the whole extent was too short.)
-///The second (following) extent is the portion of the whole extent that follows the first extent. Concatenating the first and second extents will always recreate the whole extent.
-///The return value is the number of bytes that will fit in the first extent (i.e., the dividend of the same division from which remainderBytes is the remainder).
-///For example, say the block size is 0x200 bytes and you want to split a data whose length is 0x900 bytes. If the whole extent is 0xa00 bytes (5 blocks), then the first extent will be 0x800, the remainder will be 0x100, and the second extent will be 0x200.
-///If the whole extent is only 0x600 bytes (3 blocks), then the first extent will be 0x600, the remainder will be 0x300 (0x900 - 0x600), and the second extent will be empty.
-- (u_int64_t) splitExtent:(struct HFSPlusExtentDescriptor const *_Nonnull const)wholeExtent
-	usingData:(NSData *_Nonnull const)data
-	intoExtent:(struct HFSPlusExtentDescriptor *_Nonnull const)outExtentThatCoversData
-	andRemainderBytes:(u_int64_t *_Nonnull const)outRemainderBytes
-	andFollowingExtent:(struct HFSPlusExtentDescriptor *_Nonnull const)outExtentThatFollowsData
-{
-	u_int32_t const aBlockSizeInBytes = _backingVolume.numberOfBytesPerBlock;
-	u_int32_t const wholeExtentLengthInABlocks = L(wholeExtent->blockCount);
-
-	u_int64_t const dataLengthInBytes = data.length;
-	u_int64_t const dataLengthInABlocksNotIncludingRemainder = dataLengthInBytes / aBlockSizeInBytes;
-	u_int64_t dividendInBytes = dataLengthInABlocksNotIncludingRemainder * aBlockSizeInBytes;
-	u_int64_t remainderBytes = dataLengthInBytes % aBlockSizeInBytes;
-
-	struct HFSPlusExtentDescriptor firstExtent;
-	struct HFSPlusExtentDescriptor secondExtent;
-
-	if (dataLengthInABlocksNotIncludingRemainder <= wholeExtentLengthInABlocks) {
-		//The whole extent is at least big enough to fit the whole data.
-		firstExtent.startBlock = wholeExtent->startBlock; //Not swapped because we're copying as-is
-		S(firstExtent.blockCount, (u_int32_t)dataLengthInABlocksNotIncludingRemainder);
-
-		S(secondExtent.startBlock, (u_int32_t)(L(firstExtent.startBlock) + dataLengthInABlocksNotIncludingRemainder));
-		S(secondExtent.blockCount, (u_int32_t)(L(wholeExtent->blockCount) - dataLengthInABlocksNotIncludingRemainder));
-	} else {
-		//The data is too long to fit in the whole extent. Return the whole extent and the number of bytes we had nowhere to put.
-		firstExtent.startBlock = wholeExtent->startBlock; //Not swapped because we're copying as-is
-		firstExtent.blockCount = wholeExtent->blockCount; //Not swapped because we're copying as-is
-		secondExtent = (struct HFSPlusExtentDescriptor){ 0, 0 };
-		u_int64_t const numBytesAssignedToAnExtent = L(firstExtent.blockCount) * aBlockSizeInBytes;
-		dividendInBytes = numBytesAssignedToAnExtent;
-		remainderBytes = dataLengthInBytes - numBytesAssignedToAnExtent;
+///A gathered write can't skip over zero blocks, so when the volume is writing sparse output, hand it each vector in turn. Returns the same as ImpWriteVectorsAtOffset.
+- (ssize_t) writeVectorsSparsely:(struct iovec const *_Nonnull const)vectors count:(int const)numVectors atOffsetInFile:(off_t const)offsetInFile {
+	ssize_t total = 0;
+	for (int i = 0; i < numVectors; ++i) {
+		int64_t const amtWritten = [_backingVolume writeBytes:vectors[i].iov_base length:vectors[i].iov_len atOffsetInFile:offsetInFile + total];
+		if (amtWritten < 0) {
+			return total > 0 ? total : amtWritten;
+		}
+		total += amtWritten;
+		if ((size_t)amtWritten < vectors[i].iov_len) {
+			break;
+		}
 	}
-
-	*outExtentThatCoversData = firstExtent;
-	*outExtentThatFollowsData = secondExtent;
-	*outRemainderBytes = remainderBytes;
-	return dividendInBytes;
+	return total;
 }
 
-- (NSInteger) writeData:(NSData *_Nonnull const)data error:(NSError *_Nullable *_Nonnull const)outError {
-	NSInteger bytesWrittenSoFar = 0;
-
-	NSAssert([_backingVolume isKindOfClass:[ImpHFSPlusDestinationVolume class]], @"impluse bug: Can't write to destination volumes that aren't HFS+ (yet…)");
-	ImpHFSPlusDestinationVolume *_Nonnull const hfsPlusVol = (ImpHFSPlusDestinationVolume *)_backingVolume;
-
-	//If we have a leftover partial block, re-write it with some or all of this data appended.
-	//If this data still isn't enough to fill out the block, then we need to leave it appended for the next write's benefit.
-	//If we did append enough to fill out a block, then we can empty the leftover bucket and advance the extent by 1 block, to either write out the rest of this data (if there is any) or the next data (if there is any).
-	NSUInteger offsetIntoData = 0;
-	NSUInteger const numBytesLeftOver = dataNotYetWritten.length;
-	NSUInteger const numBytesRemainingInBlock = _blockSize - numBytesLeftOver;
-	if (numBytesLeftOver > 0) {
-		NSRange const rangeOfFirstPortion = {
-			0,
-			data.length < numBytesRemainingInBlock ? data.length : numBytesRemainingInBlock
-		};
-		NSData *_Nonnull const firstPortion = [data dangerouslyFastSubdataWithRange_Imp:rangeOfFirstPortion];
-		[dataNotYetWritten appendData:firstPortion];
-		NSInteger bytesWrittenThisTime = [hfsPlusVol writeData:dataNotYetWritten startingFrom:bytesWrittenSoFar toExtent:&_remainderOfCurrentExtent error:outError];
-		if (bytesWrittenThisTime < 0) {
-			bytesWrittenSoFar = bytesWrittenThisTime;
-		} else {
-			bytesWrittenSoFar += bytesWrittenThisTime;
-			offsetIntoData += rangeOfFirstPortion.length;
-
-			if (rangeOfFirstPortion.length == _blockSize) {
-				//We've now written one (1) full block at the start of this extent, so remove it from the extent still to be written.
-				S(_remainderOfCurrentExtent.startBlock, L(_remainderOfCurrentExtent.startBlock) + 1);
-				S(_remainderOfCurrentExtent.blockCount, L(_remainderOfCurrentExtent.blockCount) - 1);
-				if (_remainderOfCurrentExtent.blockCount == 0) {
-					++_currentExtentIndex;
-				}
-
-				//Also empty out the leftovers bucket.
-				[dataNotYetWritten setLength:0];
+///Write length bytes from the source vectors into the fork, immediately after the last bytes flushed. The write is split wherever the fork crosses from one extent to the next, so each extent gets one write (barring short writes). length must be a whole number of blocks.
+- (bool) writeVectors:(struct iovec const *_Nonnull const)sourceVectors
+	count:(int const)numSourceVectors
+	length:(u_int64_t const)length
+	error:(NSError *_Nullable *_Nonnull const)outError
+{
+	int const writeFD = _backingVolume.fileDescriptor;
+	u_int64_t const volumeStartInBytes = _backingVolume.startOffsetInBytes;
+	bool const writesSparseOutput = _backingVolume.writesSparseOutput;
+
+	u_int64_t offsetInSource = 0;
+	while (offsetInSource < length) {
+		u_int64_t extentLengthInBytes = 0;
+		while (_flushExtentIndex < _numExtents) {
+			extentLengthInBytes = L(_extentsPtr[_flushExtentIndex].blockCount) * (u_int64_t)_blockSize;
+			if (_bytesFlushed < _flushExtentStartInFork + extentLengthInBytes) {
+				break;
 			}
+			_flushExtentStartInFork += extentLengthInBytes;
+			++_flushExtentIndex;
+		}
+		if (_flushExtentIndex >= _numExtents) {
+			NSError *_Nonnull const outOfExtentsError = [NSError errorWithDomain:NSCocoaErrorDomain code:NSFileWriteOutOfSpaceError userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Ran out of extents to write to after 0x%llx bytes", @""), _bytesFlushed] }];
+			if (outError != NULL) {
+				*outError = outOfExtentsError;
+			}
+			return false;
 		}
-	}
 
-	while (bytesWrittenSoFar >= 0 && data.length - bytesWrittenSoFar >= _blockSize) {
-		if (_remainderOfCurrentExtent.blockCount == 0) {
-			if (_currentExtentIndex >= _numExtents) {
-				break;
+		u_int64_t const offsetIntoExtent = _bytesFlushed - _flushExtentStartInFork;
+		u_int64_t const pieceLength = MIN(length - offsetInSource, extentLengthInBytes - offsetIntoExtent);
+		off_t const pieceStartInVolume = L(_extentsPtr[_flushExtentIndex].startBlock) * (off_t)_blockSize + (off_t)offsetIntoExtent;
+
+		struct iovec vectors[ImpVirtualFileHandleMaxSourceVectors];
+		int const numVectors = ImpSliceVectors(sourceVectors, numSourceVectors, offsetInSource, pieceLength, vectors);
+		ImpTraceTimestamp const traceStart = writesSparseOutput ? 0 : ImpTraceBegin(); //The sparse path goes through the volume's writeBytes:…, which traces itself.
+		ssize_t const amtWritten = writesSparseOutput
+			? [self writeVectorsSparsely:vectors count:numVectors atOffsetInFile:(off_t)volumeStartInBytes + pieceStartInVolume]
+			: ImpWriteVectorsAtOffset(writeFD, vectors, numVectors, (off_t)volumeStartInBytes + pieceStartInVolume);
+		ImpTraceEndWithArguments(traceStart, "io", "Write", "offset", volumeStartInBytes + (u_int64_t)pieceStartInVolume, "length", pieceLength);
+		if (amtWritten <= 0) {
+			int const writeErrno = amtWritten < 0 ? errno : EIO;
+			NSError *_Nonnull const writeError = [NSError errorWithDomain:NSPOSIXErrorDomain code:writeErrno userInfo:@{ NSLocalizedDescriptionKey: [NSString stringWithFormat:NSLocalizedString(@"Failed to write 0x%llx (%llu) bytes at fork offset 0x%llx starting at 0x%llx bytes", @""), pieceLength, pieceLength, _bytesFlushed, volumeStartInBytes + pieceStartInVolume] }];
+			if (outError != NULL) {
+				*outError = writeError;
 			}
-			_remainderOfCurrentExtent = _extentsPtr[_currentExtentIndex];
+			return false;
 		}
 
-		struct HFSPlusExtentDescriptor extentToWrite, extentAfterThat;
-		u_int64_t remainderBytes;
-		u_int64_t const dividendBytes = [self splitExtent:&_remainderOfCurrentExtent usingData:data intoExtent:&extentToWrite andRemainderBytes:&remainderBytes andFollowingExtent:&extentAfterThat];
+		//A short write just means we go around again for the rest.
+		offsetInSource += (u_int64_t)amtWritten;
+		_bytesFlushed += (u_int64_t)amtWritten;
+	}
 
-		NSRange const rangeToWrite = { bytesWrittenSoFar, dividendBytes };
-		NSData *_Nonnull const dataToWrite = [data dangerouslyFastSubdataWithRange_Imp:rangeToWrite];
+	return true;
+}
 
-		NSInteger bytesWrittenThisTime = [hfsPlusVol writeData:dataToWrite startingFrom:offsetIntoData toExtent:&extentToWrite error:outError];
-		if (bytesWrittenThisTime < 0) {
-			bytesWrittenSoFar = bytesWrittenThisTime;
-			break;
-		}
+- (NSInteger) writeData:(NSData *_Nonnull const)data error:(NSError *_Nullable *_Nonnull const)outError {
+	NSAssert(! _closed, @"Attempt to write to a virtual file handle that has already been closed");
+	NSAssert([_backingVolume isKindOfClass:[ImpHFSPlusDestinationVolume class]], @"impluse bug: Can't write to destination volumes that aren't HFS+ (yet…)");
 
-		bytesWrittenSoFar += bytesWrittenThisTime;
-		offsetIntoData += bytesWrittenThisTime;
-		_remainderOfCurrentExtent = extentAfterThat;
-		if (extentAfterThat.blockCount == 0) {
-			++_currentExtentIndex;
-		}
+	NSUInteger const numBytesAccepted = (NSUInteger)MIN((u_int64_t)data.length, _totalPhysicalSize - _bytesWrittenSoFar);
+	NSUInteger const numBytesBuffered = _writeBuffer.length;
+	if (numBytesBuffered + numBytesAccepted < _writeBufferCapacity) {
+		[_writeBuffer appendBytes:data.bytes length:numBytesAccepted];
+		_bytesWrittenSoFar += numBytesAccepted;
+		return numBytesAccepted;
 	}
 
-	if (bytesWrittenSoFar >= 0 && (data.length > (NSUInteger)bytesWrittenSoFar) && _currentExtentIndex < _numExtents) {
-		if (_remainderOfCurrentExtent.blockCount == 0) {
-			_remainderOfCurrentExtent = _extentsPtr[_currentExtentIndex];
-		}
+	//Enough has piled up to be worth writing out. Write everything in the buffer, followed by as much of this data as makes up whole blocks, straight from the client's data rather than copying it into the buffer first. Only a partial block at the end of this data gets held back for next time.
+	//Since the buffer's capacity is a whole number of blocks, the whole blocks to be written always include everything in the buffer.
+	u_int64_t const numBytesPending = numBytesBuffered + numBytesAccepted;
+	u_int64_t const numBytesToWrite = numBytesPending - numBytesPending % _blockSize;
+	NSUInteger const numBytesOfDataToWrite = (NSUInteger)(numBytesToWrite - numBytesBuffered);
+	struct iovec const sourceVectors[ImpVirtualFileHandleMaxSourceVectors] = {
+		{ _writeBuffer.mutableBytes, numBytesBuffered },
+		{ (void *)data.bytes, numBytesOfDataToWrite },
+	};
+	if (! [self writeVectors:sourceVectors count:ImpVirtualFileHandleMaxSourceVectors length:numBytesToWrite error:outError]) {
+		return -1;
+	}
 
-		//Write out the remainder of this data without advancing the mark. We'll pad it with zeroes to a full block for this last write, but then leave it in the buffer unpadded so that if another write comes in, we can prepend this data to the next data to overwrite the block.
-		[dataNotYetWritten setData:[data subdataWithRange:(NSRange){ bytesWrittenSoFar, data.length - bytesWrittenSoFar }]];
-//		NSUInteger const numBytesNotYetWritten = dataNotYetWritten.length;
+	[_writeBuffer setLength:0];
+	[_writeBuffer appendBytes:data.bytes + numBytesOfDataToWrite length:numBytesAccepted - numBytesOfDataToWrite];
+	_bytesWrittenSoFar += numBytesAccepted;
+	return numBytesAccepted;
+}
 
-//		[dataNotYetWritten setLength:_blockSize]; //This should extend rather than truncate, since we're going from a partial block to a full block.
-		NSInteger bytesWrittenThisTime = [hfsPlusVol writeData:dataNotYetWritten startingFrom:0 toExtent:&_remainderOfCurrentExtent error:outError];
-		if (bytesWrittenThisTime < 0) {
-			bytesWrittenSoFar = bytesWrittenThisTime;
-		} else {
-			bytesWrittenSoFar += bytesWrittenThisTime;
-		}
-//		[dataNotYetWritten setLength:numBytesNotYetWritten]; //Trim back to the actual leftover data length.
+- (bool) closeFileAndReturnError:(NSError *_Nullable *_Nonnull const)outError {
+	if (_closed) {
+		return true;
+	}
+	_closed = true;
+	ImpPerformanceBufferFreed(_writeBufferCapacity);
 
-		//Note that we do not advance the extent because if another write comes in, we'll need to rewrite this block with some data appended to the leftover (see first section of method).
+	NSUInteger const numBytesBuffered = _writeBuffer.length;
+	if (numBytesBuffered == 0) {
+		return true;
 	}
 
-	return bytesWrittenSoFar;
+	//Pad the last block out with zeroes, so it's written whole and exactly once. The fork's logical length says where the real data ends.
+	NSUInteger const numBytesToWrite = ImpNextMultipleOfSize(numBytesBuffered, _blockSize);
+	[_writeBuffer setLength:numBytesToWrite];
+	struct iovec const bufferVector = { _writeBuffer.mutableBytes, numBytesToWrite };
+	bool const wrote = [self writeVectors:&bufferVector count:1 length:numBytesToWrite error:outError];
+	_writeBuffer = [NSMutableData data];
+	return wrote;
 }
 
 - (void) closeFile {
-	//TODO: Implement me
+	NSError *_Nullable closeError = nil;
+	if (! [self closeFileAndReturnError:&closeError]) {
+		ImpPrintf(@"Failed to write the end of a file: %@", closeError.localizedDescription);
+	}
 }
 
 @end
@@ -10,6 +10,7 @@
 #import "ImpSizeUtilities.h"
 #import "ImpByteOrder.h"
 #import "NSData+ImpSubdata.h"
+#import "ImpPerformanceCounters.h"
 
 #import "ImpSourceVolume.h"
 #import "ImpHFSSourceVolume.h"
@@ -168,15 +169,15 @@ struct APMPartitionRecord_IM5 {
 	};
 	off_t offset = initialOffset;
 	void *_Nullable const buf = malloc(bufSize);
-	ssize_t amtRead = pread(_readFD, buf, bufSize, offset);
+	ssize_t amtRead = ImpPread(_readFD, buf, bufSize, offset);
 	while (amtRead == bufSize) {
 		offset += offsetIncrement;
-		amtRead = pread(_readFD, buf, bufSize, offset);
+		amtRead = ImpPread(_readFD, buf, bufSize, offset);
 	}
 	if (amtRead == 0) {
 		while (amtRead == 0) {
 			offset -= bufSize;
-			amtRead = pread(_readFD, buf, bufSize, offset);
+			amtRead = ImpPread(_readFD, buf, bufSize, offset);
 		}
 	}
 
@@ -190,7 +191,7 @@ struct APMPartitionRecord_IM5 {
 	NSMutableData *_Nonnull const mutableData = [NSMutableData dataWithLength:amtToRead];
 	void *_Nonnull const buf = mutableData.mutableBytes;
 
-	ssize_t const amtRead = pread(_readFD, buf, amtToRead, kISOStandardBlockSize * idx);
+	ssize_t const amtRead = ImpPread(_readFD, buf, amtToRead, kISOStandardBlockSize * idx);
 
 	bool const readSuccessfully = (amtRead == amtToRead);
 	if (! readSuccessfully) {
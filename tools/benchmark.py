@@ -0,0 +1,150 @@
+#!/usr/bin/python3
+
+"""Time impluse's list, extract, convert, and analyze subcommands against synthetic HFS volumes of increasing size.
+
+Volumes are generated with make_synthetic_hfs.py (next to this script) and kept in the work directory, so later runs with the same parameters reuse them. Each subcommand is run --repeat times; the report gives the median wall-clock time, the CPU time and peak resident memory of that run, and throughput in items (files plus folders) and fork bytes per second.
+
+HFS has at most 65,535 allocation blocks, so at larger file counts most files have to be empty: the benchmark keeps the number of non-empty forks at or below --non-empty-forks regardless of how many files there are.
+"""
+
+import argparse
+import csv
+import json
+import os
+import pathlib
+import shutil
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+OPERATIONS = ('list', 'extract', 'convert', 'analyze')
+
+def distribution_spec(sizes_and_weights: list) -> str:
+	return ','.join('{}:{:.6f}'.format(size, weight) for size, weight in sizes_and_weights)
+
+def generate_volume(opts, number_of_files: int) -> (pathlib.Path, dict):
+	name = 'synthetic-{}f-d{}x{}-frag{:g}-seed{}'.format(number_of_files, opts.depth, opts.fanout, opts.fragmented_percent, opts.seed)
+	image_path = opts.work_dir / (name + '.img')
+	stats_path = opts.work_dir / (name + '.json')
+	if not (image_path.exists() and stats_path.exists()):
+		#Three quarters of the non-empty forks are data forks, the rest resource forks.
+		non_empty_fraction = min(0.9, opts.non_empty_forks / number_of_files)
+		data_fraction = non_empty_fraction * 0.75
+		rsrc_fraction = non_empty_fraction * 0.25
+		data_sizes = distribution_spec([(0, 1.0 - data_fraction), ('2K', data_fraction * 0.6), ('32K', data_fraction * 0.3), ('512K', data_fraction * 0.1)])
+		rsrc_sizes = distribution_spec([(0, 1.0 - rsrc_fraction), ('1K', rsrc_fraction * 0.8), ('16K', rsrc_fraction * 0.2)])
+		subprocess.run([sys.executable, str(pathlib.Path(__file__).with_name('make_synthetic_hfs.py')),
+			'--files', str(number_of_files),
+			'--depth', str(opts.depth), '--fanout', str(opts.fanout),
+			'--data-sizes', data_sizes, '--rsrc-sizes', rsrc_sizes,
+			'--fragmented-percent', str(opts.fragmented_percent),
+			'--seed', str(opts.seed),
+			'--stats', str(stats_path),
+			str(image_path),
+		], check=True)
+	with open(stats_path) as stats_file:
+		return image_path, json.load(stats_file)
+
+def run_and_measure(argv: list, stdout) -> dict:
+	"Run a command and return its wall-clock time, CPU time, peak resident memory, and exit status."
+	start = time.perf_counter()
+	process = subprocess.Popen(argv, stdout=stdout, stderr=subprocess.DEVNULL)
+	_, wait_status, rusage = os.wait4(process.pid, 0)
+	wall_seconds = time.perf_counter() - start
+	process.returncode = os.waitstatus_to_exitcode(wait_status)
+	#ru_maxrss is in bytes on macOS but kilobytes on Linux.
+	peak_rss_bytes = rusage.ru_maxrss if sys.platform == 'darwin' else rusage.ru_maxrss * 1024
+	return {
+		'wall_seconds': wall_seconds,
+		'cpu_seconds': rusage.ru_utime + rusage.ru_stime,
+		'peak_rss_bytes': peak_rss_bytes,
+		'exit_status': process.returncode,
+	}
+
+def benchmark_operation(opts, operation: str, image_path: pathlib.Path) -> dict:
+	runs = []
+	for i in range(opts.repeat):
+		with tempfile.TemporaryDirectory(dir=opts.work_dir, prefix='scratch-') as scratch_dir:
+			if operation == 'list':
+				argv = [opts.impluse, 'list', '--paths', str(image_path)]
+			elif operation == 'extract':
+				argv = [opts.impluse, 'extract', str(image_path), ':', scratch_dir + '/']
+			elif operation == 'convert':
+				argv = [opts.impluse, 'convert', str(image_path), os.path.join(scratch_dir, 'converted.img')]
+			elif operation == 'analyze':
+				argv = [opts.impluse, 'analyze', str(image_path)]
+			with open(os.devnull, 'w') as devnull:
+				runs.append(run_and_measure(argv, devnull))
+	#Report the median run (by wall-clock time) rather than averaging, so one slow outlier doesn't skew the numbers.
+	runs.sort(key=lambda run: run['wall_seconds'])
+	median_run = runs[len(runs) // 2]
+	median_run['median_of'] = len(runs)
+	median_run['wall_seconds_stdev'] = statistics.stdev(run['wall_seconds'] for run in runs) if len(runs) > 1 else 0.0
+	median_run['failed_runs'] = sum(1 for run in runs if run['exit_status'] != 0)
+	return median_run
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0], epilog='\n\n'.join(__doc__.split('\n\n')[1:]), formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument('--impluse', default=shutil.which('impluse') or 'impluse', help='Path to the impluse executable to benchmark (default: the one on your PATH)')
+	parser.add_argument('--sizes', default='10000,100000,1000000', help='Comma-separated file counts to generate volumes for (default: %(default)s)')
+	parser.add_argument('--operations', default=','.join(OPERATIONS), help='Comma-separated subcommands to time (default: %(default)s)')
+	parser.add_argument('--work-dir', type=pathlib.Path, default=pathlib.Path(tempfile.gettempdir()) / 'impluse-benchmark', help='Where to keep generated volumes and scratch output (default: %(default)s)')
+	parser.add_argument('--depth', type=int, default=3, help='Folder depth of generated volumes (default: %(default)s)')
+	parser.add_argument('--fanout', type=int, default=10, help='Folder fanout of generated volumes (default: %(default)s)')
+	parser.add_argument('--fragmented-percent', type=float, default=10.0, help='Percentage of forks to fragment (default: %(default)s)')
+	parser.add_argument('--non-empty-forks', type=int, default=40000, help='Most non-empty forks to put in any one volume (default: %(default)s)')
+	parser.add_argument('--seed', type=int, default=1, help='Seed for the generated volumes (default: %(default)s)')
+	parser.add_argument('--repeat', type=int, default=3, help='Times to run each subcommand (default: %(default)s)')
+	parser.add_argument('--format', choices=('table', 'csv', 'json'), default='table', help='Report format (default: %(default)s)')
+	opts = parser.parse_args()
+
+	operations = [operation.strip() for operation in opts.operations.split(',') if operation.strip()]
+	for operation in operations:
+		if operation not in OPERATIONS:
+			parser.error('unknown operation {!r}; choose from {}'.format(operation, ', '.join(OPERATIONS)))
+	if opts.repeat < 1:
+		parser.error('--repeat must be at least 1')
+	opts.work_dir.mkdir(parents=True, exist_ok=True)
+
+	results = []
+	for number_of_files in (int(size.replace(',', '').replace('_', '')) for size in opts.sizes.split(',') if size):
+		image_path, stats = generate_volume(opts, number_of_files)
+		number_of_items = stats['files'] + stats['folders']
+		for operation in operations:
+			print('Running {} on {}…'.format(operation, image_path.name), file=sys.stderr)
+			run = benchmark_operation(opts, operation, image_path)
+			results.append({
+				'files': stats['files'],
+				'folders': stats['folders'],
+				'fork_bytes': stats['fork_bytes'],
+				'operation': operation,
+				'wall_seconds': round(run['wall_seconds'], 3),
+				'wall_seconds_stdev': round(run['wall_seconds_stdev'], 3),
+				'cpu_seconds': round(run['cpu_seconds'], 3),
+				'peak_rss_bytes': run['peak_rss_bytes'],
+				'items_per_second': round(number_of_items / run['wall_seconds'], 1),
+				'fork_megabytes_per_second': round(stats['fork_bytes'] / (1 << 20) / run['wall_seconds'], 2),
+				'runs': run['median_of'],
+				'failed_runs': run['failed_runs'],
+			})
+
+	if opts.format == 'json':
+		json.dump(results, sys.stdout, indent='\t')
+		print()
+	elif opts.format == 'csv':
+		writer = csv.DictWriter(sys.stdout, fieldnames=list(results[0].keys()) if results else [])
+		writer.writeheader()
+		writer.writerows(results)
+	else:
+		print('Files    \tOperation\tWall (s)\tCPU (s)\tPeak RSS\tItems/s\tMiB/s\tFailed')
+		print('═════════\t═════════\t════════\t═══════\t════════\t═══════\t═════\t══════')
+		for result in results:
+			print('{files:,}\t{operation}\t{wall_seconds:.2f} ± {wall_seconds_stdev:.2f}\t{cpu_seconds:.2f}\t{peak_rss_mib:,.1f} MiB\t{items_per_second:,.0f}\t{fork_megabytes_per_second:,.1f}\t{failed_runs}/{runs}'.format(peak_rss_mib=result['peak_rss_bytes'] / (1 << 20), **result))
+
+	if any(result['failed_runs'] for result in results):
+		sys.exit(1)
+
+if __name__ == '__main__':
+	main()
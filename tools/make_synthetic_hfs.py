@@ -0,0 +1,609 @@
+#!/usr/bin/python3
+
+"""Generate a synthetic HFS volume with a parameterized number of files, folder hierarchy, fork sizes, and fragmentation.
+
+The volume is written directly (MDB, volume bitmap, catalog and extents overflow B*-trees, fork contents), without going through the File Manager or impluse's own archiver, which can't produce HFS volumes yet. Everything is derived from the seed, so the same arguments always produce the same image.
+
+Fork size distributions are given as comma-separated size:weight pairs, such as 0:50,4K:30,1M:20. A fork is given a size by picking one of the sizes by weight and then picking a length between half that size and that size. Sizes take an optional K, M, or G suffix.
+
+Keep in mind that HFS can't have more than 65,535 allocation blocks, and every non-empty fork takes at least one. A volume with a million files is possible, but only if most of those files are empty.
+"""
+
+import argparse
+import array
+import json
+import math
+import os
+import random
+import struct
+import sys
+
+SECTOR_SIZE = 512
+NODE_SIZE = 512
+MAX_ALLOCATION_BLOCKS = 0xffff
+MAX_FOLDER_VALENCE = 32767
+MAX_FORK_LENGTH = 0x7fffffff
+
+#2000-01-01T00:00:00, in seconds since 1904-01-01. All dates are the same so the output is reproducible.
+SYNTHETIC_DATE = 3029529600
+
+ROOT_FOLDER_ID = 2
+EXTENTS_FILE_ID = 3
+CATALOG_FILE_ID = 4
+FIRST_USER_CATALOG_NODE_ID = 16
+
+FOLDER_RECORD = 1
+FILE_RECORD = 2
+FOLDER_THREAD_RECORD = 3
+
+DATA_FORK = 0x00
+RESOURCE_FORK = 0xff
+
+CATALOG_MAX_KEY_LENGTH = 37
+EXTENTS_MAX_KEY_LENGTH = 7
+
+FOLDER_RECORD_SIZE = 70
+FILE_RECORD_SIZE = 102
+THREAD_RECORD_SIZE = 46
+EXTENT_RECORD_SIZE = 12
+EXTENTS_KEY_SIZE = 8
+
+NODE_DESCRIPTOR_SIZE = 14
+HEADER_RECORD_SIZE = 106
+USER_DATA_RECORD_SIZE = 128
+HEADER_MAP_RECORD_SIZE = NODE_SIZE - NODE_DESCRIPTOR_SIZE - HEADER_RECORD_SIZE - USER_DATA_RECORD_SIZE - 4 * 2
+MAP_NODE_RECORD_SIZE = NODE_SIZE - NODE_DESCRIPTOR_SIZE - 2 * 2
+
+NODE_KIND_LEAF = 0xff
+NODE_KIND_INDEX = 0
+NODE_KIND_HEADER = 1
+NODE_KIND_MAP = 2
+
+def parse_size(size_spec: str) -> int:
+	multipliers = { 'K': 1 << 10, 'M': 1 << 20, 'G': 1 << 30 }
+	size_spec = size_spec.strip().upper()
+	if size_spec.endswith('B'):
+		size_spec = size_spec[:-1]
+	if size_spec and size_spec[-1] in multipliers:
+		return int(float(size_spec[:-1]) * multipliers[size_spec[-1]])
+	return int(size_spec)
+
+def parse_distribution(distribution_spec: str) -> list:
+	buckets = []
+	for pair in distribution_spec.split(','):
+		size_spec, _, weight_spec = pair.partition(':')
+		buckets.append((parse_size(size_spec), float(weight_spec or 1)))
+	if not buckets or sum(weight for size, weight in buckets) <= 0:
+		raise argparse.ArgumentTypeError('distribution needs at least one size with a positive weight: {}'.format(distribution_spec))
+	return buckets
+
+def ceiling_divide(numerator: int, denominator: int) -> int:
+	return (numerator + denominator - 1) // denominator
+
+class VolumePlan:
+	"""The shape of the volume: the folder hierarchy, and every fork's length and how many pieces it should be broken into.
+
+	Folders are numbered breadth-first, 0 being the root, so folder n's subfolders are n * fanout + 1 through n * fanout + fanout. Files are dealt out to folders round-robin: file i goes in folder i % number_of_folders.
+	"""
+
+	def __init__(self, opts):
+		self.volume_name = opts.volume_name.encode('mac_roman')[:27]
+		self.fanout = opts.fanout
+		self.number_of_subfolders = sum(opts.fanout ** level for level in range(1, opts.depth + 1)) if opts.fanout > 0 else 0
+		self.number_of_folders = self.number_of_subfolders + 1
+		self.number_of_files = opts.files
+
+		rng = random.Random(opts.seed)
+		self.data_lengths = array.array('Q', (self.pick_length(rng, opts.data_sizes) for i in range(self.number_of_files)))
+		self.rsrc_lengths = array.array('Q', (self.pick_length(rng, opts.rsrc_sizes) for i in range(self.number_of_files)))
+		fragmented_fraction = opts.fragmented_percent / 100.0
+		def pick_pieces(length):
+			return rng.randint(2, opts.max_extents) if length > 0 and rng.random() < fragmented_fraction else 1
+		self.data_pieces = array.array('H', (pick_pieces(length) for length in self.data_lengths))
+		self.rsrc_pieces = array.array('H', (pick_pieces(length) for length in self.rsrc_lengths))
+
+		#The root has as many subfolders as any folder, and gets the first of any files left over from dealing them out evenly, so no folder has more items than the root.
+		root_valence = len(self.subfolder_indexes(0)) + self.number_of_files_in_folder(0)
+		if root_valence > MAX_FOLDER_VALENCE:
+			sys.exit('Each folder would have as many as {:,} items in it; HFS allows at most {:,}. Use more depth or fanout.'.format(root_valence, MAX_FOLDER_VALENCE))
+
+		#Only non-empty forks take up blocks, so these are all that matter when choosing a block size.
+		self.non_empty_forks = [(length, pieces) for lengths, all_pieces in ((self.data_lengths, self.data_pieces), (self.rsrc_lengths, self.rsrc_pieces)) for length, pieces in zip(lengths, all_pieces) if length > 0]
+
+	@staticmethod
+	def pick_length(rng: random.Random, buckets: list) -> int:
+		size = rng.choices([size for size, weight in buckets], weights=[weight for size, weight in buckets])[0]
+		if size <= 1:
+			return size
+		return min(rng.randint(size // 2, size), MAX_FORK_LENGTH)
+
+	def folder_id(self, folder_index: int) -> int:
+		return ROOT_FOLDER_ID if folder_index == 0 else FIRST_USER_CATALOG_NODE_ID + folder_index - 1
+
+	def file_id(self, file_index: int) -> int:
+		return FIRST_USER_CATALOG_NODE_ID + self.number_of_subfolders + file_index
+
+	def parent_folder_index(self, folder_index: int) -> int:
+		return (folder_index - 1) // self.fanout
+
+	def subfolder_indexes(self, folder_index: int) -> range:
+		first = folder_index * self.fanout + 1
+		return range(min(first, self.number_of_folders), min(first + self.fanout, self.number_of_folders))
+
+	def number_of_files_in_folder(self, folder_index: int) -> int:
+		return self.number_of_files // self.number_of_folders + (1 if folder_index < self.number_of_files % self.number_of_folders else 0)
+
+	def folder_name(self, folder_index: int) -> bytes:
+		if folder_index == 0:
+			return self.volume_name
+		siblings = self.subfolder_indexes(self.parent_folder_index(folder_index))
+		return 'Folder {:0{}d}'.format(folder_index - siblings.start + 1, len(str(len(siblings)))).encode('mac_roman')
+
+	def file_name(self, folder_index: int, number_in_folder: int) -> bytes:
+		return 'File {:0{}d}'.format(number_in_folder + 1, len(str(self.number_of_files_in_folder(folder_index)))).encode('mac_roman')
+
+	@property
+	def next_catalog_node_id(self) -> int:
+		return self.file_id(self.number_of_files)
+
+def piece_lengths(number_of_blocks: int, number_of_pieces: int) -> list:
+	"Split a fork's blocks into (up to) this many nearly-equal pieces."
+	number_of_pieces = max(1, min(number_of_pieces, number_of_blocks))
+	base, remainder = divmod(number_of_blocks, number_of_pieces)
+	return [base + (1 if i < remainder else 0) for i in range(number_of_pieces)]
+
+def number_of_overflow_records(number_of_pieces: int) -> int:
+	"The catalog record holds the first three extents; each extents overflow record holds three more."
+	return ceiling_divide(max(0, number_of_pieces - 3), 3)
+
+class Allocation:
+	"""Where every fork's blocks ended up. Forks are laid out in file order, data fork first, each one starting right after the previous one; a fork broken into pieces has a one-block gap after each piece but the last."""
+
+	def __init__(self, plan: VolumePlan, block_size: int, first_block: int):
+		self.plan = plan
+		self.block_size = block_size
+		self.data_starts = array.array('I', bytes(4 * plan.number_of_files))
+		self.rsrc_starts = array.array('I', bytes(4 * plan.number_of_files))
+		next_block = first_block
+		self.number_of_fork_blocks = 0
+		for file_index in range(plan.number_of_files):
+			for lengths, pieces, starts in ((plan.data_lengths, plan.data_pieces, self.data_starts), (plan.rsrc_lengths, plan.rsrc_pieces, self.rsrc_starts)):
+				number_of_blocks = ceiling_divide(lengths[file_index], block_size)
+				if number_of_blocks == 0:
+					continue
+				starts[file_index] = next_block
+				pieces_here = piece_lengths(number_of_blocks, pieces[file_index])
+				next_block += number_of_blocks + len(pieces_here) - 1
+				self.number_of_fork_blocks += number_of_blocks
+		self.end_block = next_block
+
+	def extents(self, file_index: int, fork_type: int) -> list:
+		"Returns a list of (startBlock, blockCount) pairs."
+		if fork_type == DATA_FORK:
+			length, pieces, start = self.plan.data_lengths[file_index], self.plan.data_pieces[file_index], self.data_starts[file_index]
+		else:
+			length, pieces, start = self.plan.rsrc_lengths[file_index], self.plan.rsrc_pieces[file_index], self.rsrc_starts[file_index]
+		extents = []
+		for piece_length in piece_lengths(ceiling_divide(length, self.block_size), pieces):
+			if piece_length > 0:
+				extents.append((start, piece_length))
+				start += piece_length + 1
+		return extents
+
+def blocks_needed_for_forks(plan: VolumePlan, block_size: int) -> (int, int):
+	"Returns the number of blocks the forks will span (including gaps between pieces), and the number of extents overflow records they'll need."
+	total = 0
+	overflow_records = 0
+	for length, number_of_pieces in plan.non_empty_forks:
+		number_of_blocks = ceiling_divide(length, block_size)
+		number_of_pieces = min(number_of_pieces, number_of_blocks)
+		total += number_of_blocks + number_of_pieces - 1
+		overflow_records += number_of_overflow_records(number_of_pieces)
+	return total, overflow_records
+
+#MARK: B*-trees
+
+class NodePacker:
+	"Decides where node boundaries fall, given the sizes of the records to be stored, in order. Each node holds as many records as will fit."
+
+	def __init__(self):
+		self.record_counts = array.array('I')
+		self.bytes_used = NODE_SIZE
+
+	def add(self, record_size: int) -> bool:
+		"Returns true if this record starts a new node."
+		count = self.record_counts[-1] if self.record_counts else 0
+		#Record data, plus one offset per record, plus the offset to free space.
+		if self.record_counts and self.bytes_used + record_size + 2 * (count + 2) <= NODE_SIZE:
+			self.bytes_used += record_size
+			self.record_counts[-1] += 1
+			return False
+		self.record_counts.append(1)
+		self.bytes_used = NODE_DESCRIPTOR_SIZE + record_size
+		return True
+
+def build_node(kind: int, height: int, forward_link: int, backward_link: int, records: list) -> bytes:
+	node = bytearray(NODE_SIZE)
+	struct.pack_into('>IIBBHH', node, 0, forward_link, backward_link, kind, height, len(records), 0)
+	offset = NODE_DESCRIPTOR_SIZE
+	for idx, record in enumerate(records):
+		struct.pack_into('>H', node, NODE_SIZE - 2 * (idx + 1), offset)
+		node[offset:offset + len(record)] = record
+		offset += len(record)
+	struct.pack_into('>H', node, NODE_SIZE - 2 * (len(records) + 1), offset)
+	assert offset <= NODE_SIZE - 2 * (len(records) + 1), 'Overfilled node'
+	return bytes(node)
+
+class BTreeLayout:
+	"""Node numbering for a B*-tree whose leaf records have already been run through a NodePacker: the header node, then any map nodes, then the leaves, then each row of index nodes from the bottom up, ending with the root."""
+
+	def __init__(self, leaf_packer: NodePacker, leaf_first_keys: list, index_record_size: int, index_key: callable, block_size: int):
+		self.leaf_record_counts = leaf_packer.record_counts
+		self.number_of_leaf_records = sum(self.leaf_record_counts)
+		self.number_of_leaves = len(self.leaf_record_counts)
+
+		#Each row of index nodes: a list of (first key, child node offsets within the row below) per node.
+		self.index_rows = []
+		row_first_keys = leaf_first_keys
+		while len(row_first_keys) > 1:
+			packer = NodePacker()
+			parent_first_keys = []
+			for key in row_first_keys:
+				if packer.add(index_record_size):
+					parent_first_keys.append(key)
+			self.index_rows.append(packer.record_counts)
+			row_first_keys = parent_first_keys
+		self.index_key = index_key
+
+		number_of_index_nodes = sum(len(row) for row in self.index_rows)
+		self.number_of_map_nodes = 0
+		while True:
+			number_of_used_nodes = 1 + self.number_of_map_nodes + self.number_of_leaves + number_of_index_nodes
+			self.number_of_blocks = ceiling_divide(number_of_used_nodes * NODE_SIZE, block_size)
+			self.total_nodes = self.number_of_blocks * block_size // NODE_SIZE
+			map_bits_needed = self.total_nodes - HEADER_MAP_RECORD_SIZE * 8
+			map_nodes_needed = ceiling_divide(max(0, map_bits_needed), MAP_NODE_RECORD_SIZE * 8)
+			if map_nodes_needed <= self.number_of_map_nodes:
+				break
+			self.number_of_map_nodes = map_nodes_needed
+		self.free_nodes = self.total_nodes - number_of_used_nodes
+		self.first_leaf = 1 + self.number_of_map_nodes
+		self.depth = (1 + len(self.index_rows)) if self.number_of_leaves > 0 else 0
+
+	def first_node_of_index_row(self, row_number: int) -> int:
+		return self.first_leaf + self.number_of_leaves + sum(len(row) for row in self.index_rows[:row_number])
+
+	@property
+	def root_node(self) -> int:
+		if self.number_of_leaves == 0:
+			return 0
+		if not self.index_rows:
+			return self.first_leaf
+		return self.first_node_of_index_row(len(self.index_rows) - 1)
+
+	def write(self, leaf_records, max_key_length: int, clump_size: int) -> bytearray:
+		"leaf_records must yield the same (key, record) pairs, in the same order, that were used to plan the tree."
+		tree = bytearray(self.total_nodes * NODE_SIZE)
+
+		#Leaves first, keeping each leaf's first key for the index rows.
+		row_first_keys = []
+		records_iter = iter(leaf_records)
+		for leaf_number, count in enumerate(self.leaf_record_counts):
+			records = []
+			for i in range(count):
+				key, record = next(records_iter)
+				if i == 0:
+					row_first_keys.append(key)
+				records.append(key + record)
+			node_number = self.first_leaf + leaf_number
+			forward_link = node_number + 1 if leaf_number + 1 < self.number_of_leaves else 0
+			backward_link = node_number - 1 if leaf_number > 0 else 0
+			tree[node_number * NODE_SIZE:(node_number + 1) * NODE_SIZE] = build_node(NODE_KIND_LEAF, 1, forward_link, backward_link, records)
+		assert next(records_iter, None) is None, 'More leaf records than were planned for'
+
+		child_row_first_node = self.first_leaf
+		for row_number, row_counts in enumerate(self.index_rows):
+			row_first_node = self.first_node_of_index_row(row_number)
+			parent_first_keys = []
+			child_idx = 0
+			for node_idx, count in enumerate(row_counts):
+				records = []
+				for i in range(count):
+					key = row_first_keys[child_idx]
+					if i == 0:
+						parent_first_keys.append(key)
+					records.append(self.index_key(key) + struct.pack('>I', child_row_first_node + child_idx))
+					child_idx += 1
+				node_number = row_first_node + node_idx
+				forward_link = node_number + 1 if node_idx + 1 < len(row_counts) else 0
+				backward_link = node_number - 1 if node_idx > 0 else 0
+				tree[node_number * NODE_SIZE:(node_number + 1) * NODE_SIZE] = build_node(NODE_KIND_INDEX, row_number + 2, forward_link, backward_link, records)
+			row_first_keys = parent_first_keys
+			child_row_first_node = row_first_node
+
+		#Every node up to the last index node is in use; everything after that is free.
+		number_of_used_nodes = self.total_nodes - self.free_nodes
+		node_map = bytearray(ceiling_divide(self.total_nodes, 8))
+		node_map[:number_of_used_nodes // 8] = b'\xff' * (number_of_used_nodes // 8)
+		if number_of_used_nodes % 8:
+			node_map[number_of_used_nodes // 8] = (0xff00 >> (number_of_used_nodes % 8)) & 0xff
+
+		header_record = struct.pack('>HIIIIHHIIHIBBI64x',
+			self.depth, self.root_node, self.number_of_leaf_records,
+			self.first_leaf if self.number_of_leaves else 0,
+			self.first_leaf + self.number_of_leaves - 1 if self.number_of_leaves else 0,
+			NODE_SIZE, max_key_length, self.total_nodes, self.free_nodes,
+			0, clump_size, 0, 0, 0)
+		assert len(header_record) == HEADER_RECORD_SIZE
+		header_map_record = bytes(node_map[:HEADER_MAP_RECORD_SIZE]).ljust(HEADER_MAP_RECORD_SIZE, b'\0')
+		tree[0:NODE_SIZE] = build_node(NODE_KIND_HEADER, 0, 1 if self.number_of_map_nodes else 0, 0, [header_record, bytes(USER_DATA_RECORD_SIZE), header_map_record])
+		for map_idx in range(self.number_of_map_nodes):
+			map_start = HEADER_MAP_RECORD_SIZE + map_idx * MAP_NODE_RECORD_SIZE
+			map_record = bytes(node_map[map_start:map_start + MAP_NODE_RECORD_SIZE]).ljust(MAP_NODE_RECORD_SIZE, b'\0')
+			node_number = 1 + map_idx
+			forward_link = node_number + 1 if map_idx + 1 < self.number_of_map_nodes else 0
+			tree[node_number * NODE_SIZE:(node_number + 1) * NODE_SIZE] = build_node(NODE_KIND_MAP, 0, forward_link, 0, [map_record])
+
+		return tree
+
+#MARK: Catalog and extents records
+
+def catalog_key(parent_id: int, name: bytes) -> bytes:
+	"A leaf-node catalog key, padded to an even length."
+	key = struct.pack('>BBIB', 6 + len(name), 0, parent_id, len(name)) + name
+	return key + b'\0' if len(key) % 2 else key
+
+def catalog_index_key(leaf_key: bytes) -> bytes:
+	"HFS catalog index nodes always use maximum-length keys."
+	parent_id, name_length = struct.unpack_from('>IB', leaf_key, 2)
+	name = leaf_key[7:7 + name_length]
+	return struct.pack('>BBIB', CATALOG_MAX_KEY_LENGTH, 0, parent_id, name_length) + name.ljust(31, b'\0')
+
+def extents_key(fork_type: int, file_id: int, start_block: int) -> bytes:
+	return struct.pack('>BBIH', EXTENTS_MAX_KEY_LENGTH, fork_type, file_id, start_block)
+
+def extent_record(extents: list) -> bytes:
+	extents = list(extents[:3]) + [(0, 0)] * (3 - len(extents[:3]))
+	return b''.join(struct.pack('>HH', start, count) for start, count in extents)
+
+def folder_record(folder_id: int, valence: int) -> bytes:
+	return struct.pack('>BBHHIIII16x16x16x', FOLDER_RECORD, 0, 0, valence, folder_id, SYNTHETIC_DATE, SYNTHETIC_DATE, 0)
+
+def folder_thread_record(parent_id: int, name: bytes) -> bytes:
+	return struct.pack('>BB8xIB', FOLDER_THREAD_RECORD, 0, parent_id, len(name)) + name.ljust(31, b'\0')
+
+def file_record(file_id: int, data_length: int, data_extents: list, rsrc_length: int, rsrc_extents: list, block_size: int) -> bytes:
+	finder_info = struct.pack('>4s4sHhhH', b'TEXT', b'ttxt', 0, 0, 0, 0)
+	data_physical = sum(count for start, count in data_extents) * block_size
+	rsrc_physical = sum(count for start, count in rsrc_extents) * block_size
+	return (struct.pack('>BBBB', FILE_RECORD, 0, 0, 0)
+		+ finder_info
+		+ struct.pack('>IHiiHiiIII', file_id, 0, data_length, data_physical, 0, rsrc_length, rsrc_physical, SYNTHETIC_DATE, SYNTHETIC_DATE, 0)
+		+ bytes(16)
+		+ struct.pack('>H', 0)
+		+ extent_record(data_extents)
+		+ extent_record(rsrc_extents)
+		+ bytes(4))
+
+def catalog_leaf_records(plan: VolumePlan, allocation: Allocation):
+	"""Yields (key, record) for every catalog leaf record, in key order. If allocation is None, file records have no extents (they're the same size either way, which is all the planning pass needs).
+
+	Keys sort by parent ID, then name. A folder's thread record has an empty name, so it comes before the folder's contents; within a folder, every “File” sorts before every “Folder”, and names of each kind are zero-padded to the same width.
+	"""
+	root_name = plan.folder_name(0)
+	yield catalog_key(1, root_name), folder_record(ROOT_FOLDER_ID, len(plan.subfolder_indexes(0)) + plan.number_of_files_in_folder(0))
+
+	for folder_index in range(plan.number_of_folders):
+		folder_id = plan.folder_id(folder_index)
+		parent_id = 1 if folder_index == 0 else plan.folder_id(plan.parent_folder_index(folder_index))
+		yield catalog_key(folder_id, b''), folder_thread_record(parent_id, plan.folder_name(folder_index))
+
+		for number_in_folder in range(plan.number_of_files_in_folder(folder_index)):
+			file_index = folder_index + number_in_folder * plan.number_of_folders
+			data_extents = allocation.extents(file_index, DATA_FORK) if allocation else []
+			rsrc_extents = allocation.extents(file_index, RESOURCE_FORK) if allocation else []
+			yield catalog_key(folder_id, plan.file_name(folder_index, number_in_folder)), file_record(plan.file_id(file_index), plan.data_lengths[file_index], data_extents, plan.rsrc_lengths[file_index], rsrc_extents, allocation.block_size if allocation else 0)
+
+		for subfolder_index in plan.subfolder_indexes(folder_index):
+			valence = len(plan.subfolder_indexes(subfolder_index)) + plan.number_of_files_in_folder(subfolder_index)
+			yield catalog_key(folder_id, plan.folder_name(subfolder_index)), folder_record(plan.folder_id(subfolder_index), valence)
+
+def extents_leaf_records(plan: VolumePlan, allocation: Allocation):
+	"Yields (key, record) for every extents overflow record, in key order (file ID, then fork type, then the file allocation block the record starts at)."
+	for file_index in range(plan.number_of_files):
+		for fork_type in (DATA_FORK, RESOURCE_FORK):
+			extents = allocation.extents(file_index, fork_type)
+			if len(extents) <= 3:
+				continue
+			start_in_fork = sum(count for start, count in extents[:3])
+			for record_start in range(3, len(extents), 3):
+				record_extents = extents[record_start:record_start + 3]
+				yield extents_key(fork_type, plan.file_id(file_index), start_in_fork), extent_record(record_extents)
+				start_in_fork += sum(count for start, count in record_extents)
+
+#MARK: Putting it all together
+
+def plan_catalog(plan: VolumePlan):
+	packer = NodePacker()
+	first_keys = []
+	for key, record in catalog_leaf_records(plan, None):
+		if packer.add(len(key) + len(record)):
+			first_keys.append(key)
+	return packer, first_keys
+
+def plan_extents_file(number_of_records: int):
+	packer = NodePacker()
+	for i in range(number_of_records):
+		packer.add(EXTENTS_KEY_SIZE + EXTENT_RECORD_SIZE)
+	#The first keys only matter for writing; the planning pass just needs one per leaf.
+	return packer, [None] * len(packer.record_counts)
+
+def choose_block_size(plan: VolumePlan, catalog_packer, catalog_first_keys, free_fraction: float, requested_block_size: int):
+	"Returns the smallest multiple of 512 bytes that lets everything fit in 65,535 allocation blocks (with the requested free space left over), along with the B*-tree layouts and total block count for that size."
+	def layout_for(block_size):
+		fork_blocks, overflow_records = blocks_needed_for_forks(plan, block_size)
+		catalog = BTreeLayout(catalog_packer, catalog_first_keys, len(catalog_index_key(catalog_key(0, b''))) + 4, catalog_index_key, block_size)
+		extents_packer, extents_first_keys = plan_extents_file(overflow_records)
+		extents = BTreeLayout(extents_packer, extents_first_keys, EXTENTS_KEY_SIZE + 4, lambda key: key, block_size)
+		used_blocks = catalog.number_of_blocks + extents.number_of_blocks + fork_blocks
+		total_blocks = max(used_blocks + 1, math.ceil(used_blocks / (1.0 - free_fraction)))
+		return total_blocks, catalog, extents, overflow_records
+
+	if requested_block_size:
+		total_blocks, catalog, extents, overflow_records = layout_for(requested_block_size)
+		if total_blocks > MAX_ALLOCATION_BLOCKS:
+			sys.exit('{:,} blocks of {:,} bytes are needed, but HFS allows at most {:,}'.format(total_blocks, requested_block_size, MAX_ALLOCATION_BLOCKS))
+		return requested_block_size, total_blocks, catalog, extents
+
+	#The number of blocks needed only goes down as the block size goes up, so binary-search for the smallest size that fits.
+	low, high = 1, 1
+	while layout_for(high * SECTOR_SIZE)[0] > MAX_ALLOCATION_BLOCKS:
+		low = high + 1
+		high *= 2
+		if high * SECTOR_SIZE > 0x7fffffff:
+			sys.exit('These files won\'t fit in an HFS volume at any block size (there are probably too many non-empty forks)')
+	while low < high:
+		mid = (low + high) // 2
+		if layout_for(mid * SECTOR_SIZE)[0] > MAX_ALLOCATION_BLOCKS:
+			low = mid + 1
+		else:
+			high = mid
+	block_size = high * SECTOR_SIZE
+	total_blocks, catalog, extents, overflow_records = layout_for(block_size)
+	return block_size, total_blocks, catalog, extents
+
+def fill_pattern(seed: int) -> bytes:
+	rng = random.Random(seed)
+	return bytes(rng.getrandbits(8) for i in range(1 << 16))
+
+def write_fork(fd: int, allocation_start: int, block_size: int, extents: list, length: int, pattern: bytes):
+	remaining = length
+	pattern_offset = 0
+	for start, count in extents:
+		offset = allocation_start + start * block_size
+		piece_remaining = min(remaining, count * block_size)
+		remaining -= piece_remaining
+		while piece_remaining > 0:
+			chunk_length = min(piece_remaining, len(pattern) - pattern_offset)
+			os.pwrite(fd, pattern[pattern_offset:pattern_offset + chunk_length], offset)
+			offset += chunk_length
+			piece_remaining -= chunk_length
+			pattern_offset = (pattern_offset + chunk_length) % len(pattern)
+
+def main():
+	parser = argparse.ArgumentParser(description=__doc__.split('\n\n')[0], epilog='\n\n'.join(__doc__.split('\n\n')[1:]), formatter_class=argparse.RawDescriptionHelpFormatter)
+	parser.add_argument('output_path', help='Path to write the volume image to. Will be replaced if it exists.')
+	parser.add_argument('--files', type=int, default=10000, help='Number of files (default: %(default)s)')
+	parser.add_argument('--depth', type=int, default=2, help='Levels of folders below the root (default: %(default)s)')
+	parser.add_argument('--fanout', type=int, default=10, help='Number of subfolders in each folder above the bottom level (default: %(default)s)')
+	parser.add_argument('--data-sizes', type=parse_distribution, default='0:10,512:25,4K:35,32K:20,256K:8,2M:2', help='Data fork length distribution (default: %(default)s)')
+	parser.add_argument('--rsrc-sizes', type=parse_distribution, default='0:75,1K:15,16K:10', help='Resource fork length distribution (default: %(default)s)')
+	parser.add_argument('--fragmented-percent', type=float, default=0.0, help='Percentage of non-empty forks to break into pieces, with a free block between each piece (default: %(default)s)')
+	parser.add_argument('--max-extents', type=int, default=8, help='Most pieces a fragmented fork is broken into; more than 3 puts records in the extents overflow file (default: %(default)s)')
+	parser.add_argument('--free-percent', type=float, default=10.0, help='Percentage of the volume to leave free (default: %(default)s)')
+	parser.add_argument('--block-size', type=parse_size, default=0, help='Allocation block size; must be a multiple of 512 (default: the smallest that fits)')
+	parser.add_argument('--volume-name', default='Synthetic', help='Volume name, up to 27 bytes in MacRoman (default: %(default)s)')
+	parser.add_argument('--seed', type=int, default=1, help='Seed for every random choice (default: %(default)s)')
+	parser.add_argument('--stats', metavar='JSON_PATH', help='Write a summary of the generated volume to this file as JSON')
+	opts = parser.parse_args()
+
+	if opts.block_size % SECTOR_SIZE:
+		parser.error('--block-size must be a multiple of 512')
+	if opts.max_extents < 2:
+		parser.error('--max-extents must be at least 2')
+	if opts.fanout < 1 and opts.depth > 0:
+		parser.error('--fanout must be at least 1 if --depth is more than 0')
+	if not 0 <= opts.free_percent < 100:
+		parser.error('--free-percent must be at least 0 and less than 100')
+
+	plan = VolumePlan(opts)
+	catalog_packer, catalog_first_keys = plan_catalog(plan)
+	block_size, total_blocks, catalog_layout, extents_layout = choose_block_size(plan, catalog_packer, catalog_first_keys, opts.free_percent / 100.0, opts.block_size)
+
+	#The extents overflow file comes first, then the catalog, then every fork.
+	extents_start = 0
+	catalog_start = extents_start + extents_layout.number_of_blocks
+	allocation = Allocation(plan, block_size, catalog_start + catalog_layout.number_of_blocks)
+	assert allocation.end_block <= total_blocks
+
+	bitmap_sectors = ceiling_divide(ceiling_divide(total_blocks, 8), SECTOR_SIZE)
+	volume_bitmap_start = 3
+	allocation_start_sector = volume_bitmap_start + bitmap_sectors
+	allocation_start = allocation_start_sector * SECTOR_SIZE
+	volume_length = allocation_start + total_blocks * block_size + 2 * SECTOR_SIZE
+
+	#Used blocks: both B*-tree files, and every piece of every fork. Gaps between pieces stay free.
+	bitmap = bytearray(bitmap_sectors * SECTOR_SIZE)
+	def mark_used(start, count):
+		for block in range(start, start + count):
+			bitmap[block >> 3] |= 0x80 >> (block & 7)
+	mark_used(extents_start, extents_layout.number_of_blocks)
+	mark_used(catalog_start, catalog_layout.number_of_blocks)
+	for file_index in range(plan.number_of_files):
+		for fork_type in (DATA_FORK, RESOURCE_FORK):
+			for start, count in allocation.extents(file_index, fork_type):
+				mark_used(start, count)
+	used_blocks = extents_layout.number_of_blocks + catalog_layout.number_of_blocks + allocation.number_of_fork_blocks
+
+	catalog_data = catalog_layout.write(catalog_leaf_records(plan, allocation), CATALOG_MAX_KEY_LENGTH, catalog_layout.number_of_blocks * block_size)
+	extents_data = extents_layout.write(extents_leaf_records(plan, allocation), EXTENTS_MAX_KEY_LENGTH, extents_layout.number_of_blocks * block_size)
+
+	number_of_root_files = plan.number_of_files_in_folder(0)
+	number_of_root_folders = len(plan.subfolder_indexes(0))
+	mdb = struct.pack('>HIIHHHHHIIHIH28sIHIIIHII32sHHHI12sI12s',
+		0x4244, SYNTHETIC_DATE, SYNTHETIC_DATE,
+		0x0100, #Volume was cleanly unmounted
+		number_of_root_files, volume_bitmap_start, allocation.end_block % total_blocks, total_blocks,
+		block_size, block_size * 4, allocation_start_sector,
+		plan.next_catalog_node_id, total_blocks - used_blocks,
+		bytes([len(plan.volume_name)]) + plan.volume_name,
+		0, 0, 0,
+		len(extents_data), len(catalog_data),
+		number_of_root_folders, plan.number_of_files, plan.number_of_subfolders,
+		bytes(32), 0, 0, 0,
+		len(extents_data), extent_record([(extents_start, extents_layout.number_of_blocks)]),
+		len(catalog_data), extent_record([(catalog_start, catalog_layout.number_of_blocks)]))
+	assert len(mdb) == 162
+
+	pattern = fill_pattern(opts.seed)
+	fd = os.open(opts.output_path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o644)
+	try:
+		os.ftruncate(fd, volume_length)
+		os.pwrite(fd, mdb, 2 * SECTOR_SIZE)
+		os.pwrite(fd, bitmap, volume_bitmap_start * SECTOR_SIZE)
+		os.pwrite(fd, extents_data, allocation_start + extents_start * block_size)
+		os.pwrite(fd, catalog_data, allocation_start + catalog_start * block_size)
+		total_fork_bytes = 0
+		for file_index in range(plan.number_of_files):
+			for fork_type, lengths in ((DATA_FORK, plan.data_lengths), (RESOURCE_FORK, plan.rsrc_lengths)):
+				if lengths[file_index] > 0:
+					write_fork(fd, allocation_start, block_size, allocation.extents(file_index, fork_type), lengths[file_index], pattern)
+					total_fork_bytes += lengths[file_index]
+		os.pwrite(fd, mdb, volume_length - 2 * SECTOR_SIZE)
+	finally:
+		os.close(fd)
+
+	stats = {
+		'path': opts.output_path,
+		'files': plan.number_of_files,
+		'folders': plan.number_of_subfolders,
+		'volume_bytes': volume_length,
+		'block_size': block_size,
+		'total_blocks': total_blocks,
+		'free_blocks': total_blocks - used_blocks,
+		'fork_bytes': total_fork_bytes,
+		'non_empty_forks': sum(1 for length in plan.data_lengths if length) + sum(1 for length in plan.rsrc_lengths if length),
+		'fragmented_forks': sum(1 for file_index in range(plan.number_of_files) for fork_type in (DATA_FORK, RESOURCE_FORK) if len(allocation.extents(file_index, fork_type)) > 1),
+		'extents_overflow_records': extents_layout.number_of_leaf_records,
+		'catalog_nodes': catalog_layout.total_nodes,
+		'catalog_depth': catalog_layout.depth,
+		'seed': opts.seed,
+	}
+	print('Wrote {path}: {files:,} files in {folders:,} folders, {fork_bytes:,} bytes of fork data, {block_size:,}-byte blocks ({free_blocks:,} of {total_blocks:,} free), {fragmented_forks:,} fragmented forks, {extents_overflow_records:,} extents overflow records, {catalog_nodes:,} catalog nodes'.format(**stats))
+	if opts.stats:
+		with open(opts.stats, 'w') as stats_file:
+			json.dump(stats, stats_file, indent='\t')
+			stats_file.write('\n')
+
+if __name__ == '__main__':
+	main()